@@ -0,0 +1,653 @@
+/*
+    Pi-side bridge daemon.  Owns the gateway's serial port, parses its output
+    once, and fans the parsed events out to any number of local clients over a
+    Unix socket, while multiplexing their S>G messages to the gateway.  Lets
+    several consumers (the server, a logger, a dashboard) share the gateway.
+
+    Clients exchange lines of text.  From a client:
+      S>G:<message>             sent to the gateway, whole, in turn with other
+                                clients' messages.  Up to 39 characters, as
+                                the gateway's serial input.
+      SUB <chan>[,<chan>...]    sets the client's subscriptions, replacing the
+                                last (default MSG).  Channels:
+                                  MSG    all G>S messages
+                                  <type> G>S messages of a type, e.g. MUPC
+                                  MTR    meter update intervals
+                                  LOG    log lines
+                                  CON    console lines
+                                  CAP    traffic capture lines (capt=1)
+      STATS                     bridge counters
+    To a client:
+      EVT <type> <node_id|-> <body>
+      MTR <node_id> <end_time> <duration_secs> <wh> <meter_value> <current|->
+      LOG <text>, CON <text>, CAP <text>
+      OK, ERR <reason>          to SUB and bad requests
+      STATS <name>=<value> ...
+
+    Replies from the gateway (e.g. SMVAL_ACK) go to all clients subscribed to
+    them, as they can't be matched to a sender.  A client that stops reading
+    is dropped once its unsent output passes --max-client-buf.
+
+    With --ring, the same events are also published to a shared memory ring
+    (see gwring.h), for local consumers that want them without a copy and
+    system call per event.
+
+    Usage:
+      gwbridge [--port path] [--baud bps] [--socket path] [--line-gap-ms ms]
+              [--max-client-buf bytes] [--ring name] [--ring-slots count]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include "gwproto.h"
+#include "gwring.h"
+
+static const size_t MAX_CLIENT_LINE = 256;
+// longest S>G line the gateway takes, its serial input buffer
+// (SERIAL_IN_BUFFER_SIZE) less the terminator; it cuts longer ones short
+static const size_t MAX_GATEWAY_LINE = 39;
+static const size_t MAX_CLIENT_PENDING = 32;    // queued S>G messages
+static const int MAX_EPOLL_EVENTS = 32;
+
+static const char SMSG_RX_PREFIX[] = "S>G:";
+
+struct BridgeConfig {
+    const char* portPath = "/dev/serial0";
+    uint32_t baud = 115200;
+    const char* socketPath = "/run/gwbridge.sock";
+    uint32_t lineGapMs = 50;        // between S>G lines, as the gateway
+                                    // handles a line per loop()
+    size_t maxClientBuf = 1048576;
+    const char* ringName = NULL;    // no ring if NULL
+    uint32_t ringSlots = GW_RING_DEF_SLOTS;
+};
+
+static BridgeConfig bridgeCfg;
+
+struct BridgeStats {
+    uint64_t linesIn = 0;
+    uint64_t msgsIn = 0;
+    uint64_t intervalsIn = 0;
+    uint64_t msgsOut = 0;
+    uint64_t clientsAccepted = 0;
+    uint64_t clientsDropped = 0;
+};
+
+static BridgeStats bridgeStats;
+static GwRingWriter ringWriter;
+
+// *****************************************************************************
+//    Clients
+// *****************************************************************************
+
+enum SubFlag {
+    subMsg = 1,
+    subMtr = 2,
+    subLog = 4,
+    subCon = 8,
+    subCap = 16
+};
+
+struct BridgeClient {
+    int fd = -1;
+    uint8_t subFlags = subMsg;
+    std::set<std::string> subTypes;     // with subMsg clear
+    std::string inBuf;
+    std::string outBuf;
+    size_t outPos = 0;
+    bool isWriteWaiting = false;        // EPOLLOUT registered
+    std::deque<std::string> pendingMsgs;
+
+    bool wantsMsg(const std::string& msgType) const {
+        return (subFlags & subMsg) || subTypes.count(msgType) > 0;
+    }
+};
+
+static int epollFd = -1;
+static std::map<int, std::unique_ptr<BridgeClient> > clients;
+
+
+static void closeClient(int clientFd){
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, clientFd, NULL);
+    close(clientFd);
+    clients.erase(clientFd);
+}
+
+
+static void flushClient(BridgeClient& client){
+    /*
+       Writes what the socket will take, waiting on EPOLLOUT for the rest.
+    */
+    while (client.outPos < client.outBuf.size()){
+        ssize_t writeLen = write(client.fd, client.outBuf.data() +
+                client.outPos, client.outBuf.size() - client.outPos);
+        if (writeLen < 0 && errno == EINTR)
+            continue;
+        if (writeLen < 0)
+            break;
+        client.outPos += writeLen;
+    }
+    if (client.outPos == client.outBuf.size()){
+        client.outBuf.clear();
+        client.outPos = 0;
+    }
+    else if (client.outPos > client.outBuf.size() / 2){
+        client.outBuf.erase(0, client.outPos);
+        client.outPos = 0;
+    }
+
+    bool isWriteWanted = ! client.outBuf.empty();
+    if (isWriteWanted != client.isWriteWaiting){
+        struct epoll_event clientEvent = {};
+        clientEvent.events = EPOLLIN | EPOLLRDHUP |
+                (isWriteWanted ? (uint32_t)EPOLLOUT : 0u);
+        clientEvent.data.fd = client.fd;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, client.fd, &clientEvent);
+        client.isWriteWaiting = isWriteWanted;
+    }
+}
+
+
+static void sendToClient(BridgeClient& client, const std::string& outLine){
+    client.outBuf += outLine;
+    if (! client.isWriteWaiting)
+        flushClient(client);
+}
+
+
+// sends to each client wanting it, dropping any too far behind
+template <typename WantsFunc>
+static void fanOut(const std::string& outLine, WantsFunc wants){
+    std::vector<int> droppedFds;
+    for (auto& clientEntry : clients){
+        BridgeClient& client = *clientEntry.second;
+        if (! wants(client))
+            continue;
+        if (client.outBuf.size() - client.outPos + outLine.size() >
+                bridgeCfg.maxClientBuf){
+            droppedFds.push_back(client.fd);
+            continue;
+        }
+        sendToClient(client, outLine);
+    }
+    for (int clientFd : droppedFds){
+        fprintf(stderr, "gwbridge: client %d too slow, dropped\n", clientFd);
+        bridgeStats.clientsDropped++;
+        closeClient(clientFd);
+    }
+}
+
+// *****************************************************************************
+//    Gateway Serial
+// *****************************************************************************
+
+static int serialFd = -1;
+static int gapTimerFd = -1;
+static bool isGapTiming = false;
+static std::string serialOutBuf;
+static int nextClientTurn = -1;     // fd after which to look for a message
+static GwLineSplitter gwSplitter;
+
+
+static bool openSerial(){
+    static const struct {
+        uint32_t baud;
+        speed_t speed;
+    } BAUD_SPEEDS[] = {{9600, B9600}, {19200, B19200}, {38400, B38400},
+            {57600, B57600}, {115200, B115200}, {230400, B230400}};
+
+    serialFd = open(bridgeCfg.portPath, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (serialFd < 0){
+        perror(bridgeCfg.portPath);
+        return false;
+    }
+    // anything else (e.g. a FIFO for testing) is used as is
+    if (! isatty(serialFd))
+        return true;
+
+    speed_t speed = 0;
+    for (size_t i = 0; i < sizeof(BAUD_SPEEDS) / sizeof(BAUD_SPEEDS[0]); i++)
+        if (BAUD_SPEEDS[i].baud == bridgeCfg.baud)
+            speed = BAUD_SPEEDS[i].speed;
+    if (speed == 0){
+        fprintf(stderr, "gwbridge: unsupported baud %" PRIu32 "\n",
+                bridgeCfg.baud);
+        return false;
+    }
+
+    // 8N1, raw, no flow control
+    struct termios serialTerm;
+    if (tcgetattr(serialFd, &serialTerm) != 0){
+        perror(bridgeCfg.portPath);
+        return false;
+    }
+    cfmakeraw(&serialTerm);
+    serialTerm.c_cflag |= CLOCAL | CREAD;
+    serialTerm.c_cflag &= ~(CRTSCTS | CSTOPB);
+    cfsetispeed(&serialTerm, speed);
+    cfsetospeed(&serialTerm, speed);
+    if (tcsetattr(serialFd, TCSANOW, &serialTerm) != 0){
+        perror(bridgeCfg.portPath);
+        return false;
+    }
+    tcflush(serialFd, TCIOFLUSH);
+    return true;
+}
+
+
+static void watchSerialWrite(bool isWriteWanted){
+    struct epoll_event serialEvent = {};
+    serialEvent.events = EPOLLIN | (isWriteWanted ? (uint32_t)EPOLLOUT : 0u);
+    serialEvent.data.fd = serialFd;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, serialFd, &serialEvent);
+}
+
+
+static void flushSerial(){
+    while (! serialOutBuf.empty()){
+        ssize_t writeLen = write(serialFd, serialOutBuf.data(),
+                serialOutBuf.size());
+        if (writeLen < 0 && errno == EINTR)
+            continue;
+        if (writeLen <= 0)
+            break;
+        serialOutBuf.erase(0, writeLen);
+    }
+    watchSerialWrite(! serialOutBuf.empty());
+}
+
+
+static void sendNextMsg(){
+    /*
+       Sends the next client's waiting S>G message, taking clients in turn, then
+       holds off the next for the line gap.
+    */
+    if (isGapTiming || clients.empty())
+        return;
+
+    auto clientIt = clients.upper_bound(nextClientTurn);
+    for (size_t i = 0; i < clients.size(); i++, clientIt++){
+        if (clientIt == clients.end())
+            clientIt = clients.begin();
+        BridgeClient& client = *clientIt->second;
+        if (client.pendingMsgs.empty())
+            continue;
+
+        serialOutBuf += client.pendingMsgs.front();
+        serialOutBuf += '\r';
+        client.pendingMsgs.pop_front();
+        nextClientTurn = client.fd;
+        bridgeStats.msgsOut++;
+        flushSerial();
+
+        struct itimerspec gapTime = {};
+        gapTime.it_value.tv_sec = bridgeCfg.lineGapMs / 1000;
+        gapTime.it_value.tv_nsec = (bridgeCfg.lineGapMs % 1000) * 1000000l +
+                1;  // non-zero to arm
+        timerfd_settime(gapTimerFd, 0, &gapTime, NULL);
+        isGapTiming = true;
+        return;
+    }
+}
+
+
+static std::string fmtEvent(const GwMessage& gwMsg){
+    char nodeStr[12] = "-";
+    if (gwMsg.nodeId >= 0)
+        snprintf(nodeStr, sizeof(nodeStr), "%d", gwMsg.nodeId);
+    return "EVT " + gwMsg.type + " " + nodeStr + " " + gwMsg.body + "\n";
+}
+
+
+static std::string fmtInterval(const MeterInterval& interval){
+    char intervalStr[128];
+    char currentStr[24] = "-";
+    if (interval.hasCurrent)
+        snprintf(currentStr, sizeof(currentStr), "%.2f", interval.currentRMS);
+    snprintf(intervalStr, sizeof(intervalStr), "MTR %u %" PRIu32 " %u %" PRIu32
+            " %" PRIu32 " %s\n", interval.nodeId, interval.endTime,
+            interval.durationSecs, interval.wh, interval.meterValue,
+            currentStr);
+    return intervalStr;
+}
+
+
+static void dispatchLine(const GwLine& line){
+    bridgeStats.linesIn++;
+
+    if (line.kind == lineMessage){
+        GwMessage gwMsg;
+        if (! parseGwMessage(line.text, gwMsg))
+            return;
+        bridgeStats.msgsIn++;
+        ringWriter.publishMsg(gwMsg);
+        fanOut(fmtEvent(gwMsg), [&gwMsg](const BridgeClient& client){
+            return client.wantsMsg(gwMsg.type);
+        });
+
+        MeterBase meterBase;
+        std::vector<MeterInterval> intervals;
+        if (parseMeterUpdate(gwMsg, meterBase, intervals)){
+            std::string mtrLines;
+            for (const MeterInterval& interval : intervals){
+                mtrLines += fmtInterval(interval);
+                ringWriter.publishInterval(interval);
+            }
+            bridgeStats.intervalsIn += intervals.size();
+            fanOut(mtrLines, [](const BridgeClient& client){
+                return (client.subFlags & subMtr) != 0;
+            });
+        }
+        return;
+    }
+
+    static const char* const LINE_TAGS[] = {"", "CON ", "LOG ", "", "CAP "};
+    static const uint8_t LINE_SUBS[] = {0, subCon, subLog, 0, subCap};
+    static const uint8_t LINE_RING_KINDS[] = {0, ringCon, ringLog, 0, ringCap};
+    uint8_t lineSub = LINE_SUBS[line.kind];
+    ringWriter.publish(LINE_RING_KINDS[line.kind], 0, line.text.data(),
+            line.text.size());
+    fanOut(LINE_TAGS[line.kind] + line.text + "\n",
+            [lineSub](const BridgeClient& client){
+        return (client.subFlags & lineSub) != 0;
+    });
+}
+
+
+static bool readSerial(){
+    char readBuf[4096];
+    ssize_t readLen = read(serialFd, readBuf, sizeof(readBuf));
+    if (readLen < 0)
+        return errno == EAGAIN || errno == EINTR;
+    if (readLen == 0)
+        return false;
+
+    GwLine line;
+    gwSplitter.feed(readBuf, readLen);
+    while (gwSplitter.next(line))
+        dispatchLine(line);
+    return true;
+}
+
+// *****************************************************************************
+//    Client Requests
+// *****************************************************************************
+
+static void handleSub(BridgeClient& client, const std::string& chanList){
+    static const struct {
+        const char* name;
+        uint8_t flag;
+    } SUB_CHANS[] = {{"MSG", subMsg}, {"MTR", subMtr}, {"LOG", subLog},
+            {"CON", subCon}, {"CAP", subCap}};
+
+    client.subFlags = 0;
+    client.subTypes.clear();
+
+    size_t chanStart = 0;
+    while (chanStart < chanList.size()){
+        size_t chanEnd = chanList.find(',', chanStart);
+        if (chanEnd == std::string::npos)
+            chanEnd = chanList.size();
+        std::string chanName = chanList.substr(chanStart, chanEnd - chanStart);
+        chanStart = chanEnd + 1;
+
+        bool isKnown = false;
+        for (size_t i = 0; i < sizeof(SUB_CHANS) / sizeof(SUB_CHANS[0]); i++)
+            if (chanName == SUB_CHANS[i].name){
+                client.subFlags |= SUB_CHANS[i].flag;
+                isKnown = true;
+            }
+        if (! isKnown && ! chanName.empty())
+            client.subTypes.insert(chanName);
+    }
+    sendToClient(client, "OK\n");
+}
+
+
+static void handleStats(BridgeClient& client){
+    uint64_t ringEvents = 0;
+    uint8_t ringConsumers = 0;
+    if (ringWriter.header() != NULL){
+        ringEvents = ringWriter.header()->writeSeq.load();
+        for (uint8_t i = 0; i < GW_RING_MAX_CONSUMERS; i++)
+            if (ringWriter.header()->consumers[i].pid.load() != 0)
+                ringConsumers++;
+    }
+
+    char statsStr[320];
+    snprintf(statsStr, sizeof(statsStr), "STATS lines_in=%" PRIu64
+            " msgs_in=%" PRIu64 " intervals_in=%" PRIu64 " msgs_out=%" PRIu64
+            " clients=%zu clients_accepted=%" PRIu64 " clients_dropped=%"
+            PRIu64 " ring_events=%" PRIu64 " ring_consumers=%u\n",
+            bridgeStats.linesIn, bridgeStats.msgsIn, bridgeStats.intervalsIn,
+            bridgeStats.msgsOut, clients.size(), bridgeStats.clientsAccepted,
+            bridgeStats.clientsDropped, ringEvents, ringConsumers);
+    sendToClient(client, statsStr);
+}
+
+
+static void handleRequest(BridgeClient& client, const std::string& reqLine){
+    if (reqLine.compare(0, strlen(SMSG_RX_PREFIX), SMSG_RX_PREFIX) == 0){
+        // the gateway takes printable ASCII only, and CR ends its line
+        if (reqLine.find_first_of("\r\n") != std::string::npos)
+            sendToClient(client, "ERR bad message\n");
+        else if (reqLine.size() > MAX_GATEWAY_LINE)
+            sendToClient(client, "ERR message too long\n");
+        else if (client.pendingMsgs.size() >= MAX_CLIENT_PENDING)
+            sendToClient(client, "ERR busy\n");
+        else {
+            client.pendingMsgs.push_back(reqLine);
+            sendNextMsg();
+        }
+    }
+    else if (reqLine.compare(0, 4, "SUB ") == 0)
+        handleSub(client, reqLine.substr(4));
+    else if (reqLine == "STATS")
+        handleStats(client);
+    else if (! reqLine.empty())
+        sendToClient(client, "ERR unknown request\n");
+}
+
+
+static bool readClient(BridgeClient& client){
+    char readBuf[1024];
+    ssize_t readLen = read(client.fd, readBuf, sizeof(readBuf));
+    if (readLen < 0)
+        return errno == EAGAIN || errno == EINTR;
+    if (readLen == 0)
+        return false;
+
+    client.inBuf.append(readBuf, readLen);
+    size_t lineEnd;
+    while ((lineEnd = client.inBuf.find('\n')) != std::string::npos){
+        std::string reqLine = client.inBuf.substr(0, lineEnd);
+        client.inBuf.erase(0, lineEnd + 1);
+        if (! reqLine.empty() && reqLine.back() == '\r')
+            reqLine.pop_back();
+        handleRequest(client, reqLine);
+    }
+    if (client.inBuf.size() > MAX_CLIENT_LINE){
+        client.inBuf.clear();
+        sendToClient(client, "ERR line too long\n");
+    }
+    return true;
+}
+
+// *****************************************************************************
+//    Main
+// *****************************************************************************
+
+static int openSocket(){
+    struct sockaddr_un sockAddr = {};
+    sockAddr.sun_family = AF_UNIX;
+    if (strlen(bridgeCfg.socketPath) >= sizeof(sockAddr.sun_path)){
+        fprintf(stderr, "gwbridge: socket path too long\n");
+        return -1;
+    }
+    strcpy(sockAddr.sun_path, bridgeCfg.socketPath);
+    unlink(bridgeCfg.socketPath);
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+            0);
+    if (listenFd < 0 || bind(listenFd, (struct sockaddr*)&sockAddr,
+            sizeof(sockAddr)) != 0 || listen(listenFd, 16) != 0){
+        perror(bridgeCfg.socketPath);
+        return -1;
+    }
+    return listenFd;
+}
+
+
+static void acceptClient(int listenFd){
+    int clientFd;
+    while ((clientFd = accept4(listenFd, NULL, NULL,
+            SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0){
+        std::unique_ptr<BridgeClient> client(new BridgeClient());
+        client->fd = clientFd;
+        struct epoll_event clientEvent = {};
+        clientEvent.events = EPOLLIN | EPOLLRDHUP;
+        clientEvent.data.fd = clientFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, clientFd, &clientEvent);
+        clients[clientFd] = std::move(client);
+        bridgeStats.clientsAccepted++;
+    }
+}
+
+
+static void watchFd(int fd){
+    struct epoll_event fdEvent = {};
+    fdEvent.events = EPOLLIN;
+    fdEvent.data.fd = fd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &fdEvent);
+}
+
+
+static void usage(){
+    fprintf(stderr, "usage: gwbridge [--port path] [--baud bps] "
+            "[--socket path] [--line-gap-ms ms]\n"
+            "                [--max-client-buf bytes] [--ring name] "
+            "[--ring-slots count]\n");
+    exit(1);
+}
+
+
+int main(int argc, char** argv){
+    for (int i = 1; i < argc; i++){
+        if (i + 1 >= argc)
+            usage();
+        const char* argName = argv[i];
+        const char* argVal = argv[++i];
+        if (strcmp(argName, "--port") == 0)
+            bridgeCfg.portPath = argVal;
+        else if (strcmp(argName, "--baud") == 0)
+            bridgeCfg.baud = atol(argVal);
+        else if (strcmp(argName, "--socket") == 0)
+            bridgeCfg.socketPath = argVal;
+        else if (strcmp(argName, "--line-gap-ms") == 0)
+            bridgeCfg.lineGapMs = atol(argVal);
+        else if (strcmp(argName, "--max-client-buf") == 0)
+            bridgeCfg.maxClientBuf = atol(argVal);
+        else if (strcmp(argName, "--ring") == 0)
+            bridgeCfg.ringName = argVal;
+        else if (strcmp(argName, "--ring-slots") == 0)
+            bridgeCfg.ringSlots = atol(argVal);
+        else
+            usage();
+    }
+
+    // exit cleanly on SIGINT/SIGTERM, handled in the loop
+    sigset_t exitSignals;
+    sigemptyset(&exitSignals);
+    sigaddset(&exitSignals, SIGINT);
+    sigaddset(&exitSignals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &exitSignals, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    int signalFd = signalfd(-1, &exitSignals, SFD_NONBLOCK | SFD_CLOEXEC);
+    gapTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (! openSerial())
+        return 1;
+    int listenFd = openSocket();
+    if (listenFd < 0)
+        return 1;
+    if (bridgeCfg.ringName != NULL &&
+            ! ringWriter.create(bridgeCfg.ringName, bridgeCfg.ringSlots))
+        return 1;
+
+    watchFd(signalFd);
+    watchFd(gapTimerFd);
+    watchFd(serialFd);
+    watchFd(listenFd);
+    fprintf(stderr, "gwbridge: %s on %s\n", bridgeCfg.portPath,
+            bridgeCfg.socketPath);
+
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    bool isRunning = true;
+    int exitStatus = 0;
+    while (isRunning){
+        int eventCount = epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, -1);
+        if (eventCount < 0 && errno != EINTR){
+            perror("epoll_wait");
+            return 1;
+        }
+
+        for (int i = 0; i < eventCount; i++){
+            int eventFd = events[i].data.fd;
+            uint32_t eventFlags = events[i].events;
+
+            if (eventFd == signalFd)
+                isRunning = false;
+            else if (eventFd == gapTimerFd){
+                uint64_t expiries;
+                if (read(gapTimerFd, &expiries, sizeof(expiries)) > 0){
+                    isGapTiming = false;
+                    sendNextMsg();
+                }
+            }
+            else if (eventFd == serialFd){
+                if ((eventFlags & EPOLLOUT) != 0)
+                    flushSerial();
+                if ((eventFlags & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0 &&
+                        ! readSerial()){
+                    fprintf(stderr, "gwbridge: %s closed\n",
+                            bridgeCfg.portPath);
+                    isRunning = false;
+                    exitStatus = 2;
+                }
+            }
+            else if (eventFd == listenFd)
+                acceptClient(listenFd);
+            else if (clients.count(eventFd) > 0){
+                BridgeClient& client = *clients[eventFd];
+                if ((eventFlags & EPOLLOUT) != 0)
+                    flushClient(client);
+                if ((eventFlags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP |
+                        EPOLLERR)) != 0 && ! readClient(client))
+                    closeClient(eventFd);
+            }
+        }
+    }
+
+    unlink(bridgeCfg.socketPath);
+    ringWriter.close();
+    return exitStatus;
+}
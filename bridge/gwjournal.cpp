@@ -0,0 +1,414 @@
+/*
+    Append-only journal of meter intervals, see gwjournal.h.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <vector>
+#include "gwjournal.h"
+
+static const uint32_t JOURNAL_MAGIC = 0x4a4d5747;
+static const uint32_t JOURNAL_VERSION = 1;
+static const size_t JOURNAL_HEADER_LEN = 4096;
+static const size_t JOURNAL_COMMIT_OFFSETS[] = {512, 1024};
+static const char JOURNAL_SEG_FMT[] = "seg%08" PRIu32 ".gwj";
+
+// *****************************************************************************
+//    Segments
+// *****************************************************************************
+
+uint32_t gwCrc32(const void* data, size_t len){
+    static uint32_t crcTable[256];
+    if (crcTable[1] == 0)
+        for (uint32_t i = 0; i < 256; i++){
+            uint32_t crc = i;
+            for (uint8_t bit = 0; bit < 8; bit++)
+                crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+            crcTable[i] = crc;
+        }
+
+    uint32_t crc = 0xFFFFFFFF;
+    const uint8_t* dataBytes = (const uint8_t*)data;
+    for (size_t i = 0; i < len; i++)
+        crc = crcTable[(crc ^ dataBytes[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+
+static size_t segFileLen(uint32_t recordCount){
+    return JOURNAL_HEADER_LEN + (size_t)recordCount * sizeof(JournalRecord);
+}
+
+
+static std::string segPath(const std::string& dirPath, uint32_t segNum){
+    char segName[32];
+    snprintf(segName, sizeof(segName), JOURNAL_SEG_FMT, segNum);
+    return dirPath + "/" + segName;
+}
+
+
+// segment numbers in dirPath, ascending
+static std::vector<uint32_t> listSegments(const std::string& dirPath){
+    std::vector<uint32_t> segNums;
+    DIR* journalDir = opendir(dirPath.c_str());
+    if (journalDir == NULL)
+        return segNums;
+    struct dirent* dirEntry;
+    while ((dirEntry = readdir(journalDir)) != NULL){
+        uint32_t segNum;
+        char segName[32];
+        if (sscanf(dirEntry->d_name, JOURNAL_SEG_FMT, &segNum) != 1)
+            continue;
+        snprintf(segName, sizeof(segName), JOURNAL_SEG_FMT, segNum);
+        if (strcmp(segName, dirEntry->d_name) == 0)
+            segNums.push_back(segNum);
+    }
+    closedir(journalDir);
+    std::sort(segNums.begin(), segNums.end());
+    return segNums;
+}
+
+
+static bool isSegHeaderValid(const JournalSegHeader* segHead, size_t fileLen){
+    return segHead->magic == JOURNAL_MAGIC &&
+            segHead->version == JOURNAL_VERSION &&
+            segHead->recordSize == sizeof(JournalRecord) &&
+            segHead->crc == gwCrc32(segHead, offsetof(JournalSegHeader, crc)) &&
+            fileLen == segFileLen(segHead->recordCount);
+}
+
+
+static bool isRecordValid(const JournalRecord& record, uint64_t seq){
+    return record.seq == seq &&
+            record.crc == gwCrc32(&record, offsetof(JournalRecord, crc));
+}
+
+
+static uint32_t usedRecords(const uint8_t* segMap, uint64_t& generation,
+        uint32_t& committedCount){
+    /*
+       Records used per the newer valid commit marker, then any complete
+       records after it, in sequence (written but their commit not finished).
+    */
+    const JournalSegHeader* segHead = (const JournalSegHeader*)segMap;
+    uint32_t recordsUsed = 0;
+    generation = 0;
+    for (size_t i = 0; i < 2; i++){
+        const JournalCommit* marker = (const JournalCommit*)(segMap +
+                JOURNAL_COMMIT_OFFSETS[i]);
+        if (marker->generation > generation &&
+                marker->recordsUsed <= segHead->recordCount &&
+                marker->crc == gwCrc32(marker, offsetof(JournalCommit, crc))){
+            generation = marker->generation;
+            recordsUsed = marker->recordsUsed;
+        }
+    }
+
+    committedCount = recordsUsed;
+    const JournalRecord* records = (const JournalRecord*)(segMap +
+            JOURNAL_HEADER_LEN);
+    while (recordsUsed < segHead->recordCount &&
+            isRecordValid(records[recordsUsed], segHead->firstSeq +
+            recordsUsed))
+        recordsUsed++;
+    return recordsUsed;
+}
+
+// *****************************************************************************
+//    Writer
+// *****************************************************************************
+
+bool MeterJournal::open(const char* journalDir, uint32_t segRecordCount,
+        uint32_t maxSegmentCount){
+    close();
+    dirPath = journalDir;
+    segRecords = segRecordCount;
+    maxSegments = maxSegmentCount;
+    recoveredCount = 0;
+    if (segRecords == 0){
+        fprintf(stderr, "gwjournal: segments need records\n");
+        return false;
+    }
+    if (mkdir(journalDir, 0755) != 0 && errno != EEXIST){
+        perror(journalDir);
+        return false;
+    }
+
+    std::vector<uint32_t> segNums = listSegments(dirPath);
+    if (segNums.empty()){
+        seqNext = 1;
+        return startSegment(1);
+    }
+
+    // carry on in the last segment, keeping what was written of it
+    if (! mapSegment(segPath(dirPath, segNums.back()), true))
+        return false;
+    seqNext = segHead->firstSeq + recordsUsed;
+    seqCommitted = segHead->firstSeq + recordsSynced - 1;
+    if (! commit())
+        return false;
+    if (recordsUsed == segHead->recordCount){
+        uint32_t segNum = segHead->segNum;
+        unmapSegment();
+        return startSegment(segNum + 1);
+    }
+    return true;
+}
+
+
+void MeterJournal::close(){
+    if (segMap == NULL)
+        return;
+    commit();
+    unmapSegment();
+}
+
+
+bool MeterJournal::mapSegment(const std::string& path, bool isRecovering){
+    int segFd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    struct stat segStat;
+    if (segFd < 0 || fstat(segFd, &segStat) != 0){
+        perror(path.c_str());
+        if (segFd >= 0)
+            ::close(segFd);
+        return false;
+    }
+    void* fileMap = MAP_FAILED;
+    if ((size_t)segStat.st_size >= JOURNAL_HEADER_LEN)
+        fileMap = mmap(NULL, segStat.st_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED, segFd, 0);
+    ::close(segFd);
+    if (fileMap == MAP_FAILED ||
+            ! isSegHeaderValid((JournalSegHeader*)fileMap, segStat.st_size)){
+        fprintf(stderr, "gwjournal: %s: not a journal segment\n",
+                path.c_str());
+        if (fileMap != MAP_FAILED)
+            munmap(fileMap, segStat.st_size);
+        return false;
+    }
+
+    segMap = (uint8_t*)fileMap;
+    segMapLen = segStat.st_size;
+    segHead = (JournalSegHeader*)segMap;
+    records = (JournalRecord*)(segMap + JOURNAL_HEADER_LEN);
+    uint32_t committedCount;
+    recordsUsed = usedRecords(segMap, commitGeneration, committedCount);
+    recordsSynced = recordsUsed;
+    if (! isRecovering)
+        return true;
+
+    // records past the last marker get one of their own at the next commit
+    recoveredCount = recordsUsed - committedCount;
+    recordsSynced = committedCount;
+
+    /*
+       Clear what's left of records that didn't make it (torn, or out of
+       sequence), so they can't be taken as valid once records are appended up
+       to them.
+    */
+    static const JournalRecord ZERO_RECORD = {};
+    uint32_t lastWritten = segHead->recordCount;
+    while (lastWritten > recordsUsed && memcmp(&records[lastWritten - 1],
+            &ZERO_RECORD, sizeof(JournalRecord)) == 0)
+        lastWritten--;
+    if (lastWritten > recordsUsed){
+        fprintf(stderr, "gwjournal: %s: cleared %" PRIu32 " incomplete "
+                "records\n", path.c_str(), lastWritten - recordsUsed);
+        memset(&records[recordsUsed], 0, (lastWritten - recordsUsed) *
+                sizeof(JournalRecord));
+        long pageSize = sysconf(_SC_PAGESIZE);
+        size_t clearStart = JOURNAL_HEADER_LEN + (size_t)recordsUsed *
+                sizeof(JournalRecord);
+        clearStart -= clearStart % pageSize;
+        msync(segMap + clearStart, JOURNAL_HEADER_LEN + (size_t)lastWritten *
+                sizeof(JournalRecord) - clearStart, MS_SYNC);
+    }
+    return true;
+}
+
+
+void MeterJournal::unmapSegment(){
+    if (segMap != NULL)
+        munmap(segMap, segMapLen);
+    segMap = NULL;
+    segHead = NULL;
+    records = NULL;
+}
+
+
+bool MeterJournal::startSegment(uint32_t segNum){
+    /*
+       Allocated whole and written under a temporary name, then renamed, so a
+       segment is either complete or absent.
+    */
+    std::string tmpPath = dirPath + "/seg.tmp";
+    std::string path = segPath(dirPath, segNum);
+    int segFd = ::open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+            0644);
+    if (segFd < 0){
+        perror(tmpPath.c_str());
+        return false;
+    }
+
+    JournalSegHeader newHead = {};
+    newHead.magic = JOURNAL_MAGIC;
+    newHead.version = JOURNAL_VERSION;
+    newHead.recordSize = sizeof(JournalRecord);
+    newHead.recordCount = segRecords;
+    newHead.segNum = segNum;
+    newHead.firstSeq = seqNext;
+    newHead.crc = gwCrc32(&newHead, offsetof(JournalSegHeader, crc));
+
+    bool isWritten = posix_fallocate(segFd, 0, segFileLen(segRecords)) == 0 &&
+            pwrite(segFd, &newHead, sizeof(newHead), 0) ==
+            (ssize_t)sizeof(newHead) && fsync(segFd) == 0;
+    ::close(segFd);
+    if (! isWritten || rename(tmpPath.c_str(), path.c_str()) != 0){
+        perror(path.c_str());
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    int dirFd = ::open(dirPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd >= 0){
+        fsync(dirFd);
+        ::close(dirFd);
+    }
+
+    if (! mapSegment(path, false))
+        return false;
+    pruneSegments();
+    return true;
+}
+
+
+void MeterJournal::pruneSegments(){
+    if (maxSegments == 0)
+        return;
+    std::vector<uint32_t> segNums = listSegments(dirPath);
+    for (size_t i = 0; i + maxSegments < segNums.size(); i++)
+        unlink(segPath(dirPath, segNums[i]).c_str());
+}
+
+
+bool MeterJournal::append(const MeterInterval& interval){
+    if (segMap == NULL)
+        return false;
+    if (recordsUsed == segHead->recordCount){
+        uint32_t segNum = segHead->segNum;
+        if (! commit())
+            return false;
+        unmapSegment();
+        if (! startSegment(segNum + 1))
+            return false;
+    }
+
+    JournalRecord& record = records[recordsUsed];
+    record.seq = seqNext;
+    record.startTime = interval.endTime - interval.durationSecs;
+    record.wh = interval.wh;
+    record.meterValue = interval.meterValue;
+    record.currentRMS = interval.hasCurrent ? interval.currentRMS : 0;
+    record.durationSecs = interval.durationSecs;
+    record.nodeId = interval.nodeId;
+    record.flags = interval.hasCurrent ? JOURNAL_HAS_CURRENT : 0;
+    record.crc = gwCrc32(&record, offsetof(JournalRecord, crc));
+    recordsUsed++;
+    seqNext++;
+    return true;
+}
+
+
+bool MeterJournal::commit(){
+    /*
+       Syncs the pages of the records written since the last commit, then
+       writes the other commit marker and syncs that.
+    */
+    if (segMap == NULL)
+        return false;
+    if (recordsSynced == recordsUsed)
+        return true;
+
+    long pageSize = sysconf(_SC_PAGESIZE);
+    size_t syncStart = JOURNAL_HEADER_LEN + (size_t)recordsSynced *
+            sizeof(JournalRecord);
+    size_t syncEnd = JOURNAL_HEADER_LEN + (size_t)recordsUsed *
+            sizeof(JournalRecord);
+    syncStart -= syncStart % pageSize;
+    if (msync(segMap + syncStart, syncEnd - syncStart, MS_SYNC) != 0){
+        perror("gwjournal: msync");
+        return false;
+    }
+
+    commitGeneration++;
+    JournalCommit* marker = (JournalCommit*)(segMap +
+            JOURNAL_COMMIT_OFFSETS[commitGeneration & 1]);
+    marker->generation = commitGeneration;
+    marker->recordsUsed = recordsUsed;
+    marker->crc = gwCrc32(marker, offsetof(JournalCommit, crc));
+    if (msync(segMap, JOURNAL_HEADER_LEN, MS_SYNC) != 0){
+        perror("gwjournal: msync");
+        return false;
+    }
+    recordsSynced = recordsUsed;
+    seqCommitted = seqNext - 1;
+    return true;
+}
+
+// *****************************************************************************
+//    Reader
+// *****************************************************************************
+
+bool readJournal(const char* dirPath,
+        std::function<void(const JournalRecord&)> recordFunc,
+        uint64_t fromSeq){
+    std::vector<uint32_t> segNums = listSegments(dirPath);
+    if (segNums.empty()){
+        fprintf(stderr, "gwjournal: %s: no journal segments\n", dirPath);
+        return false;
+    }
+
+    for (uint32_t segNum : segNums){
+        std::string path = segPath(dirPath, segNum);
+        int segFd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat segStat;
+        void* segMap = MAP_FAILED;
+        if (segFd >= 0 && fstat(segFd, &segStat) == 0 &&
+                (size_t)segStat.st_size >= JOURNAL_HEADER_LEN)
+            segMap = mmap(NULL, segStat.st_size, PROT_READ, MAP_SHARED, segFd,
+                    0);
+        if (segFd >= 0)
+            close(segFd);
+        if (segMap == MAP_FAILED){
+            perror(path.c_str());
+            return false;
+        }
+        if (! isSegHeaderValid((JournalSegHeader*)segMap, segStat.st_size)){
+            fprintf(stderr, "gwjournal: %s: not a journal segment\n",
+                    path.c_str());
+            munmap(segMap, segStat.st_size);
+            return false;
+        }
+
+        uint64_t generation;
+        uint32_t committedCount;
+        uint32_t recordsUsed = usedRecords((uint8_t*)segMap, generation,
+                committedCount);
+        const JournalRecord* records = (const JournalRecord*)((uint8_t*)segMap
+                + JOURNAL_HEADER_LEN);
+        uint64_t firstSeq = ((JournalSegHeader*)segMap)->firstSeq;
+        uint32_t firstRecord = fromSeq <= firstSeq ? 0 :
+                (uint32_t)std::min<uint64_t>(fromSeq - firstSeq, recordsUsed);
+        for (uint32_t i = firstRecord; i < recordsUsed; i++)
+            recordFunc(records[i]);
+        munmap(segMap, segStat.st_size);
+    }
+    return true;
+}
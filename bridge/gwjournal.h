@@ -0,0 +1,124 @@
+/*
+    Append-only journal of meter intervals, for persisting the MUPC/MUP_
+    stream on the Pi.
+
+    The journal is a directory of fixed size segment files, each a header page
+    then fixed size records, written through mmap.  An append is a copy into
+    the mapping; nothing reaches the SD card until a commit, which syncs the
+    pages written since the last, then a commit marker.  So committing every
+    few seconds writes each page about once, rather than a block per line as a
+    text log would, and segments are allocated whole so the file system's
+    metadata isn't touched per write.  When a segment fills it is committed and
+    the next started; the oldest are deleted past maxSegments.
+
+    Crash safety: a commit marker holds the record count with a CRC, and there
+    are two in separate sectors, written alternately, so a torn marker write
+    leaves the previous one.  Each record also has a CRC and its sequence
+    number, so on open, records after the last marker that made it to the card
+    whole and in sequence are kept, and the rest cleared.
+
+    Segment file layout, little endian:
+      page 0        header (JournalSegHeader) at 0, commit markers
+                    (JournalCommit) at 512 and 1024
+      then          JournalRecord * recordCount
+ */
+
+#ifndef GW_JOURNAL_H
+#define GW_JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include "gwproto.h"
+
+static const uint32_t JOURNAL_DEF_SEG_RECORDS = 32768;     // 1 MiB segments
+static const uint32_t JOURNAL_DEF_MAX_SEGMENTS = 0;        // 0 to keep all
+
+// record flags
+static const uint8_t JOURNAL_HAS_CURRENT = 1;
+
+struct JournalRecord {
+    uint64_t seq;               // from 1, across segments
+    uint32_t startTime;         // UNIX epoch secs
+    uint32_t wh;
+    uint32_t meterValue;        // accumulated Wh at startTime + durationSecs
+    float currentRMS;
+    uint16_t durationSecs;
+    uint8_t nodeId;
+    uint8_t flags;
+    uint32_t crc;               // of the bytes before
+};
+
+static_assert(sizeof(JournalRecord) == 32, "journal record size");
+
+struct JournalSegHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t recordCount;       // capacity
+    uint32_t segNum;
+    uint32_t reserved;
+    uint64_t firstSeq;
+    uint32_t crc;
+};
+
+struct JournalCommit {
+    uint64_t generation;        // the newer valid marker is current
+    uint32_t recordsUsed;
+    uint32_t crc;
+};
+
+
+class MeterJournal {
+  public:
+    ~MeterJournal(){ close(); }
+
+    // opens (creating if need be) the journal in dirPath, recovering the last
+    // segment; false with an error on stderr if not
+    bool open(const char* dirPath, uint32_t segRecords = JOURNAL_DEF_SEG_RECORDS,
+            uint32_t maxSegments = JOURNAL_DEF_MAX_SEGMENTS);
+    void close();
+
+    bool append(const MeterInterval& interval);
+
+    // makes appended records durable, false on an I/O error
+    bool commit();
+
+    uint64_t nextSeq(){ return seqNext; }
+    uint64_t committedSeq(){ return seqCommitted; }
+    uint32_t recovered(){ return recoveredCount; }
+
+  private:
+    bool startSegment(uint32_t segNum);
+    bool mapSegment(const std::string& segPath, bool isRecovering);
+    void unmapSegment();
+    void pruneSegments();
+
+    std::string dirPath;
+    uint32_t segRecords = 0;
+    uint32_t maxSegments = 0;
+    uint8_t* segMap = NULL;
+    size_t segMapLen = 0;
+    JournalSegHeader* segHead = NULL;
+    JournalRecord* records = NULL;
+    uint32_t recordsUsed = 0;
+    uint32_t recordsSynced = 0;
+    uint64_t commitGeneration = 0;
+    uint64_t seqNext = 1;
+    uint64_t seqCommitted = 0;
+    uint32_t recoveredCount = 0;
+};
+
+
+// Calls recordFunc with each record of the journal in dirPath from fromSeq, in
+// order, up to the last commit (and any complete records after it).  False if
+// the journal can't be read.
+bool readJournal(const char* dirPath,
+        std::function<void(const JournalRecord&)> recordFunc,
+        uint64_t fromSeq = 0);
+
+// CRC-32 (IEEE 802.3), as used for records and markers.
+uint32_t gwCrc32(const void* data, size_t len);
+
+#endif
@@ -0,0 +1,809 @@
+/*
+    gwmerge: merges the message streams of several gateways sharing a network
+    id, so gateways can be added for coverage without the server seeing each
+    node message once per gateway that heard it.
+
+    Each gateway is reached through its gwbridge socket: a Unix socket path,
+    or host:port for a remote Pi's (e.g. forwarded by socat or ssh).  The
+    merged G>S messages are written to stdout, as lines of a single gateway's
+    serial output, and S>G lines read from stdin are sent on, so a server can
+    run gwmerge in place of a gateway's serial port.
+
+    Node passthroughs (MUPC, MUP_, MREB, GMSG) heard by several gateways are
+    held for --window-ms, then the copy with the best RSSI passed on and the
+    rest dropped.  Copies are matched by node, base time and base value for
+    meter updates, and any arriving up to --dedup-secs later are dropped too.
+    Others are matched by their body, and as a node may send the same body
+    again, late copies are only dropped for REPEAT_DEDUP_MS.  RSSI needs the
+    gateways set to mrss=1, and is removed from the copy passed on; without it
+    copies rank equally and the first is passed on.
+
+    Each node's preferred gateway is tracked from a running average of the
+    RSSI it is heard at by each gateway, a copy not heard counting as
+    RSSI_MISSED, so both signal and delivery count.  It changes only when
+    another gateway is better by --switch-db, and each change is written as
+        G>S:MGNODE;<node_id>,<gateway_name>,<avg_rssi>
+    Instructions to a node (SMVAL, SPLED, SMINT, SGITR, GNOSNAP;<node_id>) go
+    only to its preferred gateway, as do other node events (e.g. NDARK from a
+    gateway the node has moved away from), apart from ACK/NACKs, which are
+    passed from any.  Other S>G messages go to all gateways.
+
+    gwmerge answers each gateway's GTIME itself, from the host's clock, with
+    the request id and ms, and drops the STIME_ACKs.  SIGUSR1 prints the node
+    table and counters to stderr.
+
+    Usage:
+      gwmerge --gw name=socket [--gw name=socket ...] [--window-ms ms]
+              [--dedup-secs secs] [--switch-db db]
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "gwproto.h"
+
+static const int MAX_GATEWAYS = 32;
+static const int MAX_EPOLL_EVENTS = 32;
+static const size_t MAX_GW_LINE = 1024;
+static const uint32_t RECONNECT_MS = 5000;
+static const uint32_t CONNECT_TIMEOUT_MS = 3000;
+static const uint32_t REPEAT_DEDUP_MS = 5000;
+static const int RSSI_MISSED = -130;        // averaged in for a copy not heard
+static const int RSSI_AVG_WEIGHT = 8;       // 1/n of each new sample
+
+static const char SMSG_RX_PREFIX[] = "S>G:";
+static const char SMSG_TX_PREFIX[] = "G>S:";
+
+// node passthroughs, deduplicated
+static const char* const PASS_MSG_TYPES[] = {"MUPC", "MUP_", "MREB", "GMSG"};
+
+// S>G instructions whose first body field is a node id
+static const char* const NODE_INSTR_TYPES[] = {"SMVAL", "SPLED", "SMINT",
+        "SGITR", "GNOSNAP"};
+
+struct MergeConfig {
+    uint32_t windowMs = 500;
+    uint32_t dedupSecs = 600;
+    int switchDb = 3;
+};
+
+static MergeConfig mergeCfg;
+
+struct MergeGateway {
+    std::string name;
+    std::string addr;
+    int fd = -1;
+    bool isConnecting = false;      // until the non-blocking connect completes
+    uint64_t retryAtMs = 0;         // or, while connecting, when to give up
+    std::string inBuf;
+    std::string outBuf;
+    bool isWriteWaiting = false;
+    uint64_t msgsIn = 0;
+    uint64_t copiesPassed = 0;      // the best copy of a passthrough
+    uint64_t copiesDropped = 0;
+    uint64_t timeReqs = 0;
+};
+
+// a gateway's copy of a passthrough
+struct PassCopy {
+    std::string keyStr;
+    std::string msgLine;            // as passed on, without the RSSI
+    int rssi = 0;
+    bool hasRSSI = false;
+    bool isUpdate = false;          // a meter update, keyed by its base
+};
+
+// a passthrough being held for its copies from other gateways
+struct PendingPass {
+    uint64_t dueMs = 0;
+    uint64_t dedupMs = 0;           // how long late copies are dropped for
+    int nodeId = -1;
+    int bestGw = -1;
+    int bestRSSI = RSSI_MISSED;
+    std::string bestLine;
+    uint32_t heardMask = 0;         // by gateway index
+    int heardRSSI[MAX_GATEWAYS];
+};
+
+struct NodeRoute {
+    int preferredGw = -1;
+    bool hasAvg[MAX_GATEWAYS] = {};
+    float avgRSSI[MAX_GATEWAYS] = {};
+    uint64_t passCount = 0;
+};
+
+struct MergeStats {
+    uint64_t passedOut = 0;
+    uint64_t lateDropped = 0;
+    uint64_t eventsDropped = 0;     // node events from a non-preferred gateway
+    uint64_t instrsRouted = 0;
+    uint64_t msgsBroadcast = 0;
+    uint64_t preferenceChanges = 0;
+};
+
+static MergeStats mergeStats;
+static std::vector<MergeGateway> gateways;
+static std::map<std::string, PendingPass> pendingPasses;
+static std::map<std::string, uint64_t> passedUntilMs;
+static std::deque<std::pair<uint64_t, std::string> > passedOrder;
+static std::map<uint8_t, NodeRoute> nodeRoutes;
+static int epollFd = -1;
+
+
+static uint64_t monotonicMillis(){
+    struct timespec nowTime;
+    clock_gettime(CLOCK_MONOTONIC, &nowTime);
+    return (uint64_t)nowTime.tv_sec * 1000 + nowTime.tv_nsec / 1000000;
+}
+
+
+static bool isTypeIn(const std::string& msgType, const char* const* types,
+        size_t typeCount){
+    for (size_t i = 0; i < typeCount; i++)
+        if (msgType == types[i])
+            return true;
+    return false;
+}
+
+
+static void writeOut(const std::string& msgType, const std::string& msgBody){
+    // as the gateway's serial output, unframed
+    printf("%s%s%s%s\n", SMSG_TX_PREFIX, msgType.c_str(),
+            msgBody.empty() ? "" : ";", msgBody.c_str());
+}
+
+// *****************************************************************************
+//    Gateway Connections
+// *****************************************************************************
+
+static void watchGateway(MergeGateway& gw){
+    struct epoll_event gwEvent = {};
+    gwEvent.events = EPOLLIN | EPOLLRDHUP |
+            (gw.isWriteWaiting || gw.isConnecting ? (uint32_t)EPOLLOUT : 0u);
+    gwEvent.data.fd = gw.fd;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, gw.fd, &gwEvent);
+}
+
+
+static void flushGateway(MergeGateway& gw){
+    while (! gw.outBuf.empty()){
+        ssize_t writeLen = send(gw.fd, gw.outBuf.data(), gw.outBuf.size(),
+                MSG_NOSIGNAL);
+        if (writeLen < 0 && errno == EINTR)
+            continue;
+        if (writeLen < 0)
+            break;
+        gw.outBuf.erase(0, writeLen);
+    }
+    bool isWriteWanted = ! gw.outBuf.empty();
+    if (isWriteWanted != gw.isWriteWaiting){
+        gw.isWriteWaiting = isWriteWanted;
+        watchGateway(gw);
+    }
+}
+
+
+static void sendToGateway(MergeGateway& gw, const std::string& outLine){
+    if (gw.fd < 0)
+        return;
+    gw.outBuf += outLine + "\n";
+    if (! gw.isWriteWaiting && ! gw.isConnecting)
+        flushGateway(gw);
+}
+
+
+static int connectAddr(const std::string& addr, bool& isInProgress){
+    /*
+       Starts a non-blocking connect to a path (Unix socket) or host:port
+       (TCP), returning the socket or -1 if it failed at once.  isInProgress
+       is set if it completes later, when the socket is writable.  Of a host's
+       addresses, the first not failing at once is used.
+    */
+    int sockFd = -1;
+    isInProgress = false;
+    size_t portSep = addr.rfind(':');
+    if (addr.find('/') != std::string::npos || portSep == std::string::npos){
+        struct sockaddr_un sockAddr = {};
+        sockAddr.sun_family = AF_UNIX;
+        if (addr.size() >= sizeof(sockAddr.sun_path))
+            return -1;
+        strcpy(sockAddr.sun_path, addr.c_str());
+        sockFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                0);
+        if (sockFd >= 0 && connect(sockFd, (struct sockaddr*)&sockAddr,
+                sizeof(sockAddr)) != 0){
+            close(sockFd);
+            sockFd = -1;
+        }
+        return sockFd;
+    }
+
+    struct addrinfo addrHints = {};
+    struct addrinfo* addrList = NULL;
+    addrHints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(addr.substr(0, portSep).c_str(),
+            addr.substr(portSep + 1).c_str(), &addrHints, &addrList) != 0)
+        return -1;
+    for (struct addrinfo* addrInfo = addrList; addrInfo != NULL && sockFd < 0;
+            addrInfo = addrInfo->ai_next){
+        sockFd = socket(addrInfo->ai_family, addrInfo->ai_socktype |
+                SOCK_NONBLOCK | SOCK_CLOEXEC, addrInfo->ai_protocol);
+        if (sockFd < 0)
+            continue;
+        if (connect(sockFd, addrInfo->ai_addr, addrInfo->ai_addrlen) == 0)
+            break;
+        if (errno == EINPROGRESS){
+            isInProgress = true;
+            break;
+        }
+        close(sockFd);
+        sockFd = -1;
+    }
+    freeaddrinfo(addrList);
+    return sockFd;
+}
+
+
+static void connectedGateway(MergeGateway& gw){
+    // SUB MSG, queued first, goes out with any S>G lines held meanwhile
+    gw.isConnecting = false;
+    watchGateway(gw);
+    flushGateway(gw);
+    fprintf(stderr, "gwmerge: %s connected (%s)\n", gw.name.c_str(),
+            gw.addr.c_str());
+}
+
+
+static void connectGateway(MergeGateway& gw, uint64_t nowMs){
+    bool isInProgress = false;
+    gw.fd = connectAddr(gw.addr, isInProgress);
+    if (gw.fd < 0){
+        gw.retryAtMs = nowMs + RECONNECT_MS;
+        return;
+    }
+    gw.isConnecting = isInProgress;
+    gw.retryAtMs = nowMs + CONNECT_TIMEOUT_MS;
+    gw.inBuf.clear();
+    gw.outBuf.clear();
+    gw.isWriteWaiting = false;
+    struct epoll_event gwEvent = {};
+    gwEvent.events = EPOLLIN | EPOLLRDHUP |
+            (gw.isConnecting ? (uint32_t)EPOLLOUT : 0u);
+    gwEvent.data.fd = gw.fd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, gw.fd, &gwEvent);
+    sendToGateway(gw, "SUB MSG");
+    if (! gw.isConnecting)
+        connectedGateway(gw);
+}
+
+
+static void closeGateway(int gwIx, uint64_t nowMs){
+    MergeGateway& gw = gateways[gwIx];
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, gw.fd, NULL);
+    close(gw.fd);
+    gw.fd = -1;
+    gw.retryAtMs = nowMs + RECONNECT_MS;
+    if (gw.isConnecting){
+        // quietly, as while a gateway is down this is every RECONNECT_MS
+        gw.isConnecting = false;
+        return;
+    }
+    fprintf(stderr, "gwmerge: %s disconnected\n", gw.name.c_str());
+
+    // its nodes are routed to all gateways until heard again
+    for (auto& routeEntry : nodeRoutes)
+        if (routeEntry.second.preferredGw == gwIx)
+            routeEntry.second.preferredGw = -1;
+}
+
+// *****************************************************************************
+//    Passthroughs
+// *****************************************************************************
+
+static bool getPassCopy(const GwMessage& gwMsg, PassCopy& passCopy){
+    /*
+       Key of a passthrough's copies, e.g. 'M3,1700000000,1000' for a meter
+       update from node 3, the RSSI it was heard at if the gateway sent it
+       (after the node id, with mrss=1), and the message without it.
+    */
+    MeterBase meterBase;
+    std::vector<MeterInterval> intervals;
+    bool isUpdate = parseMeterUpdate(gwMsg, meterBase, intervals);
+    if (! isUpdate && (gwMsg.type == "MUPC" || gwMsg.type == "MUP_"))
+        return false;
+
+    // '<node_id>,[<rssi>,]<type>,...'
+    std::string msgBody = gwMsg.body;
+    size_t rssiStart = msgBody.find(',') + 1;
+    size_t rssiEnd = msgBody.find(',', rssiStart);
+    passCopy.hasRSSI = (rssiStart > 0 && rssiEnd != std::string::npos &&
+            msgBody.compare(rssiStart, rssiEnd - rssiStart, gwMsg.type) != 0 &&
+            msgBody.compare(rssiEnd + 1, gwMsg.type.size(), gwMsg.type) == 0);
+    if (passCopy.hasRSSI){
+        passCopy.rssi = atoi(msgBody.c_str() + rssiStart);
+        msgBody.erase(rssiStart, rssiEnd + 1 - rssiStart);
+    }
+    passCopy.msgLine = std::string(SMSG_TX_PREFIX) + gwMsg.type + ";" +
+            msgBody;
+    passCopy.isUpdate = isUpdate;
+
+    // MUPC and MUP_ of a base are the same update
+    if (isUpdate)
+        passCopy.keyStr = "M" + std::to_string(meterBase.nodeId) + "," +
+                std::to_string(meterBase.baseTime) + "," +
+                std::to_string(meterBase.baseValue);
+    else
+        passCopy.keyStr = gwMsg.type + msgBody;
+    return true;
+}
+
+
+static void updateRoute(const PendingPass& pass){
+    /*
+       Averages each connected gateway's RSSI for the node, the copies it
+       didn't hear as RSSI_MISSED, and moves the node's preference to the best
+       gateway if better than the preferred by switchDb.
+    */
+    NodeRoute& route = nodeRoutes[pass.nodeId];
+    route.passCount++;
+    for (size_t i = 0; i < gateways.size(); i++){
+        if (gateways[i].fd < 0 && (pass.heardMask & (1u << i)) == 0)
+            continue;
+        int rssiSample = (pass.heardMask & (1u << i)) ? pass.heardRSSI[i] :
+                RSSI_MISSED;
+        if (! route.hasAvg[i])
+            route.avgRSSI[i] = rssiSample;
+        else
+            route.avgRSSI[i] += (rssiSample - route.avgRSSI[i]) /
+                    RSSI_AVG_WEIGHT;
+        route.hasAvg[i] = true;
+    }
+
+    int bestGw = -1;
+    for (size_t i = 0; i < gateways.size(); i++)
+        if (route.hasAvg[i] && gateways[i].fd >= 0 && (bestGw < 0 ||
+                route.avgRSSI[i] > route.avgRSSI[bestGw]))
+            bestGw = i;
+    if (bestGw < 0 || bestGw == route.preferredGw || (route.preferredGw >= 0 &&
+            route.avgRSSI[bestGw] < route.avgRSSI[route.preferredGw] +
+            mergeCfg.switchDb))
+        return;
+
+    route.preferredGw = bestGw;
+    mergeStats.preferenceChanges++;
+    char routeStr[96];
+    snprintf(routeStr, sizeof(routeStr), "%d,%s,%.0f", pass.nodeId,
+            gateways[bestGw].name.c_str(), route.avgRSSI[bestGw]);
+    writeOut("MGNODE", routeStr);
+}
+
+
+static void passOn(const std::string& keyStr, const PendingPass& pass,
+        uint64_t nowMs){
+    printf("%s\n", pass.bestLine.c_str());
+    mergeStats.passedOut++;
+    gateways[pass.bestGw].copiesPassed++;
+    for (size_t i = 0; i < gateways.size(); i++)
+        if ((pass.heardMask & (1u << i)) != 0 && (int)i != pass.bestGw)
+            gateways[i].copiesDropped++;
+    updateRoute(pass);
+
+    passedUntilMs[keyStr] = nowMs + pass.dedupMs;
+    passedOrder.push_back(std::make_pair(nowMs + pass.dedupMs, keyStr));
+}
+
+
+static void handlePass(int gwIx, const GwMessage& gwMsg,
+        const std::string& msgLine, uint64_t nowMs){
+    PassCopy passCopy;
+    if (! getPassCopy(gwMsg, passCopy)){
+        // malformed, pass on as is
+        printf("%s\n", msgLine.c_str());
+        return;
+    }
+    const std::string& keyStr = passCopy.keyStr;
+    int rssi = passCopy.hasRSSI ? passCopy.rssi : 0;  // else ranked equally,
+                                                      // the first kept
+
+    if (passedUntilMs.count(keyStr) > 0){
+        mergeStats.lateDropped++;
+        gateways[gwIx].copiesDropped++;
+        return;
+    }
+
+    auto passEntry = pendingPasses.find(keyStr);
+    if (passEntry == pendingPasses.end()){
+        PendingPass& pass = pendingPasses[keyStr];
+        pass.dueMs = nowMs + mergeCfg.windowMs;
+        pass.dedupMs = passCopy.isUpdate ? mergeCfg.dedupSecs * 1000ull :
+                REPEAT_DEDUP_MS;
+        pass.nodeId = gwMsg.nodeId;
+        pass.bestGw = gwIx;
+        pass.bestRSSI = rssi;
+        pass.bestLine = passCopy.msgLine;
+        pass.heardMask = 1u << gwIx;
+        pass.heardRSSI[gwIx] = rssi;
+        return;
+    }
+
+    PendingPass& pass = passEntry->second;
+    if ((pass.heardMask & (1u << gwIx)) != 0){
+        // the same gateway again, e.g. the node resending a lost ACK
+        gateways[gwIx].copiesDropped++;
+        return;
+    }
+    pass.heardMask |= 1u << gwIx;
+    pass.heardRSSI[gwIx] = rssi;
+    if (rssi > pass.bestRSSI){
+        pass.bestGw = gwIx;
+        pass.bestRSSI = rssi;
+        pass.bestLine = passCopy.msgLine;
+    }
+}
+
+
+static void passDue(uint64_t nowMs, bool isAll){
+    for (auto passEntry = pendingPasses.begin();
+            passEntry != pendingPasses.end();){
+        if (! isAll && passEntry->second.dueMs > nowMs){
+            ++passEntry;
+            continue;
+        }
+        passOn(passEntry->first, passEntry->second, nowMs);
+        passEntry = pendingPasses.erase(passEntry);
+    }
+
+    while (! passedOrder.empty() && passedOrder.front().first <= nowMs){
+        auto passedEntry = passedUntilMs.find(passedOrder.front().second);
+        if (passedEntry != passedUntilMs.end() &&
+                passedEntry->second <= nowMs)
+            passedUntilMs.erase(passedEntry);
+        passedOrder.pop_front();
+    }
+}
+
+// *****************************************************************************
+//    Messages
+// *****************************************************************************
+
+static void answerTimeReq(MergeGateway& gw, const GwMessage& gwMsg){
+    /*
+       STIME with ms and the request id, as the gateway times the round trip
+    */
+    struct timespec nowTime;
+    clock_gettime(CLOCK_REALTIME, &nowTime);
+    std::string timeStr = std::string(SMSG_RX_PREFIX) + "STIME," +
+            std::to_string(nowTime.tv_sec);
+    if (! gwMsg.body.empty())
+        timeStr += "," + std::to_string(nowTime.tv_nsec / 1000000) + "," +
+                gwMsg.body;
+    gw.timeReqs++;
+    sendToGateway(gw, timeStr);
+}
+
+
+static void handleGwMessage(int gwIx, const GwMessage& gwMsg, uint64_t nowMs){
+    MergeGateway& gw = gateways[gwIx];
+    std::string msgLine = std::string(SMSG_TX_PREFIX) + gwMsg.type +
+            (gwMsg.body.empty() ? "" : ";" + gwMsg.body);
+    gw.msgsIn++;
+
+    if (gwMsg.type == "GTIME"){
+        answerTimeReq(gw, gwMsg);
+        return;
+    }
+    // ours, to the STIMEs above
+    if (gwMsg.type == "STIME_ACK" && ! gwMsg.body.empty())
+        return;
+
+    if (gwMsg.nodeId >= 0 && isTypeIn(gwMsg.type, PASS_MSG_TYPES,
+            sizeof(PASS_MSG_TYPES) / sizeof(PASS_MSG_TYPES[0]))){
+        handlePass(gwIx, gwMsg, msgLine, nowMs);
+        return;
+    }
+
+    // other node events from the node's gateway, bar replies to instructions
+    if (gwMsg.nodeId >= 0){
+        auto routeEntry = nodeRoutes.find(gwMsg.nodeId);
+        bool isReply = (gwMsg.type.size() > 4 && (gwMsg.type.compare(
+                gwMsg.type.size() - 4, 4, "_ACK") == 0 ||
+                gwMsg.type.compare(gwMsg.type.size() - 5, 5, "_NACK") == 0));
+        if (! isReply && routeEntry != nodeRoutes.end() &&
+                routeEntry->second.preferredGw >= 0 &&
+                routeEntry->second.preferredGw != gwIx){
+            mergeStats.eventsDropped++;
+            return;
+        }
+    }
+    printf("%s\n", msgLine.c_str());
+}
+
+
+static void handleGwLine(int gwIx, const std::string& gwLine, uint64_t nowMs){
+    // EVT <type> <node_id|-> <body>, other lines (OK, ERR) ignored
+    if (gwLine.compare(0, 4, "EVT ") != 0)
+        return;
+    size_t typeEnd = gwLine.find(' ', 4);
+    size_t nodeEnd = (typeEnd == std::string::npos) ? std::string::npos :
+            gwLine.find(' ', typeEnd + 1);
+    if (nodeEnd == std::string::npos)
+        return;
+
+    GwMessage gwMsg;
+    gwMsg.type = gwLine.substr(4, typeEnd - 4);
+    gwMsg.nodeId = (gwLine[typeEnd + 1] == '-') ? -1 :
+            atoi(gwLine.c_str() + typeEnd + 1);
+    gwMsg.body = gwLine.substr(nodeEnd + 1);
+    handleGwMessage(gwIx, gwMsg, nowMs);
+}
+
+
+static bool readGateway(int gwIx, uint64_t nowMs){
+    MergeGateway& gw = gateways[gwIx];
+    char readBuf[4096];
+    ssize_t readLen = read(gw.fd, readBuf, sizeof(readBuf));
+    if (readLen < 0)
+        return errno == EAGAIN || errno == EINTR;
+    if (readLen == 0)
+        return false;
+
+    gw.inBuf.append(readBuf, readLen);
+    size_t lineStart = 0;
+    size_t lineEnd;
+    while ((lineEnd = gw.inBuf.find('\n', lineStart)) != std::string::npos){
+        handleGwLine(gwIx, gw.inBuf.substr(lineStart, lineEnd - lineStart),
+                nowMs);
+        lineStart = lineEnd + 1;
+    }
+    gw.inBuf.erase(0, lineStart);
+    if (gw.inBuf.size() > MAX_GW_LINE)
+        gw.inBuf.clear();
+    return true;
+}
+
+
+static void handleServerLine(const std::string& serverLine){
+    /*
+       Routes an S>G message: a node instruction to the node's gateway (all if
+       not known yet), anything else to all gateways.
+    */
+    if (serverLine.compare(0, strlen(SMSG_RX_PREFIX), SMSG_RX_PREFIX) != 0){
+        if (! serverLine.empty())
+            fprintf(stderr, "gwmerge: not an S>G message: %s\n",
+                    serverLine.c_str());
+        return;
+    }
+
+    size_t typeStart = strlen(SMSG_RX_PREFIX);
+    size_t typeEnd = serverLine.find_first_of(";,", typeStart);
+    std::string msgType = serverLine.substr(typeStart,
+            typeEnd == std::string::npos ? std::string::npos :
+            typeEnd - typeStart);
+    int nodeId = -1;
+    if (typeEnd != std::string::npos && isTypeIn(msgType, NODE_INSTR_TYPES,
+            sizeof(NODE_INSTR_TYPES) / sizeof(NODE_INSTR_TYPES[0]))){
+        char* idEnd = NULL;
+        unsigned long idVal = strtoul(serverLine.c_str() + typeEnd + 1, &idEnd,
+                10);
+        if (idEnd != serverLine.c_str() + typeEnd + 1 && idVal < 254)
+            nodeId = idVal;
+    }
+
+    auto routeEntry = nodeRoutes.find(nodeId);
+    if (nodeId >= 0 && routeEntry != nodeRoutes.end() &&
+            routeEntry->second.preferredGw >= 0){
+        sendToGateway(gateways[routeEntry->second.preferredGw], serverLine);
+        mergeStats.instrsRouted++;
+        return;
+    }
+    for (MergeGateway& gw : gateways)
+        sendToGateway(gw, serverLine);
+    mergeStats.msgsBroadcast++;
+}
+
+
+static bool readServer(std::string& serverBuf){
+    char readBuf[1024];
+    ssize_t readLen = read(STDIN_FILENO, readBuf, sizeof(readBuf));
+    if (readLen < 0)
+        return errno == EAGAIN || errno == EINTR;
+    if (readLen == 0)
+        return false;
+
+    serverBuf.append(readBuf, readLen);
+    size_t lineEnd;
+    while ((lineEnd = serverBuf.find('\n')) != std::string::npos){
+        std::string serverLine = serverBuf.substr(0, lineEnd);
+        serverBuf.erase(0, lineEnd + 1);
+        if (! serverLine.empty() && serverLine.back() == '\r')
+            serverLine.pop_back();
+        handleServerLine(serverLine);
+    }
+    if (serverBuf.size() > MAX_GW_LINE)
+        serverBuf.clear();
+    return true;
+}
+
+// *****************************************************************************
+//    Main
+// *****************************************************************************
+
+static void printStats(){
+    fprintf(stderr, "gwmerge: passed %" PRIu64 ", late copies dropped %"
+            PRIu64 ", node events dropped %" PRIu64 ", instructions routed %"
+            PRIu64 ", broadcast %" PRIu64 ", preference changes %" PRIu64
+            "\n", mergeStats.passedOut, mergeStats.lateDropped,
+            mergeStats.eventsDropped, mergeStats.instrsRouted,
+            mergeStats.msgsBroadcast, mergeStats.preferenceChanges);
+    for (const MergeGateway& gw : gateways)
+        fprintf(stderr, "  gateway %s: %s, msgs %" PRIu64 ", best copies %"
+                PRIu64 ", dropped copies %" PRIu64 ", time requests %" PRIu64
+                "\n", gw.name.c_str(), gw.fd >= 0 ? "up" : "down", gw.msgsIn,
+                gw.copiesPassed, gw.copiesDropped, gw.timeReqs);
+    for (const auto& routeEntry : nodeRoutes){
+        const NodeRoute& route = routeEntry.second;
+        fprintf(stderr, "  node %u: preferred %s, %" PRIu64 " passthroughs,"
+                " avg rssi", routeEntry.first, route.preferredGw >= 0 ?
+                gateways[route.preferredGw].name.c_str() : "-",
+                route.passCount);
+        for (size_t i = 0; i < gateways.size(); i++)
+            if (route.hasAvg[i])
+                fprintf(stderr, " %s=%.0f", gateways[i].name.c_str(),
+                        route.avgRSSI[i]);
+        fprintf(stderr, "\n");
+    }
+}
+
+
+static void usage(){
+    fprintf(stderr, "usage: gwmerge --gw name=socket [--gw name=socket ...] "
+            "[--window-ms ms]\n"
+            "               [--dedup-secs secs] [--switch-db db]\n");
+    exit(1);
+}
+
+
+int main(int argc, char** argv){
+    for (int i = 1; i < argc; i++){
+        if (i + 1 >= argc)
+            usage();
+        const char* argName = argv[i];
+        const char* argVal = argv[++i];
+        if (strcmp(argName, "--gw") == 0){
+            const char* nameEnd = strchr(argVal, '=');
+            if (nameEnd == NULL || nameEnd == argVal ||
+                    gateways.size() >= (size_t)MAX_GATEWAYS)
+                usage();
+            MergeGateway gw;
+            gw.name.assign(argVal, nameEnd - argVal);
+            gw.addr = nameEnd + 1;
+            gateways.push_back(gw);
+        }
+        else if (strcmp(argName, "--window-ms") == 0)
+            mergeCfg.windowMs = atol(argVal);
+        else if (strcmp(argName, "--dedup-secs") == 0)
+            mergeCfg.dedupSecs = atol(argVal);
+        else if (strcmp(argName, "--switch-db") == 0)
+            mergeCfg.switchDb = atoi(argVal);
+        else
+            usage();
+    }
+    if (gateways.empty())
+        usage();
+
+    // exit cleanly on SIGINT/SIGTERM, print stats on SIGUSR1
+    sigset_t handledSignals;
+    sigemptyset(&handledSignals);
+    sigaddset(&handledSignals, SIGINT);
+    sigaddset(&handledSignals, SIGTERM);
+    sigaddset(&handledSignals, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &handledSignals, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    int signalFd = signalfd(-1, &handledSignals, SFD_NONBLOCK | SFD_CLOEXEC);
+    struct epoll_event fdEvent = {};
+    fdEvent.events = EPOLLIN;
+    fdEvent.data.fd = signalFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, signalFd, &fdEvent);
+    fdEvent.data.fd = STDIN_FILENO;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, STDIN_FILENO, &fdEvent);
+
+    for (MergeGateway& gw : gateways)
+        connectGateway(gw, monotonicMillis());
+
+    std::string serverBuf;
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    bool isRunning = true;
+    while (isRunning){
+        // until the next passthrough is due or gateway to reconnect
+        uint64_t nowMs = monotonicMillis();
+        uint64_t wakeMs = UINT64_MAX;
+        for (const auto& passEntry : pendingPasses)
+            wakeMs = std::min(wakeMs, passEntry.second.dueMs);
+        for (const MergeGateway& gw : gateways)
+            if (gw.fd < 0 || gw.isConnecting)
+                wakeMs = std::min(wakeMs, gw.retryAtMs);
+        int waitMs = (wakeMs == UINT64_MAX) ? -1 : (wakeMs <= nowMs) ? 0 :
+                (int)std::min<uint64_t>(wakeMs - nowMs, 60000);
+
+        int eventCount = epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, waitMs);
+        if (eventCount < 0 && errno != EINTR){
+            perror("epoll_wait");
+            return 1;
+        }
+
+        nowMs = monotonicMillis();
+        for (int i = 0; i < eventCount; i++){
+            int eventFd = events[i].data.fd;
+            uint32_t eventFlags = events[i].events;
+
+            if (eventFd == signalFd){
+                struct signalfd_siginfo sigInfo;
+                if (read(signalFd, &sigInfo, sizeof(sigInfo)) !=
+                        sizeof(sigInfo))
+                    continue;
+                if (sigInfo.ssi_signo == SIGUSR1)
+                    printStats();
+                else
+                    isRunning = false;
+            }
+            else if (eventFd == STDIN_FILENO){
+                if (! readServer(serverBuf))
+                    isRunning = false;
+            }
+            else {
+                for (size_t gwIx = 0; gwIx < gateways.size(); gwIx++){
+                    if (gateways[gwIx].fd != eventFd)
+                        continue;
+                    if (gateways[gwIx].isConnecting){
+                        int connError = 0;
+                        socklen_t errorLen = sizeof(connError);
+                        getsockopt(eventFd, SOL_SOCKET, SO_ERROR, &connError,
+                                &errorLen);
+                        if (connError != 0 || (eventFlags & EPOLLOUT) == 0)
+                            closeGateway(gwIx, nowMs);
+                        else
+                            connectedGateway(gateways[gwIx]);
+                        break;
+                    }
+                    if ((eventFlags & EPOLLOUT) != 0)
+                        flushGateway(gateways[gwIx]);
+                    if ((eventFlags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP |
+                            EPOLLERR)) != 0 && ! readGateway(gwIx, nowMs))
+                        closeGateway(gwIx, nowMs);
+                    break;
+                }
+            }
+        }
+
+        passDue(nowMs, false);
+        for (size_t gwIx = 0; gwIx < gateways.size(); gwIx++){
+            MergeGateway& gw = gateways[gwIx];
+            if (gw.isConnecting && gw.retryAtMs <= nowMs)
+                closeGateway(gwIx, nowMs);
+            else if (gw.fd < 0 && gw.retryAtMs <= nowMs)
+                connectGateway(gw, nowMs);
+        }
+    }
+
+    passDue(monotonicMillis(), true);
+    printStats();
+    return 0;
+}
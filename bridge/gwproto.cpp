@@ -0,0 +1,182 @@
+/*
+    Parsing of the gateway's serial output, see gwproto.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "gwproto.h"
+
+static const char SMSG_TX_PREFIX[] = "G>S:";
+static const char CAPT_PREFIX[] = "CAP:";
+static const char SER_FRAME_SEP = '|';
+
+// start of a tokenised log line (logt=1)
+static const char LOG_TOKEN_START = 0x1F;
+
+static const char* const LOG_LEVEL_LBLS[] = {"ERROR:", "WARN:", "INFO:",
+        "DEBUG:"};
+
+// messages whose first body field is the node they concern
+static const char* const NODE_MSG_TYPES[] = {"MUPC", "MUP_", "MREB", "GMSG",
+        "NDARK", "NALRT", "GNOSNAP_NACK", "SMVAL_ACK", "SMVAL_NACK",
+        "SPLED_ACK", "SPLED_NACK", "SMINT_ACK", "SMINT_NACK", "SGITR_ACK",
+        "SGITR_NACK"};
+
+// *****************************************************************************
+//    Lines
+// *****************************************************************************
+
+static bool startsWith(const std::string& str, const char* prefix){
+    return str.compare(0, strlen(prefix), prefix) == 0;
+}
+
+
+static void classifyLine(const std::string& rawLine, GwLine& line){
+    // framed, e.g. '3|G>S:GTIME'
+    if (rawLine.size() >= 2 && rawLine[1] == SER_FRAME_SEP &&
+            rawLine[0] >= '0' + lineConsole && rawLine[0] <= '0' + lineCapture){
+        line.kind = (GwLineKind)(rawLine[0] - '0');
+        line.text = rawLine.substr(2);
+        return;
+    }
+
+    line.text = rawLine;
+    if (startsWith(rawLine, SMSG_TX_PREFIX))
+        line.kind = lineMessage;
+    else if (startsWith(rawLine, CAPT_PREFIX))
+        line.kind = lineCapture;
+    else if (! rawLine.empty() && rawLine[0] == LOG_TOKEN_START)
+        line.kind = lineLog;
+    else {
+        line.kind = lineConsole;
+        for (size_t i = 0; i < sizeof(LOG_LEVEL_LBLS) /
+                sizeof(LOG_LEVEL_LBLS[0]); i++)
+            if (startsWith(rawLine, LOG_LEVEL_LBLS[i]))
+                line.kind = lineLog;
+    }
+}
+
+
+void GwLineSplitter::feed(const char* inBytes, size_t inLen){
+    if (nextReady == readyLines.size()){
+        readyLines.clear();
+        nextReady = 0;
+    }
+
+    for (size_t i = 0; i < inLen; i++){
+        char inChar = inBytes[i];
+        if (inChar == '\n' || partLine.size() >= maxLen){
+            // empty lines (e.g. the gateway's blank lines at boot) are dropped
+            if (! partLine.empty())
+                readyLines.push_back(partLine);
+            partLine.clear();
+            if (inChar == '\n')
+                continue;
+        }
+        if (inChar != '\r')
+            partLine += inChar;
+    }
+}
+
+
+bool GwLineSplitter::next(GwLine& line){
+    if (nextReady == readyLines.size())
+        return false;
+    classifyLine(readyLines[nextReady++], line);
+    return true;
+}
+
+// *****************************************************************************
+//    Messages
+// *****************************************************************************
+
+bool parseGwMessage(const std::string& lineText, GwMessage& gwMsg){
+    size_t typeStart = startsWith(lineText, SMSG_TX_PREFIX) ?
+            strlen(SMSG_TX_PREFIX) : 0;
+    size_t typeEnd = lineText.find(';', typeStart);
+
+    gwMsg.type = lineText.substr(typeStart, typeEnd == std::string::npos ?
+            std::string::npos : typeEnd - typeStart);
+    gwMsg.body = (typeEnd == std::string::npos) ? "" :
+            lineText.substr(typeEnd + 1);
+    gwMsg.nodeId = -1;
+
+    if (gwMsg.type.empty() || gwMsg.type.find_first_not_of(
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZ_") != std::string::npos)
+        return false;
+
+    for (size_t i = 0; i < sizeof(NODE_MSG_TYPES) / sizeof(NODE_MSG_TYPES[0]);
+            i++){
+        if (gwMsg.type != NODE_MSG_TYPES[i])
+            continue;
+        char* idEnd = NULL;
+        unsigned long nodeId = strtoul(gwMsg.body.c_str(), &idEnd, 10);
+        if (idEnd != gwMsg.body.c_str() && nodeId < 256)
+            gwMsg.nodeId = nodeId;
+        break;
+    }
+    return true;
+}
+
+
+bool parseMeterUpdate(const GwMessage& gwMsg, MeterBase& meterBase,
+        std::vector<MeterInterval>& intervals){
+    /*
+       Body is '<node_id>,<MUPC|MUP_>,<base_time>,<base_value>' followed by a
+       '<duration>,<wh>[,<current>]' group per interval, as the firmware's
+       parseMeterUpdateMsg, with the RSSI after the node id if the gateway
+       has mrss=1.  Fields may be separated by ',' or ';'.
+    */
+    bool isWithCurrent = (gwMsg.type == "MUPC");
+    if ((! isWithCurrent && gwMsg.type != "MUP_") || gwMsg.nodeId < 0)
+        return false;
+
+    std::vector<std::string> fields;
+    size_t fieldStart = 0;
+    while (fieldStart <= gwMsg.body.size()){
+        size_t fieldEnd = gwMsg.body.find_first_of(",;", fieldStart);
+        if (fieldEnd == std::string::npos)
+            fieldEnd = gwMsg.body.size();
+        if (fieldEnd > fieldStart)
+            fields.push_back(gwMsg.body.substr(fieldStart,
+                    fieldEnd - fieldStart));
+        fieldStart = fieldEnd + 1;
+    }
+
+    meterBase.hasRSSI = (fields.size() >= 5 && fields[1] != gwMsg.type &&
+            fields[2] == gwMsg.type);
+    if (meterBase.hasRSSI){
+        meterBase.rssi = atoi(fields[1].c_str());
+        fields.erase(fields.begin() + 1);
+    }
+
+    // node id, type, base time and value
+    if (fields.size() < 4 || fields[1] != gwMsg.type)
+        return false;
+    meterBase.nodeId = gwMsg.nodeId;
+    meterBase.baseTime = strtoul(fields[2].c_str(), NULL, 10);
+    meterBase.baseValue = strtoul(fields[3].c_str(), NULL, 10);
+
+    size_t groupLen = isWithCurrent ? 3 : 2;
+    if ((fields.size() - 4) % groupLen != 0)
+        return false;
+
+    uint32_t endTime = meterBase.baseTime;
+    uint32_t meterValue = meterBase.baseValue;
+    intervals.clear();
+    for (size_t i = 4; i < fields.size(); i += groupLen){
+        MeterInterval interval;
+        interval.nodeId = gwMsg.nodeId;
+        interval.durationSecs = strtoul(fields[i].c_str(), NULL, 10);
+        interval.wh = strtoul(fields[i + 1].c_str(), NULL, 10);
+        endTime += interval.durationSecs;
+        meterValue += interval.wh;
+        interval.endTime = endTime;
+        interval.meterValue = meterValue;
+        interval.hasCurrent = isWithCurrent;
+        if (isWithCurrent)
+            interval.currentRMS = strtof(fields[i + 2].c_str(), NULL);
+        intervals.push_back(interval);
+    }
+    return true;
+}
@@ -0,0 +1,90 @@
+/*
+    Parsing of the gateway's serial output, shared by the Pi-side tools.
+
+    Output is split into lines incrementally as bytes arrive, each line
+    classed by channel (from its framing prefix if framing is on, else from its
+    content), and G>S message lines split into type, node id and body.  Meter
+    updates (MUPC, MUP_) can be expanded into their intervals.
+ */
+
+#ifndef GW_PROTO_H
+#define GW_PROTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// channel of an output line, as the gateway's SerChan
+enum GwLineKind {
+    lineConsole = 1,
+    lineLog = 2,
+    lineMessage = 3,
+    lineCapture = 4
+};
+
+struct GwLine {
+    GwLineKind kind = lineConsole;
+    std::string text;       // without framing prefix or line end
+};
+
+
+class GwLineSplitter {
+    /*
+       Splits a byte stream into lines.  Lines longer than maxLen are cut at
+       maxLen (the rest being its own line), so a garbled stream can't grow the
+       buffer.
+    */
+  public:
+    explicit GwLineSplitter(size_t maxLen = 512) : maxLen(maxLen){}
+
+    // adds bytes, any whole lines then being returned by next(), which is
+    // false once there are none
+    void feed(const char* inBytes, size_t inLen);
+    bool next(GwLine& line);
+
+  private:
+    size_t maxLen;
+    std::string partLine;
+    std::vector<std::string> readyLines;
+    size_t nextReady = 0;
+};
+
+
+struct GwMessage {
+    std::string type;       // e.g. MUPC, STIME_ACK
+    int nodeId = -1;        // for node messages, else -1
+    std::string body;       // after the type and ';', may be empty
+};
+
+// Splits a G>S message line (with or without the G>S: prefix) into type, body
+// and node id (the first body field of node messages).  False if not a message.
+bool parseGwMessage(const std::string& lineText, GwMessage& gwMsg);
+
+
+// One interval of a meter update: Wh used over durationSecs to endTime.
+struct MeterInterval {
+    uint8_t nodeId = 0;
+    uint32_t endTime = 0;       // UNIX epoch secs
+    uint16_t durationSecs = 0;
+    uint32_t wh = 0;
+    uint32_t meterValue = 0;    // accumulated Wh at endTime
+    bool hasCurrent = false;
+    float currentRMS = 0;       // amps, if hasCurrent
+};
+
+// Meter update base: accumulated Wh at a time, from which intervals follow.
+struct MeterBase {
+    uint8_t nodeId = 0;
+    uint32_t baseTime = 0;
+    uint32_t baseValue = 0;
+    bool hasRSSI = false;
+    int rssi = 0;               // dBm at the gateway, if hasRSSI (mrss=1)
+};
+
+// Expands a MUPC or MUP_ message into its base and intervals.  False if not a
+// meter update or malformed.
+bool parseMeterUpdate(const GwMessage& gwMsg, MeterBase& meterBase,
+        std::vector<MeterInterval>& intervals);
+
+#endif
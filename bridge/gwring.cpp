@@ -0,0 +1,367 @@
+/*
+    Shared memory event ring, see gwring.h.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "gwring.h"
+
+static const uint32_t GW_RING_MAGIC = 0x47575247;
+static const uint32_t GW_RING_VERSION = 1;
+
+// *****************************************************************************
+//    Common
+// *****************************************************************************
+
+static size_t ringMapLen(uint32_t slotCount){
+    return sizeof(GwRingHeader) + (size_t)slotCount * sizeof(GwRingSlot);
+}
+
+
+static uint64_t monotonicMicros(){
+    // vDSO, so no system call
+    struct timespec nowTime;
+    clock_gettime(CLOCK_MONOTONIC, &nowTime);
+    return (uint64_t)nowTime.tv_sec * 1000000 + nowTime.tv_nsec / 1000;
+}
+
+
+static GwRingSlot* ringSlots(GwRingHeader* ringHead){
+    return (GwRingSlot*)(ringHead + 1);
+}
+
+
+static bool isRingValid(const GwRingHeader* ringHead, size_t fileLen){
+    return ringHead->magic == GW_RING_MAGIC &&
+            ringHead->version == GW_RING_VERSION &&
+            ringHead->slotSize == sizeof(GwRingSlot) &&
+            ringHead->slotCount > 0 &&
+            (ringHead->slotCount & (ringHead->slotCount - 1)) == 0 &&
+            fileLen >= ringMapLen(ringHead->slotCount);
+}
+
+
+bool isRingPidAlive(pid_t pid){
+    return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+// *****************************************************************************
+//    Writer
+// *****************************************************************************
+
+bool GwRingWriter::create(const char* ringName, uint32_t slotCount){
+    /*
+       An existing ring of the same size (e.g. from before a restart) is taken
+       over, so its consumers carry on from where they were.  One with a live
+       producer is left alone, and an error returned.
+    */
+    if (slotCount == 0 || (slotCount & (slotCount - 1)) != 0){
+        fprintf(stderr, "gwring: slot count must be a power of 2\n");
+        return false;
+    }
+    close();
+
+    int shmFd = shm_open(ringName, O_RDWR | O_CLOEXEC, 0);
+    if (shmFd >= 0){
+        struct stat shmStat;
+        void* shmMap = MAP_FAILED;
+        if (fstat(shmFd, &shmStat) == 0 &&
+                (size_t)shmStat.st_size >= sizeof(GwRingHeader))
+            shmMap = mmap(NULL, shmStat.st_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, shmFd, 0);
+        if (shmMap != MAP_FAILED){
+            GwRingHeader* oldHead = (GwRingHeader*)shmMap;
+            if (isRingValid(oldHead, shmStat.st_size)){
+                pid_t producerPid = oldHead->producerPid.load();
+                if (isRingPidAlive(producerPid)){
+                    fprintf(stderr, "gwring: %s is in use by pid %d\n",
+                            ringName, (int)producerPid);
+                    munmap(shmMap, shmStat.st_size);
+                    ::close(shmFd);
+                    return false;
+                }
+                if (oldHead->slotCount == slotCount){
+                    ::close(shmFd);
+                    ringHead = oldHead;
+                    slots = ringSlots(ringHead);
+                    mapLen = shmStat.st_size;
+                    ringHead->producerPid.store(getpid());
+                    return true;
+                }
+            }
+            munmap(shmMap, shmStat.st_size);
+        }
+        // a dead producer's ring of another size, or not a ring
+        ::close(shmFd);
+        shm_unlink(ringName);
+    }
+
+    // consumers write their cursors, so need write access
+    shmFd = shm_open(ringName, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0660);
+    if (shmFd < 0){
+        perror(ringName);
+        return false;
+    }
+    fchmod(shmFd, 0660);
+    mapLen = ringMapLen(slotCount);
+    void* shmMap = MAP_FAILED;
+    if (ftruncate(shmFd, mapLen) == 0)
+        shmMap = mmap(NULL, mapLen, PROT_READ | PROT_WRITE, MAP_SHARED, shmFd,
+                0);
+    ::close(shmFd);
+    if (shmMap == MAP_FAILED){
+        perror(ringName);
+        shm_unlink(ringName);
+        mapLen = 0;
+        return false;
+    }
+
+    // zero filled by ftruncate, so atomics start at 0
+    ringHead = (GwRingHeader*)shmMap;
+    slots = ringSlots(ringHead);
+    ringHead->version = GW_RING_VERSION;
+    ringHead->slotCount = slotCount;
+    ringHead->slotSize = sizeof(GwRingSlot);
+    ringHead->producerPid.store(getpid());
+    std::atomic_thread_fence(std::memory_order_release);
+    ringHead->magic = GW_RING_MAGIC;
+    return true;
+}
+
+
+void GwRingWriter::close(){
+    // the ring is left for consumers to finish reading, and for a restart
+    if (ringHead == NULL)
+        return;
+    ringHead->producerPid.store(0);
+    munmap(ringHead, mapLen);
+    ringHead = NULL;
+    slots = NULL;
+}
+
+
+void GwRingWriter::publish(uint8_t kind, uint8_t nodeId, const char* data,
+        size_t len){
+    /*
+       Seqlock write: the slot's seq is odd while it is written, so a consumer
+       copying it at the same time sees the change and discards its copy.
+    */
+    if (ringHead == NULL)
+        return;
+    uint64_t eventNum = ringHead->writeSeq.load(std::memory_order_relaxed);
+    GwRingSlot& slot = slots[eventNum & (ringHead->slotCount - 1)];
+
+    slot.seq.store(eventNum * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.publishMicros = monotonicMicros();
+    slot.kind = kind;
+    slot.nodeId = nodeId;
+    slot.flags = 0;
+    if (len > sizeof(slot.data)){
+        len = sizeof(slot.data);
+        slot.flags |= GW_RING_TRUNCATED;
+    }
+    slot.len = len;
+    memcpy(slot.data, data, len);
+
+    slot.seq.store(eventNum * 2 + 2, std::memory_order_release);
+    ringHead->writeSeq.store(eventNum + 1, std::memory_order_seq_cst);
+
+    // only a system call if a consumer is asleep, see GwRingReader::wait()
+    if (ringHead->waiters.load(std::memory_order_seq_cst) > 0){
+        ringHead->wakeWord.fetch_add(1, std::memory_order_seq_cst);
+        syscall(SYS_futex, &ringHead->wakeWord, FUTEX_WAKE, INT_MAX, NULL,
+                NULL, 0);
+    }
+}
+
+
+void GwRingWriter::publishMsg(const GwMessage& gwMsg){
+    // a long body is cut by publish() and flagged as truncated
+    std::string msgData = gwMsg.type;
+    msgData += '\0';
+    msgData += gwMsg.body;
+    publish(ringMsg, gwMsg.nodeId > 0 ? gwMsg.nodeId : 0, msgData.data(),
+            msgData.size());
+}
+
+
+void GwRingWriter::publishInterval(const MeterInterval& interval){
+    GwRingInterval packedInterval = {};
+    packedInterval.endTime = interval.endTime;
+    packedInterval.wh = interval.wh;
+    packedInterval.meterValue = interval.meterValue;
+    packedInterval.currentRMS = interval.currentRMS;
+    packedInterval.durationSecs = interval.durationSecs;
+    packedInterval.hasCurrent = interval.hasCurrent;
+    publish(ringInterval, interval.nodeId, (const char*)&packedInterval,
+            sizeof(packedInterval));
+}
+
+// *****************************************************************************
+//    Reader
+// *****************************************************************************
+
+bool GwRingReader::open(const char* ringName, const char* consumerName,
+        bool fromOldest){
+    close();
+    int shmFd = shm_open(ringName, O_RDWR | O_CLOEXEC, 0);
+    if (shmFd < 0){
+        perror(ringName);
+        return false;
+    }
+    struct stat shmStat;
+    void* shmMap = MAP_FAILED;
+    if (fstat(shmFd, &shmStat) == 0 &&
+            (size_t)shmStat.st_size >= sizeof(GwRingHeader))
+        shmMap = mmap(NULL, shmStat.st_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED, shmFd, 0);
+    ::close(shmFd);
+    if (shmMap == MAP_FAILED){
+        fprintf(stderr, "gwring: %s: can't map\n", ringName);
+        return false;
+    }
+    ringHead = (GwRingHeader*)shmMap;
+    mapLen = shmStat.st_size;
+    if (! isRingValid(ringHead, mapLen)){
+        fprintf(stderr, "gwring: %s: not a ring, or another version\n",
+                ringName);
+        close();
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    slots = ringSlots(ringHead);
+
+    uint64_t writeSeq = ringHead->writeSeq.load(std::memory_order_acquire);
+    cursor = writeSeq;
+    if (fromOldest)
+        cursor = writeSeq > ringHead->slotCount ?
+                writeSeq - ringHead->slotCount : 0;
+    lostCount = 0;
+
+    // claim a free consumer entry, or that of one that has exited
+    for (uint8_t i = 0; i < GW_RING_MAX_CONSUMERS && consumer == NULL; i++){
+        GwRingConsumer& entry = ringHead->consumers[i];
+        int32_t entryPid = entry.pid.load();
+        if ((entryPid == 0 || ! isRingPidAlive(entryPid)) &&
+                entry.pid.compare_exchange_strong(entryPid, getpid())){
+            consumer = &entry;
+            strncpy(consumer->name, consumerName, sizeof(consumer->name) - 1);
+            consumer->name[sizeof(consumer->name) - 1] = '\0';
+            consumer->cursor.store(cursor, std::memory_order_relaxed);
+            consumer->lost.store(0, std::memory_order_relaxed);
+        }
+    }
+    if (consumer == NULL){
+        fprintf(stderr, "gwring: %s: no free consumer entry\n", ringName);
+        close();
+        return false;
+    }
+    return true;
+}
+
+
+void GwRingReader::close(){
+    if (consumer != NULL)
+        consumer->pid.store(0);
+    consumer = NULL;
+    if (ringHead != NULL)
+        munmap(ringHead, mapLen);
+    ringHead = NULL;
+    slots = NULL;
+}
+
+
+bool GwRingReader::next(GwRingEvent& ringEvent){
+    if (ringHead == NULL)
+        return false;
+    uint32_t slotCount = ringHead->slotCount;
+
+    while (true){
+        uint64_t writeSeq = ringHead->writeSeq.load(std::memory_order_acquire);
+        if (cursor >= writeSeq)
+            return false;
+        if (writeSeq - cursor > slotCount){
+            lostCount += writeSeq - slotCount - cursor;
+            cursor = writeSeq - slotCount;
+        }
+
+        const GwRingSlot& slot = slots[cursor & (slotCount - 1)];
+        uint64_t slotSeq = slot.seq.load(std::memory_order_acquire);
+        if (slotSeq == cursor * 2 + 2){
+            ringEvent.publishMicros = slot.publishMicros;
+            ringEvent.kind = slot.kind;
+            ringEvent.nodeId = slot.nodeId;
+            ringEvent.flags = slot.flags;
+            ringEvent.len = std::min((size_t)slot.len, sizeof(slot.data));
+            memcpy(ringEvent.data, slot.data, ringEvent.len);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) == slotSeq){
+                ringEvent.num = cursor++;
+                consumer->cursor.store(cursor, std::memory_order_relaxed);
+                consumer->lost.store(lostCount, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        /*
+           Overwritten as it was read, so this consumer is a ring behind.
+           Skip to half a ring behind the producer, rather than chase it.
+        */
+        writeSeq = ringHead->writeSeq.load(std::memory_order_acquire);
+        uint64_t skipTo = std::max(cursor + 1, writeSeq > slotCount / 2 ?
+                writeSeq - slotCount / 2 : 0);
+        lostCount += skipTo - cursor;
+        cursor = skipTo;
+    }
+}
+
+
+void GwRingReader::wait(int timeoutMs){
+    /*
+       Registers as a waiter before checking for events, so a publish after the
+       check either changes wakeWord (and the futex wait returns at once) or
+       wakes it.
+    */
+    if (ringHead == NULL)
+        return;
+    ringHead->waiters.fetch_add(1, std::memory_order_seq_cst);
+    uint32_t wakeWord = ringHead->wakeWord.load(std::memory_order_seq_cst);
+    if (cursor >= ringHead->writeSeq.load(std::memory_order_seq_cst)){
+        struct timespec timeout;
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_nsec = (timeoutMs % 1000) * 1000000l;
+        syscall(SYS_futex, &ringHead->wakeWord, FUTEX_WAIT, wakeWord,
+                timeoutMs < 0 ? NULL : &timeout, NULL, 0);
+    }
+    ringHead->waiters.fetch_sub(1, std::memory_order_seq_cst);
+}
+
+
+bool ringEventInterval(const GwRingEvent& ringEvent, MeterInterval& interval){
+    GwRingInterval packedInterval;
+    if (ringEvent.kind != ringInterval ||
+            ringEvent.len != sizeof(packedInterval))
+        return false;
+    memcpy(&packedInterval, ringEvent.data, sizeof(packedInterval));
+    interval.nodeId = ringEvent.nodeId;
+    interval.endTime = packedInterval.endTime;
+    interval.wh = packedInterval.wh;
+    interval.meterValue = packedInterval.meterValue;
+    interval.currentRMS = packedInterval.currentRMS;
+    interval.durationSecs = packedInterval.durationSecs;
+    interval.hasCurrent = packedInterval.hasCurrent != 0;
+    return true;
+}
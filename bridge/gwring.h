@@ -0,0 +1,159 @@
+/*
+    Shared memory event ring, published by gwbridge for local consumers.
+
+    A single producer (gwbridge --ring) writes decoded gateway events into a
+    ring of fixed size slots in POSIX shared memory.  Every consumer reads
+    every event, at its own pace, with its own cursor.  In steady state
+    neither side makes a system call: the producer writes a slot and bumps a
+    sequence number, a consumer reads slots up to it.  An idle consumer sleeps
+    on a futex, which the producer only wakes when a consumer is waiting.
+
+    The producer never waits for consumers.  Each slot carries the event
+    number last written to it (seqlock style), so a consumer that falls a ring
+    behind sees its slot overwritten, skips ahead, and counts the lost events.
+    Consumers register their cursor in the ring's header, so their lag can be
+    seen (gwringcat --list).
+
+    Events are as gwbridge's socket events: a G>S message (type and body), a
+    meter interval (binary), or a log, console or capture line.
+ */
+
+#ifndef GW_RING_H
+#define GW_RING_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "gwproto.h"
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+        "ring needs lock-free 64 bit atomics to be shared between processes");
+
+static const char GW_RING_DEF_NAME[] = "/gwbridge";
+static const uint32_t GW_RING_DEF_SLOTS = 4096;
+static const uint8_t GW_RING_MAX_CONSUMERS = 16;
+static const size_t GW_RING_SLOT_SIZE = 256;
+
+enum GwRingKind {
+    ringMsg = 1,        // data: type, '\0', body
+    ringInterval = 2,   // data: GwRingInterval
+    ringLog = 3,        // data: line text
+    ringCon = 4,
+    ringCap = 5
+};
+
+// slot flags
+static const uint8_t GW_RING_TRUNCATED = 1;
+
+struct GwRingInterval {
+    uint32_t endTime;
+    uint32_t wh;
+    uint32_t meterValue;
+    float currentRMS;
+    uint16_t durationSecs;
+    uint8_t hasCurrent;
+};
+
+struct GwRingSlot {
+    std::atomic<uint64_t> seq;      // 2n+1 while event n is written, 2n+2 after
+    uint64_t publishMicros;         // CLOCK_MONOTONIC
+    uint8_t kind;
+    uint8_t nodeId;                 // 0 if not a node event
+    uint8_t flags;
+    uint8_t reserved;
+    uint16_t len;
+    char data[GW_RING_SLOT_SIZE - 22];
+};
+
+static_assert(sizeof(GwRingSlot) == GW_RING_SLOT_SIZE, "slot size");
+
+struct GwRingConsumer {
+    std::atomic<int32_t> pid;       // 0 if free
+    std::atomic<uint64_t> cursor;   // next event number to read
+    std::atomic<uint64_t> lost;
+    char name[24];
+};
+
+struct GwRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t slotSize;
+    std::atomic<int32_t> producerPid;
+    std::atomic<uint64_t> writeSeq;     // events published
+    std::atomic<uint32_t> wakeWord;     // futex, bumped per publish if waiters
+    std::atomic<uint32_t> waiters;
+    GwRingConsumer consumers[GW_RING_MAX_CONSUMERS];
+} __attribute__((aligned(64)));
+
+
+// An event as read, copied out of its slot.
+struct GwRingEvent {
+    uint64_t num;
+    uint64_t publishMicros;
+    uint8_t kind;
+    uint8_t nodeId;
+    uint8_t flags;
+    uint16_t len;
+    char data[sizeof(GwRingSlot::data)];
+};
+
+
+class GwRingWriter {
+  public:
+    ~GwRingWriter(){ close(); }
+
+    // creates (or takes over a dead producer's) ring, false with an error on
+    // stderr if not, e.g. if another producer is running
+    bool create(const char* ringName, uint32_t slotCount);
+    void close();
+
+    void publish(uint8_t kind, uint8_t nodeId, const char* data, size_t len);
+    void publishMsg(const GwMessage& gwMsg);
+    void publishInterval(const MeterInterval& interval);
+
+    GwRingHeader* header(){ return ringHead; }
+
+  private:
+    GwRingHeader* ringHead = NULL;
+    GwRingSlot* slots = NULL;
+    size_t mapLen = 0;
+};
+
+
+class GwRingReader {
+  public:
+    ~GwRingReader(){ close(); }
+
+    // attaches to the ring, registering as a consumer starting at the newest
+    // event (or the oldest still held if fromOldest)
+    bool open(const char* ringName, const char* consumerName,
+            bool fromOldest = false);
+    void close();
+
+    // copies the next event, false if none waiting
+    bool next(GwRingEvent& ringEvent);
+
+    // waits up to timeoutMs (-1 for ever) for an event
+    void wait(int timeoutMs);
+
+    uint64_t lost(){ return lostCount; }
+    GwRingHeader* header(){ return ringHead; }
+
+  private:
+    GwRingHeader* ringHead = NULL;
+    GwRingSlot* slots = NULL;
+    GwRingConsumer* consumer = NULL;
+    size_t mapLen = 0;
+    uint64_t cursor = 0;
+    uint64_t lostCount = 0;
+};
+
+// Unpacks a ringInterval event.
+bool ringEventInterval(const GwRingEvent& ringEvent, MeterInterval& interval);
+
+// True if the process registered as a ring producer/consumer still exists.
+bool isRingPidAlive(pid_t pid);
+
+#endif
@@ -0,0 +1,232 @@
+/*
+    Reads gwbridge's shared memory event ring (gwbridge --ring), as an example
+    ring consumer and for checking a ring's consumers.
+
+    Events are printed as gwbridge's socket events (EVT, MTR, LOG, CON, CAP
+    lines), each optionally preceded by its number and publish to read latency.
+
+    Usage:
+      gwringcat [--ring name] [--name consumer] [--oldest] [--latency]
+      gwringcat [--ring name] --list
+          ring state and its consumers' cursors, lag and lost events
+      gwringcat --bench count
+          publishes count events to a private ring as fast as possible while a
+          second process reads them, then prints the consumer's rate
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "gwring.h"
+
+static uint64_t monotonicMicros(){
+    struct timespec nowTime;
+    clock_gettime(CLOCK_MONOTONIC, &nowTime);
+    return (uint64_t)nowTime.tv_sec * 1000000 + nowTime.tv_nsec / 1000;
+}
+
+
+static void printEvent(const GwRingEvent& ringEvent){
+    static const char* const LINE_TAGS[] = {"", "", "", "LOG", "CON", "CAP"};
+    const char* truncStr = (ringEvent.flags & GW_RING_TRUNCATED) ? "..." : "";
+    MeterInterval interval;
+
+    if (ringEventInterval(ringEvent, interval)){
+        char currentStr[24] = "-";
+        if (interval.hasCurrent)
+            snprintf(currentStr, sizeof(currentStr), "%.2f",
+                    interval.currentRMS);
+        printf("MTR %u %" PRIu32 " %u %" PRIu32 " %" PRIu32 " %s\n",
+                interval.nodeId, interval.endTime, interval.durationSecs,
+                interval.wh, interval.meterValue, currentStr);
+    }
+    else if (ringEvent.kind == ringMsg){
+        // type, '\0', body
+        size_t typeLen = strnlen(ringEvent.data, ringEvent.len);
+        size_t bodyStart = std::min((size_t)ringEvent.len, typeLen + 1);
+        char nodeStr[8] = "-";
+        if (ringEvent.nodeId != 0)
+            snprintf(nodeStr, sizeof(nodeStr), "%u", ringEvent.nodeId);
+        printf("EVT %.*s %s %.*s%s\n", (int)typeLen, ringEvent.data, nodeStr,
+                (int)(ringEvent.len - bodyStart), ringEvent.data + bodyStart,
+                truncStr);
+    }
+    else if (ringEvent.kind >= ringLog && ringEvent.kind <= ringCap)
+        printf("%s %.*s%s\n", LINE_TAGS[ringEvent.kind], (int)ringEvent.len,
+                ringEvent.data, truncStr);
+}
+
+
+static int listRing(const char* ringName){
+    GwRingReader ringReader;
+    if (! ringReader.open(ringName, "gwringcat --list"))
+        return 1;
+    GwRingHeader* ringHead = ringReader.header();
+    uint64_t writeSeq = ringHead->writeSeq.load();
+    int32_t producerPid = ringHead->producerPid.load();
+
+    printf("ring %s: slots=%" PRIu32 " events=%" PRIu64 " producer=%d%s\n",
+            ringName, ringHead->slotCount, writeSeq, producerPid,
+            isRingPidAlive(producerPid) ? "" : " (exited)");
+    for (uint8_t i = 0; i < GW_RING_MAX_CONSUMERS; i++){
+        GwRingConsumer& consumer = ringHead->consumers[i];
+        int32_t consumerPid = consumer.pid.load();
+        if (consumerPid == 0 || consumerPid == getpid())
+            continue;
+        uint64_t cursor = consumer.cursor.load();
+        printf("  %-24s pid=%d lag=%" PRIu64 " lost=%" PRIu64 "%s\n",
+                consumer.name, consumerPid,
+                writeSeq > cursor ? writeSeq - cursor : 0, consumer.lost.load(),
+                isRingPidAlive(consumerPid) ? "" : " (exited)");
+    }
+    return 0;
+}
+
+
+static int benchRing(uint64_t eventCount){
+    char ringName[32];
+    snprintf(ringName, sizeof(ringName), "/gwringbench.%d", getpid());
+    GwRingWriter ringWriter;
+    if (! ringWriter.create(ringName, GW_RING_DEF_SLOTS))
+        return 1;
+
+    int readyPipe[2];
+    if (pipe(readyPipe) != 0){
+        perror("pipe");
+        return 1;
+    }
+    pid_t readerPid = fork();
+    if (readerPid == 0){
+        GwRingReader ringReader;
+        if (! ringReader.open(ringName, "gwringcat --bench"))
+            _exit(1);
+        if (write(readyPipe[1], "R", 1) != 1)
+            _exit(1);
+
+        GwRingEvent ringEvent;
+        uint64_t readCount = 0;
+        uint64_t latencySum = 0;
+        uint64_t waitCount = 0;
+        uint64_t startMicros = 0;
+        while (readCount + ringReader.lost() < eventCount){
+            if (! ringReader.next(ringEvent)){
+                ringReader.wait(1000);
+                waitCount++;
+                continue;
+            }
+            uint64_t nowMicros = monotonicMicros();
+            if (readCount == 0)
+                startMicros = nowMicros;
+            latencySum += nowMicros - ringEvent.publishMicros;
+            readCount++;
+        }
+        uint64_t elapsedMicros = monotonicMicros() - startMicros;
+        printf("read %" PRIu64 " events in %" PRIu64 " us (%.0f/s), lost %"
+                PRIu64 ", mean latency %.1f us, %" PRIu64 " waits\n",
+                readCount, elapsedMicros, elapsedMicros ?
+                readCount * 1e6 / elapsedMicros : 0.0, ringReader.lost(),
+                readCount ? (double)latencySum / readCount : 0.0, waitCount);
+        fflush(stdout);
+        _exit(0);
+    }
+
+    char readyChar;
+    if (readerPid < 0 || read(readyPipe[0], &readyChar, 1) != 1){
+        fprintf(stderr, "gwringcat: bench reader failed\n");
+        shm_unlink(ringName);
+        return 1;
+    }
+
+    MeterInterval interval;
+    interval.nodeId = 1;
+    interval.durationSecs = 15;
+    interval.hasCurrent = true;
+    uint64_t startMicros = monotonicMicros();
+    for (uint64_t i = 0; i < eventCount; i++){
+        interval.endTime = 1700000000 + i * 15;
+        interval.wh = i & 7;
+        interval.meterValue += interval.wh;
+        ringWriter.publishInterval(interval);
+    }
+    uint64_t elapsedMicros = monotonicMicros() - startMicros;
+    printf("published %" PRIu64 " events in %" PRIu64 " us\n", eventCount,
+            elapsedMicros);
+    fflush(stdout);
+
+    int readerStatus;
+    waitpid(readerPid, &readerStatus, 0);
+    ringWriter.close();
+    shm_unlink(ringName);
+    return WIFEXITED(readerStatus) ? WEXITSTATUS(readerStatus) : 1;
+}
+
+
+static void usage(){
+    fprintf(stderr, "usage: gwringcat [--ring name] [--name consumer] "
+            "[--oldest] [--latency]\n"
+            "       gwringcat [--ring name] --list\n"
+            "       gwringcat --bench count\n");
+    exit(1);
+}
+
+
+int main(int argc, char** argv){
+    const char* ringName = GW_RING_DEF_NAME;
+    const char* consumerName = "gwringcat";
+    bool isFromOldest = false;
+    bool isLatencyShown = false;
+    bool isList = false;
+    uint64_t benchCount = 0;
+
+    for (int i = 1; i < argc; i++){
+        const char* argName = argv[i];
+        if (strcmp(argName, "--oldest") == 0)
+            isFromOldest = true;
+        else if (strcmp(argName, "--latency") == 0)
+            isLatencyShown = true;
+        else if (strcmp(argName, "--list") == 0)
+            isList = true;
+        else if (i + 1 >= argc)
+            usage();
+        else if (strcmp(argName, "--ring") == 0)
+            ringName = argv[++i];
+        else if (strcmp(argName, "--name") == 0)
+            consumerName = argv[++i];
+        else if (strcmp(argName, "--bench") == 0)
+            benchCount = strtoull(argv[++i], NULL, 10);
+        else
+            usage();
+    }
+
+    if (benchCount > 0)
+        return benchRing(benchCount);
+    if (isList)
+        return listRing(ringName);
+
+    GwRingReader ringReader;
+    if (! ringReader.open(ringName, consumerName, isFromOldest))
+        return 1;
+    GwRingEvent ringEvent;
+    uint64_t lastLost = 0;
+    while (true){
+        if (! ringReader.next(ringEvent)){
+            fflush(stdout);
+            ringReader.wait(-1);
+            continue;
+        }
+        if (ringReader.lost() != lastLost){
+            fprintf(stderr, "gwringcat: lost %" PRIu64 " events\n",
+                    ringReader.lost() - lastLost);
+            lastLost = ringReader.lost();
+        }
+        if (isLatencyShown)
+            printf("#%" PRIu64 " %" PRIu64 "us ", ringEvent.num,
+                    monotonicMicros() - ringEvent.publishMicros);
+        printEvent(ringEvent);
+    }
+}
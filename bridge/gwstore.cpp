@@ -0,0 +1,702 @@
+/*
+    Compressed column store of meter intervals, see gwstore.h.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include "gwstore.h"
+
+static const char STORE_DATA_FMT[] = "node%03u.gwd";
+static const char STORE_INDEX_FMT[] = "node%03u.gwi";
+static const char STORE_STATE_NAME[] = "imported";
+
+enum StoreColumn {
+    colStart,
+    colDuration,
+    colWh,
+    colMeterValue,
+    colCurrent,
+    colFlags,
+    colCount
+};
+
+// *****************************************************************************
+//    Bit Streams
+// *****************************************************************************
+
+class BitWriter {
+  public:
+    // puts the low bitLen bits of value, most significant first
+    void put(uint64_t value, uint8_t bitLen){
+        while (bitLen > 0){
+            if (bitsFree == 0){
+                bytes += '\0';
+                bitsFree = 8;
+            }
+            uint8_t takeLen = std::min(bitLen, bitsFree);
+            uint8_t takeBits = (value >> (bitLen - takeLen)) &
+                    ((1u << takeLen) - 1);
+            bytes.back() |= takeBits << (bitsFree - takeLen);
+            bitsFree -= takeLen;
+            bitLen -= takeLen;
+        }
+    }
+
+    std::string bytes;
+
+  private:
+    uint8_t bitsFree = 0;
+};
+
+
+class BitReader {
+  public:
+    BitReader(const uint8_t* data, size_t len) : data(data), bitEnd(len * 8){}
+
+    // false (leaving value 0) if past the end
+    bool get(uint8_t bitLen, uint64_t& value){
+        value = 0;
+        if (bitPos + bitLen > bitEnd)
+            return false;
+        for (uint8_t i = 0; i < bitLen; i++, bitPos++)
+            value = (value << 1) | ((data[bitPos >> 3] >> (7 - (bitPos & 7))) &
+                    1);
+        return true;
+    }
+
+    bool getBit(){
+        uint64_t bit;
+        return get(1, bit) && bit != 0;
+    }
+
+  private:
+    const uint8_t* data;
+    size_t bitEnd;
+    size_t bitPos = 0;
+};
+
+
+static uint32_t zigzag(int32_t value){
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+
+static int32_t unzigzag(uint32_t value){
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+
+static bool fitsSigned(int64_t value, uint8_t bitLen){
+    return value >= -(1ll << (bitLen - 1)) && value < (1ll << (bitLen - 1));
+}
+
+
+static int64_t signExtend(uint64_t value, uint8_t bitLen){
+    return (int64_t)(value << (64 - bitLen)) >> (64 - bitLen);
+}
+
+// *****************************************************************************
+//    Blocks
+// *****************************************************************************
+
+// Bucket prefixes '10', '110', '1110', '1111', the leading '1' being for a
+// value other than predicted.
+static const uint8_t BUCKET_PREFIXES[] = {0x2, 0x6, 0xE, 0xF};
+static const uint8_t BUCKET_PREFIX_LENS[] = {2, 3, 4, 4};
+
+// Delta-of-delta sizes for the first three buckets, the last being followed
+// by the raw 32 bit time.
+static const uint8_t DOD_BITS[] = {7, 9, 12};
+
+// Wh zigzag delta sizes per bucket.
+static const uint8_t WH_BITS[] = {4, 8, 16, 32};
+
+
+static std::string encodeBlock(const std::vector<JournalRecord>& records){
+    BitWriter colWriters[colCount];
+
+    uint32_t prevStart = 0;
+    int64_t prevDelta = records.empty() ? 0 : records[0].durationSecs;
+    uint16_t prevDuration = 0;
+    uint32_t prevWh = 0;
+    uint32_t prevMeterValue = 0;
+    uint32_t prevCurrentBits = 0;
+    uint8_t prevLeading = 0xFF;         // no XOR window yet
+    uint8_t prevMeaningful = 0;
+    uint8_t prevFlags = 0;
+
+    for (size_t i = 0; i < records.size(); i++){
+        const JournalRecord& record = records[i];
+
+        BitWriter& startWriter = colWriters[colStart];
+        if (i == 0)
+            startWriter.put(record.startTime, 32);
+        else {
+            int64_t delta = (int64_t)record.startTime - prevStart;
+            int64_t dod = delta - prevDelta;
+            if (dod == 0)
+                startWriter.put(0, 1);
+            else {
+                size_t bucket = 0;
+                while (bucket < sizeof(DOD_BITS) &&
+                        ! fitsSigned(dod, DOD_BITS[bucket]))
+                    bucket++;
+                startWriter.put(BUCKET_PREFIXES[bucket],
+                        BUCKET_PREFIX_LENS[bucket]);
+                if (bucket < sizeof(DOD_BITS))
+                    startWriter.put(dod, DOD_BITS[bucket]);
+                else
+                    startWriter.put(record.startTime, 32);
+            }
+            prevDelta = delta;
+        }
+        prevStart = record.startTime;
+
+        if (i > 0 && record.durationSecs == prevDuration)
+            colWriters[colDuration].put(0, 1);
+        else {
+            colWriters[colDuration].put(1, 1);
+            colWriters[colDuration].put(record.durationSecs, 16);
+        }
+        prevDuration = record.durationSecs;
+
+        BitWriter& whWriter = colWriters[colWh];
+        if (record.wh == prevWh)
+            whWriter.put(0, 1);
+        else {
+            uint32_t whDelta = zigzag((int32_t)(record.wh - prevWh));
+            size_t bucket = 0;
+            while (bucket + 1 < sizeof(WH_BITS) &&
+                    (whDelta >> WH_BITS[bucket]) != 0)
+                bucket++;
+            whWriter.put(BUCKET_PREFIXES[bucket], BUCKET_PREFIX_LENS[bucket]);
+            whWriter.put(whDelta, WH_BITS[bucket]);
+        }
+        prevWh = record.wh;
+
+        if (i > 0 && record.meterValue == prevMeterValue + record.wh)
+            colWriters[colMeterValue].put(0, 1);
+        else {
+            colWriters[colMeterValue].put(1, 1);
+            colWriters[colMeterValue].put(record.meterValue, 32);
+        }
+        prevMeterValue = record.meterValue;
+
+        BitWriter& currentWriter = colWriters[colCurrent];
+        uint32_t currentBits;
+        memcpy(&currentBits, &record.currentRMS, sizeof(currentBits));
+        uint32_t currentXor = currentBits ^ prevCurrentBits;
+        if (currentXor == 0)
+            currentWriter.put(0, 1);
+        else {
+            uint8_t leading = std::min(__builtin_clz(currentXor), 31);
+            uint8_t trailing = __builtin_ctz(currentXor);
+            currentWriter.put(1, 1);
+            if (prevLeading != 0xFF && leading >= prevLeading &&
+                    32 - trailing <= prevLeading + prevMeaningful){
+                // within the last window
+                currentWriter.put(0, 1);
+                currentWriter.put(currentXor >> (32 - prevLeading -
+                        prevMeaningful), prevMeaningful);
+            }
+            else {
+                uint8_t meaningful = 32 - leading - trailing;
+                currentWriter.put(1, 1);
+                currentWriter.put(leading, 5);
+                currentWriter.put(meaningful - 1, 5);
+                currentWriter.put(currentXor >> trailing, meaningful);
+                prevLeading = leading;
+                prevMeaningful = meaningful;
+            }
+        }
+        prevCurrentBits = currentBits;
+
+        if (i > 0 && record.flags == prevFlags)
+            colWriters[colFlags].put(0, 1);
+        else {
+            colWriters[colFlags].put(1, 1);
+            colWriters[colFlags].put(record.flags, 8);
+        }
+        prevFlags = record.flags;
+    }
+
+    // column lengths, then the columns
+    std::string blockBytes;
+    for (size_t col = 0; col < colCount; col++){
+        uint32_t colLen = colWriters[col].bytes.size();
+        blockBytes.append((const char*)&colLen, sizeof(colLen));
+    }
+    for (size_t col = 0; col < colCount; col++)
+        blockBytes += colWriters[col].bytes;
+    return blockBytes;
+}
+
+
+static bool decodeBlock(const uint8_t* blockBytes, size_t blockLen,
+        uint32_t count, bool isTimeWhOnly, std::vector<JournalRecord>& records){
+    /*
+       False if the block is malformed.  With isTimeWhOnly, only the start
+       time, duration and Wh columns are decoded, the rest left zero.
+    */
+    uint32_t colLens[colCount];
+    size_t colOffsets[colCount];
+    size_t colEnd = sizeof(colLens);
+    if (blockLen < sizeof(colLens))
+        return false;
+    memcpy(colLens, blockBytes, sizeof(colLens));
+    for (size_t col = 0; col < colCount; col++){
+        colOffsets[col] = colEnd;
+        colEnd += colLens[col];
+    }
+    if (colEnd != blockLen)
+        return false;
+
+    records.assign(count, JournalRecord());
+    BitReader startReader(blockBytes + colOffsets[colStart], colLens[colStart]);
+    BitReader durationReader(blockBytes + colOffsets[colDuration],
+            colLens[colDuration]);
+    BitReader whReader(blockBytes + colOffsets[colWh], colLens[colWh]);
+    uint64_t bits;
+
+    int64_t prevDelta = 0;
+    uint32_t prevWh = 0;
+    for (uint32_t i = 0; i < count; i++){
+        JournalRecord& record = records[i];
+
+        if (durationReader.getBit()){
+            if (! durationReader.get(16, bits))
+                return false;
+            record.durationSecs = bits;
+        }
+        else if (i == 0)
+            return false;
+        else
+            record.durationSecs = records[i - 1].durationSecs;
+
+        if (i == 0){
+            if (! startReader.get(32, bits))
+                return false;
+            record.startTime = bits;
+            prevDelta = record.durationSecs;
+        }
+        else if (! startReader.getBit())
+            record.startTime = records[i - 1].startTime + prevDelta;
+        else {
+            size_t bucket = 0;
+            while (bucket < sizeof(DOD_BITS) && startReader.getBit())
+                bucket++;
+            if (bucket < sizeof(DOD_BITS)){
+                if (! startReader.get(DOD_BITS[bucket], bits))
+                    return false;
+                prevDelta += signExtend(bits, DOD_BITS[bucket]);
+                record.startTime = records[i - 1].startTime + prevDelta;
+            }
+            else {
+                if (! startReader.get(32, bits))
+                    return false;
+                record.startTime = bits;
+                prevDelta = (int64_t)record.startTime -
+                        records[i - 1].startTime;
+            }
+        }
+        if (! whReader.getBit())
+            record.wh = prevWh;
+        else {
+            size_t bucket = 0;
+            while (bucket + 1 < sizeof(WH_BITS) && whReader.getBit())
+                bucket++;
+            if (! whReader.get(WH_BITS[bucket], bits))
+                return false;
+            record.wh = prevWh + (uint32_t)unzigzag(bits);
+        }
+        prevWh = record.wh;
+    }
+    if (isTimeWhOnly)
+        return true;
+
+    BitReader meterReader(blockBytes + colOffsets[colMeterValue],
+            colLens[colMeterValue]);
+    BitReader currentReader(blockBytes + colOffsets[colCurrent],
+            colLens[colCurrent]);
+    BitReader flagsReader(blockBytes + colOffsets[colFlags], colLens[colFlags]);
+    uint32_t prevCurrentBits = 0;
+    uint8_t prevLeading = 0xFF;
+    uint8_t prevMeaningful = 0;
+    for (uint32_t i = 0; i < count; i++){
+        JournalRecord& record = records[i];
+
+        if (meterReader.getBit()){
+            if (! meterReader.get(32, bits))
+                return false;
+            record.meterValue = bits;
+        }
+        else if (i == 0)
+            return false;
+        else
+            record.meterValue = records[i - 1].meterValue + record.wh;
+
+        uint32_t currentBits = prevCurrentBits;
+        if (currentReader.getBit()){
+            if (currentReader.getBit()){
+                uint64_t leading, meaningful;
+                if (! currentReader.get(5, leading) ||
+                        ! currentReader.get(5, meaningful))
+                    return false;
+                prevLeading = leading;
+                prevMeaningful = meaningful + 1;
+                if (prevLeading + prevMeaningful > 32)
+                    return false;
+            }
+            else if (prevLeading == 0xFF)
+                return false;
+            if (! currentReader.get(prevMeaningful, bits))
+                return false;
+            currentBits ^= bits << (32 - prevLeading - prevMeaningful);
+        }
+        memcpy(&record.currentRMS, &currentBits, sizeof(currentBits));
+        prevCurrentBits = currentBits;
+
+        if (flagsReader.getBit()){
+            if (! flagsReader.get(8, bits))
+                return false;
+            record.flags = bits;
+        }
+        else if (i == 0)
+            return false;
+        else
+            record.flags = records[i - 1].flags;
+    }
+    return true;
+}
+
+// *****************************************************************************
+//    Series
+// *****************************************************************************
+
+static std::string nodePath(const std::string& dirPath, const char* nameFmt,
+        uint8_t nodeId){
+    char fileName[32];
+    snprintf(fileName, sizeof(fileName), nameFmt, nodeId);
+    return dirPath + "/" + fileName;
+}
+
+
+bool MeterStore::open(const char* storeDir){
+    close();
+    dirPath = storeDir;
+    if (mkdir(storeDir, 0755) != 0 && errno != EEXIST){
+        perror(storeDir);
+        return false;
+    }
+
+    FILE* stateFile = fopen((dirPath + "/" + STORE_STATE_NAME).c_str(), "r");
+    seqImported = 0;
+    if (stateFile != NULL){
+        if (fscanf(stateFile, "%" SCNu64, &seqImported) != 1)
+            seqImported = 0;
+        fclose(stateFile);
+    }
+    seqAppended = seqImported;
+
+    DIR* storeDirp = opendir(storeDir);
+    if (storeDirp == NULL){
+        perror(storeDir);
+        return false;
+    }
+    struct dirent* dirEntry;
+    std::vector<uint8_t> nodeIds;
+    while ((dirEntry = readdir(storeDirp)) != NULL){
+        unsigned nodeId;
+        char fileName[32];
+        if (sscanf(dirEntry->d_name, STORE_INDEX_FMT, &nodeId) != 1 ||
+                nodeId > 255)
+            continue;
+        snprintf(fileName, sizeof(fileName), STORE_INDEX_FMT, nodeId);
+        if (strcmp(fileName, dirEntry->d_name) == 0)
+            nodeIds.push_back(nodeId);
+    }
+    closedir(storeDirp);
+
+    for (uint8_t nodeId : nodeIds)
+        if (series(nodeId, false) == NULL)
+            return false;
+    return true;
+}
+
+
+void MeterStore::close(){
+    flush();
+    for (auto& seriesEntry : allSeries){
+        ::close(seriesEntry.second.dataFd);
+        ::close(seriesEntry.second.indexFd);
+    }
+    allSeries.clear();
+}
+
+
+MeterStore::NodeSeries* MeterStore::series(uint8_t nodeId, bool isCreated){
+    auto seriesIt = allSeries.find(nodeId);
+    if (seriesIt != allSeries.end())
+        return &seriesIt->second;
+    if (! isCreated && access(nodePath(dirPath, STORE_INDEX_FMT,
+            nodeId).c_str(), F_OK) != 0)
+        return NULL;
+
+    NodeSeries& nodeSeries = allSeries[nodeId];
+    if (! loadSeries(nodeId, nodeSeries)){
+        allSeries.erase(nodeId);
+        return NULL;
+    }
+    return &nodeSeries;
+}
+
+
+bool MeterStore::loadSeries(uint8_t nodeId, NodeSeries& nodeSeries){
+    /*
+       Keeps index entries up to the first that is torn or doesn't match its
+       block, and cuts both files to them.
+    */
+    std::string dataPath = nodePath(dirPath, STORE_DATA_FMT, nodeId);
+    std::string indexPath = nodePath(dirPath, STORE_INDEX_FMT, nodeId);
+    nodeSeries.dataFd = ::open(dataPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC,
+            0644);
+    nodeSeries.indexFd = ::open(indexPath.c_str(), O_RDWR | O_CREAT |
+            O_CLOEXEC, 0644);
+    struct stat dataStat, indexStat;
+    if (nodeSeries.dataFd < 0 || nodeSeries.indexFd < 0 ||
+            fstat(nodeSeries.dataFd, &dataStat) != 0 ||
+            fstat(nodeSeries.indexFd, &indexStat) != 0){
+        perror(dataPath.c_str());
+        ::close(nodeSeries.dataFd);
+        ::close(nodeSeries.indexFd);
+        return false;
+    }
+
+    size_t entryCount = indexStat.st_size / sizeof(StoreBlockIndex);
+    nodeSeries.index.resize(entryCount);
+    if (entryCount > 0 && pread(nodeSeries.indexFd, nodeSeries.index.data(),
+            entryCount * sizeof(StoreBlockIndex), 0) !=
+            (ssize_t)(entryCount * sizeof(StoreBlockIndex)))
+        entryCount = 0;
+
+    uint64_t dataEnd = 0;
+    size_t goodCount = 0;
+    while (goodCount < entryCount){
+        const StoreBlockIndex& entry = nodeSeries.index[goodCount];
+        if (entry.crc != gwCrc32(&entry, offsetof(StoreBlockIndex, crc)) ||
+                entry.offset != dataEnd ||
+                entry.offset + entry.len > (uint64_t)dataStat.st_size)
+            break;
+        dataEnd += entry.len;
+        goodCount++;
+    }
+    nodeSeries.index.resize(goodCount);
+    nodeSeries.dataLen = dataEnd;
+    nodeSeries.lastSeq = goodCount > 0 ? nodeSeries.index.back().lastSeq : 0;
+
+    if (goodCount != entryCount || (uint64_t)dataStat.st_size != dataEnd ||
+            indexStat.st_size % sizeof(StoreBlockIndex) != 0){
+        fprintf(stderr, "gwstore: node %u: cut to %zu whole blocks\n", nodeId,
+                goodCount);
+        // so the next import writes the lost blocks again
+        seqImported = std::min(seqImported, nodeSeries.lastSeq);
+        seqAppended = seqImported;
+        isStateStale = true;
+        if (ftruncate(nodeSeries.dataFd, dataEnd) != 0 ||
+                ftruncate(nodeSeries.indexFd, goodCount *
+                sizeof(StoreBlockIndex)) != 0){
+            perror(dataPath.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool MeterStore::writeBlock(uint8_t nodeId, NodeSeries& nodeSeries){
+    std::vector<JournalRecord>& pending = nodeSeries.pending;
+    if (pending.empty())
+        return true;
+
+    std::string blockBytes = encodeBlock(pending);
+    StoreBlockIndex entry = {};
+    entry.offset = nodeSeries.dataLen;
+    entry.lastSeq = pending.back().seq;
+    entry.len = blockBytes.size();
+    entry.count = pending.size();
+    entry.minStart = entry.minWh = UINT32_MAX;
+    for (const JournalRecord& record : pending){
+        entry.sumWh += record.wh;
+        entry.minStart = std::min(entry.minStart, record.startTime);
+        entry.maxStart = std::max(entry.maxStart, record.startTime);
+        entry.maxEnd = std::max(entry.maxEnd, record.startTime +
+                record.durationSecs);
+        entry.minWh = std::min(entry.minWh, record.wh);
+        entry.maxWh = std::max(entry.maxWh, record.wh);
+        entry.maxCurrent = std::max(entry.maxCurrent, record.currentRMS);
+    }
+    entry.firstMeterValue = pending.front().meterValue;
+    entry.lastMeterValue = pending.back().meterValue;
+    entry.dataCrc = gwCrc32(blockBytes.data(), blockBytes.size());
+    entry.crc = gwCrc32(&entry, offsetof(StoreBlockIndex, crc));
+
+    // block before its entry, so an entry always has its block
+    off_t indexOffset = nodeSeries.index.size() * sizeof(StoreBlockIndex);
+    if (pwrite(nodeSeries.dataFd, blockBytes.data(), blockBytes.size(),
+            entry.offset) != (ssize_t)blockBytes.size() ||
+            fdatasync(nodeSeries.dataFd) != 0 ||
+            pwrite(nodeSeries.indexFd, &entry, sizeof(entry), indexOffset) !=
+            (ssize_t)sizeof(entry) || fdatasync(nodeSeries.indexFd) != 0){
+        fprintf(stderr, "gwstore: node %u: %s\n", nodeId, strerror(errno));
+        return false;
+    }
+    nodeSeries.index.push_back(entry);
+    nodeSeries.dataLen += blockBytes.size();
+    pending.clear();
+    return true;
+}
+
+
+bool MeterStore::readBlock(const NodeSeries& nodeSeries,
+        const StoreBlockIndex& entry, bool isTimeWhOnly,
+        std::vector<JournalRecord>& blockRecords){
+    std::vector<uint8_t> blockBytes(entry.len);
+    if (pread(nodeSeries.dataFd, blockBytes.data(), entry.len, entry.offset) !=
+            (ssize_t)entry.len ||
+            gwCrc32(blockBytes.data(), entry.len) != entry.dataCrc ||
+            ! decodeBlock(blockBytes.data(), entry.len, entry.count,
+            isTimeWhOnly, blockRecords)){
+        fprintf(stderr, "gwstore: bad block at %" PRIu64 "\n", entry.offset);
+        return false;
+    }
+    return true;
+}
+
+// *****************************************************************************
+//    Store
+// *****************************************************************************
+
+bool MeterStore::append(const JournalRecord& record){
+    NodeSeries* nodeSeries = series(record.nodeId, true);
+    if (nodeSeries == NULL)
+        return false;
+    seqAppended = std::max(seqAppended, record.seq);
+    if (record.seq <= nodeSeries->lastSeq)
+        return true;
+
+    nodeSeries->pending.push_back(record);
+    nodeSeries->lastSeq = record.seq;
+    if (nodeSeries->pending.size() >= STORE_BLOCK_MAX)
+        return writeBlock(record.nodeId, *nodeSeries);
+    return true;
+}
+
+
+bool MeterStore::flush(){
+    for (auto& seriesEntry : allSeries)
+        if (! writeBlock(seriesEntry.first, seriesEntry.second))
+            return false;
+    if (seqAppended == seqImported && ! isStateStale)
+        return true;
+
+    std::string statePath = dirPath + "/" + STORE_STATE_NAME;
+    std::string tmpPath = statePath + ".tmp";
+    FILE* stateFile = fopen(tmpPath.c_str(), "w");
+    bool isWritten = stateFile != NULL &&
+            fprintf(stateFile, "%" PRIu64 "\n", seqAppended) > 0 &&
+            fflush(stateFile) == 0 && fsync(fileno(stateFile)) == 0;
+    if (stateFile != NULL)
+        fclose(stateFile);
+    if (! isWritten || rename(tmpPath.c_str(), statePath.c_str()) != 0){
+        perror(statePath.c_str());
+        return false;
+    }
+    seqImported = seqAppended;
+    isStateStale = false;
+    return true;
+}
+
+
+bool MeterStore::total(uint8_t nodeId, uint32_t fromTime, uint32_t toTime,
+        StoreTotal& storeTotal){
+    storeTotal = StoreTotal();
+    NodeSeries* nodeSeries = series(nodeId, false);
+    if (nodeSeries == NULL)
+        return true;
+
+    std::vector<JournalRecord> blockRecords;
+    for (const StoreBlockIndex& entry : nodeSeries->index){
+        if (entry.maxStart < fromTime || entry.minStart >= toTime)
+            continue;
+        if (entry.minStart >= fromTime && entry.maxStart < toTime){
+            storeTotal.wh += entry.sumWh;
+            storeTotal.count += entry.count;
+            storeTotal.blocksSummed++;
+            continue;
+        }
+        if (! readBlock(*nodeSeries, entry, true, blockRecords))
+            return false;
+        storeTotal.blocksDecoded++;
+        for (const JournalRecord& record : blockRecords)
+            if (record.startTime >= fromTime && record.startTime < toTime){
+                storeTotal.wh += record.wh;
+                storeTotal.count++;
+            }
+    }
+    return true;
+}
+
+
+bool MeterStore::read(uint8_t nodeId, uint32_t fromTime, uint32_t toTime,
+        std::function<void(const JournalRecord&)> recordFunc){
+    NodeSeries* nodeSeries = series(nodeId, false);
+    if (nodeSeries == NULL)
+        return true;
+
+    std::vector<JournalRecord> blockRecords;
+    for (const StoreBlockIndex& entry : nodeSeries->index){
+        if (entry.maxStart < fromTime || entry.minStart >= toTime)
+            continue;
+        if (! readBlock(*nodeSeries, entry, false, blockRecords))
+            return false;
+        for (JournalRecord& record : blockRecords)
+            if (record.startTime >= fromTime && record.startTime < toTime){
+                record.nodeId = nodeId;
+                recordFunc(record);
+            }
+    }
+    return true;
+}
+
+
+std::vector<uint8_t> MeterStore::nodes(){
+    std::vector<uint8_t> nodeIds;
+    for (auto& seriesEntry : allSeries)
+        nodeIds.push_back(seriesEntry.first);
+    return nodeIds;
+}
+
+
+StoreNodeStats MeterStore::nodeStats(uint8_t nodeId){
+    StoreNodeStats stats;
+    NodeSeries* nodeSeries = series(nodeId, false);
+    if (nodeSeries == NULL || nodeSeries->index.empty())
+        return stats;
+    stats.firstStart = UINT32_MAX;
+    for (const StoreBlockIndex& entry : nodeSeries->index){
+        stats.count += entry.count;
+        stats.dataBytes += entry.len;
+        stats.blocks++;
+        stats.firstStart = std::min(stats.firstStart, entry.minStart);
+        stats.lastEnd = std::max(stats.lastEnd, entry.maxEnd);
+    }
+    return stats;
+}
@@ -0,0 +1,129 @@
+/*
+    Compressed column store of meter intervals, for years of history on the
+    Pi's SD card.
+
+    Intervals are imported from the journal (gwjournal.h) into a series per
+    node, each a data file of compressed blocks and an index file of fixed size
+    block entries.  A block holds up to STORE_BLOCK_MAX intervals of a node, as
+    columns, each a bit stream:
+      start time    delta-of-delta: '0' for the usual interval following the
+                    last, else a prefix and 7, 9, 12 or 32 bits
+      duration      '0' if as the last, else '1' and 16 bits
+      Wh            as the last '0', else zigzag delta from the last in 4, 8,
+                    16 or 32 bits after a prefix
+      meter value   '0' if the last plus Wh (the usual), else '1' and 32 bits
+      current       Gorilla XOR of the float with the last: '0' if the same,
+                    else the meaningful bits of the XOR
+      flags         '0' if as the last, else '1' and 8 bits
+    so a steady 5 second series packs into a few bytes per interval.
+
+    Each index entry has the block's time range, count, Wh min/max/sum and
+    current max, so a range total sums whole blocks from the index and decodes
+    only the time and Wh columns of the (at most two) blocks at its ends.
+
+    A block is written to the data file, then its entry to the index.  On open,
+    the index is cut to whole entries with a good CRC, and the data file to the
+    end of the last block, so a crash loses at most the blocks being written,
+    which the next import writes again (entries hold the last journal seq they
+    cover, so nothing is imported twice).
+ */
+
+#ifndef GW_STORE_H
+#define GW_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include "gwjournal.h"
+
+static const uint32_t STORE_BLOCK_MAX = 4096;
+
+struct StoreBlockIndex {
+    uint64_t offset;            // in the data file
+    uint64_t lastSeq;           // journal seq of the last interval
+    uint64_t sumWh;
+    uint32_t len;
+    uint32_t count;
+    uint32_t minStart;
+    uint32_t maxStart;
+    uint32_t maxEnd;
+    uint32_t minWh;
+    uint32_t maxWh;
+    uint32_t firstMeterValue;
+    uint32_t lastMeterValue;
+    float maxCurrent;
+    uint32_t dataCrc;           // of the block
+    uint32_t crc;               // of the entry before this
+};
+
+static_assert(sizeof(StoreBlockIndex) == 72, "store index entry size");
+
+struct StoreTotal {
+    uint64_t wh = 0;
+    uint64_t count = 0;
+    uint32_t blocksSummed = 0;      // from the index
+    uint32_t blocksDecoded = 0;
+};
+
+struct StoreNodeStats {
+    uint64_t count = 0;
+    uint64_t dataBytes = 0;
+    uint32_t blocks = 0;
+    uint32_t firstStart = 0;
+    uint32_t lastEnd = 0;
+};
+
+
+class MeterStore {
+  public:
+    ~MeterStore(){ close(); }
+
+    // opens (creating if need be) the store in dirPath, false with an error on
+    // stderr if not
+    bool open(const char* dirPath);
+    void close();
+
+    // adds an interval (ignored if already stored), written when its node's
+    // block fills or at flush()
+    bool append(const JournalRecord& record);
+    bool flush();
+
+    // journal seq imported up to, persisted by flush()
+    uint64_t importedSeq(){ return seqImported; }
+
+    // intervals of a node starting in [fromTime, toTime)
+    bool total(uint8_t nodeId, uint32_t fromTime, uint32_t toTime,
+            StoreTotal& storeTotal);
+    bool read(uint8_t nodeId, uint32_t fromTime, uint32_t toTime,
+            std::function<void(const JournalRecord&)> recordFunc);
+
+    std::vector<uint8_t> nodes();
+    StoreNodeStats nodeStats(uint8_t nodeId);
+
+  private:
+    struct NodeSeries {
+        int dataFd = -1;
+        int indexFd = -1;
+        uint64_t dataLen = 0;
+        uint64_t lastSeq = 0;
+        std::vector<StoreBlockIndex> index;
+        std::vector<JournalRecord> pending;
+    };
+
+    NodeSeries* series(uint8_t nodeId, bool isCreated);
+    bool loadSeries(uint8_t nodeId, NodeSeries& nodeSeries);
+    bool writeBlock(uint8_t nodeId, NodeSeries& nodeSeries);
+    bool readBlock(const NodeSeries& nodeSeries, const StoreBlockIndex& entry,
+            bool isTimeWhOnly, std::vector<JournalRecord>& blockRecords);
+
+    std::string dirPath;
+    std::map<uint8_t, NodeSeries> allSeries;
+    uint64_t seqImported = 0;
+    uint64_t seqAppended = 0;
+    bool isStateStale = false;      // seqImported lowered since last saved
+};
+
+#endif
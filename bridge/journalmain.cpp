@@ -0,0 +1,244 @@
+/*
+    gwjournal: journals meter intervals from gwbridge's event ring (gwbridge
+    --ring) to an append-only journal (see gwjournal.h), committing every
+    --commit-ms, and on exit.  It reads the ring from the oldest event held,
+    skipping intervals already journaled, so intervals published while it
+    was down or restarting aren't lost (unless the ring overran meanwhile).
+
+    Usage:
+      gwjournal [--ring name] [--dir path] [--segment-records count]
+              [--max-segments count] [--commit-ms ms]
+      gwjournal [--dir path] --dump [--node id]
+          prints the journal's records as
+          <seq> <node_id> <start_time> <duration_secs> <wh> <meter_value>
+          <current|->
+      gwjournal --dir path --bench count
+          appends count intervals to the journal in path as fast as possible,
+          committing every 1000, and prints the rate
+ */
+
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <set>
+#include <tuple>
+#include "gwjournal.h"
+#include "gwring.h"
+
+struct JournalConfig {
+    const char* ringName = GW_RING_DEF_NAME;
+    const char* dirPath = "/var/lib/gwjournal";
+    uint32_t segRecords = JOURNAL_DEF_SEG_RECORDS;
+    uint32_t maxSegments = JOURNAL_DEF_MAX_SEGMENTS;
+    uint32_t commitMs = 5000;
+};
+
+static JournalConfig journalCfg;
+static volatile sig_atomic_t isExitSignalled = 0;
+
+
+static uint64_t monotonicMicros(){
+    struct timespec nowTime;
+    clock_gettime(CLOCK_MONOTONIC, &nowTime);
+    return (uint64_t)nowTime.tv_sec * 1000000 + nowTime.tv_nsec / 1000;
+}
+
+
+static void onExitSignal(int){
+    isExitSignalled = 1;
+}
+
+
+// an interval by node, end time and meter value
+typedef std::tuple<uint8_t, uint32_t, uint32_t> IntervalKey;
+
+
+static std::set<IntervalKey> readJournaledKeys(uint64_t nextSeq,
+        uint32_t recordCount){
+    /*
+       Keys of the last recordCount intervals journaled - all that can still
+       be in a ring of that many slots
+    */
+    std::set<IntervalKey> journaledKeys;
+    readJournal(journalCfg.dirPath, [&](const JournalRecord& record){
+        journaledKeys.insert(IntervalKey(record.nodeId, record.startTime +
+                record.durationSecs, record.meterValue));
+    }, nextSeq > recordCount ? nextSeq - recordCount : 1);
+    return journaledKeys;
+}
+
+
+static int runJournal(){
+    MeterJournal journal;
+    if (! journal.open(journalCfg.dirPath, journalCfg.segRecords,
+            journalCfg.maxSegments))
+        return 1;
+    if (journal.recovered() > 0)
+        fprintf(stderr, "gwjournal: recovered %" PRIu32 " uncommitted "
+                "records\n", journal.recovered());
+
+    // from the oldest event, as those from while not running may be held
+    GwRingReader ringReader;
+    if (! ringReader.open(journalCfg.ringName, "gwjournal", true))
+        return 1;
+    fprintf(stderr, "gwjournal: %s to %s from seq %" PRIu64 "\n",
+            journalCfg.ringName, journalCfg.dirPath, journal.nextSeq());
+    std::set<IntervalKey> journaledKeys = readJournaledKeys(journal.nextSeq(),
+            ringReader.header()->slotCount);
+    uint64_t skipCount = 0;
+
+    // no SA_RESTART, so a signal ends the ring wait
+    struct sigaction exitAction = {};
+    exitAction.sa_handler = onExitSignal;
+    sigaction(SIGINT, &exitAction, NULL);
+    sigaction(SIGTERM, &exitAction, NULL);
+
+    GwRingEvent ringEvent;
+    MeterInterval interval;
+    uint64_t lastLost = 0;
+    uint64_t commitDueMicros = 0;       // 0 if nothing to commit
+    while (! isExitSignalled){
+        while (ringReader.next(ringEvent)){
+            if (! ringEventInterval(ringEvent, interval))
+                continue;
+            // the ring's order is the journal's, so once an interval isn't
+            // journaled, none after it are
+            if (! journaledKeys.empty()){
+                if (journaledKeys.count(IntervalKey(interval.nodeId,
+                        interval.endTime, interval.meterValue)) > 0){
+                    skipCount++;
+                    continue;
+                }
+                journaledKeys.clear();
+                if (skipCount > 0)
+                    fprintf(stderr, "gwjournal: skipped %" PRIu64 " intervals "
+                            "already journaled\n", skipCount);
+            }
+            if (! journal.append(interval))
+                return 2;
+            if (commitDueMicros == 0)
+                commitDueMicros = monotonicMicros() +
+                        journalCfg.commitMs * 1000ull;
+        }
+        if (ringReader.lost() != lastLost){
+            fprintf(stderr, "gwjournal: ring overran, lost %" PRIu64
+                    " events\n", ringReader.lost() - lastLost);
+            lastLost = ringReader.lost();
+        }
+
+        uint64_t nowMicros = monotonicMicros();
+        if (commitDueMicros != 0 && nowMicros >= commitDueMicros){
+            if (! journal.commit())
+                return 2;
+            commitDueMicros = 0;
+        }
+        ringReader.wait(commitDueMicros == 0 ? -1 :
+                (int)((commitDueMicros - nowMicros) / 1000) + 1);
+    }
+
+    if (! journal.commit())
+        return 2;
+    fprintf(stderr, "gwjournal: committed to seq %" PRIu64 "\n",
+            journal.committedSeq());
+    return 0;
+}
+
+
+static int dumpJournal(int nodeId){
+    bool isRead = readJournal(journalCfg.dirPath,
+            [nodeId](const JournalRecord& record){
+        if (nodeId >= 0 && record.nodeId != nodeId)
+            return;
+        char currentStr[24] = "-";
+        if (record.flags & JOURNAL_HAS_CURRENT)
+            snprintf(currentStr, sizeof(currentStr), "%.2f",
+                    record.currentRMS);
+        printf("%" PRIu64 " %u %" PRIu32 " %u %" PRIu32 " %" PRIu32 " %s\n",
+                record.seq, record.nodeId, record.startTime,
+                record.durationSecs, record.wh, record.meterValue, currentStr);
+    });
+    return isRead ? 0 : 1;
+}
+
+
+static int benchJournal(uint64_t intervalCount){
+    MeterJournal journal;
+    if (! journal.open(journalCfg.dirPath, journalCfg.segRecords,
+            journalCfg.maxSegments))
+        return 1;
+
+    MeterInterval interval;
+    interval.nodeId = 1;
+    interval.durationSecs = 5;
+    interval.hasCurrent = true;
+    interval.currentRMS = 2.5;
+    uint64_t startMicros = monotonicMicros();
+    for (uint64_t i = 0; i < intervalCount; i++){
+        interval.endTime = 1700000000 + i * 5;
+        interval.wh = i & 3;
+        interval.meterValue += interval.wh;
+        if (! journal.append(interval) || (i % 1000 == 999 &&
+                ! journal.commit()))
+            return 2;
+    }
+    if (! journal.commit())
+        return 2;
+    uint64_t elapsedMicros = monotonicMicros() - startMicros;
+    printf("appended %" PRIu64 " intervals in %" PRIu64 " us (%.0f/s)\n",
+            intervalCount, elapsedMicros, elapsedMicros ?
+            intervalCount * 1e6 / elapsedMicros : 0.0);
+    return 0;
+}
+
+
+static void usage(){
+    fprintf(stderr, "usage: gwjournal [--ring name] [--dir path] "
+            "[--segment-records count]\n"
+            "                 [--max-segments count] [--commit-ms ms]\n"
+            "       gwjournal [--dir path] --dump [--node id]\n"
+            "       gwjournal --dir path --bench count\n");
+    exit(1);
+}
+
+
+int main(int argc, char** argv){
+    bool isDump = false;
+    int dumpNodeId = -1;
+    uint64_t benchCount = 0;
+
+    for (int i = 1; i < argc; i++){
+        const char* argName = argv[i];
+        if (strcmp(argName, "--dump") == 0){
+            isDump = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+            usage();
+        const char* argVal = argv[++i];
+        if (strcmp(argName, "--ring") == 0)
+            journalCfg.ringName = argVal;
+        else if (strcmp(argName, "--dir") == 0)
+            journalCfg.dirPath = argVal;
+        else if (strcmp(argName, "--segment-records") == 0)
+            journalCfg.segRecords = atol(argVal);
+        else if (strcmp(argName, "--max-segments") == 0)
+            journalCfg.maxSegments = atol(argVal);
+        else if (strcmp(argName, "--commit-ms") == 0)
+            journalCfg.commitMs = atol(argVal);
+        else if (strcmp(argName, "--node") == 0)
+            dumpNodeId = atoi(argVal);
+        else if (strcmp(argName, "--bench") == 0)
+            benchCount = strtoull(argVal, NULL, 10);
+        else
+            usage();
+    }
+
+    if (isDump)
+        return dumpJournal(dumpNodeId);
+    if (benchCount > 0)
+        return benchJournal(benchCount);
+    return runJournal();
+}
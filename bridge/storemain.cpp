@@ -0,0 +1,145 @@
+/*
+    gwstore: long-term compressed store of meter intervals (see gwstore.h),
+    imported from gwjournal's journal, e.g. hourly from a timer.
+
+    Usage:
+      gwstore [--dir path] --import journal_dir
+          imports the journal's intervals since the last import
+      gwstore [--dir path] --total --node id [--from time] [--to time]
+          Wh used by a node over intervals starting in [from, to) (UNIX epoch
+          secs, default all)
+      gwstore [--dir path] --dump --node id [--from time] [--to time]
+          prints intervals as
+          <node_id> <start_time> <duration_secs> <wh> <meter_value>
+          <current|->
+      gwstore [--dir path] --stats
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gwstore.h"
+
+enum StoreMode {
+    modeNone,
+    modeImport,
+    modeTotal,
+    modeDump,
+    modeStats
+};
+
+
+static int importJournal(MeterStore& meterStore, const char* journalDir){
+    uint64_t importCount = 0;
+    bool isStored = true;
+    bool isRead = readJournal(journalDir,
+            [&](const JournalRecord& record){
+        if (isStored && record.seq > meterStore.importedSeq()){
+            isStored = meterStore.append(record);
+            importCount++;
+        }
+    }, meterStore.importedSeq() + 1);
+    if (! isRead || ! isStored || ! meterStore.flush())
+        return 2;
+    printf("read %" PRIu64 " journal intervals, imported to seq %" PRIu64
+            "\n", importCount, meterStore.importedSeq());
+    return 0;
+}
+
+
+static void printStats(MeterStore& meterStore){
+    for (uint8_t nodeId : meterStore.nodes()){
+        StoreNodeStats stats = meterStore.nodeStats(nodeId);
+        printf("node %u: %" PRIu64 " intervals in %" PRIu32 " blocks, %"
+                PRIu64 " bytes (%.2f per interval, %.1fx the journal), %"
+                PRIu32 " to %" PRIu32 "\n", nodeId, stats.count, stats.blocks,
+                stats.dataBytes, stats.count ? (double)stats.dataBytes /
+                stats.count : 0.0, stats.dataBytes ? (double)stats.count *
+                sizeof(JournalRecord) / stats.dataBytes : 0.0,
+                stats.firstStart, stats.lastEnd);
+    }
+}
+
+
+static void usage(){
+    fprintf(stderr, "usage: gwstore [--dir path] --import journal_dir\n"
+            "       gwstore [--dir path] --total --node id [--from time] "
+            "[--to time]\n"
+            "       gwstore [--dir path] --dump --node id [--from time] "
+            "[--to time]\n"
+            "       gwstore [--dir path] --stats\n");
+    exit(1);
+}
+
+
+int main(int argc, char** argv){
+    const char* storeDir = "/var/lib/gwstore";
+    const char* journalDir = NULL;
+    StoreMode storeMode = modeNone;
+    int nodeId = -1;
+    uint32_t fromTime = 0;
+    uint32_t toTime = UINT32_MAX;
+
+    for (int i = 1; i < argc; i++){
+        const char* argName = argv[i];
+        if (strcmp(argName, "--total") == 0)
+            storeMode = modeTotal;
+        else if (strcmp(argName, "--dump") == 0)
+            storeMode = modeDump;
+        else if (strcmp(argName, "--stats") == 0)
+            storeMode = modeStats;
+        else if (i + 1 >= argc)
+            usage();
+        else if (strcmp(argName, "--import") == 0){
+            storeMode = modeImport;
+            journalDir = argv[++i];
+        }
+        else if (strcmp(argName, "--dir") == 0)
+            storeDir = argv[++i];
+        else if (strcmp(argName, "--node") == 0)
+            nodeId = atoi(argv[++i]);
+        else if (strcmp(argName, "--from") == 0)
+            fromTime = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argName, "--to") == 0)
+            toTime = strtoul(argv[++i], NULL, 10);
+        else
+            usage();
+    }
+    if (storeMode == modeNone || ((storeMode == modeTotal ||
+            storeMode == modeDump) && (nodeId < 0 || nodeId > 255)))
+        usage();
+
+    MeterStore meterStore;
+    if (! meterStore.open(storeDir))
+        return 1;
+
+    if (storeMode == modeImport)
+        return importJournal(meterStore, journalDir);
+    if (storeMode == modeStats){
+        printStats(meterStore);
+        return 0;
+    }
+    if (storeMode == modeTotal){
+        StoreTotal storeTotal;
+        if (! meterStore.total(nodeId, fromTime, toTime, storeTotal))
+            return 2;
+        printf("%" PRIu64 " Wh over %" PRIu64 " intervals (%" PRIu32
+                " blocks from index, %" PRIu32 " decoded)\n", storeTotal.wh,
+                storeTotal.count, storeTotal.blocksSummed,
+                storeTotal.blocksDecoded);
+        return 0;
+    }
+
+    bool isRead = meterStore.read(nodeId, fromTime, toTime,
+            [](const JournalRecord& record){
+        char currentStr[24] = "-";
+        if (record.flags & JOURNAL_HAS_CURRENT)
+            snprintf(currentStr, sizeof(currentStr), "%.2f",
+                    record.currentRMS);
+        printf("%u %" PRIu32 " %u %" PRIu32 " %" PRIu32 " %s\n",
+                record.nodeId, record.startTime, record.durationSecs,
+                record.wh, record.meterValue, currentStr);
+    });
+    return isRead ? 0 : 2;
+}
@@ -0,0 +1,338 @@
+/*
+    Capture files of gateway traffic, see capture.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "capture.h"
+
+static const char CAP_MAGIC[] = "GWCAP";
+static const uint8_t CAP_VERSION = 1;
+
+// *****************************************************************************
+//    Writing
+// *****************************************************************************
+
+bool CaptureWriter::open(const char* capPath){
+    close();
+    capFile = fopen(capPath, "wb");
+    if (capFile == NULL)
+        return false;
+    fwrite(CAP_MAGIC, 1, strlen(CAP_MAGIC), capFile);
+    fputc(CAP_VERSION, capFile);
+    lastMicros = 0;
+    return true;
+}
+
+
+void CaptureWriter::putVarint(uint64_t value){
+    do {
+        uint8_t varByte = value & 0x7F;
+        value >>= 7;
+        fputc(value ? (varByte | 0x80) : varByte, capFile);
+    } while (value);
+}
+
+
+void CaptureWriter::write(const CaptureRecord& capRecord){
+    if (capFile == NULL)
+        return;
+
+    fputc(capRecord.kind, capFile);
+    putVarint(capRecord.micros > lastMicros ?
+            capRecord.micros - lastMicros : 0);
+    if (capRecord.micros > lastMicros)
+        lastMicros = capRecord.micros;
+    if (capRecord.kind == capRadioIn || capRecord.kind == capRadioOut){
+        fputc(capRecord.nodeId, capFile);
+        fputc((uint8_t)capRecord.val, capFile);
+    }
+    putVarint(capRecord.bytes.size());
+    fwrite(capRecord.bytes.data(), 1, capRecord.bytes.size(), capFile);
+}
+
+
+void CaptureWriter::close(){
+    if (capFile)
+        fclose(capFile);
+    capFile = NULL;
+}
+
+// *****************************************************************************
+//    Reading
+// *****************************************************************************
+
+static bool getVarint(FILE* capFile, uint64_t& value){
+    int varByte;
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7){
+        if ((varByte = fgetc(capFile)) == EOF)
+            return false;
+        value |= (uint64_t)(varByte & 0x7F) << shift;
+        if ((varByte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+
+bool readCapture(const char* capPath, std::vector<CaptureRecord>& capRecords){
+    FILE* capFile = fopen(capPath, "rb");
+    char magicStr[sizeof(CAP_MAGIC)] = {0};
+    uint64_t capMicros = 0;
+
+    if (capFile == NULL){
+        perror(capPath);
+        return false;
+    }
+    if (fread(magicStr, 1, strlen(CAP_MAGIC), capFile) != strlen(CAP_MAGIC) ||
+            strcmp(magicStr, CAP_MAGIC) != 0 || fgetc(capFile) != CAP_VERSION){
+        fprintf(stderr, "%s: not a version %u capture\n", capPath,
+                CAP_VERSION);
+        fclose(capFile);
+        return false;
+    }
+
+    int kindByte;
+    bool isValid = true;
+    while (isValid && (kindByte = fgetc(capFile)) != EOF){
+        CaptureRecord capRecord;
+        uint64_t deltaMicros = 0;
+        uint64_t bytesLen = 0;
+
+        capRecord.kind = kindByte;
+        isValid = (kindByte == capSerialIn || kindByte == capSerialOut ||
+                kindByte == capRadioIn || kindByte == capRadioOut) &&
+                getVarint(capFile, deltaMicros);
+        if (isValid && (kindByte == capRadioIn || kindByte == capRadioOut)){
+            int nodeByte = fgetc(capFile);
+            int valByte = fgetc(capFile);
+            isValid = (nodeByte != EOF && valByte != EOF);
+            capRecord.nodeId = nodeByte;
+            capRecord.val = (kindByte == capRadioIn) ? (int8_t)valByte :
+                    valByte;
+        }
+        isValid = isValid && getVarint(capFile, bytesLen) && bytesLen < 65536;
+        if (isValid){
+            capRecord.bytes.resize(bytesLen);
+            isValid = (fread(&capRecord.bytes[0], 1, bytesLen, capFile) ==
+                    bytesLen);
+        }
+        capMicros += deltaMicros;
+        capRecord.micros = capMicros;
+        if (isValid)
+            capRecords.push_back(capRecord);
+    }
+    fclose(capFile);
+
+    if (! isValid)
+        fprintf(stderr, "%s: truncated or corrupt after %zu records\n",
+                capPath, capRecords.size());
+    return isValid;
+}
+
+// *****************************************************************************
+//    Import and Format
+// *****************************************************************************
+
+static const char CAP_LINE_PREFIX[] = "CAP:";
+static const char SMSG_TX_PREFIX[] = "G>S:";
+
+
+// bytes of a capture line payload, with \xNN escapes
+static std::string unescapeCapture(const char* capStr){
+    std::string capBytes;
+    while (*capStr != '\0'){
+        if (capStr[0] == '\\' && capStr[1] == 'x' && capStr[2] != '\0' &&
+                capStr[3] != '\0'){
+            char hexStr[3] = {capStr[2], capStr[3], '\0'};
+            capBytes += (char)strtoul(hexStr, NULL, 16);
+            capStr += 4;
+        }
+        else
+            capBytes += *capStr++;
+    }
+    return capBytes;
+}
+
+
+static bool parseCaptureLine(const char* lineStr, CaptureRecord& capRecord){
+    char capKind = 0;
+    unsigned long capMillis = 0;
+    unsigned nodeId = 0;
+    int capVal = 0;
+    int payloadPos = 0;
+
+    if (sscanf(lineStr, "CAP:%c,%lu,%n", &capKind, &capMillis,
+            &payloadPos) != 2 || payloadPos == 0)
+        return false;
+    capRecord.kind = capKind;
+    capRecord.micros = (uint64_t)capMillis * 1000;
+
+    if (capKind == capSerialIn){
+        capRecord.bytes = unescapeCapture(lineStr + payloadPos);
+        return true;
+    }
+    if (capKind != capRadioIn && capKind != capRadioOut)
+        return false;
+
+    const char* radioStr = lineStr + payloadPos;
+    payloadPos = 0;
+    if (sscanf(radioStr, "%u,%d,%n", &nodeId, &capVal, &payloadPos) != 2 ||
+            payloadPos == 0 || nodeId > 255)
+        return false;
+    capRecord.nodeId = nodeId;
+    capRecord.val = capVal;
+    capRecord.bytes = unescapeCapture(radioStr + payloadPos);
+    return true;
+}
+
+
+size_t importCaptureLog(FILE* logFile, std::vector<CaptureRecord>& capRecords){
+    char lineStr[512];
+    size_t badLines = 0;
+    bool isStarted = false;
+    uint64_t lastMicros = 0;
+
+    while (fgets(lineStr, sizeof(lineStr), logFile)){
+        lineStr[strcspn(lineStr, "\r\n")] = '\0';
+
+        // skip a channel framing prefix, e.g. '4|'
+        const char* bodyStr = lineStr;
+        if (bodyStr[0] >= '0' && bodyStr[0] <= '9' && bodyStr[1] == '|')
+            bodyStr += 2;
+
+        CaptureRecord capRecord;
+        if (strncmp(bodyStr, CAP_LINE_PREFIX, strlen(CAP_LINE_PREFIX)) == 0){
+            if (! parseCaptureLine(bodyStr, capRecord)){
+                badLines++;
+                continue;
+            }
+            // starts at the first capture line
+            isStarted = true;
+            lastMicros = capRecord.micros;
+        }
+        else if (isStarted && strncmp(bodyStr, SMSG_TX_PREFIX,
+                strlen(SMSG_TX_PREFIX)) == 0){
+            capRecord.kind = capSerialOut;
+            capRecord.micros = lastMicros;
+            capRecord.bytes = bodyStr;
+        }
+        else
+            continue;
+        capRecords.push_back(capRecord);
+    }
+    return badLines;
+}
+
+
+std::string formatCapture(const CaptureRecord& capRecord){
+    char headStr[64];
+    std::string capStr;
+
+    if (capRecord.kind == capRadioIn || capRecord.kind == capRadioOut)
+        snprintf(headStr, sizeof(headStr), "%10.3f %c %3u %4d ",
+                capRecord.micros / 1e6, capRecord.kind, capRecord.nodeId,
+                capRecord.val);
+    else
+        snprintf(headStr, sizeof(headStr), "%10.3f %c ",
+                capRecord.micros / 1e6, capRecord.kind);
+    capStr = headStr;
+
+    for (size_t i = 0; i < capRecord.bytes.size(); i++){
+        uint8_t capByte = capRecord.bytes[i];
+        if (capByte < 32 || capByte > 126 || capByte == '\\'){
+            char escStr[5];
+            snprintf(escStr, sizeof(escStr), "\\x%02X", capByte);
+            capStr += escStr;
+        }
+        else
+            capStr += (char)capByte;
+    }
+    return capStr;
+}
+
+// *****************************************************************************
+//    Recording Links
+// *****************************************************************************
+
+int RecordingSerialLink::readByte(){
+    int readVal = link->readByte();
+    if (readVal < 0)
+        return readVal;
+
+    if (readVal == '\r'){
+        capWriter->write(inLine);
+        inLine.bytes.clear();
+    }
+    else {
+        if (inLine.bytes.empty()){
+            inLine.kind = capSerialIn;
+            inLine.micros = hostClock()->nowMicros();
+        }
+        inLine.bytes += (char)readVal;
+    }
+    return readVal;
+}
+
+
+void RecordingSerialLink::writeBytes(const uint8_t* outBytes, size_t outLen){
+    link->writeBytes(outBytes, outLen);
+
+    for (size_t i = 0; i < outLen; i++){
+        if (outBytes[i] == '\n'){
+            outLine.kind = capSerialOut;
+            outLine.micros = hostClock()->nowMicros();
+            capWriter->write(outLine);
+            outLine.bytes.clear();
+        }
+        else if (outBytes[i] != '\r')
+            outLine.bytes += (char)outBytes[i];
+    }
+}
+
+
+void RecordingSerialLink::flushLines(){
+    if (! inLine.bytes.empty())
+        capWriter->write(inLine);
+    if (! outLine.bytes.empty()){
+        outLine.kind = capSerialOut;
+        outLine.micros = hostClock()->nowMicros();
+        capWriter->write(outLine);
+    }
+    inLine.bytes.clear();
+    outLine.bytes.clear();
+}
+
+
+bool RecordingRadioLink::recv(uint8_t* msgBytes, uint8_t* msgLen,
+        uint8_t* fromAddr, int16_t* rssi){
+    if (! link->recv(msgBytes, msgLen, fromAddr, rssi))
+        return false;
+
+    CaptureRecord capRecord;
+    capRecord.kind = capRadioIn;
+    capRecord.micros = hostClock()->nowMicros();
+    capRecord.nodeId = *fromAddr;
+    capRecord.val = *rssi;
+    capRecord.bytes.assign((const char*)msgBytes, *msgLen);
+    capWriter->write(capRecord);
+    return true;
+}
+
+
+bool RecordingRadioLink::send(const uint8_t* msgBytes, uint8_t msgLen,
+        uint8_t toAddr){
+    bool isAcked = link->send(msgBytes, msgLen, toAddr);
+
+    CaptureRecord capRecord;
+    capRecord.kind = capRadioOut;
+    capRecord.micros = hostClock()->nowMicros();
+    capRecord.nodeId = toAddr;
+    capRecord.val = isAcked;
+    // zero padding isn't kept
+    capRecord.bytes.assign((const char*)msgBytes,
+            strnlen((const char*)msgBytes, msgLen));
+    capWriter->write(capRecord);
+    return isAcked;
+}
@@ -0,0 +1,121 @@
+/*
+    Capture files of gateway traffic, for record and replay.
+
+    A capture is the gateway's serial and radio traffic in both directions,
+    timestamped, so a run can be fed back through the firmware with the same
+    interleaving (see gwreplay.cpp).  Captures are recorded by the host build
+    (metergateway_host --record), or imported from a real gateway's capture
+    lines (the CAPT console command).
+
+    File format, integers as unsigned LEB128 varints unless noted:
+      header        "GWCAP" then version byte (1)
+      record        kind byte, micros since previous record, then by kind:
+        'S'/'O'       serial line in/out: length, bytes (without line end)
+        'R'           radio message in: from node id byte, RSSI (signed byte),
+                      length, bytes
+        'T'           radio message out: to node id byte, ACKed byte (0/1),
+                      length, bytes (without zero padding)
+ */
+
+#ifndef HOST_CAPTURE_H
+#define HOST_CAPTURE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "hostlinks.h"
+
+enum CaptureKind {
+    capSerialIn = 'S',
+    capSerialOut = 'O',
+    capRadioIn = 'R',
+    capRadioOut = 'T'
+};
+
+struct CaptureRecord {
+    uint8_t kind = capSerialIn;
+    uint64_t micros = 0;        // since start of capture
+    uint8_t nodeId = 0;         // radio: from/to node
+    int16_t val = 0;            // radio: RSSI if in, ACKed if out
+    std::string bytes;
+};
+
+
+class CaptureWriter {
+  public:
+    ~CaptureWriter(){ close(); }
+
+    bool open(const char* capPath);
+    void write(const CaptureRecord& capRecord);
+    void close();
+
+  private:
+    void putVarint(uint64_t value);
+
+    FILE* capFile = NULL;
+    uint64_t lastMicros = 0;
+};
+
+
+// Reads a whole capture, false (with an error on stderr) if unreadable.
+bool readCapture(const char* capPath, std::vector<CaptureRecord>& capRecords);
+
+// Converts a gateway's serial output with capture lines (CAP:...) to records,
+// timed by the gateway's millis().  G>S lines are taken as serial output at the
+// time of the last capture line, other lines are skipped.  Returns the number
+// of lines not understood.
+size_t importCaptureLog(FILE* logFile, std::vector<CaptureRecord>& capRecords);
+
+// Record as a line of text, for dumps and reports.
+std::string formatCapture(const CaptureRecord& capRecord);
+
+
+/*
+    Links that record the traffic through another link.  Serial is recorded a
+    line at a time, input timed from its first byte being read.
+ */
+class RecordingSerialLink : public HostSerialLink {
+  public:
+    RecordingSerialLink(HostSerialLink* link, CaptureWriter* capWriter) :
+            link(link), capWriter(capWriter){}
+    ~RecordingSerialLink(){ flushLines(); }
+
+    int readByte();
+    int available(){ return link->available(); }
+    void writeBytes(const uint8_t* outBytes, size_t outLen);
+    void flush(){ link->flush(); }
+
+    // records partial lines, e.g. at end of run
+    void flushLines();
+
+  private:
+    HostSerialLink* link;
+    CaptureWriter* capWriter;
+    CaptureRecord inLine;
+    CaptureRecord outLine;
+};
+
+
+class RecordingRadioLink : public HostRadioLink {
+  public:
+    RecordingRadioLink(HostRadioLink* link, CaptureWriter* capWriter) :
+            link(link), capWriter(capWriter){}
+
+    void setAddress(uint8_t address){ link->setAddress(address); }
+    void setRetryTiming(uint16_t timeoutMs, uint8_t retries){
+        link->setRetryTiming(timeoutMs, retries);
+    }
+    bool available(){ return link->available(); }
+    bool recv(uint8_t* msgBytes, uint8_t* msgLen, uint8_t* fromAddr,
+            int16_t* rssi);
+    bool send(const uint8_t* msgBytes, uint8_t msgLen, uint8_t toAddr);
+    int16_t rssiNow(){ return link->rssiNow(); }
+    uint32_t retransmissions(){ return link->retransmissions(); }
+
+  private:
+    HostRadioLink* link;
+    CaptureWriter* capWriter;
+};
+
+#endif
@@ -0,0 +1,162 @@
+/*
+    Fuzz target over the host build of the gateway firmware, for libFuzzer
+    (LLVMFuzzerTestOneInput), AFL or the fuzzmain.cpp replay driver.
+
+    The first input byte selects what the rest is fed to:
+      'S' - serial input: console commands and S>G messages, with LF read as
+            CR and a CR appended so the last line is processed
+      'R' - a radio message: the next byte is the sending node's id, the rest
+            its payload (up to the radio's maximum message length)
+    Other inputs are ignored.  The firmware is set up once, so state (node
+    table, config) carries from input to input, as on a running gateway.
+    Time is virtual, so delays cost nothing.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <RH_RF69.h>
+#include "hostlinks.h"
+
+// firmware entry points
+void setup();
+void loop();
+
+static const size_t FUZZ_MAX_SERIAL_LEN = 4096;
+static const uint32_t FUZZ_LOOP_MICROS = 100;
+static const uint16_t FUZZ_MAX_RADIO_LOOPS = 100;
+
+// *****************************************************************************
+//    Links
+// *****************************************************************************
+
+class FuzzClock : public HostClock {
+  public:
+    uint64_t nowMicros(){ return now; }
+    void sleepMicros(uint32_t us){ now += us; }
+
+    uint64_t now = 0;
+};
+
+
+class FuzzSerialLink : public HostSerialLink {
+  public:
+    int readByte(){
+        if (inPos == inLen)
+            return -1;
+        uint8_t readVal = inBytes[inPos++];
+        return readVal == '\n' ? '\r' : readVal;
+    }
+    int available(){ return inLen - inPos; }
+
+    // output is discarded, unless FUZZ_VERBOSE is set
+    void writeBytes(const uint8_t* outBytes, size_t outLen){
+        if (isVerbose)
+            fwrite(outBytes, 1, outLen, stdout);
+    }
+
+    const uint8_t* inBytes = NULL;
+    size_t inLen = 0;
+    size_t inPos = 0;
+    bool isVerbose = false;
+};
+
+
+class FuzzRadioLink : public HostRadioLink {
+  public:
+    bool available(){ return isPending; }
+
+    bool recv(uint8_t* msgBytes, uint8_t* msgLen, uint8_t* fromAddr,
+            int16_t* rssi){
+        if (! isPending)
+            return false;
+        uint8_t recvLen = pendingLen < *msgLen ? pendingLen : *msgLen;
+        memcpy(msgBytes, pendingPayload, recvLen);
+        *msgLen = recvLen;
+        *fromAddr = pendingFrom;
+        *rssi = -70;
+        isPending = false;
+        return true;
+    }
+
+    // every node ACKs
+    bool send(const uint8_t* msgBytes, uint8_t msgLen, uint8_t toAddr){
+        (void)msgBytes;
+        (void)msgLen;
+        (void)toAddr;
+        return true;
+    }
+
+    uint8_t pendingPayload[RH_RF69_MAX_MESSAGE_LEN];
+    uint8_t pendingLen = 0;
+    uint8_t pendingFrom = 0;
+    bool isPending = false;
+};
+
+
+static FuzzClock fuzzClock;
+static FuzzSerialLink fuzzSerial;
+static FuzzRadioLink fuzzRadio;
+
+// *****************************************************************************
+//    Fuzz Target
+// *****************************************************************************
+
+static void runLoop(){
+    loop();
+    fuzzClock.now += FUZZ_LOOP_MICROS;
+}
+
+
+static void fuzzSerialInput(const uint8_t* inBytes, size_t inLen){
+    static uint8_t lineBytes[FUZZ_MAX_SERIAL_LEN + 1];
+
+    if (inLen > FUZZ_MAX_SERIAL_LEN)
+        inLen = FUZZ_MAX_SERIAL_LEN;
+    memcpy(lineBytes, inBytes, inLen);
+    lineBytes[inLen++] = '\r';
+
+    fuzzSerial.inBytes = lineBytes;
+    fuzzSerial.inLen = inLen;
+    fuzzSerial.inPos = 0;
+    while (fuzzSerial.available() > 0)
+        runLoop();
+    fuzzSerial.inLen = fuzzSerial.inPos = 0;
+}
+
+
+static void fuzzRadioMsg(const uint8_t* inBytes, size_t inLen){
+    if (inLen < 1)
+        return;
+    fuzzRadio.pendingFrom = inBytes[0];
+    fuzzRadio.pendingLen = inLen - 1 < sizeof(fuzzRadio.pendingPayload) ?
+            inLen - 1 : sizeof(fuzzRadio.pendingPayload);
+    memcpy(fuzzRadio.pendingPayload, inBytes + 1, fuzzRadio.pendingLen);
+    fuzzRadio.isPending = true;
+    for (uint16_t i = 0; i < FUZZ_MAX_RADIO_LOOPS && fuzzRadio.isPending; i++)
+        runLoop();
+    fuzzRadio.isPending = false;
+}
+
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* inBytes, size_t inLen){
+    static bool isSetUp = false;
+
+    if (! isSetUp){
+        fuzzSerial.isVerbose = getenv("FUZZ_VERBOSE") != NULL;
+        hostSetClock(&fuzzClock);
+        hostSetSerialLink(&fuzzSerial);
+        hostSetRadioLink(&fuzzRadio);
+        setup();
+        isSetUp = true;
+    }
+
+    if (inLen < 1)
+        return 0;
+    if (inBytes[0] == 'S')
+        fuzzSerialInput(inBytes + 1, inLen - 1);
+    else if (inBytes[0] == 'R')
+        fuzzRadioMsg(inBytes + 1, inLen - 1);
+    return 0;
+}
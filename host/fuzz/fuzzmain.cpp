@@ -0,0 +1,241 @@
+/*
+    Standalone driver for the fuzzgw.cpp target, for replaying a corpus or
+    crash inputs under ASan/UBSan without libFuzzer, and as an AFL target
+    (afl-fuzz ... -- ./fuzz_replay @@).
+
+    Runs each file given (or each file in each directory given) through the
+    target.  With -n, then runs that many random mutations of those inputs -
+    byte flips, inserts, deletes, splices, and tokens from the -x dictionary -
+    as a quick check where libFuzzer isn't available.  On a sanitizer error
+    the input being run is written to crash-<n> before the report.
+
+    Usage:
+      fuzz_replay [-n mutations] [-s seed] [-x dict] path...
+ */
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include <sanitizer/common_interface_defs.h>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* inBytes, size_t inLen);
+
+static const size_t MAX_INPUT_LEN = 512;
+
+typedef std::vector<uint8_t> FuzzInput;
+
+static FuzzInput curInput;
+static unsigned long curInputNum = 0;
+
+
+static void onSanitizerDeath(){
+    char crashPath[32];
+    snprintf(crashPath, sizeof(crashPath), "crash-%lu", curInputNum);
+    FILE* crashFile = fopen(crashPath, "wb");
+    if (crashFile){
+        fwrite(curInput.data(), 1, curInput.size(), crashFile);
+        fclose(crashFile);
+        fprintf(stderr, "fuzz_replay: input written to %s\n", crashPath);
+    }
+}
+
+
+static void runInput(const FuzzInput& fuzzInput){
+    curInput = fuzzInput;
+    curInputNum++;
+    LLVMFuzzerTestOneInput(curInput.data(), curInput.size());
+}
+
+
+static bool readFile(const std::string& filePath, FuzzInput& fileInput){
+    FILE* inFile = fopen(filePath.c_str(), "rb");
+    if (inFile == NULL)
+        return false;
+    uint8_t readBuff[MAX_INPUT_LEN];
+    size_t readLen = fread(readBuff, 1, sizeof(readBuff), inFile);
+    fclose(inFile);
+    fileInput.assign(readBuff, readBuff + readLen);
+    return true;
+}
+
+
+static void readInputs(const char* inPath, std::vector<FuzzInput>& inputs){
+    struct stat pathStat;
+    FuzzInput fileInput;
+
+    if (stat(inPath, &pathStat) == 0 && S_ISDIR(pathStat.st_mode)){
+        DIR* inDir = opendir(inPath);
+        struct dirent* dirEntry;
+        while (inDir && (dirEntry = readdir(inDir)) != NULL){
+            std::string filePath = std::string(inPath) + "/" + dirEntry->d_name;
+            if (dirEntry->d_name[0] != '.' && readFile(filePath, fileInput))
+                inputs.push_back(fileInput);
+        }
+        if (inDir)
+            closedir(inDir);
+    }
+    else if (readFile(inPath, fileInput))
+        inputs.push_back(fileInput);
+    else
+        fprintf(stderr, "fuzz_replay: can't read %s\n", inPath);
+}
+
+
+// token from a dictionary line, with \\, \" and \xNN escapes
+static std::string unescapeToken(const char* tokenStart,
+        const char* tokenEnd){
+    std::string token;
+    for (const char* tokenPos = tokenStart; tokenPos < tokenEnd; tokenPos++){
+        if (*tokenPos == '\\' && tokenPos + 3 < tokenEnd &&
+                tokenPos[1] == 'x'){
+            char hexStr[3] = {tokenPos[2], tokenPos[3], '\0'};
+            token += (char)strtoul(hexStr, NULL, 16);
+            tokenPos += 3;
+        }
+        else if (*tokenPos == '\\' && tokenPos + 1 < tokenEnd)
+            token += *++tokenPos;
+        else
+            token += *tokenPos;
+    }
+    return token;
+}
+
+
+// reads a libFuzzer/AFL dictionary, i.e. lines of [name=]"token"
+static void readDict(const char* dictPath, std::vector<std::string>& tokens){
+    FILE* dictFile = fopen(dictPath, "r");
+    char lineStr[256];
+
+    if (dictFile == NULL){
+        fprintf(stderr, "fuzz_replay: can't read %s\n", dictPath);
+        return;
+    }
+    while (fgets(lineStr, sizeof(lineStr), dictFile)){
+        char* tokenStart = strchr(lineStr, '"');
+        char* tokenEnd = strrchr(lineStr, '"');
+        if (lineStr[0] != '#' && tokenStart && tokenEnd > tokenStart)
+            tokens.push_back(unescapeToken(tokenStart + 1, tokenEnd));
+    }
+    fclose(dictFile);
+}
+
+
+static void mutate(FuzzInput& fuzzInput, const std::vector<FuzzInput>& inputs,
+        const std::vector<std::string>& tokens, std::mt19937& fuzzRand){
+    uint8_t mutationCount = 1 + fuzzRand() % 4;
+
+    for (uint8_t i = 0; i < mutationCount; i++){
+        // keep the target selector byte
+        size_t bodyPos = 1 + (fuzzInput.size() > 1 ?
+                fuzzRand() % fuzzInput.size() : 0);
+        bodyPos = bodyPos > fuzzInput.size() ? fuzzInput.size() : bodyPos;
+
+        switch (fuzzRand() % 6){
+            case 0:     // flip a bit
+                if (bodyPos < fuzzInput.size())
+                    fuzzInput[bodyPos] ^= 1 << (fuzzRand() % 8);
+                break;
+            case 1:     // random byte
+                fuzzInput.insert(fuzzInput.begin() + bodyPos,
+                        (uint8_t)fuzzRand());
+                break;
+            case 2:     // delete a run
+                if (bodyPos < fuzzInput.size())
+                    fuzzInput.erase(fuzzInput.begin() + bodyPos,
+                            fuzzInput.begin() + std::min(fuzzInput.size(),
+                                    bodyPos + 1 + fuzzRand() % 8));
+                break;
+            case 3:     // repeat a run, making long fields
+                if (bodyPos < fuzzInput.size()){
+                    FuzzInput runBytes(fuzzInput.begin() + bodyPos,
+                            fuzzInput.begin() + std::min(fuzzInput.size(),
+                                    bodyPos + 1 + fuzzRand() % 8));
+                    for (uint8_t j = fuzzRand() % 8; j > 0; j--)
+                        fuzzInput.insert(fuzzInput.begin() + bodyPos,
+                                runBytes.begin(), runBytes.end());
+                }
+                break;
+            case 4:     // dictionary token
+                if (! tokens.empty()){
+                    const std::string& token = tokens[fuzzRand() %
+                            tokens.size()];
+                    fuzzInput.insert(fuzzInput.begin() + bodyPos,
+                            token.begin(), token.end());
+                }
+                break;
+            case 5:     // splice in the tail of another input
+                {
+                    const FuzzInput& otherInput = inputs[fuzzRand() %
+                            inputs.size()];
+                    if (otherInput.size() > 1){
+                        fuzzInput.resize(bodyPos);
+                        fuzzInput.insert(fuzzInput.end(), otherInput.begin() +
+                                1 + fuzzRand() % (otherInput.size() - 1),
+                                otherInput.end());
+                    }
+                }
+                break;
+        }
+    }
+    if (fuzzInput.size() > MAX_INPUT_LEN)
+        fuzzInput.resize(MAX_INPUT_LEN);
+}
+
+
+static void usage(){
+    fprintf(stderr, "usage: fuzz_replay [-n mutations] [-s seed] [-x dict] "
+            "path...\n");
+    exit(1);
+}
+
+
+int main(int argc, char** argv){
+    unsigned long mutationCount = 0;
+    unsigned long seed = 1;
+    std::vector<FuzzInput> inputs;
+    std::vector<std::string> tokens;
+
+    for (int i = 1; i < argc; i++){
+        if (argv[i][0] == '-'){
+            if (i + 1 >= argc)
+                usage();
+            else if (strcmp(argv[i], "-n") == 0)
+                mutationCount = strtoul(argv[++i], NULL, 0);
+            else if (strcmp(argv[i], "-s") == 0)
+                seed = strtoul(argv[++i], NULL, 0);
+            else if (strcmp(argv[i], "-x") == 0)
+                readDict(argv[++i], tokens);
+            else
+                usage();
+        }
+        else
+            readInputs(argv[i], inputs);
+    }
+    if (inputs.empty())
+        usage();
+
+    __sanitizer_set_death_callback(onSanitizerDeath);
+
+    for (size_t i = 0; i < inputs.size(); i++)
+        runInput(inputs[i]);
+
+    std::mt19937 fuzzRand(seed);
+    for (unsigned long i = 0; i < mutationCount; i++){
+        FuzzInput fuzzInput = inputs[fuzzRand() % inputs.size()];
+        if (fuzzInput.empty())
+            continue;
+        mutate(fuzzInput, inputs, tokens, fuzzRand);
+        runInput(fuzzInput);
+    }
+
+    printf("fuzz_replay: ran %lu inputs (%zu from corpus)\n", curInputNum,
+            inputs.size());
+    return 0;
+}
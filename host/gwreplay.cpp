@@ -0,0 +1,574 @@
+/*
+    Replays a capture of gateway traffic (see capture.h) through the host build
+    of the firmware, feeding serial lines and radio messages in at their
+    captured times, to reproduce an issue or check a change against a
+    known-good run.
+
+    Time is virtual by default, the replay running as fast as the firmware
+    allows (each loop() pass costing --loop-us), or with --speed is real time
+    scaled, e.g. 1 for the original pace or 10 for ten times faster.  Radio
+    sends are ACKed as they were in the capture.
+
+    After the run, the gateway's G>S messages and radio sends are compared in
+    order with those captured, and the first differences shown, along with the
+    wall time taken.  Fields taken from the gateway's clock or loop timing
+    (e.g. GSTATS max_loop_us, GWSNAP time) aren't compared.  Exits with status 3 if any differ, 2 if the firmware's
+    watchdog expires.
+
+    Usage:
+      gwreplay [--speed x] [--loop-us us] [--eeprom path] [--record path]
+              [--show] [--max-diffs n] capture
+      gwreplay --dump capture
+      gwreplay --import gateway_output capture
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include "capture.h"
+#include "hostlinks.h"
+
+// firmware entry points
+void setup();
+void loop();
+
+// time after the last input to let the gateway finish handling it
+static const uint64_t REPLAY_DRAIN_MICROS = 5000000;
+
+struct ReplayConfig {
+    double speed = 0;                   // 0 for virtual time
+    uint32_t loopMicros = 100;          // virtual time per loop() pass
+    const char* eepromPath = NULL;
+    const char* recordPath = NULL;
+    bool isShowOutput = false;
+    size_t maxDiffs = 10;
+};
+
+static ReplayConfig replayCfg;
+
+
+static uint64_t monotonicMicros(){
+    struct timespec nowTime;
+    clock_gettime(CLOCK_MONOTONIC, &nowTime);
+    return (uint64_t)nowTime.tv_sec * 1000000 + nowTime.tv_nsec / 1000;
+}
+
+// *****************************************************************************
+//    Replay Links
+// *****************************************************************************
+
+class ReplayClock : public HostClock {
+    /*
+       Virtual time (speed 0), advanced by waits and loop() passes, or real
+       time scaled by speed.
+    */
+  public:
+    void start(){ startMicros = monotonicMicros(); }
+
+    uint64_t nowMicros(){
+        if (replayCfg.speed <= 0)
+            return virtualMicros;
+        return (uint64_t)((monotonicMicros() - startMicros) * replayCfg.speed);
+    }
+
+    void sleepMicros(uint32_t us){
+        if (replayCfg.speed <= 0){
+            virtualMicros += us;
+            return;
+        }
+        uint64_t realMicros = (uint64_t)(us / replayCfg.speed);
+        struct timespec sleepTime = {(time_t)(realMicros / 1000000),
+                (long)(realMicros % 1000000) * 1000};
+        nanosleep(&sleepTime, NULL);
+    }
+
+    // skips ahead in virtual time, as when the gateway is idle
+    void skipTo(uint64_t toMicros){
+        if (replayCfg.speed <= 0 && toMicros > virtualMicros)
+            virtualMicros = toMicros;
+    }
+
+  private:
+    uint64_t virtualMicros = 0;
+    uint64_t startMicros = 0;
+};
+
+static ReplayClock replayClock;
+
+
+class ReplaySchedule {
+    /*
+       The captured inputs, released to the links as they fall due, and the
+       captured outputs to compare against.
+    */
+  public:
+    void load(const std::vector<CaptureRecord>& capRecords){
+        for (size_t i = 0; i < capRecords.size(); i++){
+            const CaptureRecord& capRecord = capRecords[i];
+            if (capRecord.kind == capSerialIn || capRecord.kind == capRadioIn)
+                inputs.push_back(capRecord);
+            else {
+                outputs.push_back(capRecord);
+                if (capRecord.kind == capRadioOut)
+                    sendAcks.push_back(capRecord.val != 0);
+            }
+        }
+    }
+
+    // Moves the next input into the serial or radio queue once due.  Each is
+    // held until the last has been read, so the firmware handles them in the
+    // captured order even if running slower than the captured gateway.
+    void release(){
+        uint64_t nowMicros = replayClock.nowMicros();
+        while (nextInput < inputs.size() && serialIn.empty() &&
+                radioIn.empty() && inputs[nextInput].micros <= nowMicros){
+            const CaptureRecord& capRecord = inputs[nextInput++];
+            if (capRecord.kind == capSerialIn){
+                serialIn.insert(serialIn.end(), capRecord.bytes.begin(),
+                        capRecord.bytes.end());
+                serialIn.push_back('\r');
+            }
+            else
+                radioIn.push_back(capRecord);
+        }
+    }
+
+    // moves all inputs and outputs in time, by whole seconds so the firmware
+    // rounds its clock the same way (its time is seconds of millis())
+    void shiftToStart(uint64_t startMicros, uint64_t firstMicros){
+        int64_t shiftMicros = (int64_t)startMicros - (int64_t)firstMicros;
+        shiftMicros = (shiftMicros > 0) ?
+                (shiftMicros + 999999) / 1000000 * 1000000 :
+                shiftMicros / 1000000 * 1000000;
+        for (size_t i = 0; i < inputs.size(); i++)
+            inputs[i].micros += shiftMicros;
+        for (size_t i = 0; i < outputs.size(); i++)
+            outputs[i].micros += shiftMicros;
+    }
+
+    bool isInputLeft(){ return nextInput < inputs.size(); }
+
+    uint64_t endMicros(){
+        uint64_t lastMicros = 0;
+        if (! inputs.empty())
+            lastMicros = inputs.back().micros;
+        if (! outputs.empty() && outputs.back().micros > lastMicros)
+            lastMicros = outputs.back().micros;
+        return lastMicros;
+    }
+
+    uint64_t nextInputMicros(){ return inputs[nextInput].micros; }
+
+    // ACK for the next radio send, as captured, or true past the capture's end
+    bool nextSendAck(){
+        return nextSend < sendAcks.size() ? sendAcks[nextSend++] : true;
+    }
+
+    std::vector<CaptureRecord> inputs;
+    std::vector<CaptureRecord> outputs;
+    std::deque<uint8_t> serialIn;
+    std::deque<CaptureRecord> radioIn;
+
+  private:
+    size_t nextInput = 0;
+    std::vector<bool> sendAcks;
+    size_t nextSend = 0;
+};
+
+static ReplaySchedule replaySched;
+
+// outputs of the replayed gateway, to compare
+static std::vector<CaptureRecord> replayOutputs;
+
+// replayed outputs before this (the replayed gateway's boot) aren't compared
+static uint64_t compareFromMicros = 0;
+
+
+class ReplaySerialLink : public HostSerialLink {
+  public:
+    int readByte(){
+        replaySched.release();
+        if (replaySched.serialIn.empty())
+            return -1;
+        int readVal = replaySched.serialIn.front();
+        replaySched.serialIn.pop_front();
+        return readVal;
+    }
+
+    int available(){
+        replaySched.release();
+        return replaySched.serialIn.size();
+    }
+
+    void writeBytes(const uint8_t* outBytes, size_t outLen){
+        if (replayCfg.isShowOutput)
+            fwrite(outBytes, 1, outLen, stdout);
+        for (size_t i = 0; i < outLen; i++){
+            if (outBytes[i] == '\n'){
+                outLine.kind = capSerialOut;
+                outLine.micros = replayClock.nowMicros();
+                replayOutputs.push_back(outLine);
+                outLine.bytes.clear();
+            }
+            else if (outBytes[i] != '\r')
+                outLine.bytes += (char)outBytes[i];
+        }
+    }
+
+  private:
+    CaptureRecord outLine;
+};
+
+
+class ReplayRadioLink : public HostRadioLink {
+  public:
+    bool available(){
+        replaySched.release();
+        return ! replaySched.radioIn.empty();
+    }
+
+    bool recv(uint8_t* msgBytes, uint8_t* msgLen, uint8_t* fromAddr,
+            int16_t* rssi){
+        if (! available())
+            return false;
+        const CaptureRecord& capRecord = replaySched.radioIn.front();
+        size_t payloadLen = capRecord.bytes.size();
+        if (payloadLen > *msgLen)
+            payloadLen = *msgLen;
+        memcpy(msgBytes, capRecord.bytes.data(), payloadLen);
+        *msgLen = payloadLen;
+        *fromAddr = capRecord.nodeId;
+        *rssi = capRecord.val;
+        replaySched.radioIn.pop_front();
+        return true;
+    }
+
+    bool send(const uint8_t* msgBytes, uint8_t msgLen, uint8_t toAddr){
+        CaptureRecord capRecord;
+        capRecord.kind = capRadioOut;
+        capRecord.micros = replayClock.nowMicros();
+        capRecord.nodeId = toAddr;
+        capRecord.bytes.assign((const char*)msgBytes,
+                strnlen((const char*)msgBytes, msgLen));
+        capRecord.val = replaySched.nextSendAck();
+        replayOutputs.push_back(capRecord);
+        return capRecord.val;
+    }
+};
+
+// *****************************************************************************
+//    Compare
+// *****************************************************************************
+
+// the gateway's externally visible behaviour: messages to the server and
+// radio sends, not console or log output
+static bool isComparedOutput(const CaptureRecord& capRecord){
+    return capRecord.kind == capRadioOut || (capRecord.kind == capSerialOut &&
+            capRecord.bytes.compare(0, 4, "G>S:") == 0);
+}
+
+
+// G>S message fields taken from the gateway's clock or loop timing, which
+// differ between a capture in real time and its replay: bit n of the mask for
+// field n of each ';' separated record after the message name
+struct TimingFields {
+    const char* msgName;
+    uint32_t fieldMask;
+};
+
+static const TimingFields TIMING_FIELDS[] = {
+    {"GSTATS", 1u << 14},                   // max_loop_us
+    {"GWSNAP", (1u << 1) | (1u << 3)},      // when_booted, time
+    {"NOSNAP", 1u << 5},                    // when_last_seen
+    {"NDARK", 1u << 1},                     // last_seen
+    {"STIME_ACK", 1u << 1}                  // rtt_ms
+};
+
+
+static std::string maskTimingFields(const std::string& msgStr){
+    /*
+       Returns a G>S message with its timing fields (TIMING_FIELDS) as '*',
+       for comparing
+    */
+    size_t argsPos = msgStr.find(';');
+    if (msgStr.compare(0, 4, "G>S:") != 0 || argsPos == std::string::npos)
+        return msgStr;
+    std::string msgName = msgStr.substr(4, argsPos - 4);
+    uint32_t fieldMask = 0;
+    for (const TimingFields& timingFields : TIMING_FIELDS)
+        if (msgName == timingFields.msgName)
+            fieldMask = timingFields.fieldMask;
+    if (fieldMask == 0)
+        return msgStr;
+
+    std::string maskedStr = msgStr.substr(0, argsPos + 1);
+    unsigned fieldIx = 0;
+    bool isFieldStart = true;
+    for (size_t i = argsPos + 1; i < msgStr.size(); i++){
+        char msgChar = msgStr[i];
+        if (msgChar == ',' || msgChar == ';'){
+            fieldIx = (msgChar == ',') ? fieldIx + 1 : 0;
+            isFieldStart = true;
+            maskedStr += msgChar;
+        }
+        else if (fieldIx >= 32 || ! (fieldMask & (1u << fieldIx)))
+            maskedStr += msgChar;
+        else if (isFieldStart){
+            maskedStr += '*';
+            isFieldStart = false;
+        }
+    }
+    return maskedStr;
+}
+
+
+static bool isSameOutput(const CaptureRecord& capOutput,
+        const CaptureRecord& newOutput){
+    if (capOutput.nodeId != newOutput.nodeId)
+        return false;
+    if (capOutput.kind != capSerialOut)
+        return capOutput.bytes == newOutput.bytes;
+    return maskTimingFields(capOutput.bytes) ==
+            maskTimingFields(newOutput.bytes);
+}
+
+
+static std::vector<const CaptureRecord*> comparedOutputs(
+        const std::vector<CaptureRecord>& capRecords, uint8_t kind){
+    std::vector<const CaptureRecord*> outputs;
+    for (size_t i = 0; i < capRecords.size(); i++)
+        if (capRecords[i].kind == kind && isComparedOutput(capRecords[i]) &&
+                capRecords[i].micros >= compareFromMicros)
+            outputs.push_back(&capRecords[i]);
+    return outputs;
+}
+
+
+static size_t compareOutputs(uint8_t kind, const char* kindName,
+        size_t& shownDiffs){
+    /*
+       Compares captured and replayed outputs of a kind, in order, returning
+       how many differ.  Timing isn't compared, nor timing fields of
+       messages (TIMING_FIELDS).
+    */
+    std::vector<const CaptureRecord*> capOutputs = comparedOutputs(
+            replaySched.outputs, kind);
+    std::vector<const CaptureRecord*> newOutputs = comparedOutputs(
+            replayOutputs, kind);
+    size_t diffCount = 0;
+
+    for (size_t i = 0; i < capOutputs.size() || i < newOutputs.size(); i++){
+        const CaptureRecord* capOutput = i < capOutputs.size() ?
+                capOutputs[i] : NULL;
+        const CaptureRecord* newOutput = i < newOutputs.size() ?
+                newOutputs[i] : NULL;
+        if (capOutput && newOutput && isSameOutput(*capOutput, *newOutput))
+            continue;
+
+        diffCount++;
+        if (shownDiffs++ >= replayCfg.maxDiffs)
+            continue;
+        printf("%s %zu differs:\n", kindName, i + 1);
+        printf("  captured: %s\n", capOutput ?
+                formatCapture(*capOutput).c_str() : "(none)");
+        printf("  replayed: %s\n", newOutput ?
+                formatCapture(*newOutput).c_str() : "(none)");
+    }
+    printf("%s: %zu captured, %zu replayed, %zu differ\n", kindName,
+            capOutputs.size(), newOutputs.size(), diffCount);
+    return diffCount;
+}
+
+// *****************************************************************************
+//    Main
+// *****************************************************************************
+
+static int dumpCapture(const char* capPath){
+    std::vector<CaptureRecord> capRecords;
+    if (! readCapture(capPath, capRecords))
+        return 1;
+    for (size_t i = 0; i < capRecords.size(); i++)
+        printf("%s\n", formatCapture(capRecords[i]).c_str());
+    return 0;
+}
+
+
+static int importCapture(const char* logPath, const char* capPath){
+    std::vector<CaptureRecord> capRecords;
+    CaptureWriter capWriter;
+
+    FILE* logFile = fopen(logPath, "r");
+    if (logFile == NULL){
+        perror(logPath);
+        return 1;
+    }
+    size_t badLines = importCaptureLog(logFile, capRecords);
+    fclose(logFile);
+
+    if (! capWriter.open(capPath)){
+        perror(capPath);
+        return 1;
+    }
+    for (size_t i = 0; i < capRecords.size(); i++)
+        capWriter.write(capRecords[i]);
+    capWriter.close();
+
+    printf("gwreplay: imported %zu records", capRecords.size());
+    if (badLines > 0)
+        printf(", skipped %zu bad capture lines", badLines);
+    printf("\n");
+    return 0;
+}
+
+
+static bool runUntil(uint64_t untilMicros, uint64_t& loopCount){
+    /*
+       Runs the gateway until the replay clock reaches untilMicros, skipping
+       idle time.  Returns false if the firmware's watchdog expires.
+    */
+    while (replayClock.nowMicros() < untilMicros){
+        loop();
+        loopCount++;
+        if (replayCfg.speed <= 0)
+            replayClock.sleepMicros(replayCfg.loopMicros);
+
+        if (! hostWatchdogOk())
+            return false;
+
+        // nothing to do until the next input, skip to it
+        replaySched.release();
+        if (replaySched.serialIn.empty() && replaySched.radioIn.empty()){
+            uint64_t idleUntil = replaySched.isInputLeft() ?
+                    replaySched.nextInputMicros() : untilMicros;
+            if (idleUntil > untilMicros)
+                idleUntil = untilMicros;
+            if (replayCfg.speed <= 0)
+                replayClock.skipTo(idleUntil);
+            else if (idleUntil > replayClock.nowMicros())
+                replayClock.sleepMicros(1000);
+        }
+    }
+    return true;
+}
+
+
+static void usage(){
+    fprintf(stderr, "usage: gwreplay [--speed x] [--loop-us us] "
+            "[--eeprom path] [--record path]\n"
+            "                [--show] [--max-diffs n] capture\n"
+            "       gwreplay --dump capture\n"
+            "       gwreplay --import gateway_output capture\n");
+    exit(1);
+}
+
+
+int main(int argc, char** argv){
+    const char* capPath = NULL;
+
+    if (argc == 3 && strcmp(argv[1], "--dump") == 0)
+        return dumpCapture(argv[2]);
+    if (argc == 4 && strcmp(argv[1], "--import") == 0)
+        return importCapture(argv[2], argv[3]);
+
+    for (int i = 1; i < argc; i++){
+        const char* argName = argv[i];
+        if (strcmp(argName, "--show") == 0)
+            replayCfg.isShowOutput = true;
+        else if (argName[0] != '-'){
+            if (capPath)
+                usage();
+            capPath = argName;
+        }
+        else if (i + 1 >= argc)
+            usage();
+        else if (strcmp(argName, "--speed") == 0)
+            replayCfg.speed = atof(argv[++i]);
+        else if (strcmp(argName, "--loop-us") == 0)
+            replayCfg.loopMicros = atol(argv[++i]);
+        else if (strcmp(argName, "--eeprom") == 0)
+            replayCfg.eepromPath = argv[++i];
+        else if (strcmp(argName, "--record") == 0)
+            replayCfg.recordPath = argv[++i];
+        else if (strcmp(argName, "--max-diffs") == 0)
+            replayCfg.maxDiffs = atol(argv[++i]);
+        else
+            usage();
+    }
+    if (capPath == NULL || replayCfg.speed < 0)
+        usage();
+
+    std::vector<CaptureRecord> capRecords;
+    if (! readCapture(capPath, capRecords))
+        return 1;
+    replaySched.load(capRecords);
+
+    if (replayCfg.eepromPath && ! hostSetEEPROMFile(replayCfg.eepromPath)){
+        fprintf(stderr, "gwreplay: can't read EEPROM file %s\n",
+                replayCfg.eepromPath);
+        return 1;
+    }
+
+    ReplaySerialLink serialLink;
+    ReplayRadioLink radioLink;
+    CaptureWriter capWriter;
+    RecordingSerialLink recSerialLink(&serialLink, &capWriter);
+    RecordingRadioLink recRadioLink(&radioLink, &capWriter);
+
+    hostSetClock(&replayClock);
+    if (replayCfg.recordPath){
+        if (! capWriter.open(replayCfg.recordPath)){
+            perror(replayCfg.recordPath);
+            return 1;
+        }
+        hostSetSerialLink(&recSerialLink);
+        hostSetRadioLink(&recRadioLink);
+    }
+    else {
+        hostSetSerialLink(&serialLink);
+        hostSetRadioLink(&radioLink);
+    }
+
+    uint64_t startWallMicros = monotonicMicros();
+    uint64_t loopCount = 0;
+    replayClock.start();
+
+    setup();
+
+    // A capture starting with an input (e.g. imported) was taken from a
+    // running gateway, so is started once the replayed one has booted.  Host
+    // captures include the boot, so are in step from the start.
+    if (! capRecords.empty() && (capRecords.front().kind == capSerialIn ||
+            capRecords.front().kind == capRadioIn)){
+        compareFromMicros = replayClock.nowMicros();
+        replaySched.shiftToStart(compareFromMicros, capRecords.front().micros);
+    }
+
+    uint64_t capEndMicros = replaySched.endMicros();
+    bool isWatchdogOk = runUntil(capEndMicros + REPLAY_DRAIN_MICROS,
+            loopCount);
+    recSerialLink.flushLines();
+    capWriter.close();
+
+    double wallSecs = (monotonicMicros() - startWallMicros) / 1e6;
+    double gatewaySecs = replayClock.nowMicros() / 1e6;
+    printf("gwreplay: %zu inputs, %.3f s of gateway time replayed in %.3f s "
+            "wall (%.1fx), %" PRIu64 " loop() passes\n",
+            replaySched.inputs.size(), gatewaySecs, wallSecs,
+            wallSecs > 0 ? gatewaySecs / wallSecs : 0.0, loopCount);
+
+    if (! isWatchdogOk){
+        fprintf(stderr, "gwreplay: watchdog expired at %.3f s\n",
+                replayClock.nowMicros() / 1e6);
+        return 2;
+    }
+
+    size_t shownDiffs = 0;
+    size_t diffCount = compareOutputs(capSerialOut, "G>S message", shownDiffs) +
+            compareOutputs(capRadioOut, "Radio send", shownDiffs);
+    return diffCount > 0 ? 3 : 0;
+}
@@ -0,0 +1,293 @@
+/*
+    Host build implementation of the Arduino core, watchdog, EEPROM and Time
+    shims, and the default links.
+ */
+
+#include <Arduino.h>
+#include <avr/wdt.h>
+#include <EEPROM.h>
+#include <TimeLib.h>
+#include <time.h>
+#include "hostlinks.h"
+
+// *****************************************************************************
+//    Default Links
+// *****************************************************************************
+
+class RealClock : public HostClock {
+  public:
+    RealClock(){ startMicros = monotonicMicros(); }
+
+    uint64_t nowMicros(){ return monotonicMicros() - startMicros; }
+
+    void sleepMicros(uint32_t us){
+        struct timespec sleepTime = {(time_t)(us / 1000000),
+                (long)(us % 1000000) * 1000};
+        nanosleep(&sleepTime, NULL);
+    }
+
+  private:
+    static uint64_t monotonicMicros(){
+        struct timespec nowTime;
+        clock_gettime(CLOCK_MONOTONIC, &nowTime);
+        return (uint64_t)nowTime.tv_sec * 1000000 + nowTime.tv_nsec / 1000;
+    }
+
+    uint64_t startMicros;
+};
+
+
+class NullSerialLink : public HostSerialLink {
+  public:
+    int readByte(){ return -1; }
+    int available(){ return 0; }
+    void writeBytes(const uint8_t* outBytes, size_t outLen){
+        (void)outBytes;
+        (void)outLen;
+    }
+};
+
+
+class NullRadioLink : public HostRadioLink {
+  public:
+    bool available(){ return false; }
+    bool recv(uint8_t* msgBytes, uint8_t* msgLen, uint8_t* fromAddr,
+            int16_t* rssi){
+        (void)msgBytes;
+        (void)msgLen;
+        (void)fromAddr;
+        (void)rssi;
+        return false;
+    }
+    bool send(const uint8_t* msgBytes, uint8_t msgLen, uint8_t toAddr){
+        (void)msgBytes;
+        (void)msgLen;
+        (void)toAddr;
+        return false;   // no one to ACK
+    }
+};
+
+
+static RealClock realClock;
+static NullSerialLink nullSerialLink;
+static NullRadioLink nullRadioLink;
+
+static HostClock* curClock = &realClock;
+static HostSerialLink* curSerialLink = &nullSerialLink;
+static HostRadioLink* curRadioLink = &nullRadioLink;
+
+
+void hostSetClock(HostClock* clock){
+    curClock = clock ? clock : &realClock;
+}
+
+
+void hostSetSerialLink(HostSerialLink* serialLink){
+    curSerialLink = serialLink ? serialLink : &nullSerialLink;
+}
+
+
+void hostSetRadioLink(HostRadioLink* radioLink){
+    curRadioLink = radioLink ? radioLink : &nullRadioLink;
+}
+
+
+HostClock* hostClock(){
+    return curClock;
+}
+
+
+HostRadioLink* hostRadioLink(){
+    return curRadioLink;
+}
+
+// *****************************************************************************
+//    Arduino Core
+// *****************************************************************************
+
+volatile uint8_t MCUSR = 0;
+volatile uint8_t PORTD = 0;
+volatile uint8_t PIND = 0xFF;       // pulled up, i.e. button not pressed
+volatile uint8_t TCCR1A = 0;
+volatile uint8_t TCCR1B = 0;
+volatile uint16_t TCNT1 = 0;
+volatile uint8_t TIMSK0 = 0;
+volatile uint8_t TIMSK1 = 0;
+volatile uint8_t TIFR1 = 0;
+
+
+uint32_t millis(){
+    return (uint32_t)(curClock->nowMicros() / 1000);
+}
+
+
+uint32_t micros(){
+    return (uint32_t)curClock->nowMicros();
+}
+
+
+void delay(uint32_t ms){
+    curClock->sleepMicros(ms * 1000);
+}
+
+
+void delayMicroseconds(uint32_t us){
+    curClock->sleepMicros(us);
+}
+
+
+void pinMode(uint8_t pin, uint8_t mode){
+    (void)pin;
+    (void)mode;
+}
+
+
+void digitalWrite(uint8_t pin, uint8_t value){
+    (void)pin;
+    (void)value;
+}
+
+
+int digitalRead(uint8_t pin){
+    (void)pin;
+    return HIGH;
+}
+
+
+HardwareSerial Serial;
+
+
+void HardwareSerial::begin(uint32_t baud){
+    (void)baud;
+}
+
+
+int HardwareSerial::available(){
+    return curSerialLink->available();
+}
+
+
+int HardwareSerial::read(){
+    return curSerialLink->readByte();
+}
+
+
+void HardwareSerial::flush(){
+    curSerialLink->flush();
+}
+
+
+size_t HardwareSerial::write(uint8_t outByte){
+    curSerialLink->writeBytes(&outByte, 1);
+    return 1;
+}
+
+
+size_t HardwareSerial::write(const uint8_t* outBytes, size_t outLen){
+    curSerialLink->writeBytes(outBytes, outLen);
+    return outLen;
+}
+
+
+size_t HardwareSerial::write(const char* outStr){
+    return write((const uint8_t*)outStr, strlen(outStr));
+}
+
+
+size_t HardwareSerial::print(const __FlashStringHelper* outStr){
+    return write((const char*)outStr);
+}
+
+
+size_t HardwareSerial::print(const char* outStr){
+    return write(outStr);
+}
+
+
+size_t HardwareSerial::print(unsigned long outVal, int base){
+    char outStr[24];
+    snprintf(outStr, sizeof(outStr), base == HEX ? "%lX" : "%lu", outVal);
+    return write(outStr);
+}
+
+// *****************************************************************************
+//    Watchdog
+// *****************************************************************************
+
+static bool isWdtEnabled = false;
+static uint32_t wdtTimeoutMs = 0;
+static uint64_t wdtLastResetMicros = 0;
+
+
+void wdt_enable(uint8_t timeout){
+    wdtTimeoutMs = 15u << timeout;      // per WDTO_*, approximately
+    isWdtEnabled = true;
+    wdt_reset();
+}
+
+
+void wdt_disable(){
+    isWdtEnabled = false;
+}
+
+
+void wdt_reset(){
+    wdtLastResetMicros = curClock->nowMicros();
+}
+
+
+bool hostWatchdogOk(){
+    return (! isWdtEnabled) || (curClock->nowMicros() - wdtLastResetMicros <=
+            wdtTimeoutMs * 1000ull);
+}
+
+// *****************************************************************************
+//    EEPROM
+// *****************************************************************************
+
+EEPROMClass EEPROM;
+
+static const char* eepromFilePath = NULL;
+
+
+void EEPROMClass::save(){
+    if (eepromFilePath == NULL)
+        return;
+
+    FILE* eepromFile = fopen(eepromFilePath, "wb");
+    if (eepromFile == NULL)
+        return;
+    fwrite(mem, 1, sizeof(mem), eepromFile);
+    fclose(eepromFile);
+}
+
+
+bool hostSetEEPROMFile(const char* eepromPath){
+    eepromFilePath = eepromPath;
+
+    FILE* eepromFile = fopen(eepromPath, "rb");
+    if (eepromFile == NULL)
+        return true;    // created on first save
+    bool isRead = (fread(EEPROM.mem, 1, sizeof(EEPROM.mem), eepromFile) ==
+            sizeof(EEPROM.mem));
+    fclose(eepromFile);
+    return isRead;
+}
+
+// *****************************************************************************
+//    Time Library
+// *****************************************************************************
+
+void breakTime(uint32_t timeSecs, tmElements_t& timeTME){
+    time_t breakSecs = timeSecs;
+    struct tm brokenTime;
+    gmtime_r(&breakSecs, &brokenTime);
+
+    timeTME.Second = brokenTime.tm_sec;
+    timeTME.Minute = brokenTime.tm_min;
+    timeTME.Hour = brokenTime.tm_hour;
+    timeTME.Wday = brokenTime.tm_wday + 1;
+    timeTME.Day = brokenTime.tm_mday;
+    timeTME.Month = brokenTime.tm_mon + 1;
+    timeTME.Year = brokenTime.tm_year - 70;
+}
@@ -0,0 +1,88 @@
+/*
+    Pluggable links between the host build of the gateway firmware and the
+    outside world.  The shims call through whichever links are set, so the
+    same firmware build can run against real time and pipes (hostmain.cpp), or
+    be driven by a simulator with a virtual clock and radio medium.
+ */
+
+#ifndef HOST_LINKS_H
+#define HOST_LINKS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+class HostClock {
+  public:
+    virtual ~HostClock(){}
+
+    // monotonic time since start
+    virtual uint64_t nowMicros() = 0;
+
+    // blocking wait, as delay()
+    virtual void sleepMicros(uint32_t us) = 0;
+};
+
+
+class HostSerialLink {
+  public:
+    virtual ~HostSerialLink(){}
+
+    // next input byte, or -1 if none waiting
+    virtual int readByte() = 0;
+    virtual int available() = 0;
+    virtual void writeBytes(const uint8_t* outBytes, size_t outLen) = 0;
+    virtual void flush(){}
+};
+
+
+class HostRadioLink {
+  public:
+    virtual ~HostRadioLink(){}
+
+    // this station's address, set by RHReliableDatagram::setThisAddress()
+    virtual void setAddress(uint8_t address){ (void)address; }
+
+    // ACK timeout and retries for send(), as set on RHReliableDatagram
+    virtual void setRetryTiming(uint16_t timeoutMs, uint8_t retries){
+        (void)timeoutMs;
+        (void)retries;
+    }
+
+    // true if a message addressed to this station is waiting
+    virtual bool available() = 0;
+
+    // receives (and ACKs) the waiting message, false if none
+    virtual bool recv(uint8_t* msgBytes, uint8_t* msgLen, uint8_t* fromAddr,
+            int16_t* rssi) = 0;
+
+    // sends with RHReliableDatagram semantics, true if ACKed - or once sent,
+    // if to RH_BROADCAST_ADDRESS (0xff), which isn't ACKed
+    virtual bool send(const uint8_t* msgBytes, uint8_t msgLen,
+            uint8_t toAddr) = 0;
+
+    // frequency tuned to (MHz), as RH_RF69::setFrequency()
+    virtual void setFrequency(float centreMhz){ (void)centreMhz; }
+
+    // RSSI of channel now, as RH_RF69::rssiRead()
+    virtual int16_t rssiNow(){ return -110; }
+
+    // retransmissions since start, as RHReliableDatagram::retransmissions()
+    virtual uint32_t retransmissions(){ return 0; }
+};
+
+
+// Set links.  The defaults (real time clock, no serial input/output, no radio
+// traffic) are used until set.
+void hostSetClock(HostClock* clock);
+void hostSetSerialLink(HostSerialLink* serialLink);
+void hostSetRadioLink(HostRadioLink* radioLink);
+HostClock* hostClock();
+HostRadioLink* hostRadioLink();
+
+// Persist EEPROM contents to file, loading it now if it exists.
+bool hostSetEEPROMFile(const char* eepromPath);
+
+// Checks the watchdog, returns false if it has expired.
+bool hostWatchdogOk();
+
+#endif
@@ -0,0 +1,315 @@
+/*
+    Runs the host build of the gateway firmware as a Linux process, in real
+    time, driven by pipes:
+      - serial: stdin/stdout.  Input line ends may be LF, which is passed to
+        the firmware as CR.
+      - radio (optional): a line per message, "<from_node_id> <rssi> <payload>"
+        received from --radio-in, and "<to_node_id> <payload>" written to
+        --radio-out, non-printable bytes as \xNN.  All sent messages are
+        treated as ACKed.
+
+    Exits when all inputs reach end of file (or --run-secs after setup), or
+    with status 2 if the firmware's watchdog expires.  With --record, all
+    serial and radio traffic is also written to a capture file, to be
+    replayed with gwreplay.
+
+    Usage:
+      metergateway_host [--radio-in path] [--radio-out path] [--eeprom path]
+              [--run-secs secs] [--record path]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "capture.h"
+#include "hostlinks.h"
+
+// firmware entry points
+void setup();
+void loop();
+
+// *****************************************************************************
+//    Pipe Links
+// *****************************************************************************
+
+class FdReader {
+    /*
+       Non-blocking buffered reads from a file descriptor.
+   */
+  public:
+    FdReader(int fd) : fd(fd){}
+
+    // reads whatever is waiting, without blocking
+    void fill(){
+        if (isEOF || buffLen == sizeof(buff))
+            return;
+        struct pollfd readPoll = {fd, POLLIN, 0};
+        if (poll(&readPoll, 1, 0) <= 0)
+            return;
+        ssize_t readLen = read(fd, buff + buffLen, sizeof(buff) - buffLen);
+        if (readLen > 0)
+            buffLen += readLen;
+        else if (readLen == 0 || errno != EINTR)
+            isEOF = true;
+    }
+
+    size_t waiting(){ return buffLen - buffPos; }
+
+    int readByte(){
+        if (buffPos == buffLen)
+            return -1;
+        int readVal = buff[buffPos++];
+        if (buffPos == buffLen)
+            buffPos = buffLen = 0;
+        return readVal;
+    }
+
+    // copies a complete line (without LF) if one is waiting
+    bool readLine(char* lineStr, size_t lineSize){
+        uint8_t* lineEnd = (uint8_t*)memchr(buff + buffPos, '\n', waiting());
+        if (lineEnd == NULL){
+            // discard an overlong line rather than stall
+            if (buffPos == 0 && buffLen == sizeof(buff))
+                buffPos = buffLen = 0;
+            return false;
+        }
+        size_t lineLen = lineEnd - (buff + buffPos);
+        if (lineLen >= lineSize)
+            lineLen = lineSize - 1;
+        memcpy(lineStr, buff + buffPos, lineLen);
+        lineStr[lineLen] = '\0';
+        buffPos = lineEnd + 1 - buff;
+        if (buffPos == buffLen)
+            buffPos = buffLen = 0;
+        else if (buffPos > sizeof(buff) / 2){
+            memmove(buff, buff + buffPos, buffLen - buffPos);
+            buffLen -= buffPos;
+            buffPos = 0;
+        }
+        return true;
+    }
+
+    int fd;
+    bool isEOF = false;
+
+  private:
+    uint8_t buff[4096];
+    size_t buffPos = 0;
+    size_t buffLen = 0;
+};
+
+
+class StdioSerialLink : public HostSerialLink {
+  public:
+    StdioSerialLink() : reader(STDIN_FILENO){}
+
+    int readByte(){
+        reader.fill();
+        int readVal = reader.readByte();
+        return (readVal == '\n') ? '\r' : readVal;
+    }
+    int available(){
+        reader.fill();
+        return reader.waiting();
+    }
+    void writeBytes(const uint8_t* outBytes, size_t outLen){
+        fwrite(outBytes, 1, outLen, stdout);
+    }
+    void flush(){
+        fflush(stdout);
+    }
+
+    FdReader reader;
+};
+
+
+class PipeRadioLink : public HostRadioLink {
+  public:
+    PipeRadioLink(int inFd, FILE* outFile) : reader(inFd), outFile(outFile){}
+
+    bool available(){
+        if (! isPending)
+            readPending();
+        return isPending;
+    }
+
+    bool recv(uint8_t* msgBytes, uint8_t* msgLen, uint8_t* fromAddr,
+            int16_t* rssi){
+        if (! available())
+            return false;
+        size_t payloadLen = strlen(pendingPayload);
+        if (payloadLen > *msgLen)
+            payloadLen = *msgLen;
+        memcpy(msgBytes, pendingPayload, payloadLen);
+        *msgLen = payloadLen;
+        *fromAddr = pendingFrom;
+        *rssi = pendingRSSI;
+        isPending = false;
+        return true;
+    }
+
+    bool send(const uint8_t* msgBytes, uint8_t msgLen, uint8_t toAddr){
+        if (outFile == NULL)
+            return false;
+        // payload is a zero padded string, or binary if broadcast (a
+        // firmware chunk), written with bytes outside printable ASCII, and
+        // '\', as \xNN
+        while (toAddr != 0xff && msgLen > 0 && msgBytes[msgLen - 1] == 0)
+            msgLen--;
+        fprintf(outFile, "%u ", toAddr);
+        for (uint8_t i = 0; i < msgLen; i++){
+            if (msgBytes[i] < 32 || msgBytes[i] > 126 || msgBytes[i] == '\\')
+                fprintf(outFile, "\\x%02X", msgBytes[i]);
+            else
+                fputc(msgBytes[i], outFile);
+        }
+        fputc('\n', outFile);
+        fflush(outFile);
+        return true;
+    }
+
+    FdReader reader;
+
+  private:
+    void readPending(){
+        char lineStr[128];
+        unsigned fromVal = 0;
+        int rssiVal = 0;
+        int payloadPos = 0;
+
+        reader.fill();
+        while (reader.readLine(lineStr, sizeof(lineStr))){
+            if (sscanf(lineStr, "%u %d %n", &fromVal, &rssiVal,
+                    &payloadPos) == 2 && payloadPos > 0 && fromVal < 256){
+                pendingFrom = fromVal;
+                pendingRSSI = rssiVal;
+                snprintf(pendingPayload, sizeof(pendingPayload), "%s",
+                        lineStr + payloadPos);
+                isPending = true;
+                return;
+            }
+            fprintf(stderr, "host: bad radio input line: %s\n", lineStr);
+        }
+    }
+
+    FILE* outFile;
+    bool isPending = false;
+    uint8_t pendingFrom = 0;
+    int16_t pendingRSSI = 0;
+    char pendingPayload[128];
+};
+
+// *****************************************************************************
+//    Main
+// *****************************************************************************
+
+static void usage(){
+    fprintf(stderr, "usage: metergateway_host [--radio-in path] "
+            "[--radio-out path] [--eeprom path] [--run-secs secs]\n"
+            "        [--record path]\n");
+    exit(1);
+}
+
+
+int main(int argc, char** argv){
+    const char* radioInPath = NULL;
+    const char* radioOutPath = NULL;
+    const char* eepromPath = NULL;
+    const char* recordPath = NULL;
+    long runSecs = 0;
+
+    for (int i = 1; i < argc; i++){
+        if (i + 1 >= argc)
+            usage();
+        else if (strcmp(argv[i], "--radio-in") == 0)
+            radioInPath = argv[++i];
+        else if (strcmp(argv[i], "--radio-out") == 0)
+            radioOutPath = argv[++i];
+        else if (strcmp(argv[i], "--eeprom") == 0)
+            eepromPath = argv[++i];
+        else if (strcmp(argv[i], "--run-secs") == 0)
+            runSecs = atol(argv[++i]);
+        else if (strcmp(argv[i], "--record") == 0)
+            recordPath = argv[++i];
+        else
+            usage();
+    }
+
+    if (eepromPath && ! hostSetEEPROMFile(eepromPath)){
+        fprintf(stderr, "host: can't read EEPROM file %s\n", eepromPath);
+        return 1;
+    }
+
+    CaptureWriter capWriter;
+    if (recordPath && ! capWriter.open(recordPath)){
+        perror(recordPath);
+        return 1;
+    }
+
+    StdioSerialLink serialLink;
+    RecordingSerialLink recSerialLink(&serialLink, &capWriter);
+    hostSetSerialLink(recordPath ? (HostSerialLink*)&recSerialLink :
+            &serialLink);
+
+    PipeRadioLink* radioLink = NULL;
+    if (radioInPath || radioOutPath){
+        int radioInFd = -1;
+        FILE* radioOutFile = NULL;
+        if (radioInPath && (radioInFd = open(radioInPath, O_RDONLY)) < 0){
+            perror(radioInPath);
+            return 1;
+        }
+        if (radioOutPath && (radioOutFile = fopen(radioOutPath, "w")) == NULL){
+            perror(radioOutPath);
+            return 1;
+        }
+        radioLink = new PipeRadioLink(radioInFd, radioOutFile);
+        radioLink->reader.isEOF = (radioInFd < 0);
+        hostSetRadioLink(radioLink);
+        if (recordPath)
+            hostSetRadioLink(new RecordingRadioLink(radioLink, &capWriter));
+    }
+
+    setup();
+
+    // run time counts from the end of setup(), after its LED blinks
+    uint64_t runStartMicros = hostClock()->nowMicros();
+    while (runSecs == 0 || hostClock()->nowMicros() - runStartMicros <
+            runSecs * 1000000ull){
+        loop();
+        serialLink.flush();
+
+        if (! hostWatchdogOk()){
+            fprintf(stderr, "host: watchdog expired\n");
+            recSerialLink.flushLines();
+            return 2;
+        }
+
+        // done once all input is consumed
+        bool isSerialDone = serialLink.reader.isEOF &&
+                serialLink.reader.waiting() == 0;
+        bool isRadioDone = radioLink == NULL || (radioLink->reader.isEOF &&
+                ! radioLink->available());
+        if (runSecs == 0 && isSerialDone && isRadioDone)
+            break;
+
+        // idle until input, rather than spin.  Inputs at EOF are left out,
+        // as they would always poll ready, leaving the timeout to wait on.
+        if (serialLink.reader.waiting() == 0 &&
+                (radioLink == NULL || ! radioLink->available())){
+            struct pollfd inPolls[2] = {
+                    {serialLink.reader.isEOF ? -1 : STDIN_FILENO, POLLIN, 0},
+                    {(radioLink && ! radioLink->reader.isEOF) ?
+                    radioLink->reader.fd : -1, POLLIN, 0}};
+            poll(inPolls, 2, 1);
+        }
+    }
+
+    serialLink.flush();
+    recSerialLink.flushLines();
+    return 0;
+}
@@ -0,0 +1,1375 @@
+/*
+    Discrete-event simulator of a meter node network, for load testing the host
+    build of the gateway firmware.
+
+    The unmodified gateway firmware runs against:
+      - a virtual clock.  Time only advances when the firmware waits (delay(),
+        radio ACK waits, serial output blocking on a full transmit buffer) and
+        by a fixed cost per loop() pass, so an hour runs in seconds.
+      - a shared radio channel.  Frames take their on-air time at the
+        simulated bit rate, overlapping frames are lost to collision, a station
+        can't receive while transmitting, and frames are randomly lost with the
+        given probability.  The gateway and nodes both use RHReliableDatagram
+        ACK/retry semantics, and the gateway radio holds one received frame
+        until the firmware reads it, as the RF69 does.
+      - virtual meter nodes, sending MUPC, GINR and PREQ at their cadences,
+        each with its own clock drift, and waiting for replies to GINR/PREQ.
+        With --relay-every n, every nth node is out of the gateway's range and
+        reaches it through the node before, which relays its frames (RFWD)
+        both ways and is always listening.  With --fw-bytes n, the first node
+        takes a firmware update of n bytes, listening for chunks while one is
+        under way (as a node would, with the radio awake for the duration).
+        The gateway only hears frames, and channel activity in its RSSI,
+        while tuned to the channel.
+      - a scripted server on the serial port, answering GTIME (with ms and
+        the echoed request id, as a current server) and sending a
+        SMVAL instruction for every node part way through the run - and
+        with --fw-bytes, starting the update at --fw-secs and serving the
+        image's parts as the gateway asks for them.  With --sweep-secs, it
+        requests a spectrum sweep (SSWEEP) at that time.
+
+    Reports delivered readings and their latency (node send to the line
+    leaving the gateway's serial port), instruction delivery time (SMVAL sent
+    to the resulting MVAI received by the node), firmware update time and
+    throughput, sweep results, and radio/gateway counters.
+
+    Usage:
+      netsim [--nodes n] [--secs secs] [--bitrate bps] [--loss prob]
+              [--drift-ppm ppm] [--mupc-secs secs] [--ginr-secs secs]
+              [--preq-secs secs] [--instr-secs secs] [--loop-us us]
+              [--relay-every n] [--fw-bytes n] [--fw-secs secs]
+              [--sweep-secs secs] [--log-level level] [--seed n]
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+#include "hostlinks.h"
+
+// firmware entry points
+void setup();
+void loop();
+void wdt_reset();
+
+// *****************************************************************************
+//    Settings and Results
+// *****************************************************************************
+
+struct SimConfig {
+    uint16_t nodeCount = 50;
+    uint32_t runSecs = 3600;
+    uint32_t bitRate = 4800;            // as the firmware's MODEM_CONFIG
+    double lossProb = 0.01;
+    double maxDriftPpm = 50.0;          // node clocks uniform in +/- this
+    uint32_t mupcSecs = 60;
+    uint32_t ginrSecs = 300;
+    uint32_t preqSecs = 3600;
+    uint32_t instrSecs = 600;           // when SMVAL is sent for every node
+    uint32_t loopMicros = 100;          // gateway CPU time per loop() pass
+    uint32_t serialBaud = 115200;
+    uint16_t relayEvery = 0;            // 0 for all nodes in range
+    uint32_t fwBytes = 0;               // firmware image size, 0 for none
+    uint32_t fwSecs = 120;              // when the update is started
+    uint32_t sweepSecs = 0;             // when a sweep is requested, 0 never
+    const char* logLevel = "WARN";
+    uint32_t seed = 1;
+
+    // meter node radio settings
+    uint16_t nodeAckTimeoutMs = 200;
+    uint8_t nodeRetries = 3;
+    uint16_t nodeReplyWaitMs = 1000;
+};
+
+static const uint32_t SIM_EPOCH_SECS = 1700000000ul;
+static const uint32_t SIM_DRAIN_SECS = 10;     // after the run, for retries
+static const uint32_t SIM_IDLE_STEP_MICROS = 10000;
+static const uint8_t SIM_FIRST_NODE_ID = 2;
+static const uint8_t SIM_GATEWAY_ID = 1;
+static const uint8_t SIM_BROADCAST_ADDR = 0xff;
+static const float SIM_CHANNEL_MHZ = 915.0f;    // as the firmware's RADIO_FREQ
+static const float SIM_CHANNEL_HALF_MHZ = 0.01f;
+
+static SimConfig simCfg;
+static std::mt19937 simRand;
+
+
+struct SimStats {
+    // radio channel
+    uint32_t dataFrames = 0;
+    uint32_t ackFrames = 0;
+    uint32_t collided = 0;
+    uint32_t lost = 0;
+    uint32_t missedTx = 0;      // receiver was transmitting
+    uint32_t outOfRange = 0;
+    uint64_t airMicros = 0;
+
+    // gateway radio
+    uint32_t gwRxOverruns = 0;  // frame arrived with one still unread
+    uint32_t gwBusyDrops = 0;   // data frame arrived while awaiting an ACK
+    uint32_t gwDuplicates = 0;
+    uint32_t gwSends = 0;
+    uint32_t gwSendFails = 0;
+    uint32_t gwRetransmits = 0;
+
+    // nodes
+    uint32_t nodeMsgs = 0;
+    uint32_t nodeRetries = 0;
+    uint32_t nodeSendFails = 0;
+    uint32_t nodeReplies = 0;
+    uint32_t nodeNoReplies = 0;
+    uint32_t nodeAsleepDrops = 0;   // gateway frame arrived while not listening
+
+    // relays
+    uint32_t relayedUp = 0;
+    uint32_t relayedDown = 0;
+    uint32_t relayDropped = 0;      // relay's forward not ACKed
+
+    // firmware update
+    uint32_t fwChunksRecvd = 0;
+    uint32_t fwChunkDuplicates = 0;
+    uint32_t fwAcks = 0;
+    uint32_t fwResumes = 0;         // FWRQ after the first
+    uint32_t fwPartsServed = 0;
+    uint32_t fwPartNacks = 0;
+    uint64_t fwStartMicros = 0;     // first FWRQ sent
+    uint64_t fwEndMicros = 0;       // image complete at the node
+    bool isFwCrcOk = false;
+    std::string fwLastStatus;
+
+    // spectrum sweep
+    uint32_t sweepSteps = 0;
+    uint32_t sweepBusySteps = 0;    // any sample above the noise floor
+    uint64_t sweepStartMicros = 0;  // SSWEEP_ACK received
+    uint64_t sweepEndMicros = 0;    // SWEEPD received
+    uint32_t gwOffChannelDrops = 0; // frame arrived while tuned away
+
+    // serial/server
+    uint64_t serialBytesOut = 0;
+    uint64_t serialBlockedMicros = 0;
+    uint32_t watchdogExpiries = 0;
+    uint32_t readingDuplicates = 0;
+    uint32_t instrSent = 0;
+    uint32_t instrAcked = 0;
+    uint32_t instrNacked = 0;
+    uint32_t timeSyncs = 0;
+    int lastTimeRTTMs = -1;
+    std::string lastGwStats;
+
+    // readings by "<node_id>,<payload>", as passed through by the gateway
+    std::map<std::string, uint64_t> readingSentMicros;
+    std::map<std::string, bool> readingIsDelivered;
+    std::vector<uint64_t> readingLatencies;
+
+    // instructions by node id
+    std::map<uint8_t, uint64_t> instrSentMicros;
+    std::vector<uint64_t> instrDeliveryTimes;
+};
+
+static SimStats simStats;
+
+
+static double randUniform(double lowVal, double highVal){
+    return std::uniform_real_distribution<double>(lowVal, highVal)(simRand);
+}
+
+
+// the firmware image sent with --fw-bytes
+static std::string simFwImage;
+
+
+static uint16_t crc16(const std::string& bytes){
+    // CRC-16/XMODEM, as avr-libc's _crc_xmodem_update
+    uint16_t crcVal = 0;
+    for (size_t i = 0; i < bytes.size(); i++){
+        crcVal ^= (uint16_t)(uint8_t)bytes[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++)
+            crcVal = (crcVal & 0x8000) ? (crcVal << 1) ^ 0x1021 : crcVal << 1;
+    }
+    return crcVal;
+}
+
+// *****************************************************************************
+//    Virtual Clock
+// *****************************************************************************
+
+class VirtualClock : public HostClock {
+    /*
+       Simulated time, and the queue of events due at future times.  Waits by
+       the firmware run the events due in the meantime.
+   */
+  public:
+    uint64_t nowMicros(){ return now; }
+
+    void sleepMicros(uint32_t us){ runUntil(now + us); }
+
+    void schedule(uint64_t atMicros, std::function<void()> action){
+        events.push(Event{std::max(atMicros, now), nextSeq++, action});
+    }
+
+    // runs events due up to atMicros, leaving the clock there
+    void runUntil(uint64_t atMicros){
+        while (! events.empty() && events.top().atMicros <= atMicros){
+            Event nextEvent = events.top();
+            events.pop();
+            now = nextEvent.atMicros;
+            nextEvent.action();
+        }
+        now = std::max(now, atMicros);
+    }
+
+    uint64_t nextEventMicros(){
+        return events.empty() ? UINT64_MAX : events.top().atMicros;
+    }
+
+  private:
+    struct Event {
+        uint64_t atMicros;
+        uint64_t seq;       // keeps same-time events in scheduled order
+        std::function<void()> action;
+
+        bool operator>(const Event& other) const {
+            return atMicros != other.atMicros ? atMicros > other.atMicros :
+                    seq > other.seq;
+        }
+    };
+
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event> > events;
+    uint64_t now = 0;
+    uint64_t nextSeq = 0;
+};
+
+static VirtualClock simClock;
+
+// *****************************************************************************
+//    Radio Channel
+// *****************************************************************************
+
+struct RadioFrame {
+    uint8_t fromAddr;
+    uint8_t toAddr;
+    uint8_t seqId;
+    bool isAck;
+    std::string payload;
+    uint8_t airLen;         // payload length on air, may include padding
+    uint64_t startMicros;
+    uint64_t endMicros;
+    bool isCorrupt;
+};
+
+
+class RadioStation {
+  public:
+    virtual ~RadioStation(){}
+
+    // a frame addressed to this station arrived intact
+    virtual void onFrame(const RadioFrame& frame) = 0;
+
+    bool isTxDuring(const RadioFrame& frame){
+        return txStartMicros < frame.endMicros &&
+                txEndMicros > frame.startMicros;
+    }
+
+    uint64_t txStartMicros = 0;
+    uint64_t txEndMicros = 0;
+    int8_t rssi = -70;          // as received by the other end
+    uint8_t relayAddr = 0;      // if out of the gateway's range, its relay
+};
+
+
+class RadioChannel {
+    /*
+       A single shared channel, with every station in range of every other,
+       bar the gateway and nodes with a relay.
+   */
+  public:
+    // RF69 packet: preamble, sync words, length, RadioHead header, payload, CRC
+    static uint64_t airMicros(uint8_t payloadLen){
+        return (4 + 4 + 1 + 4 + payloadLen + 2) * 8 * 1000000ull /
+                simCfg.bitRate;
+    }
+
+    // starts sending a frame, returning when it will finish
+    uint64_t transmit(RadioStation* sender, const RadioFrame& frame){
+        std::shared_ptr<RadioFrame> txFrame(new RadioFrame(frame));
+        txFrame->startMicros = simClock.nowMicros();
+        txFrame->endMicros = txFrame->startMicros + airMicros(frame.airLen);
+        txFrame->isCorrupt = false;
+
+        for (size_t i = 0; i < inFlight.size(); i++){
+            inFlight[i]->isCorrupt = true;
+            txFrame->isCorrupt = true;
+        }
+        inFlight.push_back(txFrame);
+        sender->txStartMicros = txFrame->startMicros;
+        sender->txEndMicros = txFrame->endMicros;
+
+        if (frame.isAck)
+            simStats.ackFrames++;
+        else
+            simStats.dataFrames++;
+        simStats.airMicros += txFrame->endMicros - txFrame->startMicros;
+
+        simClock.schedule(txFrame->endMicros, [this, txFrame](){
+            finish(txFrame);
+        });
+        return txFrame->endMicros;
+    }
+
+    bool isBusy(){ return ! inFlight.empty(); }
+
+    std::map<uint8_t, RadioStation*> stations;
+
+  private:
+    void finish(std::shared_ptr<RadioFrame> txFrame){
+        inFlight.erase(std::find(inFlight.begin(), inFlight.end(), txFrame));
+
+        if (txFrame->toAddr == SIM_BROADCAST_ADDR){
+            // to each in range (only the gateway broadcasts), losses
+            // counted per receiver
+            for (std::map<uint8_t, RadioStation*>::iterator receiver =
+                    stations.begin(); receiver != stations.end(); receiver++)
+                if (receiver->first != txFrame->fromAddr &&
+                        ! isOutOfRange(txFrame->fromAddr, receiver->first))
+                    deliver(*txFrame, receiver->second);
+            return;
+        }
+
+        std::map<uint8_t, RadioStation*>::iterator receiver =
+                stations.find(txFrame->toAddr);
+        if (receiver == stations.end())
+            return;
+        if (isOutOfRange(txFrame->fromAddr, txFrame->toAddr))
+            simStats.outOfRange++;
+        else
+            deliver(*txFrame, receiver->second);
+    }
+
+    void deliver(const RadioFrame& frame, RadioStation* receiver){
+        if (frame.isCorrupt)
+            simStats.collided++;
+        else if (randUniform(0.0, 1.0) < simCfg.lossProb)
+            simStats.lost++;
+        else if (receiver->isTxDuring(frame))
+            simStats.missedTx++;
+        else
+            receiver->onFrame(frame);
+    }
+
+    bool isOutOfRange(uint8_t fromAddr, uint8_t toAddr){
+        uint8_t nodeAddr = (fromAddr == SIM_GATEWAY_ID) ? toAddr :
+                (toAddr == SIM_GATEWAY_ID) ? fromAddr : 0;
+        return nodeAddr != 0 && stations.count(nodeAddr) > 0 &&
+                stations[nodeAddr]->relayAddr != 0;
+    }
+
+    std::vector<std::shared_ptr<RadioFrame> > inFlight;
+};
+
+static RadioChannel radioChannel;
+
+// *****************************************************************************
+//    Gateway Radio
+// *****************************************************************************
+
+class SimGatewayRadio : public HostRadioLink, public RadioStation {
+    /*
+       The gateway's RF69 and RHReliableDatagram, on the simulated channel.
+   */
+  public:
+    void setAddress(uint8_t address){
+        radioChannel.stations.erase(thisAddr);
+        thisAddr = address;
+        radioChannel.stations[thisAddr] = this;
+    }
+
+    void setRetryTiming(uint16_t timeoutMs, uint8_t retries){
+        ackTimeoutMs = timeoutMs;
+        maxRetries = retries;
+    }
+
+    bool available(){ return isRxFrame; }
+
+    bool recv(uint8_t* msgBytes, uint8_t* msgLen, uint8_t* fromAddr,
+            int16_t* rssiVal){
+        if (! isRxFrame)
+            return false;
+        RadioFrame frame = rxFrame;
+        isRxFrame = false;
+
+        sendAck(frame);
+
+        // a retry after a lost ACK is ACKed again but not passed on
+        std::map<uint8_t, uint8_t>::iterator seenId =
+                seenIds.find(frame.fromAddr);
+        if (seenId != seenIds.end() && seenId->second == frame.seqId){
+            simStats.gwDuplicates++;
+            return false;
+        }
+        seenIds[frame.fromAddr] = frame.seqId;
+
+        size_t payloadLen = std::min(frame.payload.size(), (size_t)*msgLen);
+        memcpy(msgBytes, frame.payload.data(), payloadLen);
+        *msgLen = payloadLen;
+        *fromAddr = frame.fromAddr;
+        *rssiVal = radioChannel.stations[frame.fromAddr]->rssi;
+        return true;
+    }
+
+    bool send(const uint8_t* msgBytes, uint8_t msgLen, uint8_t toAddr){
+        RadioFrame frame = RadioFrame();
+        frame.fromAddr = thisAddr;
+        frame.toAddr = toAddr;
+        frame.seqId = ++lastSeqId;
+        frame.isAck = false;
+        frame.airLen = msgLen;
+        simStats.gwSends++;
+
+        // firmware chunks, binary and not ACKed
+        if (toAddr == SIM_BROADCAST_ADDR){
+            frame.payload.assign((const char*)msgBytes, msgLen);
+            simClock.runUntil(radioChannel.transmit(this, frame));
+            return true;
+        }
+        frame.payload.assign((const char*)msgBytes,
+                strnlen((const char*)msgBytes, msgLen));
+
+        isAwaitingAck = true;
+        isAckRecvd = false;
+        for (uint8_t i = 0; i <= maxRetries && ! isAckRecvd; i++){
+            if (i > 0){
+                simStats.gwRetransmits++;
+                retransmitCount++;
+            }
+            simClock.runUntil(radioChannel.transmit(this, frame));
+
+            // poll for the ACK, as sendtoWait()
+            uint64_t ackEndMicros = simClock.nowMicros() + (uint64_t)(
+                    randUniform(ackTimeoutMs, 2.0 * ackTimeoutMs) * 1000);
+            while (! isAckRecvd && simClock.nowMicros() < ackEndMicros)
+                simClock.runUntil(std::min(ackEndMicros,
+                        simClock.nowMicros() + 1000));
+        }
+        isAwaitingAck = false;
+
+        if (! isAckRecvd)
+            simStats.gwSendFails++;
+        return isAckRecvd;
+    }
+
+    void setFrequency(float centreMhz){
+        isOnChannel = fabsf(centreMhz - SIM_CHANNEL_MHZ) <=
+                SIM_CHANNEL_HALF_MHZ;
+    }
+
+    int16_t rssiNow(){
+        return (isOnChannel && radioChannel.isBusy()) ? -60 : -105;
+    }
+
+    uint32_t retransmissions(){ return retransmitCount; }
+
+    void onFrame(const RadioFrame& frame){
+        if (! isOnChannel)
+            simStats.gwOffChannelDrops++;
+        else if (frame.isAck){
+            if (isAwaitingAck && frame.seqId == lastSeqId)
+                isAckRecvd = true;
+        }
+        else if (isAwaitingAck)
+            simStats.gwBusyDrops++;
+        else if (isRxFrame)
+            simStats.gwRxOverruns++;    // radio idle until read
+        else {
+            rxFrame = frame;
+            isRxFrame = true;
+        }
+    }
+
+  private:
+    void sendAck(const RadioFrame& frame){
+        RadioFrame ackFrame = RadioFrame();
+        ackFrame.fromAddr = thisAddr;
+        ackFrame.toAddr = frame.fromAddr;
+        ackFrame.seqId = frame.seqId;
+        ackFrame.isAck = true;
+        ackFrame.airLen = 1;
+        simClock.runUntil(radioChannel.transmit(this, ackFrame));
+    }
+
+    uint8_t thisAddr = 0;
+    uint16_t ackTimeoutMs = 200;
+    uint8_t maxRetries = 3;
+    uint8_t lastSeqId = 0;
+    uint32_t retransmitCount = 0;
+    bool isAwaitingAck = false;
+    bool isAckRecvd = false;
+    bool isRxFrame = false;
+    bool isOnChannel = true;
+    RadioFrame rxFrame;
+    std::map<uint8_t, uint8_t> seenIds;
+};
+
+static SimGatewayRadio gatewayRadio;
+
+// *****************************************************************************
+//    Meter Nodes
+// *****************************************************************************
+
+static bool isNodeTrafficOn = true;
+
+
+class SimNode : public RadioStation {
+    /*
+       A virtual meter node.  Sends one message at a time, with ACK/retry,
+       and listens only while waiting for an ACK or reply - unless it is a
+       relay, which always listens, and forwards frames between its relayed
+       nodes and the gateway in its turn with its own.
+   */
+  public:
+    SimNode(uint8_t nodeId) : nodeId(nodeId){
+        driftPpm = randUniform(-simCfg.maxDriftPpm, simCfg.maxDriftPpm);
+        rssi = (int8_t)randUniform(-95, -45);
+        clockBaseSecs = SIM_EPOCH_SECS + randUniform(-30, 30);
+        meterValue = (uint32_t)randUniform(1000, 100000);
+        radioChannel.stations[nodeId] = this;
+    }
+
+    void start(){
+        // random phases, so nodes aren't in lock step
+        scheduleTimer(randUniform(0, simCfg.mupcSecs), &SimNode::onMeterTimer);
+        scheduleTimer(randUniform(0, simCfg.ginrSecs), &SimNode::onGinrTimer);
+        scheduleTimer(randUniform(0, simCfg.preqSecs), &SimNode::onPreqTimer);
+    }
+
+    void onFrame(const RadioFrame& frame){
+        if (frame.isAck){
+            if (nodeState == nodeAwaitAck && frame.seqId == curSeqId)
+                onSent();
+            return;
+        }
+        if (frame.toAddr == SIM_BROADCAST_ADDR){
+            onFwChunk(frame.payload);
+            return;
+        }
+        if (isRelay && onRelayFrame(frame))
+            return;
+        if (nodeState != nodeAwaitReply){
+            simStats.nodeAsleepDrops++;
+            return;
+        }
+
+        uint64_t ackEndMicros = sendAck(frame);
+
+        // a gateway retry after a lost ACK, keep waiting
+        if (frame.seqId == lastGatewaySeqId)
+            return;
+        lastGatewaySeqId = frame.seqId;
+
+        simStats.nodeReplies++;
+        onReply(frame.payload);
+        nodeState = nodeIdle;
+        waitToken++;
+        simClock.schedule(ackEndMicros, [this](){ sendNext(); });
+    }
+
+    bool isRelay = false;
+
+  private:
+    enum NodeState {nodeIdle, nodeAwaitAck, nodeAwaitReply};
+
+    struct OutMsg {
+        std::string payload;
+        bool isReplyWanted;
+        uint8_t toAddr;             // 0 for the gateway (or our relay)
+        uint8_t relayFrom;          // relaying up from this node, if not 0
+        uint64_t queuedMicros;
+    };
+
+    uint64_t sendAck(const RadioFrame& frame){
+        RadioFrame ackFrame = RadioFrame();
+        ackFrame.fromAddr = nodeId;
+        ackFrame.toAddr = frame.fromAddr;
+        ackFrame.seqId = frame.seqId;
+        ackFrame.isAck = true;
+        ackFrame.airLen = 1;
+        return radioChannel.transmit(this, ackFrame);
+    }
+
+    bool onRelayFrame(const RadioFrame& frame){
+        /*
+           A frame to forward: from a relayed node, to be wrapped for the
+           gateway, or from the gateway in an envelope, to be unwrapped for
+           the node.  False if for this node itself.
+        */
+        static const char RELAY_PREFIX[] = "RFWD,";
+        bool isFromGateway = (frame.fromAddr == SIM_GATEWAY_ID);
+        if (isFromGateway && frame.payload.compare(0, strlen(RELAY_PREFIX),
+                RELAY_PREFIX) != 0)
+            return false;
+
+        uint64_t ackEndMicros = sendAck(frame);
+        // a retry after a lost ACK
+        if (relaySeqIds.count(frame.fromAddr) > 0 &&
+                relaySeqIds[frame.fromAddr] == frame.seqId)
+            return true;
+        relaySeqIds[frame.fromAddr] = frame.seqId;
+
+        OutMsg relayMsg = OutMsg{"", false, 0, 0, simClock.nowMicros()};
+        if (isFromGateway){
+            size_t frameStart = frame.payload.find(';');
+            if (frameStart == std::string::npos)
+                return true;
+            relayMsg.payload = frame.payload.substr(frameStart + 1);
+            relayMsg.toAddr = atoi(frame.payload.c_str() +
+                    strlen(RELAY_PREFIX));
+            simStats.relayedDown++;
+        }
+        else {
+            relayMsg.payload = frame.payload;
+            relayMsg.relayFrom = frame.fromAddr;
+            simStats.relayedUp++;
+        }
+        outMsgs.push_back(relayMsg);
+        simClock.schedule(ackEndMicros, [this](){ sendNext(); });
+        return true;
+    }
+
+    uint32_t nodeTimeSecs(){
+        return (uint32_t)(clockBaseSecs + (simClock.nowMicros() -
+                clockBaseMicros) * (1.0 + driftPpm * 1e-6) / 1e6);
+    }
+
+    // schedules a timer of period secs by the node's (drifting) clock
+    void scheduleTimer(double periodSecs, void (SimNode::*onTimer)()){
+        uint64_t periodMicros = (uint64_t)(periodSecs * 1e6 /
+                (1.0 + driftPpm * 1e-6));
+        simClock.schedule(simClock.nowMicros() + periodMicros,
+                [this, onTimer](){
+                    if (isNodeTrafficOn)
+                        (this->*onTimer)();
+                });
+    }
+
+    void onMeterTimer(){
+        char payloadStr[61];
+        uint32_t intervalVal = (uint32_t)randUniform(1, 20);
+        meterValue += intervalVal;
+        snprintf(payloadStr, sizeof(payloadStr), "MUPC,%" PRIu32 ",%" PRIu32
+                ";15,%" PRIu32 ",%.1f;", nodeTimeSecs(), meterValue,
+                intervalVal, randUniform(0.5, 20.0));
+
+        std::string readingKey = std::to_string(nodeId) + "," + payloadStr;
+        simStats.readingSentMicros[readingKey] = simClock.nowMicros();
+        queueMsg(payloadStr, false);
+        scheduleTimer(simCfg.mupcSecs, &SimNode::onMeterTimer);
+    }
+
+    void onGinrTimer(){
+        char payloadStr[61];
+        snprintf(payloadStr, sizeof(payloadStr), "GINR,4300,%" PRIu32
+                ",%" PRIu32 ",880,%d,10,100,15,1000",
+                (uint32_t)(simClock.nowMicros() / 1000000),
+                (uint32_t)(simClock.nowMicros() / 1100000), lastGatewayRSSI);
+        queueMsg(payloadStr, true);
+        scheduleTimer(simCfg.ginrSecs, &SimNode::onGinrTimer);
+    }
+
+    void onPreqTimer(){
+        char payloadStr[61];
+        snprintf(payloadStr, sizeof(payloadStr), "PREQ,%" PRIu32,
+                nodeTimeSecs());
+        queueMsg(payloadStr, true);
+        scheduleTimer(simCfg.preqSecs, &SimNode::onPreqTimer);
+    }
+
+    void onReply(const std::string& payload){
+        uint32_t newValue = 0;
+        uint32_t nodeTime = 0;
+        uint32_t gatewayTime = 0;
+        int rssiVal = 0;
+
+        if (sscanf(payload.c_str(), "MVAI,%" SCNu32 ",%d", &newValue,
+                &rssiVal) == 2){
+            meterValue = newValue;
+            std::map<uint8_t, uint64_t>::iterator instrSent =
+                    simStats.instrSentMicros.find(nodeId);
+            if (instrSent != simStats.instrSentMicros.end()){
+                simStats.instrDeliveryTimes.push_back(simClock.nowMicros() -
+                        instrSent->second);
+                simStats.instrSentMicros.erase(instrSent);
+            }
+        }
+        else if (sscanf(payload.c_str(), "PRSP,%" SCNu32 ",%" SCNu32,
+                &nodeTime, &gatewayTime) == 2){
+            clockBaseSecs = gatewayTime;
+            clockBaseMicros = simClock.nowMicros();
+        }
+        else if (payload.compare(0, 5, "FWOF,") == 0)
+            onFwOffer(payload);
+
+        const char* rssiStr = strrchr(payload.c_str(), ',');
+        if (rssiStr)
+            lastGatewayRSSI = atoi(rssiStr + 1);
+    }
+
+    void onFwOffer(const std::string& payload){
+        /*
+           Starts listening for chunks, asking for them from the first one
+           not yet had - so an interrupted update resumes.
+        */
+        unsigned imageLen = 0;
+        unsigned imageCrc = 0;
+        unsigned chunkLen = 0;
+        unsigned windowChunks = 0;
+        if (sscanf(payload.c_str(), "FWOF,%u,%u,%u,%u", &imageLen, &imageCrc,
+                &chunkLen, &windowChunks) != 4 || chunkLen == 0 ||
+                windowChunks == 0)
+            return;
+        if (imageLen != fwImageLen || imageCrc != fwImageCrc ||
+                chunkLen != fwChunkLen){
+            fwImageLen = imageLen;
+            fwImageCrc = imageCrc;
+            fwChunkLen = chunkLen;
+            fwRecvd.assign(imageLen, '\0');
+            fwHave.assign((imageLen + chunkLen - 1) / chunkLen, false);
+            fwNext = 0;
+        }
+        fwWindowChunks = windowChunks;
+
+        if (simStats.fwStartMicros == 0)
+            simStats.fwStartMicros = simClock.nowMicros();
+        else
+            simStats.fwResumes++;
+        isFwListening = true;
+        fwQuietCount = 0;
+        queueMsg(("FWRQ," + std::to_string(fwNext)).c_str(), false);
+        scheduleFwQuiet();
+    }
+
+    void onFwChunk(const std::string& payload){
+        // FWCH<node_id><seq_hi><seq_lo><flags><data>
+        static const size_t FW_HEAD_LEN = 8;
+        if (! isFwListening || payload.size() < FW_HEAD_LEN ||
+                payload.compare(0, 4, "FWCH") != 0 ||
+                (uint8_t)payload[4] != nodeId)
+            return;
+        size_t chunkSeq = (uint8_t)payload[5] << 8 | (uint8_t)payload[6];
+        bool isLast = payload[7] & 1;
+        if (chunkSeq >= fwHave.size())
+            return;
+
+        simStats.fwChunksRecvd++;
+        if (fwHave[chunkSeq])
+            simStats.fwChunkDuplicates++;
+        else {
+            size_t chunkStart = chunkSeq * fwChunkLen;
+            size_t chunkLen = std::min((size_t)fwChunkLen,
+                    fwRecvd.size() - chunkStart);
+            fwRecvd.replace(chunkStart, chunkLen, payload, FW_HEAD_LEN,
+                    chunkLen);
+            fwHave[chunkSeq] = true;
+        }
+        while (fwNext < fwHave.size() && fwHave[fwNext])
+            fwNext++;
+        fwQuietCount = 0;
+
+        if (fwNext == fwHave.size()){
+            // whole image, check it and report
+            isFwListening = false;
+            simStats.fwEndMicros = simClock.nowMicros();
+            simStats.isFwCrcOk = (crc16(fwRecvd) == fwImageCrc &&
+                    fwRecvd == simFwImage);
+            queueMsg(simStats.isFwCrcOk ? "FWDN,1" : "FWDN,0", false);
+            return;
+        }
+        if (isLast)
+            sendFwAck();
+        scheduleFwQuiet();
+    }
+
+    void sendFwAck(){
+        // next chunk needed, and a bit per chunk after it had
+        uint32_t haveMask = 0;
+        for (size_t i = 1; i < fwWindowChunks && fwNext + i < fwHave.size();
+                i++)
+            if (fwHave[fwNext + i])
+                haveMask |= (1 << i);
+        simStats.fwAcks++;
+        queueMsg(("FWAK," + std::to_string(fwNext) + "," +
+                std::to_string(haveMask)).c_str(), false);
+    }
+
+    void scheduleFwQuiet(){
+        /*
+           If no chunk comes for a while, ACKs again in case the last was
+           lost, and gives up after a few (to resume at the next offer)
+        */
+        static const uint64_t FW_QUIET_MICROS = 3000000;
+        static const uint8_t FW_QUIET_MAX = 3;
+        uint32_t token = ++fwToken;
+        simClock.schedule(simClock.nowMicros() + FW_QUIET_MICROS,
+                [this, token](){
+            if (token != fwToken || ! isFwListening)
+                return;
+            if (++fwQuietCount > FW_QUIET_MAX){
+                isFwListening = false;
+                return;
+            }
+            sendFwAck();
+            scheduleFwQuiet();
+        });
+    }
+
+    void queueMsg(const char* payloadStr, bool isReplyWanted){
+        outMsgs.push_back(OutMsg{payloadStr, isReplyWanted, 0, 0,
+                simClock.nowMicros()});
+        simStats.nodeMsgs++;
+        sendNext();
+    }
+
+    void sendNext(){
+        if (nodeState != nodeIdle || outMsgs.empty())
+            return;
+        curMsg = outMsgs.front();
+        outMsgs.pop_front();
+        if (curMsg.relayFrom != 0)
+            curMsg.payload = "RFWD," + std::to_string(curMsg.relayFrom) +
+                    ",1," + std::to_string((simClock.nowMicros() -
+                    curMsg.queuedMicros) / 1000) + ";" + curMsg.payload;
+        curSeqId++;
+        curAttempt = 0;
+        transmitCur();
+    }
+
+    void transmitCur(){
+        RadioFrame frame = RadioFrame();
+        frame.fromAddr = nodeId;
+        frame.toAddr = curMsg.toAddr ? curMsg.toAddr : relayAddr ? relayAddr :
+                SIM_GATEWAY_ID;
+        frame.seqId = curSeqId;
+        frame.isAck = false;
+        frame.payload = curMsg.payload;
+        frame.airLen = curMsg.payload.size();
+
+        nodeState = nodeAwaitAck;
+        uint32_t token = ++waitToken;
+        uint64_t endMicros = radioChannel.transmit(this, frame) + (uint64_t)(
+                randUniform(simCfg.nodeAckTimeoutMs,
+                        2.0 * simCfg.nodeAckTimeoutMs) * 1000);
+        simClock.schedule(endMicros, [this, token](){
+            if (token == waitToken && nodeState == nodeAwaitAck)
+                onAckTimeout();
+        });
+    }
+
+    void onAckTimeout(){
+        if (curAttempt < simCfg.nodeRetries){
+            curAttempt++;
+            simStats.nodeRetries++;
+            transmitCur();
+            return;
+        }
+        if (curMsg.toAddr != 0 || curMsg.relayFrom != 0)
+            simStats.relayDropped++;
+        else
+            simStats.nodeSendFails++;
+        nodeState = nodeIdle;
+        sendNext();
+    }
+
+    void onSent(){
+        uint32_t token = ++waitToken;
+        if (! curMsg.isReplyWanted){
+            nodeState = nodeIdle;
+            sendNext();
+            return;
+        }
+        nodeState = nodeAwaitReply;
+        simClock.schedule(simClock.nowMicros() +
+                simCfg.nodeReplyWaitMs * 1000ull, [this, token](){
+            if (token == waitToken && nodeState == nodeAwaitReply){
+                simStats.nodeNoReplies++;
+                nodeState = nodeIdle;
+                sendNext();
+            }
+        });
+    }
+
+    uint8_t nodeId;
+    double driftPpm;
+    double clockBaseSecs;
+    uint64_t clockBaseMicros = 0;
+    uint32_t meterValue;
+    int lastGatewayRSSI = -70;
+
+    NodeState nodeState = nodeIdle;
+    std::deque<OutMsg> outMsgs;
+    OutMsg curMsg;
+    uint8_t curSeqId = 0;
+    uint8_t curAttempt = 0;
+    uint8_t lastGatewaySeqId = 0;
+    uint32_t waitToken = 0;     // invalidates timeouts of finished waits
+    std::map<uint8_t, uint8_t> relaySeqIds;
+
+    // firmware update, as offered (FWOF) and received so far
+    bool isFwListening = false;
+    unsigned fwImageLen = 0;
+    unsigned fwImageCrc = 0;
+    unsigned fwChunkLen = 0;
+    unsigned fwWindowChunks = 0;
+    std::string fwRecvd;
+    std::vector<bool> fwHave;
+    size_t fwNext = 0;          // first chunk not had
+    uint8_t fwQuietCount = 0;
+    uint32_t fwToken = 0;
+};
+
+// *****************************************************************************
+//    Server
+// *****************************************************************************
+
+class SimServer : public HostSerialLink {
+    /*
+       The server end of the serial port.  Output is paced at the baud rate
+       through a transmit buffer of the ATmega core's size, with the firmware
+       blocked while it is full.
+   */
+  public:
+    int readByte(){
+        if (inBytes.empty())
+            return -1;
+        int readVal = inBytes.front();
+        inBytes.pop_front();
+        return readVal;
+    }
+
+    int available(){ return inBytes.size(); }
+
+    void writeBytes(const uint8_t* outBytes, size_t outLen){
+        double byteMicros = 10e6 / simCfg.serialBaud;
+        drainTx(byteMicros);
+        if (txQueued + outLen > TX_BUFF_SIZE){
+            uint64_t blockMicros = (uint64_t)((txQueued + outLen -
+                    TX_BUFF_SIZE) * byteMicros);
+            simStats.serialBlockedMicros += blockMicros;
+            simClock.sleepMicros(blockMicros);
+            drainTx(byteMicros);
+        }
+        txQueued += outLen;
+        simStats.serialBytesOut += outLen;
+
+        for (size_t i = 0; i < outLen; i++){
+            if (outBytes[i] == '\n'){
+                // the line has reached the server once it's all sent
+                onLine(simClock.nowMicros() + (uint64_t)(txQueued *
+                        byteMicros));
+                lineStr.clear();
+            }
+            else if (outBytes[i] != '\r')
+                lineStr += (char)outBytes[i];
+        }
+    }
+
+    void sendLine(const std::string& inLine){
+        inBytes.insert(inBytes.end(), inLine.begin(), inLine.end());
+        inBytes.push_back('\r');
+    }
+
+    // queues a SMVAL for every node, sent one at a time as each is ACKed
+    void sendInstructions(){
+        for (uint16_t i = 0; i < simCfg.nodeCount; i++){
+            uint8_t nodeId = SIM_FIRST_NODE_ID + i;
+            instrs.push_back(nodeId);
+        }
+        sendNextInstr();
+    }
+
+    // starts the firmware update of the first node
+    void sendFirmware(){
+        sendLine("S>G:SFWST;" + std::to_string(SIM_FIRST_NODE_ID) + "," +
+                std::to_string(simFwImage.size()) + "," +
+                std::to_string(crc16(simFwImage)));
+    }
+
+    // requests a sweep of the channel +/- 500 kHz
+    void sendSweep(){
+        sendLine("S>G:SSWEEP;500,50,20");
+    }
+
+  private:
+    static const size_t TX_BUFF_SIZE = 64;
+    static const size_t FW_PART_LEN = 18;
+
+    static std::string toBase64(const std::string& bytes){
+        static const char B64_CHARS[] =
+                "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+                "0123456789+/";
+        std::string b64Str;
+        for (size_t i = 0; i < bytes.size(); i += 3){
+            uint32_t tripleVal = (uint8_t)bytes[i] << 16;
+            if (i + 1 < bytes.size())
+                tripleVal |= (uint8_t)bytes[i + 1] << 8;
+            if (i + 2 < bytes.size())
+                tripleVal |= (uint8_t)bytes[i + 2];
+            for (size_t j = 0; j < 4; j++)
+                b64Str += (i + j <= bytes.size()) ?
+                        B64_CHARS[(tripleVal >> (18 - 6 * j)) & 0x3F] : '=';
+        }
+        return b64Str;
+    }
+
+    // answers GFWCH;<node_id>,<first_part>,<part_count>
+    void sendFirmwareParts(const std::string& reqStr){
+        unsigned nodeId = 0;
+        unsigned firstPart = 0;
+        unsigned partCount = 0;
+        if (sscanf(reqStr.c_str(), "%u,%u,%u", &nodeId, &firstPart,
+                &partCount) != 3)
+            return;
+        for (unsigned i = firstPart; i < firstPart + partCount &&
+                i * FW_PART_LEN < simFwImage.size(); i++){
+            sendLine("S>G:SFWCH;" + std::to_string(i) + "," +
+                    toBase64(simFwImage.substr(i * FW_PART_LEN,
+                    FW_PART_LEN)));
+            simStats.fwPartsServed++;
+        }
+    }
+
+    void drainTx(double byteMicros){
+        uint64_t nowMicros = simClock.nowMicros();
+        txQueued = std::max(0.0, txQueued - (nowMicros - lastDrainMicros) /
+                byteMicros);
+        lastDrainMicros = nowMicros;
+    }
+
+    void sendNextInstr(){
+        if (isInstrAwaitingAck || instrs.empty())
+            return;
+        uint8_t nodeId = instrs.front();
+        instrs.pop_front();
+        sendLine("S>G:SMVAL," + std::to_string(nodeId) + "," +
+                std::to_string(500000 + nodeId));
+        simStats.instrSentMicros[nodeId] = simClock.nowMicros();
+        simStats.instrSent++;
+        isInstrAwaitingAck = true;
+    }
+
+    void onLine(uint64_t lineMicros){
+        static const std::string MSG_PREFIX = "G>S:";
+        // skip the channel id if framing is on
+        size_t msgPos = lineStr.find(MSG_PREFIX);
+        if (msgPos == std::string::npos || msgPos > 2)
+            return;
+        std::string msgStr = lineStr.substr(msgPos + MSG_PREFIX.size());
+
+        if (msgStr.compare(0, 5, "MUPC;") == 0 ||
+                msgStr.compare(0, 5, "MUP_;") == 0){
+            std::string readingKey = msgStr.substr(5);
+            std::map<std::string, uint64_t>::iterator readingSent =
+                    simStats.readingSentMicros.find(readingKey);
+            if (readingSent == simStats.readingSentMicros.end())
+                return;
+            if (simStats.readingIsDelivered[readingKey])
+                simStats.readingDuplicates++;
+            else {
+                simStats.readingIsDelivered[readingKey] = true;
+                simStats.readingLatencies.push_back(lineMicros -
+                        readingSent->second);
+            }
+        }
+        else if (msgStr.compare(0, 5, "GTIME") == 0){
+            // with ms and the request id echoed if the gateway sent one
+            uint64_t nowMillis = simClock.nowMicros() / 1000;
+            std::string timeStr = std::to_string(SIM_EPOCH_SECS +
+                    nowMillis / 1000);
+            if (msgStr.compare(0, 6, "GTIME;") == 0)
+                timeStr += "," + std::to_string(nowMillis % 1000) + "," +
+                        msgStr.substr(6);
+            sendLine("S>G:STIME," + timeStr);
+        }
+        else if (msgStr.compare(0, 10, "STIME_ACK;") == 0){
+            // request id, round trip ms
+            size_t rttPos = msgStr.find(',');
+            simStats.timeSyncs++;
+            if (rttPos != std::string::npos)
+                simStats.lastTimeRTTMs = atoi(msgStr.c_str() + rttPos + 1);
+        }
+        else if (msgStr.compare(0, 10, "SMVAL_ACK;") == 0){
+            simStats.instrAcked++;
+            isInstrAwaitingAck = false;
+            sendNextInstr();
+        }
+        else if (msgStr.compare(0, 11, "SMVAL_NACK;") == 0){
+            simStats.instrNacked++;
+            simStats.instrSentMicros.erase(atoi(msgStr.c_str() + 11));
+            isInstrAwaitingAck = false;
+            sendNextInstr();
+        }
+        else if (msgStr.compare(0, 7, "GSTATS;") == 0)
+            simStats.lastGwStats = msgStr.substr(7);
+        else if (msgStr.compare(0, 6, "GFWCH;") == 0)
+            sendFirmwareParts(msgStr.substr(6));
+        else if (msgStr.compare(0, 11, "SFWCH_NACK;") == 0)
+            simStats.fwPartNacks++;
+        else if (msgStr.compare(0, 11, "SSWEEP_ACK;") == 0)
+            simStats.sweepStartMicros = lineMicros;
+        else if (msgStr.compare(0, 6, "SWEEP;") == 0){
+            // <freq_khz>,<min_dbm>,<max_dbm>,<counts>
+            int freqKhz = 0;
+            int minDbm = 0;
+            int maxDbm = 0;
+            if (sscanf(msgStr.c_str() + 6, "%d,%d,%d", &freqKhz, &minDbm,
+                    &maxDbm) != 3)
+                return;
+            simStats.sweepSteps++;
+            if (maxDbm > -100)
+                simStats.sweepBusySteps++;
+        }
+        else if (msgStr.compare(0, 7, "SWEEPD;") == 0)
+            simStats.sweepEndMicros = lineMicros;
+        else if (msgStr.compare(0, 7, "FWSTAT;") == 0 ||
+                msgStr.compare(0, 11, "SFWST_NACK;") == 0)
+            simStats.fwLastStatus = msgStr;
+    }
+
+    std::deque<uint8_t> inBytes;
+    std::string lineStr;
+    double txQueued = 0.0;
+    uint64_t lastDrainMicros = 0;
+    std::deque<uint8_t> instrs;
+    bool isInstrAwaitingAck = false;
+};
+
+static SimServer simServer;
+
+// *****************************************************************************
+//    Main
+// *****************************************************************************
+
+static void runGateway(uint64_t untilMicros){
+    bool wasWatchdogOk = true;
+
+    while (simClock.nowMicros() < untilMicros){
+        loop();
+
+        // a real gateway would reset here, count it and carry on
+        bool isWatchdogOk = hostWatchdogOk();
+        if (! isWatchdogOk && wasWatchdogOk)
+            simStats.watchdogExpiries++;
+        wasWatchdogOk = isWatchdogOk;
+
+        simClock.sleepMicros(simCfg.loopMicros);
+
+        // nothing to do until the next event, skip to it
+        if (simServer.available() == 0 && ! gatewayRadio.available())
+            simClock.runUntil(std::min(untilMicros, std::min(
+                    simClock.nextEventMicros(),
+                    simClock.nowMicros() + SIM_IDLE_STEP_MICROS)));
+    }
+}
+
+
+static uint64_t percentile(std::vector<uint64_t>& vals, double pctVal){
+    if (vals.empty())
+        return 0;
+    std::sort(vals.begin(), vals.end());
+    return vals[(size_t)(pctVal / 100.0 * (vals.size() - 1) + 0.5)];
+}
+
+
+static void printReport(){
+    size_t readingCount = simStats.readingSentMicros.size();
+    size_t deliveredCount = simStats.readingLatencies.size();
+    std::vector<uint64_t>& latencies = simStats.readingLatencies;
+    std::vector<uint64_t>& instrTimes = simStats.instrDeliveryTimes;
+
+    printf("netsim: %u nodes, %" PRIu32 " s, %" PRIu32 " bps, loss %.1f%%, "
+            "drift +/-%.0f ppm, seed %" PRIu32 "\n", simCfg.nodeCount,
+            simCfg.runSecs, simCfg.bitRate, simCfg.lossProb * 100,
+            simCfg.maxDriftPpm, simCfg.seed);
+
+    printf("\nreadings:        sent %zu, delivered %zu (%.1f%%), "
+            "duplicates %" PRIu32 "\n", readingCount, deliveredCount,
+            readingCount ? 100.0 * deliveredCount / readingCount : 0.0,
+            simStats.readingDuplicates);
+    printf("latency (ms):    p50 %.1f, p90 %.1f, p99 %.1f, max %.1f\n",
+            percentile(latencies, 50) / 1e3, percentile(latencies, 90) / 1e3,
+            percentile(latencies, 99) / 1e3, percentile(latencies, 100) / 1e3);
+
+    printf("\ninstructions:    sent %" PRIu32 ", ACKed %" PRIu32 ", NACKed %"
+            PRIu32 ", delivered %zu, undelivered %zu\n", simStats.instrSent,
+            simStats.instrAcked, simStats.instrNacked, instrTimes.size(),
+            simStats.instrSentMicros.size());
+    printf("delivery (s):    p50 %.1f, p90 %.1f, max %.1f\n",
+            percentile(instrTimes, 50) / 1e6, percentile(instrTimes, 90) / 1e6,
+            percentile(instrTimes, 100) / 1e6);
+
+    if (simCfg.fwBytes > 0){
+        double fwSecs = (simStats.fwEndMicros - simStats.fwStartMicros) / 1e6;
+        printf("\nfirmware:        %zu bytes, %s in %.1f s (%.0f bps, %.0f%% "
+                "of bit rate), CRC %s, resumes %" PRIu32 "\n",
+                simFwImage.size(), simStats.fwEndMicros ? "received" :
+                "not received", fwSecs, simStats.fwEndMicros ?
+                simFwImage.size() * 8 / fwSecs : 0.0, simStats.fwEndMicros ?
+                100.0 * simFwImage.size() * 8 / fwSecs / simCfg.bitRate : 0.0,
+                simStats.isFwCrcOk ? "good" : "bad", simStats.fwResumes);
+        printf("firmware chunks: received %" PRIu32 ", duplicates %" PRIu32
+                ", ACKs %" PRIu32 ", parts served %" PRIu32 ", NACKed %"
+                PRIu32 ", last %s\n", simStats.fwChunksRecvd,
+                simStats.fwChunkDuplicates, simStats.fwAcks,
+                simStats.fwPartsServed, simStats.fwPartNacks,
+                simStats.fwLastStatus.c_str());
+    }
+
+    if (simCfg.sweepSecs > 0)
+        printf("\nsweep:           %" PRIu32 " steps, %" PRIu32 " with "
+                "signal, %s in %.1f ms, frames missed off channel %" PRIu32
+                "\n", simStats.sweepSteps, simStats.sweepBusySteps,
+                simStats.sweepEndMicros ? "done" : "not done",
+                simStats.sweepEndMicros ? (simStats.sweepEndMicros -
+                simStats.sweepStartMicros) / 1e3 : 0.0,
+                simStats.gwOffChannelDrops);
+
+    printf("\nnode messages:   sent %" PRIu32 ", retries %" PRIu32 ", failed %"
+            PRIu32 ", replies %" PRIu32 ", no reply %" PRIu32 ", missed "
+            "asleep %" PRIu32 "\n", simStats.nodeMsgs, simStats.nodeRetries,
+            simStats.nodeSendFails, simStats.nodeReplies,
+            simStats.nodeNoReplies, simStats.nodeAsleepDrops);
+    printf("radio frames:    data %" PRIu32 ", ACK %" PRIu32 ", collided %"
+            PRIu32 ", lost %" PRIu32 ", missed tx %" PRIu32 ", channel "
+            "busy %.1f%%\n", simStats.dataFrames, simStats.ackFrames,
+            simStats.collided, simStats.lost, simStats.missedTx,
+            100.0 * simStats.airMicros / simClock.nowMicros());
+    if (simCfg.relayEvery > 0)
+        printf("relays:          frames up %" PRIu32 ", down %" PRIu32
+                ", dropped %" PRIu32 ", out of range %" PRIu32 "\n",
+                simStats.relayedUp, simStats.relayedDown,
+                simStats.relayDropped, simStats.outOfRange);
+    printf("gateway radio:   sends %" PRIu32 ", failed %" PRIu32
+            ", retransmits %" PRIu32 ", rx overruns %" PRIu32 ", dropped "
+            "while sending %" PRIu32 ", duplicates %" PRIu32 "\n",
+            simStats.gwSends, simStats.gwSendFails, simStats.gwRetransmits,
+            simStats.gwRxOverruns, simStats.gwBusyDrops,
+            simStats.gwDuplicates);
+    printf("gateway serial:  %" PRIu64 " bytes out, blocked %.1f s, "
+            "watchdog expiries %" PRIu32 "\n", simStats.serialBytesOut,
+            simStats.serialBlockedMicros / 1e6, simStats.watchdogExpiries);
+    printf("gateway time:    %" PRIu32 " syncs, last round trip %d ms\n",
+            simStats.timeSyncs, simStats.lastTimeRTTMs);
+    printf("gateway GSTATS:  %s\n", simStats.lastGwStats.c_str());
+}
+
+
+static void usage(){
+    fprintf(stderr, "usage: netsim [--nodes n] [--secs secs] [--bitrate bps] "
+            "[--loss prob]\n"
+            "        [--drift-ppm ppm] [--mupc-secs secs] [--ginr-secs secs] "
+            "[--preq-secs secs]\n"
+            "        [--instr-secs secs] [--loop-us us] [--relay-every n]\n"
+            "        [--fw-bytes n] [--fw-secs secs] [--sweep-secs secs]\n"
+            "        [--log-level level] [--seed n]\n");
+    exit(1);
+}
+
+
+int main(int argc, char** argv){
+    for (int i = 1; i < argc; i++){
+        if (i + 1 >= argc)
+            usage();
+        const char* argName = argv[i];
+        const char* argVal = argv[++i];
+        if (strcmp(argName, "--nodes") == 0)
+            simCfg.nodeCount = atoi(argVal);
+        else if (strcmp(argName, "--secs") == 0)
+            simCfg.runSecs = atol(argVal);
+        else if (strcmp(argName, "--bitrate") == 0)
+            simCfg.bitRate = atol(argVal);
+        else if (strcmp(argName, "--loss") == 0)
+            simCfg.lossProb = atof(argVal);
+        else if (strcmp(argName, "--drift-ppm") == 0)
+            simCfg.maxDriftPpm = atof(argVal);
+        else if (strcmp(argName, "--mupc-secs") == 0)
+            simCfg.mupcSecs = atol(argVal);
+        else if (strcmp(argName, "--ginr-secs") == 0)
+            simCfg.ginrSecs = atol(argVal);
+        else if (strcmp(argName, "--preq-secs") == 0)
+            simCfg.preqSecs = atol(argVal);
+        else if (strcmp(argName, "--instr-secs") == 0)
+            simCfg.instrSecs = atol(argVal);
+        else if (strcmp(argName, "--loop-us") == 0)
+            simCfg.loopMicros = atol(argVal);
+        else if (strcmp(argName, "--relay-every") == 0)
+            simCfg.relayEvery = atoi(argVal);
+        else if (strcmp(argName, "--fw-bytes") == 0)
+            simCfg.fwBytes = atol(argVal);
+        else if (strcmp(argName, "--fw-secs") == 0)
+            simCfg.fwSecs = atol(argVal);
+        else if (strcmp(argName, "--sweep-secs") == 0)
+            simCfg.sweepSecs = atol(argVal);
+        else if (strcmp(argName, "--log-level") == 0)
+            simCfg.logLevel = argVal;
+        else if (strcmp(argName, "--seed") == 0)
+            simCfg.seed = atol(argVal);
+        else
+            usage();
+    }
+    if (simCfg.nodeCount < 1 || simCfg.nodeCount > 250 ||
+            simCfg.bitRate == 0 || simCfg.runSecs == 0 ||
+            simCfg.mupcSecs == 0 || simCfg.ginrSecs == 0 ||
+            simCfg.preqSecs == 0 || simCfg.fwBytes > UINT16_MAX)
+        usage();
+    simRand.seed(simCfg.seed);
+    for (uint32_t i = 0; i < simCfg.fwBytes; i++)
+        simFwImage += (char)(simRand() & 0xFF);
+
+    hostSetClock(&simClock);
+    hostSetSerialLink(&simServer);
+    hostSetRadioLink(&gatewayRadio);
+
+    std::vector<std::unique_ptr<SimNode> > nodes;
+    for (uint16_t i = 0; i < simCfg.nodeCount; i++){
+        nodes.push_back(std::unique_ptr<SimNode>(
+                new SimNode(SIM_FIRST_NODE_ID + i)));
+        if (simCfg.relayEvery > 1 && i % simCfg.relayEvery ==
+                simCfg.relayEvery - 1u){
+            nodes.back()->relayAddr = SIM_FIRST_NODE_ID + i - 1;
+            nodes[i - 1]->isRelay = true;
+        }
+        nodes.back()->start();
+    }
+    simClock.schedule(simCfg.instrSecs * 1000000ull, [](){
+        simServer.sendInstructions();
+    });
+    if (simCfg.fwBytes > 0)
+        simClock.schedule(simCfg.fwSecs * 1000000ull, [](){
+            simServer.sendFirmware();
+        });
+    if (simCfg.sweepSecs > 0)
+        simClock.schedule(simCfg.sweepSecs * 1000000ull, [](){
+            simServer.sendSweep();
+        });
+
+    simServer.sendLine(std::string("logl=") + simCfg.logLevel);
+    if (simCfg.relayEvery > 1)
+        simServer.sendLine("rlay=1");
+    setup();
+    runGateway(simCfg.runSecs * 1000000ull);
+
+    // let messages in progress finish, then collect the gateway's counters
+    isNodeTrafficOn = false;
+    simServer.sendLine("S>G:GGSTATS");
+    runGateway((simCfg.runSecs + SIM_DRAIN_SECS) * 1000000ull);
+
+    printReport();
+    return 0;
+}
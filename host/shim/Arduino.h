@@ -0,0 +1,119 @@
+/*
+    Host build shim for the Arduino core, covering what metergateway.cpp uses.
+
+    PROGMEM data is ordinary RAM on the host, so the *_P functions map to their
+    RAM equivalents.  Time, serial and (in RH_RF69.h) radio are provided through
+    the links in hostlinks.h.  MCU registers are plain variables.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// Program memory
+#define PROGMEM
+#define PSTR(s) (s)
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+
+#define strcpy_P strcpy
+#define strcat_P strcat
+#define strlen_P strlen
+#define strncasecmp_P strncasecmp
+#define strncmp_P strncmp
+#define sprintf_P sprintf
+#define memcpy_P memcpy
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(addr))
+#define pgm_read_dword(addr) (*(addr))
+
+// Pins and constants
+#define HEX 16
+#define DEC 10
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+enum {A0 = 14, A1, A2, A3, A4, A5};
+
+// binary constants (binary.h), as used by the firmware
+#define B00000000 0
+#define B00010000 16
+#define B01000000 64
+#define B11101111 239
+
+// MCU registers and bits
+extern volatile uint8_t MCUSR;
+extern volatile uint8_t PORTD;
+extern volatile uint8_t PIND;
+extern volatile uint8_t TCCR1A;
+extern volatile uint8_t TCCR1B;
+extern volatile uint16_t TCNT1;
+extern volatile uint8_t TIMSK0;
+extern volatile uint8_t TIMSK1;
+extern volatile uint8_t TIFR1;
+
+#define PORF 0
+#define EXTRF 1
+#define BORF 2
+#define WDRF 3
+#define CS10 0
+#define TOIE1 0
+#define TOV1 0
+
+// interrupt handlers are plain functions, never called
+#define ISR(vector) void vector()
+
+// Time (see HostClock)
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+// Digital IO, outputs are discarded and inputs read high
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+inline void noInterrupts(){}
+inline void interrupts(){}
+inline void cli(){}
+inline void sei(){}
+
+// Serial (see HostSerialLink)
+class HardwareSerial {
+  public:
+    void begin(uint32_t baud);
+    void end(){}
+    int available();
+    int read();
+    void flush();
+
+    size_t write(uint8_t outByte);
+    size_t write(const uint8_t* outBytes, size_t outLen);
+    size_t write(const char* outStr);
+    size_t write(const char* outStr, size_t outLen){
+        return write((const uint8_t*)outStr, outLen);
+    }
+
+    size_t print(const __FlashStringHelper* outStr);
+    size_t print(const char* outStr);
+    size_t print(unsigned long outVal, int base = DEC);
+
+    operator bool(){ return true; }
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,42 @@
+/*
+    Host build shim for the Arduino EEPROM library.  Contents start erased
+    (0xFF), and persist to a file if one is set with hostSetEEPROMFile().
+ */
+
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+#include <stdint.h>
+#include <string.h>
+
+static const uint16_t HOST_EEPROM_SIZE = 1024;    // as 328P
+
+class EEPROMClass {
+  public:
+    EEPROMClass(){ memset(mem, 0xFF, sizeof(mem)); }
+
+    uint8_t read(int addr){ return mem[addr]; }
+    void write(int addr, uint8_t val){ mem[addr] = val; save(); }
+    void update(int addr, uint8_t val){ write(addr, val); }
+    uint16_t length(){ return HOST_EEPROM_SIZE; }
+
+    template <typename T> T& get(int addr, T& val){
+        memcpy(&val, mem + addr, sizeof(T));
+        return val;
+    }
+
+    template <typename T> const T& put(int addr, const T& val){
+        memcpy(mem + addr, &val, sizeof(T));
+        save();
+        return val;
+    }
+
+    uint8_t mem[HOST_EEPROM_SIZE];
+
+  private:
+    void save();
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,81 @@
+/*
+    Host build shim for the RadioHead reliable datagram manager, passing
+    traffic to/from the current HostRadioLink.
+ */
+
+#ifndef HOST_RH_RELIABLE_DATAGRAM_H
+#define HOST_RH_RELIABLE_DATAGRAM_H
+
+#include <stdint.h>
+#include "RH_RF69.h"
+#include "../hostlinks.h"
+
+class RHReliableDatagram {
+  public:
+    RHReliableDatagram(RH_RF69& driver, uint8_t thisAddress) :
+            driver(driver), thisAddress(thisAddress){}
+
+    bool init(){
+        hostRadioLink()->setAddress(thisAddress);
+        return driver.init();
+    }
+    void setThisAddress(uint8_t thisAddress){
+        this->thisAddress = thisAddress;
+        hostRadioLink()->setAddress(thisAddress);
+    }
+    void setTimeout(uint16_t timeout){
+        this->timeout = timeout;
+        hostRadioLink()->setRetryTiming(timeout, retries);
+    }
+    void setRetries(uint8_t retries){
+        this->retries = retries;
+        hostRadioLink()->setRetryTiming(timeout, retries);
+    }
+
+    bool available(){ return hostRadioLink()->available(); }
+
+    bool recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* from = NULL,
+            uint8_t* to = NULL, uint8_t* id = NULL, uint8_t* flags = NULL){
+        uint8_t fromAddr = 0;
+        int16_t rssi = 0;
+        if (! hostRadioLink()->recv(buf, len, &fromAddr, &rssi))
+            return false;
+        driver.lastRssiVal = rssi;
+        if (from)
+            *from = fromAddr;
+        if (to)
+            *to = thisAddress;
+        if (id)
+            *id = 0;
+        if (flags)
+            *flags = 0;
+        return true;
+    }
+
+    bool recvfromAckTimeout(uint8_t* buf, uint8_t* len, uint16_t timeout,
+            uint8_t* from = NULL, uint8_t* to = NULL, uint8_t* id = NULL,
+            uint8_t* flags = NULL){
+        uint64_t endMicros = hostClock()->nowMicros() + timeout * 1000ull;
+        while (! available()){
+            if (hostClock()->nowMicros() >= endMicros)
+                return false;
+            hostClock()->sleepMicros(1000);
+        }
+        return recvfromAck(buf, len, from, to, id, flags);
+    }
+
+    bool sendtoWait(uint8_t* buf, uint8_t len, uint8_t address){
+        return hostRadioLink()->send(buf, len, address);
+    }
+
+    uint32_t retransmissions(){
+        return hostRadioLink()->retransmissions();
+    }
+
+    RH_RF69& driver;
+    uint8_t thisAddress;
+    uint16_t timeout = 200;
+    uint8_t retries = 3;
+};
+
+#endif
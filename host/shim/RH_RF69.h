@@ -0,0 +1,81 @@
+/*
+    Host build shim for the RadioHead RF69 driver.  Configuration is accepted
+    and kept but has no effect; traffic goes through the HostRadioLink (see
+    RHReliableDatagram.h).
+ */
+
+#ifndef HOST_RH_RF69_H
+#define HOST_RH_RF69_H
+
+#include <stdint.h>
+#include "../hostlinks.h"
+
+#define RH_RF69_MAX_MESSAGE_LEN 60
+
+// as RadioHead.h, sent to all stations and not ACKed
+#define RH_BROADCAST_ADDRESS 0xff
+
+class RH_RF69 {
+  public:
+    typedef enum {
+        FSK_Rb2Fd5 = 0,
+        FSK_Rb2_4Fd4_8,
+        FSK_Rb4_8Fd9_6,
+        FSK_Rb9_6Fd19_2,
+        FSK_Rb19_2Fd38_4,
+        FSK_Rb38_4Fd76_8,
+        FSK_Rb57_6Fd120,
+        FSK_Rb125Fd125,
+        FSK_Rb250Fd250,
+        FSK_Rb55555Fd50,
+        GFSK_Rb2Fd5,
+        GFSK_Rb2_4Fd4_8,
+        GFSK_Rb4_8Fd9_6,
+        GFSK_Rb9_6Fd19_2,
+        GFSK_Rb19_2Fd38_4,
+        GFSK_Rb38_4Fd76_8,
+        GFSK_Rb57_6Fd120,
+        GFSK_Rb125Fd125,
+        GFSK_Rb250Fd250,
+        GFSK_Rb55555Fd50
+    } ModemConfigChoice;
+
+    RH_RF69(uint8_t slaveSelectPin, uint8_t interruptPin){
+        (void)slaveSelectPin;
+        (void)interruptPin;
+    }
+
+    bool init(){ return true; }
+    bool setModemConfig(ModemConfigChoice modemConfig){
+        this->modemConfig = modemConfig;
+        return true;
+    }
+    bool setFrequency(float centre, float afcPullInRange = 0.05){
+        (void)afcPullInRange;
+        frequency = centre;
+        hostRadioLink()->setFrequency(centre);
+        return true;
+    }
+    void setTxPower(int8_t power, bool isHighPowerModule = true){
+        (void)isHighPowerModule;
+        txPower = power;
+    }
+    void setSyncWords(const uint8_t* syncWords = NULL, uint8_t len = 0){
+        (void)syncWords;
+        (void)len;
+    }
+    void setEncryptionKey(uint8_t* key = NULL){ (void)key; }
+    void setModeIdle(){}
+    void setModeRx(){}
+
+    int16_t lastRssi(){ return lastRssiVal; }
+    int16_t rssiRead(){ return hostRadioLink()->rssiNow(); }
+
+    // as last set, for host/simulator use
+    ModemConfigChoice modemConfig = FSK_Rb4_8Fd9_6;
+    float frequency = 0.0;
+    int8_t txPower = 0;
+    int16_t lastRssiVal = 0;
+};
+
+#endif
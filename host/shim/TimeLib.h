@@ -0,0 +1,22 @@
+/*
+    Host build shim for the Time library, covering what metergateway.cpp uses.
+ */
+
+#ifndef HOST_TIMELIB_H
+#define HOST_TIMELIB_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint8_t Second;
+    uint8_t Minute;
+    uint8_t Hour;
+    uint8_t Wday;       // day of week, sunday is day 1
+    uint8_t Day;
+    uint8_t Month;
+    uint8_t Year;       // offset from 1970
+} tmElements_t;
+
+void breakTime(uint32_t timeSecs, tmElements_t& timeTME);
+
+#endif
@@ -0,0 +1,170 @@
+#!/usr/bin/python3
+# Decodes gateway serial output containing tokenised log lines (LOGT=1),
+# expanding each back to the text it would have been written as.  Strings are
+# looked up by flash address in the firmware image that produced the output, so
+# use the .hex that is flashed to the gateway.  Other lines pass through as-is.
+#
+# Usage:
+#   logdecode.py firmware.hex [capture_file]     (reads stdin if no file)
+#   logdecode.py firmware.hex --port /dev/serial0 [--baud 115200]
+#   logdecode.py firmware.hex --table            (list flash strings)
+#
+# See 'Runtime Logging' in metergateway.cpp for the token line format.
+
+import argparse
+import sys
+
+LOG_TOKEN_START = 0x1F
+LOG_LEVEL_LBLS = {1: 'ERROR', 2: 'WARN', 3: 'INFO', 4: 'DEBUG'}
+
+TOK_FLASH_STR = 0
+TOK_STR = 1
+TOK_UINT = 2
+TOK_INT = 3
+TOK_FIXED2 = 4
+
+
+def read_hex(hex_path):
+    # Intel HEX to flash image
+    flash = bytearray()
+    base_addr = 0
+    with open(hex_path) as hex_file:
+        for rec in hex_file:
+            rec = rec.strip()
+            if not rec.startswith(':'):
+                continue
+            rec_bytes = bytes.fromhex(rec[1:])
+            rec_len, rec_type = rec_bytes[0], rec_bytes[3]
+            rec_addr = (rec_bytes[1] << 8) | rec_bytes[2]
+            rec_data = rec_bytes[4:4 + rec_len]
+            if rec_type == 0x00:
+                addr = base_addr + rec_addr
+                if len(flash) < addr + rec_len:
+                    flash.extend(b'\xff' * (addr + rec_len - len(flash)))
+                flash[addr:addr + rec_len] = rec_data
+            elif rec_type == 0x01:
+                break
+            elif rec_type == 0x02:
+                base_addr = int.from_bytes(rec_data, 'big') << 4
+            elif rec_type == 0x04:
+                base_addr = int.from_bytes(rec_data, 'big') << 16
+    return flash
+
+
+def flash_str(flash, addr):
+    end = flash.find(b'\x00', addr)
+    if addr >= len(flash) or end < 0:
+        return '<?0x%04x>' % addr
+    return flash[addr:end].decode('ascii', 'replace')
+
+
+def flash_table(flash, min_len=2):
+    # printable NUL-terminated strings, as candidates for F() strings
+    table = []
+    start = 0
+    for i, b in enumerate(flash):
+        if b == 0:
+            if i - start >= min_len:
+                table.append((start, flash[start:i].decode('ascii')))
+            start = i + 1
+        elif b < 32 or b > 126:
+            start = i + 1
+    return table
+
+
+def read_tok_val(line, pos):
+    val = 0
+    shift = 0
+    while True:
+        tok_byte = line[pos]
+        pos += 1
+        val |= (tok_byte & 0x3F) << shift
+        shift += 6
+        if not tok_byte & 0x40:
+            return val, pos
+
+
+def unzigzag(val):
+    return (val >> 1) ^ -(val & 1)
+
+
+def decode_token_line(flash, line):
+    # line excludes LOG_TOKEN_START and line end
+    text = []
+    log_level = 0
+    pos = 0
+    try:
+        while pos < len(line):
+            header = line[pos]
+            pos += 1
+            tok_kind = (header >> 3) & 0x0F
+            if not log_level:
+                log_level = header & 0x07
+            tok_val, pos = read_tok_val(line, pos)
+            if tok_kind == TOK_FLASH_STR:
+                text.append(flash_str(flash, tok_val))
+            elif tok_kind == TOK_STR:
+                text.append(bytes(b & 0x7F for b in line[pos:pos + tok_val])
+                            .decode('ascii', 'replace'))
+                pos += tok_val
+            elif tok_kind == TOK_UINT:
+                text.append(str(tok_val))
+            elif tok_kind == TOK_INT:
+                text.append(str(unzigzag(tok_val)))
+            elif tok_kind == TOK_FIXED2:
+                fixed_val = unzigzag(tok_val)
+                text.append('%s%d.%02d' % ('-' if fixed_val < 0 else '',
+                            abs(fixed_val) // 100, abs(fixed_val) % 100))
+            else:
+                text.append('<?tok %d>' % tok_kind)
+    except IndexError:
+        text.append('<truncated>')
+    return '%s: %s' % (LOG_LEVEL_LBLS.get(log_level, '?'), ''.join(text))
+
+
+def decode_line(flash, line):
+    line = line.rstrip(b'\r\n')
+    # keep any channel framing prefix (e.g. '2|'), see SerChan
+    frame_prefix = b''
+    if len(line) >= 2 and line[1:2] == b'|' and line[0:1].isdigit():
+        frame_prefix, line = line[:2], line[2:]
+    if line[:1] == bytes([LOG_TOKEN_START]):
+        text = decode_token_line(flash, line[1:])
+    else:
+        text = line.decode('ascii', 'replace')
+    return frame_prefix.decode('ascii') + text
+
+
+def main():
+    parser = argparse.ArgumentParser(
+            description='Decode tokenised gateway log output')
+    parser.add_argument('hex_file', help='firmware image (Intel HEX)')
+    parser.add_argument('capture_file', nargs='?',
+                        help='captured serial output, stdin if omitted')
+    parser.add_argument('--port', help='serial port to read from')
+    parser.add_argument('--baud', type=int, default=115200)
+    parser.add_argument('--table', action='store_true',
+                        help='print flash string table and exit')
+    args = parser.parse_args()
+
+    flash = read_hex(args.hex_file)
+
+    if args.table:
+        for addr, text in flash_table(flash):
+            print('0x%04x %s' % (addr, text))
+        return
+
+    if args.port:
+        import serial       # pyserial, only needed for live decoding
+        in_stream = serial.Serial(args.port, args.baud)
+    elif args.capture_file:
+        in_stream = open(args.capture_file, 'rb')
+    else:
+        in_stream = sys.stdin.buffer
+
+    for line in in_stream:
+        print(decode_line(flash, line), flush=True)
+
+
+if __name__ == '__main__':
+    main()
@@ -63,7 +63,7 @@
 #include <TimeLib.h>
 
 
-static const int8_t FW_VERSION = 10;
+static const int8_t FW_VERSION = 11;
 
 // Log Levels
 typedef enum {
@@ -74,10 +74,19 @@ typedef enum {
     logDebug = 4
 } LogLev;
 
+// Most verbose log level compiled into the firmware.  Log calls above it are
+// removed at compile time along with their strings, e.g. set to logInfo for
+// production builds to drop all debug output.  The runtime log level can be
+// set at or below it.
+static const LogLev BUILD_LOG_LEVEL = logDebug;
+
 // Default runtime log level.
 // Can control through serial command, save to EEPROM.
 static const LogLev DEF_LOG_LEVEL = logDebug;
 
+static_assert(DEF_LOG_LEVEL <= BUILD_LOG_LEVEL,
+        "DEF_LOG_LEVEL must not exceed BUILD_LOG_LEVEL");
+
 // if using HW/HCW module must set to true:
 static const bool RADIO_HIGH_POWER = true;
 
@@ -109,6 +118,32 @@ static const uint32_t SERIAL_BAUD = 115200;
 // whether to align node entries to mm:00 (begin at top of minute)
 static const bool DEF_ALIGN_ENTRIES = 1;
 
+// Node health alert thresholds.  Evaluated as node status arrives, sending a
+// one-shot NALRT message to the server on breach and again on recovery.  0
+// disables a threshold.
+static const uint16_t DEF_ALERT_BATT_MV = 0;        // alert if below
+static const int8_t DEF_ALERT_RSSI = 0;             // alert if below, e.g. -90
+static const uint16_t DEF_ALERT_DRIFT_SECS = 0;     // alert if abs drift above
+static const uint16_t DEF_ALERT_FREE_RAM = 0;       // alert if below (bytes)
+
+// whether to prefix each serial output line with its channel id (console, log
+// or message), see SerChan.  Off matches output of earlier firmware.
+static const bool DEF_SER_FRAMING = 0;
+
+// whether log lines are written in tokenised binary form, to be decoded on the
+// host by logdecode.py (see Runtime Logging).  Much less serial time per log
+// line, but unreadable in a terminal.
+static const bool DEF_LOG_TOKENS = 0;
+
+// whether meter passthroughs (MUPC, MUP_, MREB) carry the RSSI they were
+// received at, for a server merging the streams of several gateways to pick
+// between copies.  Off matches output of earlier firmware.
+static const bool DEF_METER_RSSI = 0;
+
+// most relay hops accepted in a relayed (RFWD) frame, 0 to not accept relayed
+// frames.  See Relay.
+static const uint8_t DEF_RELAY_MAX_HOPS = 0;
+
 // *****************************************************************************
 //    General Init - Pins
 // *****************************************************************************
@@ -131,16 +166,50 @@ static const uint8_t BUTTON_PIN = 6;            // IC12
 // variable to hold MCU reset cause
 uint8_t resetFlags __attribute__ ((section(".noinit")));
 
+// fill byte for free RAM at boot, to find stack high-water mark (see paintStack)
+static const uint8_t STACK_PAINT = 0xC5;
+
 uint32_t btnEventStartMillis = 0;    // button on start time in millis
 
-// global temporary variables, used somewhat arbitrarily vs local static vars
-char tmpStr[60] = "";
+// global temporary variable, used somewhat arbitrarily vs local vars
 uint32_t tmpInt = 0ul;
 
 static const uint8_t SERIAL_IN_BUFFER_SIZE = 40;
-char serInBuff[SERIAL_IN_BUFFER_SIZE] = "";
+static const uint8_t TMP_STR_SIZE = 60;
 uint8_t serialBuffPos = 0;
 
+// Shared buffer arena.  The large buffers are used in one of two phases that
+// never overlap, so share the same RAM:
+//  - serial: a line being entered in serInBuff, then parsed (into tmpStr) and
+//    handled.  Handling a serial line never sends or receives radio messages.
+//  - radio: a message received to/sent from msgBuffStr.  Only happens while no
+//    serial line is part-entered (serialBuffPos is 0, see loop()).
+// Contents don't survive a change of phase, so a phase must fully initialise
+// what it uses.  The BNCH benchmark alternates phases per kernel, so is run
+// from loop() between serial lines (see checkBench()).  Run ramreport.py on
+// the built .elf for per-region sizes.
+union BuffArena {
+    struct {
+        char serInBuff[SERIAL_IN_BUFFER_SIZE];
+        char tmpStr[TMP_STR_SIZE];
+    } serial;
+    struct {
+        // String buffer for message contents, also passed directly to/from
+        // the RadioHead library.  KEY_LENGTH 'fudge factor' added as while
+        // length is fixed, an accidental overflow can be caught and handled
+        // through validation instead of creating an actual overflow.
+        char msgBuffStr[RH_RF69_MAX_MESSAGE_LEN + KEY_LENGTH];
+    } radio;
+} buffArena;
+
+static char (&serInBuff)[SERIAL_IN_BUFFER_SIZE] = buffArena.serial.serInBuff;
+static char (&tmpStr)[TMP_STR_SIZE] = buffArena.serial.tmpStr;
+static char (&msgBuffStr)[RH_RF69_MAX_MESSAGE_LEN + KEY_LENGTH] =
+        buffArena.radio.msgBuffStr;
+
+static_assert(sizeof(BuffArena) == SERIAL_IN_BUFFER_SIZE + TMP_STR_SIZE,
+        "Arena sized by serial phase, check radio phase buffers still fit");
+
 // *****************************************************************************
 //    General Init - Config Vars
 // *****************************************************************************
@@ -158,6 +227,14 @@ uint8_t cfgEncryptKey[KEY_LENGTH] =
         {'\0','\0','\0','\0','\0','\0','\0','\0','\0','\0','\0','\0','\0',
         '\0','\0','\0'};
 uint8_t cfgAlignEntries = 0;
+uint16_t cfgAlertBattMV = 0;
+int8_t cfgAlertRSSI = 0;
+uint16_t cfgAlertDriftSecs = 0;
+uint16_t cfgAlertFreeRAM = 0;
+uint8_t cfgSerFraming = 0;
+uint8_t cfgLogTokens = 0;
+uint8_t cfgMeterRSSI = 0;
+uint8_t cfgRelayMaxHops = 0;
 
 // *****************************************************************************
 //    General Init - Logging
@@ -198,6 +275,21 @@ static const char SMSG_SMINT_NACK[] PROGMEM = "SMINT_NACK";
 static const char SMSG_SGITR_ACK[] PROGMEM = "SGITR_ACK";
 static const char SMSG_SGITR_NACK[] PROGMEM = "SGITR_NACK";
 static const char SMSG_NDARK[] PROGMEM = "NDARK";
+static const char SMSG_NALRT[] PROGMEM = "NALRT";
+static const char SMSG_SALRT_ACK[] PROGMEM = "SALRT_ACK";
+static const char SMSG_SALRT_NACK[] PROGMEM = "SALRT_NACK";
+static const char SMSG_SFILT_ACK[] PROGMEM = "SFILT_ACK";
+static const char SMSG_SFILT_NACK[] PROGMEM = "SFILT_NACK";
+static const char SMSG_GSTATS[] PROGMEM = "GSTATS";
+static const char SMSG_SFWST_ACK[] PROGMEM = "SFWST_ACK";
+static const char SMSG_SFWST_NACK[] PROGMEM = "SFWST_NACK";
+static const char SMSG_SFWCH_NACK[] PROGMEM = "SFWCH_NACK";
+static const char SMSG_GFWCH[] PROGMEM = "GFWCH";
+static const char SMSG_FWSTAT[] PROGMEM = "FWSTAT";
+static const char SMSG_SSWEEP_ACK[] PROGMEM = "SSWEEP_ACK";
+static const char SMSG_SSWEEP_NACK[] PROGMEM = "SSWEEP_NACK";
+static const char SMSG_SWEEP[] PROGMEM = "SWEEP";     // a step's histogram
+static const char SMSG_SWEEPD[] PROGMEM = "SWEEPD";
 
 // Serial message (RX) string prefixes.
 static const char SMSG_RX_PREFIX[] PROGMEM = "S>G:";
@@ -208,6 +300,12 @@ static const char SMSG_SMVAL[] PROGMEM = "SMVAL";
 static const char SMSG_SPLED[] PROGMEM = "SPLED";
 static const char SMSG_SMINT[] PROGMEM = "SMINT";
 static const char SMSG_SGITR[] PROGMEM = "SGITR";
+static const char SMSG_SALRT[] PROGMEM = "SALRT";
+static const char SMSG_SFILT[] PROGMEM = "SFILT";
+static const char SMSG_GGSTATS[] PROGMEM = "GGSTATS";
+static const char SMSG_SFWST[] PROGMEM = "SFWST";
+static const char SMSG_SFWCH[] PROGMEM = "SFWCH";
+static const char SMSG_SSWEEP[] PROGMEM = "SSWEEP";
 
 // Serial command (RX) strings.
 
@@ -244,11 +342,45 @@ static const char SER_CMD_TXPW[] PROGMEM = "TXPW";
 // print/set entry alignment (set with ENTA=[0,1])
 static const char SER_CMD_ENTA[] PROGMEM = "ENTA";
 
+// print/set node alert thresholds
+// (set with ALRT=[batt_mv],[rssi],[drift_secs],[free_ram])
+static const char SER_CMD_ALRT[] PROGMEM = "ALRT";
+
+// print/set serial channel framing (set with FRMG=[0,1])
+static const char SER_CMD_FRMG[] PROGMEM = "FRMG";
+
+// print/set tokenised log output (set with LOGT=[0,1])
+static const char SER_CMD_LOGT[] PROGMEM = "LOGT";
+
+// print/set RSSI in meter passthroughs (set with MRSS=[0,1])
+static const char SER_CMD_MRSS[] PROGMEM = "MRSS";
+
+// print/set most relay hops accepted, 0 for none (set with RLAY=[hops])
+static const char SER_CMD_RLAY[] PROGMEM = "RLAY";
+
+// dump runtime counters to console
+static const char SER_CMD_DUMPS[] PROGMEM = "DUMPS";
+
 // Array of commands, used to print list on help or invalid input
+// (commands of features not built in are left out, see their sections)
 const char* const SER_CMDS[] PROGMEM = {
                 SER_CMD_HELP, SER_CMD_DUMPGW, SER_CMD_DUMPNO, SER_CMD_RCFG,
                 SER_CMD_TIME, SER_CMD_LOGL, SER_CMD_EKEY, SER_CMD_NETI,
-                SER_CMD_GWID, SER_CMD_TXPW, SER_CMD_ENTA};
+                SER_CMD_GWID, SER_CMD_TXPW, SER_CMD_ENTA, SER_CMD_FRMG,
+                SER_CMD_MRSS,
+#ifdef ALERT_BUILD
+                SER_CMD_ALRT,
+#endif
+#ifdef LOG_TOKEN_BUILD
+                SER_CMD_LOGT,
+#endif
+#ifdef RELAY_BUILD
+                SER_CMD_RLAY,
+#endif
+#ifdef STATS_BUILD
+                SER_CMD_DUMPS,
+#endif
+                };
 
 // *****************************************************************************
 //    General Init - Radio Message Types
@@ -290,6 +422,17 @@ static const char RMSG_MNOI[] PROGMEM = "MNOI";
 // General purpose message (can broadcast)
 static const char RMSG_GMSG[] PROGMEM = "GMSG";
 
+// Relay envelope, around a frame forwarded by a relay node (either way)
+static const char RMSG_RFWD[] PROGMEM = "RFWD";
+
+// Firmware update offer, request, chunk, selective ACK and result (see
+// Firmware Relay)
+static const char RMSG_FWOF[] PROGMEM = "FWOF";
+static const char RMSG_FWRQ[] PROGMEM = "FWRQ";
+static const char RMSG_FWCH[] PROGMEM = "FWCH";
+static const char RMSG_FWAK[] PROGMEM = "FWAK";
+static const char RMSG_FWDN[] PROGMEM = "FWDN";
+
 // Number of seconds to wait for 'proof of life' before regarding a node as MIA,
 // and alerting.  Longer than 5m usually best.
 static const uint16_t POL_MSG_TIMEOUT_SEC = 600;        //10m
@@ -340,14 +483,184 @@ int8_t lastRSSIAtNode = 0;
 // radio/node Id of last message sender
 uint8_t lastMsgFrom = 0;
 
-// Intermediate string buffer for message contents.  Used as easier to work with
-// than byte buffer.  KEY_LENGTH 'fudge factor' added as while length is fixed,
-// an accidental overflow can be caught and handled through validation instead
-// of creating an actual overflow.
-char msgBuffStr[RH_RF69_MAX_MESSAGE_LEN + KEY_LENGTH] = "";
+// *****************************************************************************
+//    Relay
+//
+//    Nodes out of the gateway's range can reach it through a relay node (e.g.
+//    a mains powered node, always listening), which wraps each frame it
+//    forwards in an envelope:
+//        RFWD,<node_id>,<hops>,<held_ms>;<frame>
+//    Towards the gateway node_id is the origin, hops the relays passed and
+//    held_ms the time the frame was held at them; towards a node it is the
+//    destination, with the route's hops and held_ms 0, for the relay to pass
+//    on unwrapped.  Radio frames are single hop (RHReliableDatagram), so
+//    each hop is ACKed by its receiver - nodes keep their RadioHead set up,
+//    rather than moving to RHMesh's incompatible headers.
+//
+//    The gateway's routing table is the relay, hops and latency held per node
+//    (MeterNode), updated from each frame the node is heard by, so replies go
+//    back the way the last request came.  The envelope takes up to 15 bytes
+//    of the 60, so relayed nodes must keep their messages shorter.  Built in
+//    when RELAY_ENABLED, set by building with -DRELAY_BUILD; without it RFWD
+//    frames are refused as unknown and routes stay direct.
+// *****************************************************************************
+
+#ifdef RELAY_BUILD
+static const bool RELAY_ENABLED = true;
+#else
+static const bool RELAY_ENABLED = false;
+#endif
+
+static const uint8_t RELAY_MAX_HOPS = 4;
+
+// relay the last message came through, 0 if direct, and its hops and time
+// held at relays
+uint8_t lastMsgRelay = 0;
+uint8_t lastMsgHops = 0;
+uint16_t lastMsgHeldMs = 0;
+
+// *****************************************************************************
+//    Firmware Relay
+//
+//    Over the air update of a node's firmware, streamed from the server
+//    through the gateway, which holds only a window of the image at a time:
+//     1. The server starts a transfer for a node (SFWST).  The next time the
+//        node polls (GINR) with no other instruction queued, it is offered
+//        the image (FWOF), and asks for it from the first chunk it doesn't
+//        have (FWRQ) - 0, or where an interrupted transfer left off.
+//     2. The gateway asks the server for the window's chunks (GFWCH), each
+//        sent in FW_CHUNK_PARTS base64 parts (SFWCH) to fit a serial line,
+//        and sends each chunk to the node as it's held, back to back, the
+//        last one held flagged for the node to answer at once.
+//     3. The node answers with a selective ACK (FWAK): the next chunk it
+//        needs, and a bit per chunk after it that it has.  The window slides
+//        up to the chunk needed, is refilled from the server, and only
+//        chunks missed are sent again.
+//     4. With the whole image, the node checks its CRC and reports (FWDN),
+//        passed on to the server (FWSTAT).
+//    Chunks are binary rather than text, as base64 would take a third more
+//    of each frame:
+//        FWCH<node_id><seq_hi><seq_lo><flags><data, up to FW_CHUNK_LEN>
+//    and broadcast, as RadioHead ACKs every frame sent to a station, and
+//    waiting out an ACK per chunk would near halve throughput.  So only
+//    nodes in the gateway's range can be updated, not relayed ones.  In
+//    netsim, a window of 4 chunks moves an image at ~80% of the rate the
+//    frame overhead allows, 8 at ~90%.
+//
+//    If there's no progress for FW_RETRY_MS, chunks not ACKed are sent again
+//    and parts not held asked for again, and after FW_MAX_RETRIES the
+//    transfer waits for the node's next GINR to resume.  One transfer at a
+//    time, not saved - after a reboot the server starts it again, and the
+//    node picks up from the chunks it has.  Built in when FW_RELAY_ENABLED,
+//    set by building with -DFW_RELAY_BUILD; off by default to save flash.
+// *****************************************************************************
+
+#ifdef FW_RELAY_BUILD
+static const bool FW_RELAY_ENABLED = true;
+#else
+static const bool FW_RELAY_ENABLED = false;
+#endif
+
+static const uint8_t FW_PART_LEN = 18;      // 24 base64 chars
+static const uint8_t FW_CHUNK_PARTS = 2;
+static const uint8_t FW_CHUNK_LEN = FW_PART_LEN * FW_CHUNK_PARTS;
+static const uint8_t FW_WINDOW_CHUNKS = 4;  // up to 8, FW_CHUNK_LEN RAM each
+static const uint8_t FW_CHUNK_HEAD_LEN = 8; // name, node id, seq, flags
+static const uint8_t FW_FLAG_LAST = 1;      // last chunk held, ACK now
+static const uint16_t FW_RETRY_MS = 1500;
+static const uint8_t FW_MAX_RETRIES = 4;
+
+static_assert(FW_WINDOW_CHUNKS <= 8 && FW_WINDOW_CHUNKS * FW_CHUNK_PARTS <= 16,
+        "Firmware window masks too small");
+static_assert(FW_CHUNK_HEAD_LEN + FW_CHUNK_LEN <= RH_RF69_MAX_MESSAGE_LEN,
+        "Firmware chunk won't fit a frame");
+
+// transfer events reported to the server (FWSTAT)
+typedef enum {
+    fwEvtRun = 0,           // started or resumed by the node
+    fwEvtStall = 1,         // no progress, waiting for the node's next GINR
+    fwEvtDone = 2,          // node has the image, CRC good
+    fwEvtFail = 3           // node has the image, CRC bad
+} FwEvent;
+
+static const char FW_EVT_RUN_LBL[] PROGMEM = "RUN";
+static const char FW_EVT_STALL_LBL[] PROGMEM = "STALL";
+static const char FW_EVT_DONE_LBL[] PROGMEM = "DONE";
+static const char FW_EVT_FAIL_LBL[] PROGMEM = "FAIL";
+
+// indexed by FwEvent
+const char* const FW_EVT_LBLS[] PROGMEM = {
+                FW_EVT_RUN_LBL, FW_EVT_STALL_LBL, FW_EVT_DONE_LBL,
+                FW_EVT_FAIL_LBL};
+
+// node being updated (0 if none), and the image
+uint8_t fwNodeId = 0;
+uint16_t fwImageLen = 0;
+uint16_t fwImageCrc = 0;
+uint16_t fwChunkCount = 0;
+
+// window: first chunk, the node's next needed; and bit per chunk from it
+// ACKed by the node, and sent since its last FWAK
+uint16_t fwBase = 0;
+uint8_t fwAcked = 0;
+uint8_t fwSent = 0;
+
+// bit per part of the window held
+uint16_t fwParts = 0;
+
+// node listening for chunks (since its FWRQ), retries and last progress
+bool fwIsActive = false;
+uint8_t fwRetries = 0;
+uint32_t fwLastMillis = 0ul;
+
+// chunk data, at chunk seq % FW_WINDOW_CHUNKS
+uint8_t fwWindow[FW_WINDOW_CHUNKS][FW_CHUNK_LEN];
+
+// *****************************************************************************
+//    Spectrum Sweep
+//
+//    Diagnostic for poor delivery: is it interference or range?  On the
+//    server's request (SSWEEP) the gateway steps the radio across RADIO_FREQ
+//    +/- a span, samples the RSSI of the channel at each step and sends a
+//    histogram of the samples per step (SWEEP):
+//        SWEEP;<freq_khz>,<min_dbm>,<max_dbm>,<count per bucket>
+//    so a quiet channel shows as all samples in the lowest buckets, near the
+//    noise floor.  Then it retunes to RADIO_FREQ and reports done (SWEEPD).
+//
+//    A step per loop, so serial input is still handled.  Radio messages
+//    aren't, as the radio is off channel - nodes retry as for any missed
+//    frame.  Not saved, and built in when SWEEP_ENABLED, set by building with
+//    -DSWEEP_BUILD.
+// *****************************************************************************
+
+#ifdef SWEEP_BUILD
+static const bool SWEEP_ENABLED = true;
+#else
+static const bool SWEEP_ENABLED = false;
+#endif
+
+static const uint16_t SWEEP_MAX_SPAN_KHZ = 2000;
+static const uint8_t SWEEP_MIN_STEP_KHZ = 25;
+static const uint8_t SWEEP_MAX_STEPS = 81;
+static const uint8_t SWEEP_MAX_SAMPLES = 100;
+static const uint16_t SWEEP_SAMPLE_US = 500;    // between samples, and to settle
+
+// histogram buckets, from SWEEP_BKT_FLOOR_DBM up in SWEEP_BKT_DB steps, the
+// first and last open ended: <-110,-110,-100,-90,-80,>=-70
+static const uint8_t SWEEP_BKT_COUNT = 6;
+static const int8_t SWEEP_BKT_FLOOR_DBM = -110;
+static const uint8_t SWEEP_BKT_DB = 10;
+
+// steps left (0 if not sweeping) and in all, and samples per step
+uint8_t sweepStepsLeft = 0;
+uint8_t sweepStepCount = 0;
+uint8_t sweepSamples = 0;
 
-// Actual buffer used to pass payload to/from the RadioHead library.
-uint8_t radioMsgBuff[RH_RF69_MAX_MESSAGE_LEN] = "";
+// next step's frequency, and step size
+uint32_t sweepFreqKhz = 0ul;
+uint16_t sweepStepKhz = 0;
+
+// Message buffer (msgBuffStr) is in the shared buffer arena, see General Init.
 
 // *****************************************************************************
 //    Meter Nodes
@@ -399,28 +712,333 @@ struct MeterNode {
     uint16_t tmpGinrPollRate = 0;
     uint16_t tmpGinrPollPeriod = 0;
 
-    // last RSSI from node
+    // last RSSI from node (from its relay, if relayed)
     int8_t lastNodeRSSI = 0;
+
+    // route: relay node (0 if direct), hops and ms held at relays, as last
+    // heard
+    uint8_t relayId = 0;
+    uint8_t relayHops = 0;
+    uint16_t relayLatencyMs = 0;
+
+    // raised health alerts, bit per AlertMetric
+    uint8_t alertFlags = 0;
 };
 
-static const uint8_t MAX_MTR_NODES = 5;       // ~50B per node
+static const uint8_t MAX_MTR_NODES = 6;       // ~54B per node
 
 struct MeterNode meterNodes[MAX_MTR_NODES];
 
 
+// *****************************************************************************
+//    Node Health Alerts
+//
+//    Each metric is checked when the node reports it (battery and free RAM in
+//    GINR, clock drift on PREQ, RSSI on any message).  An alert is raised once
+//    on breach, and cleared once the metric recovers past the threshold by the
+//    hysteresis margin - avoiding a stream of alerts for a metric hovering
+//    around its threshold.  Built in when ALERT_ENABLED, set by building with
+//    -DALERT_BUILD; thresholds are still kept in EEPROM without it.
+// *****************************************************************************
+
+#ifdef ALERT_BUILD
+static const bool ALERT_ENABLED = true;
+#else
+static const bool ALERT_ENABLED = false;
+#endif
+
+typedef enum {
+    alertBatt = 0,
+    alertRSSI = 1,
+    alertDrift = 2,
+    alertFreeRAM = 3
+} AlertMetric;
+
+static const char ALERT_BATT_LBL[] PROGMEM = "BATT";
+static const char ALERT_RSSI_LBL[] PROGMEM = "RSSI";
+static const char ALERT_DRIFT_LBL[] PROGMEM = "DRFT";
+static const char ALERT_FREE_RAM_LBL[] PROGMEM = "FRAM";
+
+// indexed by AlertMetric
+const char* const ALERT_LBLS[] PROGMEM = {
+                ALERT_BATT_LBL, ALERT_RSSI_LBL, ALERT_DRIFT_LBL,
+                ALERT_FREE_RAM_LBL};
+
+// recovery margins
+static const uint16_t ALERT_HYST_BATT_MV = 100;
+static const int8_t ALERT_HYST_RSSI = 5;
+static const uint16_t ALERT_HYST_DRIFT_SECS = 2;
+static const uint16_t ALERT_HYST_FREE_RAM = 32;
+
+// limits for valid thresholds
+static const uint16_t ALERT_MAX_BATT_MV = 6000;
+static const int8_t ALERT_MIN_RSSI = -120;
+static const int8_t ALERT_MAX_RSSI = -20;
+static const uint16_t ALERT_MAX_DRIFT_SECS = 3600;
+static const uint16_t ALERT_MAX_FREE_RAM = 2048;
+
+
+// *****************************************************************************
+//    Server Event Filter
+//
+//    Node-originated events sent to the server can be filtered by type and by
+//    node, so a consumer only interested in a subset doesn't pay serial time
+//    for the rest.  Set by the server (SFILT), not saved to EEPROM - i.e. all
+//    events pass after a reboot.  Built in when EVT_FILTER_ENABLED, set by
+//    building with -DEVT_FILTER_BUILD; without it all events pass.
+// *****************************************************************************
+
+#ifdef EVT_FILTER_BUILD
+static const bool EVT_FILTER_ENABLED = true;
+#else
+static const bool EVT_FILTER_ENABLED = false;
+#endif
+
+// bit positions in event type mask
+typedef enum {
+    evtMUPC = 0,
+    evtMUP_ = 1,
+    evtMREB = 2,
+    evtGMSG = 3,
+    evtNDARK = 4,
+    evtNALRT = 5
+} SerEvent;
+
+static const uint8_t EVT_FILTER_ALL_TYPES = 0xFF;
+
+// wanted event types, bit per SerEvent
+uint8_t evtFilterTypes = EVT_FILTER_ALL_TYPES;
+
+// wanted nodes, bit per node id
+uint8_t evtFilterNodes[32];
+
+
+// *****************************************************************************
+//    Runtime Counters
+//
+//    Counts since boot, reported with GSTATS message and DUMPS command.  Each
+//    wraps at 65535, so a consumer should graph deltas between reads.  Built
+//    in when STATS_ENABLED, set by building with -DSTATS_BUILD.
+// *****************************************************************************
+
+#ifdef STATS_BUILD
+static const bool STATS_ENABLED = true;
+#else
+static const bool STATS_ENABLED = false;
+#endif
+
+// indexes into statCounters
+typedef enum {
+    statRxMREB = 0,         // radio messages received, by type
+    statRxMUPC = 1,
+    statRxMUP_ = 2,
+    statRxGINR = 3,
+    statRxPREQ = 4,
+    statRxGMSG = 5,
+    statRxUnknown = 6,
+    statTxOk = 7,           // radio messages sent and ACKed
+    statTxFail = 8,         // radio messages not ACKed after retries
+    statParseErr = 9,       // radio messages with missing/bad fields
+    statSerBadMsg = 10,     // unknown serial messages (S>G)
+    statSerBadCmd = 11,     // unknown console commands
+    statSerOverflow = 12,   // serial input chars dropped as line too long
+    statCount = 13
+} StatCounter;
+
+static const char STAT_RX_MREB_LBL[] PROGMEM = "RX MREB";
+static const char STAT_RX_MUPC_LBL[] PROGMEM = "RX MUPC";
+static const char STAT_RX_MUP__LBL[] PROGMEM = "RX MUP_";
+static const char STAT_RX_GINR_LBL[] PROGMEM = "RX GINR";
+static const char STAT_RX_PREQ_LBL[] PROGMEM = "RX PREQ";
+static const char STAT_RX_GMSG_LBL[] PROGMEM = "RX GMSG";
+static const char STAT_RX_UNKNOWN_LBL[] PROGMEM = "RX unknown";
+static const char STAT_TX_OK_LBL[] PROGMEM = "TX ok";
+static const char STAT_TX_FAIL_LBL[] PROGMEM = "TX fail";
+static const char STAT_PARSE_ERR_LBL[] PROGMEM = "Parse err";
+static const char STAT_SER_BAD_MSG_LBL[] PROGMEM = "Ser bad msg";
+static const char STAT_SER_BAD_CMD_LBL[] PROGMEM = "Ser bad cmd";
+static const char STAT_SER_OVERFLOW_LBL[] PROGMEM = "Ser overflow";
+
+// indexed by StatCounter
+const char* const STAT_LBLS[] PROGMEM = {
+                STAT_RX_MREB_LBL, STAT_RX_MUPC_LBL, STAT_RX_MUP__LBL,
+                STAT_RX_GINR_LBL, STAT_RX_PREQ_LBL, STAT_RX_GMSG_LBL,
+                STAT_RX_UNKNOWN_LBL, STAT_TX_OK_LBL, STAT_TX_FAIL_LBL,
+                STAT_PARSE_ERR_LBL, STAT_SER_BAD_MSG_LBL, STAT_SER_BAD_CMD_LBL,
+                STAT_SER_OVERFLOW_LBL};
+
+static_assert(sizeof(STAT_LBLS) / sizeof(STAT_LBLS[0]) == statCount,
+        "STAT_LBLS must have a label per StatCounter");
+
+uint16_t statCounters[statCount];
+
+// longest single loop() pass since boot, in microseconds
+uint32_t statMaxLoopMicros = 0ul;
+
+
+inline void incStat(StatCounter counter){
+    if (STATS_ENABLED)
+        statCounters[counter]++;
+}
+
+
+// *****************************************************************************
+//    Profiling
+//
+//    Execution time histograms for the main handlers, timed with micros()
+//    (Timer0, 4us resolution at 16MHz).  Built in when PROFILE_ENABLED, and
+//    shown with the DUMPP console command.  Off by default, as uses ~30B RAM
+//    per handler.
+// *****************************************************************************
+
+static const bool PROFILE_ENABLED = false;
+
+// print profiling histograms with DUMPP
+static const char SER_CMD_DUMPP[] PROGMEM = "DUMPP";
+
+// indexes into profStats
+typedef enum {
+    profMsgRecv = 0,
+    profSerCmd = 1,
+    profSerMsg = 2,
+    profPrintNodes = 3,
+    profCount = 4
+} ProfiledFunc;
+
+static const char PROF_MSG_RECV_LBL[] PROGMEM = "processMsgRecv";
+static const char PROF_SER_CMD_LBL[] PROGMEM = "processSerialCommand";
+static const char PROF_SER_MSG_LBL[] PROGMEM = "processSerialMessage";
+static const char PROF_PRINT_NODES_LBL[] PROGMEM = "printNodes";
+
+// indexed by ProfiledFunc
+const char* const PROF_LBLS[] PROGMEM = {
+                PROF_MSG_RECV_LBL, PROF_SER_CMD_LBL, PROF_SER_MSG_LBL,
+                PROF_PRINT_NODES_LBL};
+
+// histogram buckets are in powers of 4 - bucket n holds times below
+// 64us * 4^n (i.e. <64us, <256us, <1ms ... <262ms), the last holds the rest
+static const uint8_t PROF_BUCKETS = 8;
+static const uint8_t PROF_BUCKET0_SHIFT = 6;
+
+struct ProfileStats {
+    uint16_t calls;         // stops recording when full
+    uint32_t minMicros;
+    uint32_t maxMicros;
+    uint32_t totalMicros;
+    uint16_t buckets[PROF_BUCKETS];
+};
+
+ProfileStats profStats[profCount];
+
+
+inline uint32_t profBucketLimit(uint8_t bucket){
+    // upper bound (exclusive) of a histogram bucket, in us
+    return (uint32_t)1 << (PROF_BUCKET0_SHIFT + 2 * bucket);
+}
+
+
+inline uint32_t startProfile(){
+    return PROFILE_ENABLED ? micros() : 0ul;
+}
+
+
+void recordProfile(ProfiledFunc func, uint32_t startMicros){
+    uint32_t elapsedMicros = micros() - startMicros;
+    ProfileStats* stats = &profStats[func];
+
+    // stop before calls or total (for average) overflow
+    if (stats->calls == UINT16_MAX ||
+            stats->totalMicros > UINT32_MAX - elapsedMicros)
+        return;
+
+    if (stats->calls == 0 || elapsedMicros < stats->minMicros)
+        stats->minMicros = elapsedMicros;
+    if (elapsedMicros > stats->maxMicros)
+        stats->maxMicros = elapsedMicros;
+    stats->calls++;
+    stats->totalMicros += elapsedMicros;
+
+    uint8_t bucket = 0;
+    elapsedMicros >>= PROF_BUCKET0_SHIFT;
+    while (elapsedMicros != 0 && bucket < PROF_BUCKETS - 1){
+        elapsedMicros >>= 2;
+        bucket++;
+    }
+    stats->buckets[bucket]++;
+}
+
+
+inline __attribute__((always_inline))
+void endProfile(ProfiledFunc func, uint32_t startMicros){
+    if (PROFILE_ENABLED)
+        recordProfile(func, startMicros);
+}
+
+
+// *****************************************************************************
+//    Traffic Capture
+//
+//    Debug mode, set with the CAPT console command, in which each radio
+//    message received or sent and each serial line received is echoed to
+//    serial as a capture line, timestamped with millis().  Output captured
+//    from a gateway can be imported by the host build's gwreplay and fed back
+//    through the firmware with the same interleaving, to reproduce an issue.
+//    Capture lines are on their own channel:
+//      CAP:S,<millis>,<line>
+//      CAP:R,<millis>,<from_node_id>,<rssi>,<payload>
+//      CAP:T,<millis>,<to_node_id>,<acked 0/1>,<payload>
+//    Bytes outside printable ASCII, and '\', are written as \xNN.  Adds a
+//    line of serial output per message handled, so is off at boot and not
+//    saved.  Built in when CAPTURE_ENABLED, set by building with
+//    -DCAPTURE_BUILD.
+// *****************************************************************************
+
+#ifdef CAPTURE_BUILD
+static const bool CAPTURE_ENABLED = true;
+#else
+static const bool CAPTURE_ENABLED = false;
+#endif
+
+// print/set traffic capture (set with CAPT=[0,1])
+static const char SER_CMD_CAPT[] PROGMEM = "CAPT";
+
+static const char CAPT_PREFIX[] PROGMEM = "CAP:";
+
+uint8_t captureOn = 0;
+
 // *****************************************************************************
 //    Timers
 // *****************************************************************************
 
-// Basetime is UNIX epoch in seconds (since 1 Jan 1970 00:00:00).
-// Set from local server.
+// Basetime is UNIX epoch in seconds (since 1 Jan 1970 00:00:00) and
+// milliseconds.  Set from local server.
 uint32_t baseTime = 0ul;
+uint16_t baseTimeMs = 0;
 
 // Default UNIX epoch time.
 static const uint32_t INIT_TIME = 1483228800ul;        //  1 Jan 2017 00:00:00
 
-// Millis() value converted to seconds taken when basetime set.
-uint32_t baseTimeAsLocalSecs = 0ul;
+// Millis() value taken when basetime set.  Basetime is moved on at least
+// daily, so millis() overflow (every ~49d) doesn't matter.
+uint32_t baseTimeLocalMillis = 0ul;
+static const uint32_t TIME_REBASE_MS = 86400000ul;
+
+// Time sync with server.  GTIME carries a request id, which a server echoes
+// in STIME with the time in ms, so the round trip can be measured and half of
+// it added.  Re-synced periodically to bound clock drift.
+static const uint32_t TIME_SYNC_INTERVAL_MS = 600000ul;   // 10 mins
+uint16_t timeReqId = 0;
+uint32_t timeReqMillis = 0ul;
+bool isTimeReqPending = false;
+int16_t lastTimeRTTMs = -1;     // -1 if last set without a round trip
+// A reply slower than this is of unknown age, so is refused and re-requested
+// after TIME_RETRY_MS rather than the full interval.
+static const uint32_t TIME_MAX_RTT_MS = 2000ul;
+static const uint32_t TIME_RETRY_MS = 60000ul;
+
+// Clock steps larger than this (e.g. the first sync) reset node last seen
+// times, smaller ones move them with the clock.
+static const uint32_t TIME_MAX_ADJ_SECS = 60;
 
 // Set using time from local Server.
 uint32_t whenBooted = 0ul;
@@ -431,21 +1049,121 @@ uint32_t whenBooted = 0ul;
 //
 // *****************************************************************************
 
-// used to detect when a new line is started, to write log level
-bool newLogLine = true;
+// Serial output is a stream of lines, each belonging to one channel.  A line
+// is only ever written to by its own channel - a partial line from another
+// channel is ended first - so server messages are never split by log output,
+// and log lines are never split by messages.
+//
+// With framing on (cfgSerFraming), each line is prefixed with its channel id
+// and SER_FRAME_SEP (e.g. '3|G>S:GTIME') so the server can route or discard
+// lines on the first byte.
+typedef enum {
+    chanNone = 0,       // no line open, i.e. at start of line
+    chanConsole = 1,    // interactive console, command echo and output
+    chanLog = 2,        // runtime log output
+    chanMsg = 3,        // gateway to server messages
+    chanCapture = 4     // traffic capture lines, see Traffic Capture
+} SerChan;
+
+static const char SER_FRAME_SEP = '|';
+
+// channel of the line currently being written
+SerChan serLineChan = chanNone;
+
+
+bool beginSerLine(SerChan serChan){
+    /*
+       Claims the serial line for a channel, ending another channel's partial
+       line if needed.  Returns true if a new line was started.
+    */
+    if (serLineChan == serChan)
+        return false;
+
+    if (serLineChan != chanNone)
+        Serial.write("\r\n");
+
+    if (cfgSerFraming){
+        Serial.write('0' + serChan);
+        Serial.write(SER_FRAME_SEP);
+    }
+    serLineChan = serChan;
+    return true;
+}
+
 
+// Tokenised log lines (cfgLogTokens) carry a compact binary record per log
+// call instead of text, decoded on the host by logdecode.py using strings from
+// the firmware image.  A line starts with LOG_TOKEN_START and ends with a
+// newline as usual.  Each record is a header byte - 1, kind (4b), log level
+// (3b) - then a value in 6 bit groups, least significant first, with bit 7 set
+// and bit 6 set if more groups follow:
+//   tokFlashStr    flash address of an F() string
+//   tokStr         string length, then its chars with bit 7 set
+//   tokUInt        unsigned number
+//   tokInt         signed number, zigzag encoded
+//   tokFixed2      number x 100 (2 decimal places), zigzag encoded
+// Every byte after LOG_TOKEN_START has bit 7 set, so a token line can't be
+// mistaken for text or contain a line end.  Built in when LOG_TOKEN_ENABLED,
+// set by building with -DLOG_TOKEN_BUILD.
+#ifdef LOG_TOKEN_BUILD
+static const bool LOG_TOKEN_ENABLED = true;
+#else
+static const bool LOG_TOKEN_ENABLED = false;
+#endif
+
+static const uint8_t LOG_TOKEN_START = 0x1F;
 
-void printNewLine(LogLev logLevel){
-    if (cfgLogLevel >= logLevel){
+typedef enum {
+    tokFlashStr = 0,
+    tokStr = 1,
+    tokUInt = 2,
+    tokInt = 3,
+    tokFixed2 = 4
+} LogTokenKind;
+
+
+// Log output is gated first at compile time against BUILD_LOG_LEVEL, then at
+// runtime against cfgLogLevel.  The writeLog* functions and printNewLine are
+// forced inline so the first check is made at the call site, where the log
+// level is a constant: calls above BUILD_LOG_LEVEL fold away entirely (taking
+// their F() strings with them).  The runtime check is left to the put*
+// functions that do the output, as made inline at each of the ~300 call sites
+// it cost ~3KB flash.
+
+constexpr bool isLogLevelBuilt(LogLev logLevel){
+    return logLevel <= BUILD_LOG_LEVEL;
+}
+
+
+inline __attribute__((always_inline)) bool isLogOn(LogLev logLevel){
+    return isLogLevelBuilt(logLevel) && cfgLogLevel >= logLevel;
+}
+
+
+void putNewLine(LogLev logLevel){
+    /*
+       Ends the current line.  A log level newline only ends a log line, so a
+       newline for suppressed log output can't end another channel's line.
+    */
+    if (logLevel == logNull ||
+            (serLineChan == chanLog && cfgLogLevel >= logLevel)){
         Serial.write("\r\n");
-        newLogLine = true;
+        serLineChan = chanNone;
     }
 }
 
 
+inline __attribute__((always_inline)) void printNewLine(LogLev logLevel){
+    if (isLogLevelBuilt(logLevel))
+        putNewLine(logLevel);
+}
+
+
 void print_P(const char* flashStr){
-    strcpy_P(tmpStr, flashStr);
-    Serial.write(tmpStr);
+    // streamed from flash straight into the serial TX buffer, no RAM copy
+    char flashChar;
+    while ((flashChar = pgm_read_byte(flashStr++)) != '\0')
+        Serial.write(flashChar);
 }
 
 
@@ -455,6 +1173,16 @@ void println_P(const char* flashStr){
 }
 
 
+void beginSerMsg(){
+    /*
+       Starts a gateway to server message line, to be ended with a newline.
+       Nothing but the message may be written until it is.
+    */
+    beginSerLine(chanMsg);
+    print_P(SMSG_TX_PREFIX);
+}
+
+
 void printLogLevel(LogLev logLevel, bool printColon){
     if (logLevel == logNull)
         return;
@@ -473,120 +1201,371 @@ void printLogLevel(LogLev logLevel, bool printColon){
 }
 
 
-void writeLog(char* debugText, LogLev logLevel){
-    if (cfgLogLevel >= logLevel){
-        if (newLogLine)
+bool beginLogText(LogLev logLevel){
+    /*
+       Prepares the serial line for text at the given log level.  logNull text
+       continues the current line (or starts a console line), while other
+       levels go to a log line, labelled when new.  Returns false if the text
+       should be dropped, as below the runtime log level or it would fall
+       inside a message.
+    */
+    if (logLevel == logNull){
+        if (serLineChan == chanNone)
+            beginSerLine(chanConsole);
+        return true;
+    }
+
+    if (cfgLogLevel < logLevel || serLineChan == chanMsg)
+        return false;
+
+    if (beginSerLine(chanLog)){
+        if (LOG_TOKEN_ENABLED && cfgLogTokens)
+            Serial.write(LOG_TOKEN_START);
+        else
             printLogLevel(logLevel, true);
-        Serial.write(debugText);
-        newLogLine = false;
     }
+    return true;
 }
 
 
-void writeLogLn(char* debugText, LogLev logLevel){
-    if (cfgLogLevel >= logLevel){
-        if (newLogLine)
-            printLogLevel(logLevel, true);
-        Serial.write(debugText);
-        printNewLine(logLevel);
+bool isLogTokenLine(){
+    return (LOG_TOKEN_ENABLED && cfgLogTokens && serLineChan == chanLog);
+}
+
+
+void putLogToken(LogTokenKind tokKind, LogLev logLevel, uint32_t tokVal){
+    Serial.write(0x80 | (tokKind << 3) | logLevel);
+    do {
+        uint8_t tokByte = 0x80 | (tokVal & 0x3F);
+        tokVal >>= 6;
+        if (tokVal > 0)
+            tokByte |= 0x40;
+        Serial.write(tokByte);
+    } while (tokVal > 0);
+}
+
+
+uint32_t zigzag(int32_t value){
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+
+// Decimal number formatting, used in place of sprintf for log and message
+// output.  Digits are found by repeated subtraction of powers of ten rather
+// than division, as the AVR has no divide instruction (32 bit division is a
+// ~600 cycle library call), and values fitting 16 or 8 bits use narrower
+// arithmetic.  Output buffers need FMT_MAX_LEN chars.
+static const uint8_t FMT_MAX_LEN = 13;      // '-', 10 digits, '.', '\0'
+
+static const uint32_t POW10_U32[] PROGMEM = {
+                1000000000ul, 100000000ul, 10000000ul, 1000000ul, 100000ul,
+                10000ul};
+static const uint16_t POW10_U16[] PROGMEM = {10000, 1000, 100, 10};
+
+
+uint8_t fmtUInt8(char* outStr, uint8_t value){
+    /*
+       Writes value to outStr as decimal, returning its length
+    */
+    uint8_t len = 0;
+    char digit = '0';
+
+    if (value >= 100){
+        while (value >= 100){
+            value -= 100;
+            digit++;
+        }
+        outStr[len++] = digit;
+        digit = '0';
+    }
+    if (value >= 10 || len > 0){
+        while (value >= 10){
+            value -= 10;
+            digit++;
+        }
+        outStr[len++] = digit;
+    }
+    outStr[len++] = '0' + value;
+    outStr[len] = '\0';
+    return len;
+}
+
+
+uint8_t fmtUInt16(char* outStr, uint16_t value){
+    /*
+       Writes value to outStr as decimal, returning its length
+    */
+    uint8_t len = 0;
+    uint16_t pow10 = 0;
+    char digit = '0';
+
+    if (value <= UINT8_MAX)
+        return fmtUInt8(outStr, value);
+
+    for (uint8_t i = 0; i < sizeof(POW10_U16) / sizeof(POW10_U16[0]); i++){
+        pow10 = pgm_read_word(&POW10_U16[i]);
+        digit = '0';
+        while (value >= pow10){
+            value -= pow10;
+            digit++;
+        }
+        if (digit != '0' || len > 0)
+            outStr[len++] = digit;
+    }
+    outStr[len++] = '0' + value;
+    outStr[len] = '\0';
+    return len;
+}
+
+
+uint8_t fmtUInt32(char* outStr, uint32_t value){
+    /*
+       Writes value to outStr as decimal, returning its length
+    */
+    uint8_t len = 0;
+    uint32_t pow10 = 0ul;
+    char digit = '0';
+
+    if (value <= UINT16_MAX)
+        return fmtUInt16(outStr, value);
+
+    // leading digits until remainder is < 10000
+    for (uint8_t i = 0; i < sizeof(POW10_U32) / sizeof(POW10_U32[0]); i++){
+        pow10 = pgm_read_dword(&POW10_U32[i]);
+        digit = '0';
+        while (value >= pow10){
+            value -= pow10;
+            digit++;
+        }
+        if (digit != '0' || len > 0)
+            outStr[len++] = digit;
+    }
+
+    // remaining 4 digits, zero-padded, in 16 bits
+    uint16_t lowValue = value;
+    for (uint8_t i = 1; i < sizeof(POW10_U16) / sizeof(POW10_U16[0]); i++){
+        pow10 = pgm_read_word(&POW10_U16[i]);
+        digit = '0';
+        while (lowValue >= pow10){
+            lowValue -= pow10;
+            digit++;
+        }
+        outStr[len++] = digit;
+    }
+    outStr[len++] = '0' + lowValue;
+    outStr[len] = '\0';
+    return len;
+}
+
+
+uint8_t fmtInt32(char* outStr, int32_t value){
+    /*
+       Writes value to outStr as decimal, returning its length
+    */
+    if (value >= 0)
+        return fmtUInt32(outStr, value);
+
+    outStr[0] = '-';
+    return fmtUInt32(outStr + 1, -(uint32_t)value) + 1;
+}
+
+
+uint8_t fmtFixed2(char* outStr, int32_t hundredths){
+    /*
+       Writes a fixed point value with 2 decimal places, given in hundredths
+       (e.g. 1025 for 10.25), to outStr, returning its length
+    */
+    uint8_t len = 0;
+    uint8_t digitsLen = 0;
+    uint32_t absValue = hundredths;
+
+    if (hundredths < 0){
+        outStr[len++] = '-';
+        absValue = -(uint32_t)hundredths;
+    }
+
+    // format as at least 3 digits (e.g. 5 as 005), then insert the point
+    // before the last 2 - avoiding division by 100
+    digitsLen = fmtUInt32(outStr + len, absValue);
+    if (digitsLen < 3){
+        memmove(outStr + len + 3 - digitsLen, outStr + len, digitsLen);
+        memset(outStr + len, '0', 3 - digitsLen);
+        digitsLen = 3;
+    }
+    len += digitsLen;
+    outStr[len + 1] = '\0';
+    outStr[len] = outStr[len - 1];
+    outStr[len - 1] = outStr[len - 2];
+    outStr[len - 2] = '.';
+    return len + 1;
+}
+
+
+void putLog(const char* debugText, LogLev logLevel){
+    if (! beginLogText(logLevel))
+        return;
+
+    if (isLogTokenLine()){
+        putLogToken(tokStr, logLevel, strlen(debugText));
+        while (*debugText != '\0')
+            Serial.write(0x80 | *debugText++);
     }
+    else
+        Serial.write(debugText);
+}
+
+
+void putLog(uint32_t debugText, LogLev logLevel){
+    char printStr[FMT_MAX_LEN];
+    if (! beginLogText(logLevel))
+        return;
+
+    if (isLogTokenLine())
+        putLogToken(tokUInt, logLevel, debugText);
+    else
+        Serial.write(printStr, fmtUInt32(printStr, debugText));
+}
+
+
+void putLog(int32_t debugText, LogLev logLevel){
+    char printStr[FMT_MAX_LEN];
+    if (! beginLogText(logLevel))
+        return;
+
+    if (isLogTokenLine())
+        putLogToken(tokInt, logLevel, zigzag(debugText));
+    else
+        Serial.write(printStr, fmtInt32(printStr, debugText));
+}
+
+
+void putLog(double debugText, LogLev logLevel){
+    // as fixed point, dtostr takes up too much memory and sprintf floats are
+    // not supported
+    char printStr[FMT_MAX_LEN];
+    if (! beginLogText(logLevel))
+        return;
+
+    if (isLogTokenLine())
+        putLogToken(tokFixed2, logLevel, zigzag((int32_t)(debugText * 100)));
+    else
+        Serial.write(printStr, fmtFixed2(printStr, (int32_t)(debugText * 100)));
+}
+
+
+void putLogF(const __FlashStringHelper* debugText, LogLev logLevel){
+    // easiest to do redundant putLog as can't simply cast FlashString
+    if (! beginLogText(logLevel))
+        return;
+
+    if (isLogTokenLine())
+        putLogToken(tokFlashStr, logLevel, (uintptr_t)debugText);
+    else
+        Serial.print(debugText);
 }
 
 
+inline __attribute__((always_inline))
 void writeLog(const char* debugText, LogLev logLevel){
-    writeLog((char*)debugText, logLevel);
+    if (isLogLevelBuilt(logLevel))
+        putLog(debugText, logLevel);
 }
 
 
+inline __attribute__((always_inline))
 void writeLogLn(const char* debugText, LogLev logLevel){
-    writeLog(debugText, logLevel);
-    printNewLine(logLevel);
+    if (isLogLevelBuilt(logLevel)){
+        putLog(debugText, logLevel);
+        putNewLine(logLevel);
+    }
 }
 
 
+inline __attribute__((always_inline))
 void writeLog(uint32_t debugText, LogLev logLevel){
-    static char printStr[12] = "";
-    sprintf(printStr, "%lu", debugText);
-    writeLog(printStr, logLevel);
+    if (isLogLevelBuilt(logLevel))
+        putLog(debugText, logLevel);
 }
 
 
+inline __attribute__((always_inline))
 void writeLogLn(uint32_t debugText, LogLev logLevel){
-    writeLog(debugText, logLevel);
-    printNewLine(logLevel);
+    if (isLogLevelBuilt(logLevel)){
+        putLog(debugText, logLevel);
+        putNewLine(logLevel);
+    }
 }
 
 
+inline __attribute__((always_inline))
 void writeLog(uint16_t debugText, LogLev logLevel){
     writeLog((uint32_t)debugText, logLevel);
 }
 
 
+inline __attribute__((always_inline))
 void writeLogLn(uint16_t debugText, LogLev logLevel){
-    writeLog((uint32_t)debugText, logLevel);
-    printNewLine(logLevel);
+    writeLogLn((uint32_t)debugText, logLevel);
 }
 
 
+inline __attribute__((always_inline))
 void writeLog(int32_t debugText, LogLev logLevel){
-    static char printStr[12] = "";
-    sprintf(printStr, "%ld", debugText);
-    writeLog(printStr, logLevel);
+    if (isLogLevelBuilt(logLevel))
+        putLog(debugText, logLevel);
 }
 
 
+inline __attribute__((always_inline))
 void writeLogLn(int32_t debugText, LogLev logLevel){
-    writeLog(debugText, logLevel);
-    printNewLine(logLevel);
+    if (isLogLevelBuilt(logLevel)){
+        putLog(debugText, logLevel);
+        putNewLine(logLevel);
+    }
 }
 
 
+inline __attribute__((always_inline))
 void writeLog(int16_t debugText, LogLev logLevel){
     writeLog((int32_t)debugText, logLevel);
 }
 
 
+inline __attribute__((always_inline))
 void writeLogLn(int16_t debugText, LogLev logLevel){
-    writeLog((int32_t)debugText, logLevel);
-    printNewLine(logLevel);
+    writeLogLn((int32_t)debugText, logLevel);
 }
 
 
+inline __attribute__((always_inline))
 void writeLog(double debugText, LogLev logLevel){
-    static char printStr[12] = "";
-    // use int hack as dtostr takes up too much memory, sprintf floats
-    // not supported...
-    sprintf(printStr, "%d.%02d", (int)debugText, (int)(debugText*100)%100);
-    writeLog(printStr, logLevel);
+    if (isLogLevelBuilt(logLevel))
+        putLog(debugText, logLevel);
 }
 
 
+inline __attribute__((always_inline))
 void writeLogLn(double debugText, LogLev logLevel){
-    writeLog(debugText, logLevel);
-    printNewLine(logLevel);
+    if (isLogLevelBuilt(logLevel)){
+        putLog(debugText, logLevel);
+        putNewLine(logLevel);
+    }
 }
 
 
+inline __attribute__((always_inline))
 void writeLogF(const __FlashStringHelper* debugText, LogLev logLevel){
-    // easiest to do redundant writeLog as can't simply cast FlashString
-
-    if (cfgLogLevel >= logLevel){
-        if (newLogLine)
-            printLogLevel(logLevel, true);
-        Serial.print(debugText);
-        newLogLine = false;
-    }
+    if (isLogLevelBuilt(logLevel))
+        putLogF(debugText, logLevel);
 }
 
 
+inline __attribute__((always_inline))
 void writeLogLnF(const __FlashStringHelper* debugText, LogLev logLevel){
-
-    if (cfgLogLevel >= logLevel){
-        if (newLogLine)
-            printLogLevel(logLevel, true);
-        Serial.print(debugText);
+    if (isLogLevelBuilt(logLevel)){
+        putLogF(debugText, logLevel);
+        putNewLine(logLevel);
     }
-    printNewLine(logLevel);
 }
 
 
@@ -596,11 +1575,18 @@ void writeLogLnF(const __FlashStringHelper* debugText, LogLev logLevel){
 //
 // *****************************************************************************
 
-uint32_t getNowTimestampSec();
+uint32_t getNowTimestampSec(uint16_t* nowMs = NULL);
 void resetConfig();
+void putConfigToMem();
 void printResetVal(uint8_t resetVal);
 
 void sendRadioMsg(uint8_t recipient, bool checkReply);
+void parseMeterUpdateMsg(uint8_t nodeIx, bool isWithCurrent);
+void parseGinrMsg(uint8_t nodeIx);
+void processSerialMessage();
+void startFwRelay(uint8_t nodeId, uint16_t imageLen, uint16_t imageCrc);
+bool putFwPart(const char* partStr);
+uint8_t startSweep(uint16_t spanKhz, uint16_t stepKhz, uint8_t samples);
 
 
 void print2Digits(int digits){
@@ -627,7 +1613,7 @@ void printNetworkId(){
 
 
 void printWhValue(uint32_t whValue, LogLev logLevel){
-    if (cfgLogLevel >= logLevel){
+    if (isLogOn(logLevel)){
         writeLog(whValue, logNull);
         writeLogF(F(" Wh"), logNull);
     }
@@ -637,7 +1623,7 @@ void printWhValue(uint32_t whValue, LogLev logLevel){
 void printCmdHelp(){
     printPrompt();
     writeLogF(F("Cmds: "), logNull);
-    for (uint8_t i = 0; i <= 10; i++){
+    for (uint8_t i = 0; i < sizeof(SER_CMDS) / sizeof(SER_CMDS[0]); i++){
         print_P((char*)pgm_read_word(&(SER_CMDS[i])));
         writeLogF(F(" "), logNull);
     }
@@ -645,64 +1631,127 @@ void printCmdHelp(){
 }
 
 
-bool strStartsWith(const char *strBody, const char *strPrefix){
+const char* matchPrefixP(const char *strBody, const char *strPrefix){
     /*
-        Tests if string starts with given prefix.  Case insensitive.
+        Tests if string starts with given PROGMEM prefix, compared in place.
+        Case insensitive.  Returns position in string after the prefix, or
+        NULL if no match.
      */
-
-    return (strncasecmp(strBody, strPrefix, strlen(strPrefix)) == 0);
+    char prefixChar;
+    while ((prefixChar = pgm_read_byte(strPrefix++)) != '\0'){
+        if (tolower(*strBody) != tolower(prefixChar))
+            return NULL;    // includes end of string body
+        strBody++;
+    }
+    return strBody;
 }
 
 
 uint8_t strStartsWithP(const char *strBody, const char *strPrefix){
     /*
-        Variant of strStartsWith for PROGMEM prefix, test for presence of
-        '=' (used to distinguish a setter from getter, e.g. 'TIME=').
+        Tests if string starts with PROGMEM prefix, and for presence of '='
+        after it (used to distinguish a setter from getter, e.g. 'TIME=').
      */
-
-    static char withEq [] = "";
-    strcpy_P(withEq, strPrefix);
-    strcat_P(withEq, PSTR("="));
-    if(strStartsWith(strBody, withEq))
+    strBody = matchPrefixP(strBody, strPrefix);
+    if (strBody == NULL)
+        return 0;   // no match
+    else if (*strBody == '=')
         return 2;   // setter
-    else if(strncasecmp_P(strBody, strPrefix, strlen_P(strPrefix)) == 0)
-        return 1;   // getter/normal
     else
-        return 0;   // no match
+        return 1;   // getter/normal
 }
 
 
 uint8_t strStartsWithP(const char *strBody, const char *strPrefix1,
             const char *strPrefix2){
     /*
-        Variant of strStartsWithP for two PROGMEM prefixes.
+        Variant of strStartsWithP for two consecutive PROGMEM prefixes.
      */
-    strcpy_P(tmpStr, strPrefix1);
-    strcat_P(tmpStr, strPrefix2);
-    if (strStartsWith(strBody, tmpStr))
+    strBody = matchPrefixP(strBody, strPrefix1);
+    if (strBody != NULL && matchPrefixP(strBody, strPrefix2) != NULL)
         return 1;
     else
         return 0;
 }
 
 
-uint16_t freeRAM(){
+void copyCmdArgs(char *argStr, size_t argSize, const char *cmdEnd){
     /*
-        Returns free SRAM in bytes (328P has 2kB total)
+        Copies the arguments following a command or message name (i.e. after
+        its '=' or ',' separator) to argStr, truncated to fit.  Empty if none.
      */
-    extern int __heap_start, *__brkval;
-    int v;
-    return (uint16_t) &v - (__brkval == 0 ? (int) &__heap_start :
-            (int) __brkval);
+    if (*cmdEnd != '\0')
+        cmdEnd++;       // skip separator
+    size_t argLen = strnlen(cmdEnd, argSize - 1);
+    memcpy(argStr, cmdEnd, argLen);
+    argStr[argLen] = '\0';
 }
 
 
-void printTime(uint32_t timestampSec, LogLev logLevel) {
+bool setCfgFlag(uint8_t* cfgFlag, const char* cmdName){
+    /*
+        Sets a 0/1 config value from the serial buffer's setter command (e.g.
+        'ENTA=1'), writing it to EEPROM.  False, with an error, if malformed.
+     */
+    // setter, so the name is followed by '='
+    uint32_t flagVal = strtoul(serInBuff + strlen_P(cmdName) + 1, NULL, 0);
+    if (flagVal == 0 || flagVal == 1){
+        *cfgFlag = flagVal;
+        putConfigToMem();
+        return true;
+    }
+    printPrompt();
+    writeLogF(F("Bad "), logNull);
+    print_P(cmdName);
+    printNewLine(logNull);
+    return false;
+}
+
+
+uint16_t freeRAM(){
+    /*
+        Returns free SRAM in bytes (328P has 2kB total).  0 in a host build.
+     */
+#ifdef __AVR__
+    extern int __heap_start, *__brkval;
+    int v;
+    return (uint16_t) &v - (__brkval == 0 ? (int) &__heap_start :
+            (int) __brkval);
+#else
+    return 0;
+#endif
+}
+
+
+uint16_t minFreeRAM(){
+    /*
+        Returns lowest free SRAM in bytes since boot, i.e. at the stack's
+        high-water mark.  Counts bytes still holding the paint from boot
+        upwards from the heap end, so is a worst case over all call chains
+        run so far - unlike freeRAM().  0 in a host build.
+     */
+#ifdef __AVR__
+    extern int __heap_start, *__brkval;
+    uint8_t stackEnd = 0;       // current stack position, as local
+    const uint8_t* ramPtr = (const uint8_t*)
+            (__brkval == 0 ? &__heap_start : __brkval);
+    uint16_t unusedBytes = 0;
+
+    while (ramPtr < &stackEnd && *ramPtr++ == STACK_PAINT)
+        unusedBytes++;
+    return unusedBytes;
+#else
+    return 0;
+#endif
+}
+
+
+void printTime(uint32_t timestampSec, LogLev logLevel) {
     /*
        Print formatted timestamp to serial out if runtime log level is >=
        logLevel
     */
-    if (cfgLogLevel < logLevel)
+    if (! isLogOn(logLevel))
         return;
 
     tmElements_t timeTME;
@@ -722,30 +1771,25 @@ void printTime(uint32_t timestampSec, LogLev logLevel) {
 }
 
 
-uint32_t getNowTimestampSec(){
+uint32_t getNowTimestampSec(uint16_t* nowMs){
     /*
        Returns synthesized timestamp given sync with server and local millis
-       timer.  Accuracy will require frequent sync and no use of sleep.
+       timer, and the milliseconds past it if nowMs.  Accuracy will require
+       frequent sync and no use of sleep.
     */
+    uint32_t elapsedMs = millis() - baseTimeLocalMillis;
 
-    static uint32_t secsFromMillis = 0ul;
-    secsFromMillis = millis() / 1000;
-
-    // Check for millis overflow (every ~49d), use different method.
-    //
-    // If millis (as sec) is less than base time seconds (when clock last set),
-    // then the time elapsed since basetime will be (UINT32_MAX - base time
-    // seconds + millisAsSeconds).
-    //
-    // Otherwise it is millisAsSeconds - base time seconds.
-    //
-    // Assumes frequent RTC sync and rebase will make such adjustments small
-    // enough to fit an uint32_t.
-
-    if (secsFromMillis < baseTimeAsLocalSecs)
-        return (baseTime + secsFromMillis + (UINT32_MAX - baseTimeAsLocalSecs));
-    else
-        return (baseTime + secsFromMillis - baseTimeAsLocalSecs);
+    // move basetime on well before millis() can wrap past it
+    if (elapsedMs >= TIME_REBASE_MS){
+        baseTime += elapsedMs / 1000;
+        baseTimeLocalMillis += (elapsedMs / 1000) * 1000;
+        elapsedMs %= 1000;
+    }
+
+    uint16_t msPart = baseTimeMs + elapsedMs % 1000;
+    if (nowMs != NULL)
+        *nowMs = msPart % 1000;
+    return baseTime + elapsedMs / 1000 + msPart / 1000;
 }
 
 
@@ -754,29 +1798,34 @@ void adjustTSVar(uint32_t * timestampVar, uint32_t timeSecs){
        Adjust global timestamps to avoid negative/wild results from duration
        calcs
     */
-    static uint64_t adjTime = 0ul;
-
-    adjTime = timeSecs - (getNowTimestampSec() - (*timestampVar));
+    uint64_t adjTime = timeSecs - (getNowTimestampSec() - (*timestampVar));
     *timestampVar = adjTime >= 0 ? (uint32_t)adjTime : 0ul;
 }
 
 
-void setNowTimestampSec(uint32_t timeSecs){
+void setNowTimestamp(uint32_t timeSecs, uint16_t timeMs){
     /*
-       Sets UTC time in seconds since UNIX Epoch @ midnight Jan 1 1970
+       Sets UTC time in seconds (and ms) since UNIX Epoch @ midnight Jan 1 1970
     */
+     uint32_t prevTimeSecs = getNowTimestampSec();
+     bool isSmallAdj = (timeSecs - prevTimeSecs <= TIME_MAX_ADJ_SECS ||
+             prevTimeSecs - timeSecs <= TIME_MAX_ADJ_SECS);
 
-     baseTime = timeSecs;
-     baseTimeAsLocalSecs = millis() / 1000;
+     // reset when last seen times for nodes, unless just a correction
+     for (uint8_t i = 0; i < MAX_MTR_NODES; i++)
+         if (not isSmallAdj)
+             meterNodes[i].lastSeenTime = UINT32_MAX;
+         else if (meterNodes[i].lastSeenTime != UINT32_MAX)
+             adjustTSVar(&meterNodes[i].lastSeenTime, timeSecs);
 
      if (whenBooted <= INIT_TIME)
         whenBooted = timeSecs;
      else
         adjustTSVar(&whenBooted, timeSecs);
 
-    // reset when last seen times for nodes
-    for (uint8_t i = 0; i < MAX_MTR_NODES; i++)
-        meterNodes[i].lastSeenTime = UINT32_MAX;
+     baseTime = timeSecs;
+     baseTimeMs = timeMs % 1000;
+     baseTimeLocalMillis = millis();
 
      // push out 0 value read to update time, force rebase
      writeLogF(F("Time="), logDebug);
@@ -785,6 +1834,64 @@ void setNowTimestampSec(uint32_t timeSecs){
 }
 
 
+void setNowTimestampSec(uint32_t timeSecs){
+    setNowTimestamp(timeSecs, 0);
+}
+
+
+bool isAlertConfigValid(uint16_t battMV, int8_t rssi, uint16_t driftSecs,
+            uint16_t freeRAMBytes){
+    return (battMV <= ALERT_MAX_BATT_MV &&
+            (rssi == 0 || (rssi >= ALERT_MIN_RSSI && rssi <= ALERT_MAX_RSSI)) &&
+            driftSecs <= ALERT_MAX_DRIFT_SECS &&
+            freeRAMBytes <= ALERT_MAX_FREE_RAM);
+}
+
+
+void resetAlertConfig(){
+    cfgAlertBattMV = DEF_ALERT_BATT_MV;
+    cfgAlertRSSI = DEF_ALERT_RSSI;
+    cfgAlertDriftSecs = DEF_ALERT_DRIFT_SECS;
+    cfgAlertFreeRAM = DEF_ALERT_FREE_RAM;
+}
+
+
+bool setAlertConfig(const char* alertStr){
+    /*
+       Parses and applies alert thresholds of form
+       <batt_mv>,<rssi>,<drift_secs>,<free_ram>, writing them to EEPROM.
+       Returns false (leaving config unchanged) if malformed or out of range.
+    */
+    uint16_t battMV = 0;
+    int8_t rssi = 0;
+    uint16_t driftSecs = 0;
+    uint16_t freeRAMBytes = 0;
+
+    if (sscanf(alertStr, "%" SCNu16 ",%" SCNd8 ",%" SCNu16 ",%" SCNu16,
+                &battMV, &rssi, &driftSecs, &freeRAMBytes) != 4 ||
+            ! isAlertConfigValid(battMV, rssi, driftSecs, freeRAMBytes))
+        return false;
+
+    cfgAlertBattMV = battMV;
+    cfgAlertRSSI = rssi;
+    cfgAlertDriftSecs = driftSecs;
+    cfgAlertFreeRAM = freeRAMBytes;
+    putConfigToMem();
+    return true;
+}
+
+
+void printAlertConfig(){
+    writeLog(cfgAlertBattMV, logNull);
+    Serial.write(SMSG_FS);
+    writeLog(cfgAlertRSSI, logNull);
+    Serial.write(SMSG_FS);
+    writeLog(cfgAlertDriftSecs, logNull);
+    Serial.write(SMSG_FS);
+    writeLog(cfgAlertFreeRAM, logNull);
+}
+
+
 int8_t getTXPowMin(){
     if (RADIO_HIGH_POWER)
         return -2;
@@ -835,6 +1942,22 @@ void putConfigToMem(){
         eeAddress++;
     }
     EEPROM.put(eeAddress, cfgAlignEntries);
+    eeAddress += sizeof(cfgAlignEntries);
+    EEPROM.put(eeAddress, cfgAlertBattMV);
+    eeAddress += sizeof(cfgAlertBattMV);
+    EEPROM.put(eeAddress, cfgAlertRSSI);
+    eeAddress += sizeof(cfgAlertRSSI);
+    EEPROM.put(eeAddress, cfgAlertDriftSecs);
+    eeAddress += sizeof(cfgAlertDriftSecs);
+    EEPROM.put(eeAddress, cfgAlertFreeRAM);
+    eeAddress += sizeof(cfgAlertFreeRAM);
+    EEPROM.put(eeAddress, cfgSerFraming);
+    eeAddress += sizeof(cfgSerFraming);
+    EEPROM.put(eeAddress, cfgLogTokens);
+    eeAddress += sizeof(cfgLogTokens);
+    EEPROM.put(eeAddress, cfgMeterRSSI);
+    eeAddress += sizeof(cfgMeterRSSI);
+    EEPROM.put(eeAddress, cfgRelayMaxHops);
 }
 
 
@@ -854,7 +1977,9 @@ void getConfigFromMem(){
     wdt_reset();
     EEPROM.get(eeAddress, byteVal);
     if (byteVal >= logNull && byteVal <= logDebug)
-        cfgLogLevel = (LogLev)byteVal;
+        // saved by a build with a more verbose BUILD_LOG_LEVEL is not an error
+        cfgLogLevel = isLogLevelBuilt((LogLev)byteVal) ?
+                (LogLev)byteVal : BUILD_LOG_LEVEL;
     else
         EEPROMValid = false;
     eeAddress++;
@@ -927,6 +2052,83 @@ void getConfigFromMem(){
         writeLogLnF(F("ROM Bad"), logError);
         resetConfig();
         putConfigToMem();
+        return;
+    }
+
+    // Values below were appended to an existing layout, so are defaulted on
+    // their own when invalid (e.g. blank after a firmware upgrade) rather than
+    // resetting network config along with them.
+    bool isAppendedValid = true;
+
+    // alert thresholds, left at their defaults if not built in
+    if (ALERT_ENABLED){
+        uint16_t alertBattMV = 0;
+        uint16_t alertDriftSecs = 0;
+        uint16_t alertFreeRAM = 0;
+        EEPROM.get(eeAddress, alertBattMV);
+        eeAddress += sizeof(alertBattMV);
+        EEPROM.get(eeAddress, intVal);
+        eeAddress += sizeof(intVal);
+        EEPROM.get(eeAddress, alertDriftSecs);
+        eeAddress += sizeof(alertDriftSecs);
+        EEPROM.get(eeAddress, alertFreeRAM);
+        eeAddress += sizeof(alertFreeRAM);
+
+        if (isAlertConfigValid(alertBattMV, intVal, alertDriftSecs,
+                alertFreeRAM)){
+            cfgAlertBattMV = alertBattMV;
+            cfgAlertRSSI = intVal;
+            cfgAlertDriftSecs = alertDriftSecs;
+            cfgAlertFreeRAM = alertFreeRAM;
+        }
+        else {
+            resetAlertConfig();
+            isAppendedValid = false;
+        }
+    }
+    else
+        eeAddress += sizeof(cfgAlertBattMV) + sizeof(cfgAlertRSSI) +
+                sizeof(cfgAlertDriftSecs) + sizeof(cfgAlertFreeRAM);
+
+    EEPROM.get(eeAddress, byteVal);
+    if (byteVal <= 1)
+        cfgSerFraming = byteVal;
+    else {
+        cfgSerFraming = DEF_SER_FRAMING;
+        isAppendedValid = false;
+    }
+    eeAddress++;
+
+    EEPROM.get(eeAddress, byteVal);
+    if (byteVal <= 1)
+        cfgLogTokens = byteVal;
+    else {
+        cfgLogTokens = DEF_LOG_TOKENS;
+        isAppendedValid = false;
+    }
+    eeAddress++;
+
+    EEPROM.get(eeAddress, byteVal);
+    if (byteVal <= 1)
+        cfgMeterRSSI = byteVal;
+    else {
+        cfgMeterRSSI = DEF_METER_RSSI;
+        isAppendedValid = false;
+    }
+    eeAddress++;
+
+    EEPROM.get(eeAddress, byteVal);
+    if (byteVal <= RELAY_MAX_HOPS)
+        cfgRelayMaxHops = byteVal;
+    else {
+        cfgRelayMaxHops = DEF_RELAY_MAX_HOPS;
+        isAppendedValid = false;
+    }
+    eeAddress++;
+
+    if (! isAppendedValid){
+        writeLogLnF(F("ROM ext bad"), logWarn);
+        putConfigToMem();
     }
 }
 
@@ -977,6 +2179,11 @@ void resetConfig(){
     cfgNetworkId4 = DEF_NETWORK_ID_O4;
     memcpy(cfgEncryptKey, DEF_ENCRYPT_KEY, KEY_LENGTH);
     cfgAlignEntries = DEF_ALIGN_ENTRIES;
+    resetAlertConfig();
+    cfgSerFraming = DEF_SER_FRAMING;
+    cfgLogTokens = DEF_LOG_TOKENS;
+    cfgMeterRSSI = DEF_METER_RSSI;
+    cfgRelayMaxHops = DEF_RELAY_MAX_HOPS;
     putConfigToMem();
     applyRadioConfig();
 }
@@ -986,6 +2193,8 @@ uint8_t getNodeIxById(uint8_t nodeId){
     /*
        Returns node's index in meterNodes array given a nodeId
     */
+    if (nodeId == 0)
+        return UINT8_MAX;   // marks a free slot, never a node
     for (uint8_t i = 0; i < MAX_MTR_NODES; i++){
         if (meterNodes[i].nodeId == nodeId)
             return i;
@@ -999,10 +2208,9 @@ uint8_t getNodeIxByIdWithCreate(uint8_t nodeId){
        If node can't be found find first empty element and insert it, returning
        the index. Returns UINT8_MAX if array is full.
     */
-    static uint8_t nodeIx = 0;
-    nodeIx = getNodeIxById(nodeId);
+    uint8_t nodeIx = getNodeIxById(nodeId);
 
-    if (nodeIx == UINT8_MAX){
+    if (nodeIx == UINT8_MAX && nodeId > 0){
         // not found, so create
         for (uint8_t i = 0; i < MAX_MTR_NODES; i++){
             if (meterNodes[i].nodeId == 0){
@@ -1019,145 +2227,278 @@ uint8_t getNodeIxByIdWithCreate(uint8_t nodeId){
 }
 
 
+void printNodeSnapField(const __FlashStringHelper* label, bool isMessage){
+    // ends the previous field and starts the next, labelled if not a message
+    if (isMessage)
+        Serial.write(SMSG_FS);
+    else {
+        printNewLine(logNull);
+        printPrompt();
+        writeLogF(label, logNull);
+    }
+}
+
+
 void printNodeSnapByIx(uint8_t nodeIx, bool isMessage){
     /*
        Prints a node dump to serial out or message format.
    */
-    char fieldDelimiter[3] = "";
-
-    if (isMessage)
-        strcpy(fieldDelimiter, ",");
-    else
-        strcpy(fieldDelimiter, "\r\n");
-
     if (not isMessage) {
         printPrompt();
         writeLogF(F("node_id="), logNull);
     }
     else
         Serial.write(SMSG_RS);
-
     writeLog(meterNodes[nodeIx].nodeId, logNull);
-    Serial.write(fieldDelimiter);
 
-    if (not isMessage) {
-        printPrompt();
-        writeLogF(F("batt_v="), logNull);
-    }
+    printNodeSnapField(F("batt_v="), isMessage);
     writeLog(meterNodes[nodeIx].battVoltageMV, logNull);
-    Serial.write(fieldDelimiter);
 
-    if (not isMessage) {
-        printPrompt();
-        writeLogF(F("up_time="), logNull);
-    }
+    printNodeSnapField(F("up_time="), isMessage);
     writeLog(meterNodes[nodeIx].secondsUptime, logNull);
-    Serial.write(fieldDelimiter);
 
-    if (not isMessage) {
-        printPrompt();
-        writeLogF(F("sleep_time="), logNull);
-    }
+    printNodeSnapField(F("sleep_time="), isMessage);
     writeLog(meterNodes[nodeIx].secondsSlept, logNull);
-    Serial.write(fieldDelimiter);
 
-    if (not isMessage) {
-        printPrompt();
-        writeLogF(F("free_ram="), logNull);
-    }
+    printNodeSnapField(F("free_ram="), isMessage);
     writeLog(meterNodes[nodeIx].freeRAM, logNull);
-    Serial.write(fieldDelimiter);
 
-    if (not isMessage) {
-        printPrompt();
-        writeLogF(F("when_last_seen="), logNull);
-    }
+    printNodeSnapField(F("when_last_seen="), isMessage);
     writeLog(meterNodes[nodeIx].lastSeenTime, logNull);
-    Serial.write(fieldDelimiter);
 
-    if (not isMessage) {
-        printPrompt();
-        writeLogF(F("last_clock_drift="), logNull);
-    }
+    printNodeSnapField(F("last_clock_drift="), isMessage);
     writeLog(meterNodes[nodeIx].lastClockDriftSecs, logNull);
-    Serial.write(fieldDelimiter);
 
-    if (not isMessage) {
-        printPrompt();
-        writeLogF(F("mtr_interval="), logNull);
-    }
+    printNodeSnapField(F("mtr_interval="), isMessage);
     writeLog(meterNodes[nodeIx].meterInterval, logNull);
-    Serial.write(fieldDelimiter);
 
-    if (not isMessage) {
-        printPrompt();
-        writeLogF(F("mtr_imp_per_kwh="), logNull);
-    }
+    printNodeSnapField(F("mtr_imp_per_kwh="), isMessage);
     writeLog(meterNodes[nodeIx].meterImpPerKwh, logNull);
-    Serial.write(fieldDelimiter);
 
-    if (not isMessage) {
-        printPrompt();
-        writeLogF(F("last_meter_entry_finish="), logNull);
-    }
+    printNodeSnapField(F("last_meter_entry_finish="), isMessage);
     writeLog(meterNodes[nodeIx].lastEntryFinishTime, logNull);
-    Serial.write(fieldDelimiter);
 
-    if (not isMessage) {
-        printPrompt();
-        writeLogF(F("last_mtr_val="), logNull);
-    }
+    printNodeSnapField(F("last_mtr_val="), isMessage);
     writeLog(meterNodes[nodeIx].lastMeterValue, logNull);
-    Serial.write(fieldDelimiter);
 
-    if (not isMessage) {
-        printPrompt();
-        writeLogF(F("last_curr_val="), logNull);
-    }
+    printNodeSnapField(F("last_curr_val="), isMessage);
     writeLog(meterNodes[nodeIx].lastCurrentRMS, logNull);
-    Serial.write(fieldDelimiter);
 
-    if (not isMessage) {
-        printPrompt();
-        writeLogF(F("p_led_rate="), logNull);
-    }
+    printNodeSnapField(F("p_led_rate="), isMessage);
     writeLog(meterNodes[nodeIx].puckLEDRate, logNull);
-    Serial.write(fieldDelimiter);
 
-    if (not isMessage) {
-        printPrompt();
-        writeLogF(F("p_led_time="), logNull);
-    }
+    printNodeSnapField(F("p_led_time="), isMessage);
     writeLog(meterNodes[nodeIx].puckLEDTime, logNull);
-    Serial.write(fieldDelimiter);
 
-    if (not isMessage) {
-        printPrompt();
-        writeLogF(F("last_rssi="), logNull);
-    }
+    printNodeSnapField(F("last_rssi="), isMessage);
     writeLog(meterNodes[nodeIx].lastNodeRSSI, logNull);
 
+    printNodeSnapField(F("relay="), isMessage);
+    writeLog(meterNodes[nodeIx].relayId, logNull);
+
+    printNodeSnapField(F("hops="), isMessage);
+    writeLog(meterNodes[nodeIx].relayHops, logNull);
+
+    printNodeSnapField(F("relay_ms="), isMessage);
+    writeLog(meterNodes[nodeIx].relayLatencyMs, logNull);
+
     if (not isMessage)
         printNewLine(logNull);
 }
 
 
 void printNodes(bool isMessage){
+    uint32_t profStartMicros = startProfile();
+
     for (uint8_t i = 0; i < MAX_MTR_NODES; i++)
         if (meterNodes[i].nodeId != 0){
             printNodeSnapByIx(i, isMessage);
-            printNewLine(logNull);
+            // nodes in a message are delimited, not on separate lines
+            if (not isMessage)
+                printNewLine(logNull);
         }
+
+    endProfile(profPrintNodes, profStartMicros);
 }
 
 
 void sendSerGetTime(){
     /*
-       Sends a request message to the server to update time
+       Sends a request message to the server to update time, with a request id
+       for the server to echo so the round trip can be timed
    */
    wdt_reset();
-   print_P(SMSG_TX_PREFIX);
-   println_P(SMSG_GTIME);
+   if (++timeReqId == 0)
+       timeReqId = 1;
+   timeReqMillis = millis();
+   isTimeReqPending = true;
+   beginSerMsg();
+   print_P(SMSG_GTIME);
+   Serial.write(SMSG_RS);
+   writeLogLn(timeReqId, logNull);
+}
+
+
+void checkTimeSync(){
+    /*
+       Re-requests time from the server periodically, as the clock drifts
+    */
+    if (millis() - timeReqMillis >= TIME_SYNC_INTERVAL_MS)
+        sendSerGetTime();
+}
+
+
+void resetSerEventFilter(){
+    evtFilterTypes = EVT_FILTER_ALL_TYPES;
+    memset(evtFilterNodes, 0xFF, sizeof(evtFilterNodes));
+}
+
+
+bool setSerEventFilter(char* filterStr){
+    /*
+       Parses and applies an event filter of form <type_mask>[,<node_id>...],
+       where no node ids means all nodes.  Returns false (leaving filter
+       unchanged) if malformed.
+    */
+    uint8_t nodeBits[sizeof(evtFilterNodes)];
+    uint32_t typeMask = 0ul;
+    uint32_t nodeId = 0ul;
+    char* token;
+    char* tokenEnd;
+
+    token = strtok(filterStr, ",");
+    if (token == NULL)
+        return false;
+    typeMask = strtoul(token, &tokenEnd, 0);
+    if (tokenEnd == token || typeMask > UINT8_MAX)
+        return false;
+
+    token = strtok(NULL, ",");
+    memset(nodeBits, token == NULL ? 0xFF : 0x00, sizeof(nodeBits));
+    while (token != NULL){
+        nodeId = strtoul(token, &tokenEnd, 0);
+        if (tokenEnd == token || nodeId < 1 || nodeId > 254)
+            return false;
+        nodeBits[nodeId >> 3] |= (1 << (nodeId & 7));
+        token = strtok(NULL, ",");
+    }
+
+    evtFilterTypes = typeMask;
+    memcpy(evtFilterNodes, nodeBits, sizeof(evtFilterNodes));
+    return true;
+}
+
+
+bool isSerEventWanted(SerEvent event, uint8_t nodeId){
+    /*
+       Tests an event against the server event filter, call before writing
+       any of the event to serial.
+   */
+    return (! EVT_FILTER_ENABLED || ((evtFilterTypes & (1 << event)) &&
+            (evtFilterNodes[nodeId >> 3] & (1 << (nodeId & 7)))));
+}
+
+
+void printStats(){
+    /*
+       Prints runtime counters to console, one per line.
+   */
+    for (uint8_t i = 0; i < statCount; i++){
+        printPrompt();
+        print_P((char*)pgm_read_word(&(STAT_LBLS[i])));
+        Serial.write('=');
+        writeLogLn(statCounters[i], logNull);
+    }
+    printPrompt();
+    writeLogF(F("TX retries="), logNull);
+    writeLogLn((uint16_t)msgManager.retransmissions(), logNull);
+    printPrompt();
+    writeLogF(F("Max loop (us)="), logNull);
+    writeLogLn(statMaxLoopMicros, logNull);
+}
+
+
+void printProfile(){
+    /*
+       Prints profiling stats to console, a line per handler with times in us,
+       p99 as the upper bound of its histogram bucket, then histogram counts.
+   */
+    for (uint8_t i = 0; i < profCount; i++){
+        ProfileStats* stats = &profStats[i];
+
+        printPrompt();
+        print_P((char*)pgm_read_word(&(PROF_LBLS[i])));
+        writeLogF(F(": n="), logNull);
+        writeLog(stats->calls, logNull);
+        if (stats->calls == 0){
+            printNewLine(logNull);
+            continue;
+        }
+
+        writeLogF(F(" min="), logNull);
+        writeLog(stats->minMicros, logNull);
+        writeLogF(F(" avg="), logNull);
+        writeLog(stats->totalMicros / stats->calls, logNull);
+        writeLogF(F(" max="), logNull);
+        writeLog(stats->maxMicros, logNull);
+
+        // p99 is in first bucket where 99% of calls are at or below
+        uint16_t p99Calls = stats->calls - stats->calls / 100;
+        uint16_t cumCalls = 0;
+        uint8_t bucket = 0;
+        for (; bucket < PROF_BUCKETS - 1; bucket++){
+            cumCalls += stats->buckets[bucket];
+            if (cumCalls >= p99Calls)
+                break;
+        }
+        if (bucket < PROF_BUCKETS - 1){
+            writeLogF(F(" p99<"), logNull);
+            writeLog(profBucketLimit(bucket), logNull);
+        }
+        else {
+            writeLogF(F(" p99>="), logNull);
+            writeLog(profBucketLimit(bucket - 1), logNull);
+        }
+
+        writeLogF(F(" hist="), logNull);
+        for (uint8_t j = 0; j < PROF_BUCKETS; j++){
+            if (j > 0)
+                Serial.write(SMSG_FS);
+            writeLog(stats->buckets[j], logNull);
+        }
+        printNewLine(logNull);
+    }
+}
+
+
+void sendSerStats(){
+    /*
+       Sends runtime counters to the server, in StatCounter order then TX
+       retries and max loop time.
+   */
+    beginSerMsg();
+    print_P(SMSG_GSTATS);
+    Serial.write(SMSG_RS);
+    for (uint8_t i = 0; i < statCount; i++){
+        writeLog(statCounters[i], logNull);
+        Serial.write(SMSG_FS);
+    }
+    writeLog((uint16_t)msgManager.retransmissions(), logNull);
+    Serial.write(SMSG_FS);
+    writeLog(statMaxLoopMicros, logNull);
+    printNewLine(logNull);
+}
+
+
+void writeMeterRSSI(){
+    /*
+       Writes the RSSI the message in the buffer was received at, and a field
+       separator, if meter passthroughs carry it (cfgMeterRSSI)
+   */
+    if (! cfgMeterRSSI)
+        return;
+    writeLog((int16_t)lastRSSIAtGateway, logNull);
+    Serial.write(SMSG_FS);
 }
 
 
@@ -1165,13 +2506,17 @@ void sendSerMeterUpdate(uint8_t nodeId, bool isWithCurrent){
     /*
        Pass through a meter update message (in message buffer) to the server
    */
+    if (! isSerEventWanted(isWithCurrent ? evtMUPC : evtMUP_, nodeId))
+        return;
+
     wdt_reset();
-    print_P(SMSG_TX_PREFIX);
+    beginSerMsg();
     print_P(isWithCurrent ? SMSG_MUPC: SMSG_MUP_);
 
     Serial.write(SMSG_RS);
     writeLog(nodeId, logNull);
     Serial.write(SMSG_FS);
+    writeMeterRSSI();
     writeLogLn(msgBuffStr, logNull);
 }
 
@@ -1180,23 +2525,108 @@ void sendSerMeterRebase(uint8_t nodeId){
     /*
        Pass through a meter rebase message (in message buffer) to the server
    */
+    if (! isSerEventWanted(evtMREB, nodeId))
+        return;
+
     wdt_reset();
-    print_P(SMSG_TX_PREFIX);
+    beginSerMsg();
     print_P(SMSG_MREB);
     Serial.write(SMSG_RS);
     writeLog(nodeId, logNull);
     Serial.write(SMSG_FS);
+    writeMeterRSSI();
     writeLogLn(msgBuffStr, logNull);
 }
 
 
+void sendSerNodeAlert(uint8_t nodeIx, AlertMetric metric, bool isRaised,
+            int32_t value){
+    /*
+       Sends a node health alert (or clearance of one) to the server
+   */
+    if (! isSerEventWanted(evtNALRT, meterNodes[nodeIx].nodeId))
+        return;
+
+    wdt_reset();
+    beginSerMsg();
+    print_P(SMSG_NALRT);
+    Serial.write(SMSG_RS);
+    writeLog(meterNodes[nodeIx].nodeId, logNull);
+    Serial.write(SMSG_FS);
+    print_P((char*)pgm_read_word(&(ALERT_LBLS[metric])));
+    Serial.write(SMSG_FS);
+    Serial.write(isRaised ? '1' : '0');
+    Serial.write(SMSG_FS);
+    writeLogLn(value, logNull);
+}
+
+
+void checkNodeAlert(uint8_t nodeIx, AlertMetric metric){
+    /*
+        Checks a node metric against its alert threshold, raising or clearing
+        the alert as needed.  Call when the metric has been refreshed.
+    */
+    if (! ALERT_ENABLED)
+        return;
+
+    int32_t value = 0;
+    bool isBreach = false;
+    bool isRecovered = true;    // a disabled threshold clears a raised alert
+    uint8_t alertBit = (1 << metric);
+
+    switch (metric){
+        case alertBatt:
+            value = meterNodes[nodeIx].battVoltageMV;
+            if (cfgAlertBattMV > 0){
+                isBreach = (value < cfgAlertBattMV);
+                isRecovered = (value >= cfgAlertBattMV + ALERT_HYST_BATT_MV);
+            }
+            break;
+        case alertRSSI:
+            value = meterNodes[nodeIx].lastNodeRSSI;
+            if (cfgAlertRSSI < 0){
+                isBreach = (value < cfgAlertRSSI);
+                isRecovered = (value >= cfgAlertRSSI + ALERT_HYST_RSSI);
+            }
+            break;
+        case alertDrift:
+            value = meterNodes[nodeIx].lastClockDriftSecs;
+            if (cfgAlertDriftSecs > 0){
+                isBreach = (labs(value) > cfgAlertDriftSecs);
+                isRecovered = (labs(value) + ALERT_HYST_DRIFT_SECS <=
+                        cfgAlertDriftSecs);
+            }
+            break;
+        case alertFreeRAM:
+            value = meterNodes[nodeIx].freeRAM;
+            if (cfgAlertFreeRAM > 0){
+                isBreach = (value < cfgAlertFreeRAM);
+                isRecovered = (value >= cfgAlertFreeRAM + ALERT_HYST_FREE_RAM);
+            }
+            break;
+    }
+
+    if (isBreach && !(meterNodes[nodeIx].alertFlags & alertBit)){
+        meterNodes[nodeIx].alertFlags |= alertBit;
+        sendSerNodeAlert(nodeIx, metric, true, value);
+    }
+    else if (isRecovered && (meterNodes[nodeIx].alertFlags & alertBit)){
+        meterNodes[nodeIx].alertFlags &= ~alertBit;
+        sendSerNodeAlert(nodeIx, metric, false, value);
+    }
+}
+
+
 void sendSerNodeGenMsg(uint8_t nodeId){
     /*
        Pass through a node general purpose message (in message buffer) to the
        server
     */
+    if (! isSerEventWanted(evtGMSG, nodeId))
+        return;
+
     wdt_reset();
-    print_P(SMSG_TX_PREFIX);
+    beginSerMsg();
     print_P(SMSG_GMSG);
     Serial.write(SMSG_RS);
     writeLog(nodeId, logNull);
@@ -1204,8 +2634,8 @@ void sendSerNodeGenMsg(uint8_t nodeId){
     writeLog(msgBuffStr, logNull);
     Serial.write(' ');
     if (strStartsWithP(msgBuffStr, PSTR("GMSG,BOOT"))){
-        sscanf(msgBuffStr, "%*[^,],BOOT %lu", &tmpInt);
-        printResetVal((uint8_t)tmpInt);
+        if (sscanf(msgBuffStr, "%*[^,],BOOT %" SCNu32, &tmpInt) == 1)
+            printResetVal((uint8_t)tmpInt);
     }
     printNewLine(logNull);
 }
@@ -1228,15 +2658,20 @@ int readLineSerial(int readChar, char *serialBuffer){
     // Check if at maximum input length.  Ignore until deleted or return
     // pressed.
     else if (readChar > 0 && serialBuffPos >= (SERIAL_IN_BUFFER_SIZE -1) &&
-            readChar != '\r' && readChar != '\b')
+            readChar != '\r' && readChar != '\b'){
+        incStat(statSerOverflow);
         return -1;
+    }
 
     else if (readChar > 0) {   // allow for null terminator
         switch (readChar) {
             case '\b':
+                if (serialBuffPos == 0)
+                    break;
                 serialBuffPos--;
                 serialBuffer[serialBuffPos] = '\0';
 
+                beginSerLine(chanConsole);
                 // hacky way to realise working backspace -
                 // backspace+space+backspace
                 Serial.write("\b\x20\b");
@@ -1251,6 +2686,7 @@ int readLineSerial(int readChar, char *serialBuffer){
                     serialBuffer[serialBuffPos++] = readChar;
                     serialBuffer[serialBuffPos] = '\0';
                     // echo the value that was read back to the serial port.
+                    beginSerLine(chanConsole);
                     Serial.write(readChar);
                 }
         }
@@ -1260,6 +2696,364 @@ int readLineSerial(int readChar, char *serialBuffer){
 }
 
 
+void putCaptureHead(char capKind){
+    beginSerLine(chanCapture);
+    print_P(CAPT_PREFIX);
+    Serial.write(capKind);
+    Serial.write(',');
+    writeLog(millis(), logNull);
+    Serial.write(',');
+}
+
+
+void putCaptureBytes(const char* capBytes, uint8_t capLen){
+    /*
+       Ends a capture line with its payload, escaping anything that would
+       break the line or be ambiguous to import.
+    */
+    static const char HEX_DIGITS[] PROGMEM = "0123456789ABCDEF";
+
+    for (uint8_t i = 0; i < capLen; i++){
+        uint8_t capByte = capBytes[i];
+        if (capByte < 32 || capByte > 126 || capByte == '\\'){
+            Serial.write("\\x");
+            Serial.write(pgm_read_byte(&HEX_DIGITS[capByte >> 4]));
+            Serial.write(pgm_read_byte(&HEX_DIGITS[capByte & 0x0F]));
+        }
+        else
+            Serial.write(capByte);
+    }
+    putNewLine(logNull);
+}
+
+
+inline void captureSerialLine(){
+    if (CAPTURE_ENABLED && captureOn){
+        putCaptureHead('S');
+        putCaptureBytes(serInBuff, strlen(serInBuff));
+    }
+}
+
+
+void captureRadioMsg(char capKind, uint8_t nodeId, int16_t capVal,
+        uint8_t msgLen, bool isBinary = false){
+    /*
+       Captures the radio message in msgBuffStr, received from (R) or sent to
+       (T) a node.  capVal is the RSSI if received, or 1 if sent and ACKed.
+       Zero padding is not captured, unless the message is binary (a firmware
+       chunk).
+    */
+    if (! (CAPTURE_ENABLED && captureOn))
+        return;
+    putCaptureHead(capKind);
+    writeLog(nodeId, logNull);
+    Serial.write(',');
+    writeLog(capVal, logNull);
+    Serial.write(',');
+    putCaptureBytes(msgBuffStr, isBinary ? msgLen : strnlen(msgBuffStr,
+            msgLen));
+}
+
+
+// *****************************************************************************
+//    Benchmarks
+//
+//    Built in when BENCH_ENABLED, run with the BNCH console command.  Reports
+//    CPU cycles per number conversion for the fmt* formatters versus sprintf,
+//    and per run of the message parse, node snapshot and serial message
+//    dispatch kernels.  Timed with Timer1 counting CPU cycles (which the
+//    firmware doesn't otherwise use), extended to 32 bits by its overflow
+//    interrupt, with the millis() tick off.  Kernels that write to serial
+//    include any wait for the UART.  Enabled by building with -DBENCH_BUILD;
+//    off by default to save flash, and to leave Timer1's overflow vector free.
+// *****************************************************************************
+
+#ifdef BENCH_BUILD
+static const bool BENCH_ENABLED = true;
+#else
+static const bool BENCH_ENABLED = false;
+#endif
+
+// run benchmark with BNCH
+static const char SER_CMD_BNCH[] PROGMEM = "BNCH";
+
+static const uint32_t BENCH_VALS[] PROGMEM = {
+                7ul, 255ul, 1000ul, 65535ul, 123456ul, 4000000000ul};
+
+// kernel inputs, as sent by a meter node / server
+static const char BENCH_MUPC_MSG[] PROGMEM =
+        "MUPC,1502795790,18829393;15,1,10.2;15,5,10.7;";
+static const char BENCH_MUP__MSG[] PROGMEM =
+        "MUP_,1502795790,18829393;15,1;15,5;15,2;16,3;";
+static const char BENCH_GINR_MSG[] PROGMEM =
+        "GINR,4300,890000,555000,880,-80,10,100,5,1000";
+static const char BENCH_NOSNAP_MSG[] PROGMEM = "S>G:GNOSNAP,254";
+// followed by an id not in the node table
+static const char BENCH_NACK_MSG[] PROGMEM = "S>G:GNOSNAP,";
+static const char BENCH_NOMATCH_MSG[] PROGMEM = "S>G:ZZZZ";
+
+// bench nodes take ids not in the node table from this one up, filling free
+// node slots, and are removed after
+static const uint8_t BENCH_NODE_ID_BASE = 200;
+
+// keeps benchmarked results 'used' so calls aren't optimised away
+volatile uint8_t benchSink = 0;
+
+// set by BNCH, run from loop() once the serial line is handled
+bool benchPending = false;
+
+#ifdef BENCH_BUILD
+// upper 16 bits of the cycle count
+volatile uint16_t benchOverflows = 0;
+uint8_t benchTimer0Mask = 0;
+
+
+ISR(TIMER1_OVF_vect){
+    benchOverflows++;
+}
+
+
+void startCycleCount(){
+    Serial.flush();         // no UART interrupts from earlier output
+    noInterrupts();
+    benchTimer0Mask = TIMSK0;
+    TIMSK0 = 0;
+    TCCR1A = 0;
+    TCNT1 = 0;
+    benchOverflows = 0;
+    TIFR1 = (1 << TOV1);
+    TIMSK1 = (1 << TOIE1);
+    TCCR1B = (1 << CS10);   // no prescaling, i.e. counts CPU cycles
+    interrupts();
+}
+
+
+uint32_t stopCycleCount(){
+    noInterrupts();
+    TCCR1B = 0;
+    uint16_t cycles = TCNT1;
+    // an overflow not yet serviced
+    if (TIFR1 & (1 << TOV1)){
+        benchOverflows++;
+        TIFR1 = (1 << TOV1);
+    }
+    TIMSK1 = 0;
+    TIMSK0 = benchTimer0Mask;
+    interrupts();
+    return ((uint32_t)benchOverflows << 16) | cycles;
+}
+#else
+// the ISR is linked in whenever it's defined, so not built at all unless
+// benchmarking
+void startCycleCount(){}
+uint32_t stopCycleCount(){ return 0ul; }
+#endif
+
+
+void printBenchResult(const __FlashStringHelper* benchName, uint32_t value,
+            bool isNegative, uint32_t fmtCycles, uint32_t sprintfCycles){
+    /*
+       Prints a formatter's result, its value given as a magnitude so the u32
+       row's full range prints.
+    */
+    printPrompt();
+    writeLogF(benchName, logNull);
+    if (isNegative)
+        Serial.write('-');
+    writeLog(value, logNull);
+    writeLogF(F(": fmt="), logNull);
+    writeLog(fmtCycles, logNull);
+    writeLogF(F(" sprintf="), logNull);
+    writeLog(sprintfCycles, logNull);
+    writeLogLnF(F(" cyc"), logNull);
+}
+
+
+void runFormatBench(){
+    /*
+       Times a conversion of each benchmark value for each formatter.
+   */
+    char benchStr[FMT_MAX_LEN];
+    uint32_t overhead = 0ul;
+    uint32_t fmtCycles = 0ul;
+    uint32_t sprintfCycles = 0ul;
+    uint32_t value = 0ul;
+
+    startCycleCount();
+    overhead = stopCycleCount();
+
+    for (uint8_t i = 0; i < sizeof(BENCH_VALS) / sizeof(BENCH_VALS[0]); i++){
+        wdt_reset();
+        value = pgm_read_dword(&BENCH_VALS[i]);
+
+        startCycleCount();
+        benchSink = fmtUInt32(benchStr, value);
+        fmtCycles = stopCycleCount() - overhead;
+        startCycleCount();
+        benchSink = sprintf(benchStr, "%" PRIu32, value);
+        sprintfCycles = stopCycleCount() - overhead;
+        printBenchResult(F("u32 "), value, false, fmtCycles, sprintfCycles);
+
+        startCycleCount();
+        benchSink = fmtInt32(benchStr, -(int32_t)(value / 2));
+        fmtCycles = stopCycleCount() - overhead;
+        startCycleCount();
+        benchSink = sprintf(benchStr, "%" PRId32, -(int32_t)(value / 2));
+        sprintfCycles = stopCycleCount() - overhead;
+        printBenchResult(F("i32 "), value / 2, value > 1, fmtCycles,
+                sprintfCycles);
+
+        startCycleCount();
+        benchSink = fmtFixed2(benchStr, value / 2);
+        fmtCycles = stopCycleCount() - overhead;
+        startCycleCount();
+        benchSink = sprintf(benchStr, "%" PRId32 ".%02" PRId32,
+                (int32_t)(value / 200),
+                (int32_t)(value / 2 % 100));
+        sprintfCycles = stopCycleCount() - overhead;
+        printBenchResult(F("fix2 "), value / 2, false, fmtCycles,
+                sprintfCycles);
+    }
+}
+
+
+void printKernelResult(const __FlashStringHelper* benchName, uint32_t cycles){
+    printPrompt();
+    writeLogF(benchName, logNull);
+    writeLogF(F(": "), logNull);
+    writeLog(cycles, logNull);
+    writeLogLnF(F(" cyc"), logNull);
+}
+
+
+uint32_t timeSerialMsg(const char* benchMsgP, uint8_t nodeId,
+            uint32_t overhead){
+    /*
+       Times dispatch and handling of a serial message, as from the server,
+       with nodeId appended if not 0.
+   */
+    strcpy_P(serInBuff, benchMsgP);
+    if (nodeId > 0)
+        fmtUInt8(serInBuff + strlen(serInBuff), nodeId);
+    startCycleCount();
+    processSerialMessage();
+    return stopCycleCount() - overhead;
+}
+
+
+uint8_t getFreeBenchNodeId(){
+    /*
+       Returns the lowest id from BENCH_NODE_ID_BASE not in the node table,
+       of which there are always more than node slots.
+   */
+    uint8_t nodeId = BENCH_NODE_ID_BASE;
+    while (getNodeIxById(nodeId) < UINT8_MAX)
+        nodeId++;
+    return nodeId;
+}
+
+
+void runKernelBench(){
+    /*
+       Times the message parse, node snapshot and serial message dispatch
+       kernels, parsing into bench nodes added to the free node slots.
+   */
+    uint32_t overhead = 0ul;
+    uint32_t cycles = 0ul;
+    uint8_t nodeCount = 0;
+    uint8_t benchNodeIx = UINT8_MAX;
+    // slots filled by bench nodes, the only ones cleared after
+    bool isBenchSlot[MAX_MTR_NODES] = {};
+    LogLev prevLogLevel = cfgLogLevel;
+    uint16_t prevBadMsgs = statCounters[statSerBadMsg];
+
+    startCycleCount();
+    overhead = stopCycleCount();
+
+    for (uint8_t i = 0; i < MAX_MTR_NODES; i++){
+        if (meterNodes[i].nodeId == 0 && benchNodeIx == UINT8_MAX)
+            benchNodeIx = i;
+        if (meterNodes[i].nodeId > 0)
+            nodeCount++;
+    }
+    if (benchNodeIx == UINT8_MAX){
+        printPrompt();
+        writeLogLnF(F("No free node slot"), logNull);
+        return;
+    }
+    meterNodes[benchNodeIx].nodeId = getFreeBenchNodeId();
+    isBenchSlot[benchNodeIx] = true;
+
+    wdt_reset();
+    strcpy_P(msgBuffStr, BENCH_MUPC_MSG);
+    startCycleCount();
+    parseMeterUpdateMsg(benchNodeIx, true);
+    printKernelResult(F("MUPC parse"), stopCycleCount() - overhead);
+
+    strcpy_P(msgBuffStr, BENCH_MUP__MSG);
+    startCycleCount();
+    parseMeterUpdateMsg(benchNodeIx, false);
+    printKernelResult(F("MUP_ parse"), stopCycleCount() - overhead);
+
+    strcpy_P(msgBuffStr, BENCH_GINR_MSG);
+    startCycleCount();
+    parseGinrMsg(benchNodeIx);
+    printKernelResult(F("GINR parse"), stopCycleCount() - overhead);
+
+    // no match logs a warning, which is not the dispatch cost
+    cfgLogLevel = logError;
+    wdt_reset();
+    cycles = timeSerialMsg(BENCH_NACK_MSG, getFreeBenchNodeId(), overhead);
+    printKernelResult(F("dispatch GNOSNAP NACK"), cycles);
+    cycles = timeSerialMsg(BENCH_NOMATCH_MSG, 0, overhead);
+    printKernelResult(F("dispatch no match"), cycles);
+    cfgLogLevel = prevLogLevel;
+    statCounters[statSerBadMsg] = prevBadMsgs;
+
+    // snapshot of all nodes, adding a bench node (copied from the first)
+    // per run until the table is full
+    for (uint8_t i = benchNodeIx; i < MAX_MTR_NODES; i++){
+        if (meterNodes[i].nodeId > 0 && i != benchNodeIx)
+            continue;
+        wdt_reset();
+        if (i != benchNodeIx){
+            meterNodes[i] = meterNodes[benchNodeIx];
+            meterNodes[i].nodeId = getFreeBenchNodeId();
+            isBenchSlot[i] = true;
+        }
+        nodeCount++;
+        cycles = timeSerialMsg(BENCH_NOSNAP_MSG, 0, overhead);
+        printPrompt();
+        writeLogF(F("NOSNAP "), logNull);
+        writeLog(nodeCount, logNull);
+        writeLogF(F(" nodes: "), logNull);
+        writeLog(cycles, logNull);
+        writeLogLnF(F(" cyc"), logNull);
+    }
+
+    for (uint8_t i = 0; i < MAX_MTR_NODES; i++)
+        if (isBenchSlot[i])
+            meterNodes[i] = MeterNode();
+}
+
+
+void checkBench(){
+    /*
+       Runs the benchmarks if requested with BNCH.  Run from loop() rather
+       than while the command is handled, as the kernels use both phases of
+       BuffArena - each loads its own input, so nothing is left to clobber.
+   */
+    if (! benchPending)
+        return;
+    benchPending = false;
+
+    runFormatBench();
+    runKernelBench();
+    printPrompt();
+    writeLogLnF(F("Bench done"), logNull);
+}
+
+
 void processSerialCommand(){
     /*
        Processes a serial command from the serial buffer
@@ -1294,6 +3088,10 @@ void processSerialCommand(){
         writeLogF(F("Free RAM (B)="), logNull);
         writeLogLn(freeRAM(), logNull);
 
+        printPrompt();
+        writeLogF(F("Min Free RAM (B)="), logNull);
+        writeLogLn(minFreeRAM(), logNull);
+
         cmdStatus = dump;
     }
 
@@ -1305,8 +3103,7 @@ void processSerialCommand(){
 
     // set time
     if (strStartsWithP(serInBuff, SER_CMD_TIME) == 2){
-        strncpy(cmdVal, serInBuff + strlen_P(SER_CMD_TIME) + 1,
-                (strlen(serInBuff) - strlen_P(SER_CMD_TIME) -1));
+        copyCmdArgs(cmdVal, sizeof(cmdVal), serInBuff + strlen_P(SER_CMD_TIME));
         tmpInt = strtoul(cmdVal,NULL,0);
         if (tmpInt > 0){
             setNowTimestampSec(tmpInt);
@@ -1321,10 +3118,18 @@ void processSerialCommand(){
     // print time, also echoes after being set
     if (cmdStatus == dump || strStartsWithP(serInBuff, SER_CMD_TIME) >= 1){
         printPrompt();
+        uint16_t nowMs;
+        uint32_t nowSecs = getNowTimestampSec(&nowMs);
         writeLogF(F("Time="), logNull);
-        printTime(getNowTimestampSec(), logNull);
+        printTime(nowSecs, logNull);
         writeLogF(F(" / "), logNull);
-        writeLog(getNowTimestampSec(), logNull);
+        writeLog(nowSecs, logNull);
+        // ms as 1ddd, with the leading 1 replaced by the point
+        fmtUInt16(tmpStr, nowMs + 1000);
+        tmpStr[0] = '.';
+        writeLog(tmpStr, logNull);
+        writeLogF(F(" rtt="), logNull);
+        writeLog(lastTimeRTTMs, logNull);
         printNewLine(logNull);
         if (cmdStatus != dump)
             cmdStatus = valid;
@@ -1332,8 +3137,7 @@ void processSerialCommand(){
 
     // set log level
     if (strStartsWithP(serInBuff, SER_CMD_LOGL) == 2){
-        strncpy(tmpStr, serInBuff + strlen_P(SER_CMD_LOGL) + 1,
-                (strlen(serInBuff) - strlen_P(SER_CMD_LOGL) -1));
+        copyCmdArgs(tmpStr, sizeof(tmpStr), serInBuff + strlen_P(SER_CMD_LOGL));
         if (strStartsWithP(tmpStr, LOG_ERROR_LBL) == 1)
             cfgLogLevel = logError;
         else if (strStartsWithP(tmpStr, LOG_WARN_LBL) == 1)
@@ -1347,6 +3151,11 @@ void processSerialCommand(){
             writeLogLnF(F("Bad LogLev"), logNull);
             return;
         }
+        if (! isLogLevelBuilt(cfgLogLevel)){
+            cfgLogLevel = BUILD_LOG_LEVEL;
+            printPrompt();
+            writeLogLnF(F("LogLev limited by build"), logNull);
+        }
         putConfigToMem();  // apply config and write to EEPROM
         cmdStatus = valid;
     }
@@ -1363,8 +3172,7 @@ void processSerialCommand(){
 
     // set radio encryption key
     if (strStartsWithP(serInBuff, SER_CMD_EKEY) == 2){
-        strncpy(tmpStr, serInBuff + strlen_P(SER_CMDS[6]) + 1,
-                (strlen(serInBuff) - strlen_P(SER_CMDS[6]) -1));
+        copyCmdArgs(tmpStr, sizeof(tmpStr), serInBuff + strlen_P(SER_CMD_EKEY));
         if (strlen(tmpStr) != KEY_LENGTH){
             printPrompt();
             writeLogLnF(F("Bad Key"), logNull);
@@ -1389,8 +3197,7 @@ void processSerialCommand(){
 
     // set radio net id
     if (strStartsWithP(serInBuff, SER_CMD_NETI) == 2){
-        strncpy(tmpStr, serInBuff + strlen_P(SER_CMD_NETI) + 1,
-                (strlen(serInBuff) - strlen_P(SER_CMD_NETI) -1));
+        copyCmdArgs(tmpStr, sizeof(tmpStr), serInBuff + strlen_P(SER_CMD_NETI));
         uint8_t addr1 = 0;
         uint8_t addr2 = 0;
         uint8_t addr3 = 0;
@@ -1423,8 +3230,7 @@ void processSerialCommand(){
 
     // set gateway id
     if (strStartsWithP(serInBuff, SER_CMD_GWID) == 2){
-        strncpy(cmdVal, serInBuff + strlen_P(SER_CMD_GWID) + 1,
-                (strlen(serInBuff) - strlen_P(SER_CMD_GWID) -1));
+        copyCmdArgs(cmdVal, sizeof(cmdVal), serInBuff + strlen_P(SER_CMD_GWID));
         tmpInt = strtoul(cmdVal,NULL,0);
         if (tmpInt < 1 || tmpInt > 253){
             printPrompt();
@@ -1449,10 +3255,8 @@ void processSerialCommand(){
 
     // set TX power
     if (strStartsWithP(serInBuff, SER_CMD_TXPW) == 2){
-        strncpy(cmdVal, serInBuff + strlen_P(SER_CMD_TXPW) + 1,
-                (strlen(serInBuff) - strlen_P(SER_CMD_TXPW) -1));
-        static int16_t txPow = 0;
-        txPow = strtol(cmdVal,NULL,0);
+        copyCmdArgs(cmdVal, sizeof(cmdVal), serInBuff + strlen_P(SER_CMD_TXPW));
+        int16_t txPow = strtol(cmdVal,NULL,0);
 
         if (! isTXPowValid(txPow)){
             printPrompt();
@@ -1487,25 +3291,109 @@ void processSerialCommand(){
 
     // set entry alignment
     if (strStartsWithP(serInBuff, SER_CMD_ENTA) == 2){
-        strncpy(cmdVal, serInBuff + strlen_P(SER_CMD_ENTA) + 1,
-                (strlen(serInBuff) - strlen_P(SER_CMD_ENTA) -1));
+        if (setCfgFlag(&cfgAlignEntries, SER_CMD_ENTA))
+            cmdStatus = valid;
+    }
+
+    // print entry alignment, also echoes after being set
+    if (cmdStatus == dump || strStartsWithP(serInBuff, SER_CMD_ENTA) >= 1){
+        printPrompt();
+        writeLogF(F("Entry Algn="), logNull);
+        writeLogLn(cfgAlignEntries, logNull);
+        if (cmdStatus != dump)
+            cmdStatus = valid;
+    }
+
+    // set node alert thresholds
+    if (ALERT_ENABLED && strStartsWithP(serInBuff, SER_CMD_ALRT) == 2){
+        copyCmdArgs(tmpStr, sizeof(tmpStr), serInBuff + strlen_P(SER_CMD_ALRT));
+        if (setAlertConfig(tmpStr))
+            cmdStatus = valid;
+        else{
+            printPrompt();
+            writeLogLnF(F("Bad Alerts (batt_mv,rssi,drift_s,free_ram)"),
+                    logNull);
+        }
+    }
+
+    // print node alert thresholds, also echoes after being set
+    if (ALERT_ENABLED && (cmdStatus == dump ||
+            strStartsWithP(serInBuff, SER_CMD_ALRT) >= 1)){
+        printPrompt();
+        writeLogF(F("Alerts="), logNull);
+        printAlertConfig();
+        printNewLine(logNull);
+        if (cmdStatus != dump)
+            cmdStatus = valid;
+    }
+
+    // set serial framing
+    if (strStartsWithP(serInBuff, SER_CMD_FRMG) == 2){
+        if (setCfgFlag(&cfgSerFraming, SER_CMD_FRMG))
+            cmdStatus = valid;
+    }
+
+    // print serial framing, also echoes after being set
+    if (cmdStatus == dump || strStartsWithP(serInBuff, SER_CMD_FRMG) >= 1){
+        printPrompt();
+        writeLogF(F("Framing="), logNull);
+        writeLogLn(cfgSerFraming, logNull);
+        if (cmdStatus != dump)
+            cmdStatus = valid;
+    }
+
+    // set tokenised logging
+    if (LOG_TOKEN_ENABLED && strStartsWithP(serInBuff, SER_CMD_LOGT) == 2){
+        if (setCfgFlag(&cfgLogTokens, SER_CMD_LOGT))
+            cmdStatus = valid;
+    }
+
+    // print tokenised logging, also echoes after being set
+    if (LOG_TOKEN_ENABLED && (cmdStatus == dump ||
+            strStartsWithP(serInBuff, SER_CMD_LOGT) >= 1)){
+        printPrompt();
+        writeLogF(F("Log Tokens="), logNull);
+        writeLogLn(cfgLogTokens, logNull);
+        if (cmdStatus != dump)
+            cmdStatus = valid;
+    }
+
+    // set RSSI in meter passthroughs
+    if (strStartsWithP(serInBuff, SER_CMD_MRSS) == 2){
+        if (setCfgFlag(&cfgMeterRSSI, SER_CMD_MRSS))
+            cmdStatus = valid;
+    }
+
+    // print RSSI in meter passthroughs, also echoes after being set
+    if (cmdStatus == dump || strStartsWithP(serInBuff, SER_CMD_MRSS) >= 1){
+        printPrompt();
+        writeLogF(F("Meter RSSI="), logNull);
+        writeLogLn(cfgMeterRSSI, logNull);
+        if (cmdStatus != dump)
+            cmdStatus = valid;
+    }
+
+    // set most relay hops
+    if (RELAY_ENABLED && strStartsWithP(serInBuff, SER_CMD_RLAY) == 2){
+        copyCmdArgs(cmdVal, sizeof(cmdVal), serInBuff + strlen_P(SER_CMD_RLAY));
         tmpInt = strtoul(cmdVal,NULL,0);
-        if (tmpInt == 0 || tmpInt == 1){
-            cfgAlignEntries = tmpInt;
+        if (tmpInt <= RELAY_MAX_HOPS){
+            cfgRelayMaxHops = tmpInt;
             putConfigToMem();
             cmdStatus = valid;
         }
         else{
             printPrompt();
-            writeLogLnF(F("Bad ENTA"), logNull);
+            writeLogLnF(F("Bad RLAY"), logNull);
         }
     }
 
-    // print entry alignment, also echoes after being set
-    if (cmdStatus == dump || strStartsWithP(serInBuff, SER_CMD_ENTA) >= 1){
+    // print most relay hops, also echoes after being set
+    if (RELAY_ENABLED && (cmdStatus == dump ||
+            strStartsWithP(serInBuff, SER_CMD_RLAY) >= 1)){
         printPrompt();
-        writeLogF(F("Entry Algn="), logNull);
-        writeLogLn(cfgAlignEntries, logNull);
+        writeLogF(F("Relay Hops="), logNull);
+        writeLogLn(cfgRelayMaxHops, logNull);
         if (cmdStatus != dump)
             cmdStatus = valid;
     }
@@ -1516,8 +3404,7 @@ void processSerialCommand(){
     }
 
     if (strStartsWithP(serInBuff, SER_CMD_DUMPNO) == 2){
-        strncpy(tmpStr, serInBuff + strlen_P(SER_CMD_DUMPNO) + 1,
-                (strlen(serInBuff) - strlen_P(SER_CMD_DUMPNO) -1));
+        copyCmdArgs(tmpStr, sizeof(tmpStr), serInBuff + strlen_P(SER_CMD_DUMPNO));
         tmpInt = strtoul(tmpStr,NULL,0);
         if (tmpInt < 2 || tmpInt > 254){
             printPrompt();
@@ -1526,8 +3413,7 @@ void processSerialCommand(){
         else if (tmpInt == 254)
             printNodes(false);
         else {
-            static uint8_t nodeIx = 0;
-            nodeIx = getNodeIxById(tmpInt);
+            uint8_t nodeIx = getNodeIxById(tmpInt);
             if (nodeIx < UINT8_MAX){
                 printNodeSnapByIx(nodeIx, false);
                 printNewLine(logNull);
@@ -1540,7 +3426,46 @@ void processSerialCommand(){
         cmdStatus = valid;
     }
 
+    if (STATS_ENABLED && strStartsWithP(serInBuff, SER_CMD_DUMPS) == 1){
+        printStats();
+        cmdStatus = valid;
+    }
+
+    // set traffic capture, not saved
+    if (CAPTURE_ENABLED && strStartsWithP(serInBuff, SER_CMD_CAPT) == 2){
+        copyCmdArgs(cmdVal, sizeof(cmdVal), serInBuff + strlen_P(SER_CMD_CAPT));
+        tmpInt = strtoul(cmdVal,NULL,0);
+        if (tmpInt == 0 || tmpInt == 1){
+            captureOn = tmpInt;
+            cmdStatus = valid;
+        }
+        else{
+            printPrompt();
+            writeLogLnF(F("Bad CAPT"), logNull);
+        }
+    }
+
+    // print traffic capture, also echoes after being set
+    if (CAPTURE_ENABLED && strStartsWithP(serInBuff, SER_CMD_CAPT) >= 1){
+        printPrompt();
+        writeLogF(F("Capture="), logNull);
+        writeLogLn(captureOn, logNull);
+        cmdStatus = valid;
+    }
+
+    if (PROFILE_ENABLED && strStartsWithP(serInBuff, SER_CMD_DUMPP) == 1){
+        printProfile();
+        cmdStatus = valid;
+    }
+
+    // run from loop(), see checkBench()
+    if (BENCH_ENABLED && strStartsWithP(serInBuff, SER_CMD_BNCH) == 1){
+        benchPending = true;
+        cmdStatus = valid;
+    }
+
     if (cmdStatus == invalid){
+        incStat(statSerBadCmd);
         printPrompt();
         writeLogLnF(F("Bad Cmd"), logNull);
         printCmdHelp();
@@ -1552,37 +3477,83 @@ void processSerialMessage(){
     /*
        Processes a serial message from the serial buffer.  Minimal validation.
     */
-    static uint8_t nodeIx = UINT8_MAX;
-    static uint8_t nodeId = 0;
+    uint8_t nodeIx = UINT8_MAX;
+    uint8_t nodeId = 0;
 
     wdt_reset();
 
-    // Time set instruction.  Form is [STIME,new_epoch_time_utc].
+    // Time set instruction.  Form is [STIME,new_epoch_time_utc] or, in reply
+    // to GTIME, [STIME,new_epoch_time_utc,ms,request_id].
     if (strStartsWithP(serInBuff, SMSG_RX_PREFIX, SMSG_STIME) == 1){
-        strncpy(tmpStr, serInBuff + strlen_P(SMSG_RX_PREFIX) +
-                strlen_P(SMSG_STIME) + 1,
-                (strlen(serInBuff) - strlen_P(SMSG_STIME)));
-        tmpInt = strtoul(tmpStr,NULL,0);
-        if (tmpInt > 0){
-            setNowTimestampSec(tmpInt);
-            // write-back ACK
-            print_P(SMSG_TX_PREFIX);
-            println_P(SMSG_STIME_ACK);
+        copyCmdArgs(tmpStr, sizeof(tmpStr), serInBuff +
+                strlen_P(SMSG_RX_PREFIX) + strlen_P(SMSG_STIME));
+        char* fieldEnd = NULL;
+        uint32_t timeMs = 0;
+        uint32_t timeReqIdRx = 0;
+        tmpInt = strtoul(tmpStr, &fieldEnd, 0);
+        bool isWithMs = (*fieldEnd == SMSG_FS);
+        if (isWithMs){
+            timeMs = strtoul(fieldEnd + 1, &fieldEnd, 10);
+            if (*fieldEnd == SMSG_FS)
+                timeReqIdRx = strtoul(fieldEnd + 1, &fieldEnd, 10);
+            else
+                tmpInt = 0;
+        }
+        bool isReply = (isWithMs && isTimeReqPending &&
+                timeReqIdRx == timeReqId);
+        uint32_t rttMs = millis() - timeReqMillis;
+        if (tmpInt > 0 && isReply && rttMs > TIME_MAX_RTT_MS){
+            isTimeReqPending = false;
+            timeReqMillis = millis() - (TIME_SYNC_INTERVAL_MS - TIME_RETRY_MS);
+            beginSerMsg();
+            println_P(SMSG_STIME_NACK);
+            writeLogF(F("Stale STIME from server, rtt="), logWarn);
+            writeLogLn(rttMs, logWarn);
+        }
+        else if (tmpInt > 0 && timeMs < 1000 && *fieldEnd == '\0'){
+            // the reply to the pending GTIME is half its round trip old
+            lastTimeRTTMs = -1;
+            if (isReply){
+                lastTimeRTTMs = rttMs;
+                timeMs += rttMs / 2;
+                tmpInt += timeMs / 1000;
+                timeMs %= 1000;
+                isTimeReqPending = false;
+            }
+            setNowTimestamp(tmpInt, timeMs);
+            // write-back ACK, with the round trip if measured
+            beginSerMsg();
+            if (lastTimeRTTMs >= 0){
+                print_P(SMSG_STIME_ACK);
+                Serial.write(SMSG_RS);
+                writeLog(timeReqIdRx, logNull);
+                Serial.write(SMSG_FS);
+                writeLogLn(lastTimeRTTMs, logNull);
+            }
+            else
+                println_P(SMSG_STIME_ACK);
             writeLogF(F("Set time on svr inst="), logDebug);
             printTime(getNowTimestampSec(), logDebug);
-            writeLogLn("", logDebug);
+            writeLogF(F(" rtt="), logDebug);
+            writeLogLn(lastTimeRTTMs, logDebug);
         }
         else {
-            print_P(SMSG_TX_PREFIX);
+            beginSerMsg();
             println_P(SMSG_STIME_NACK);
             writeLogF(F("Bad STIME from server"), logWarn);
             writeLogLn("", logWarn);
         }
     }
 
+    // Request for runtime counters.  Form is [GGSTATS].
+    else if (STATS_ENABLED &&
+            strStartsWithP(serInBuff, SMSG_RX_PREFIX, SMSG_GGSTATS) == 1){
+        sendSerStats();
+    }
+
     // Request for gateway status dump.  Form is [GGWSNAP].
     else if (strStartsWithP(serInBuff, SMSG_RX_PREFIX, SMSG_GGWSNAP) == 1){
-        print_P(SMSG_TX_PREFIX);
+        beginSerMsg();
         print_P(SMSG_GWSNAP);
         Serial.write(SMSG_RS);
         writeLog(cfgGatewayId, logNull);
@@ -1600,17 +3571,18 @@ void processSerialMessage(){
         printNetworkId();
         Serial.write(SMSG_FS);
         writeLog(cfgTXPower, logNull);
+        Serial.write(SMSG_FS);
+        writeLog(minFreeRAM(), logNull);
         printNewLine(logNull);
     }
 
     // Request for node snapshot.  Form is [GNOSNAP,node_id].
     else if (strStartsWithP(serInBuff, SMSG_RX_PREFIX, SMSG_GNOSNAP) == 1){
-        strncpy(tmpStr, serInBuff + strlen_P(SMSG_RX_PREFIX) +
-                strlen_P(SMSG_GNOSNAP) + 1,
-                (strlen(serInBuff) - strlen_P(SMSG_GNOSNAP)));
+        copyCmdArgs(tmpStr, sizeof(tmpStr), serInBuff +
+                strlen_P(SMSG_RX_PREFIX) + strlen_P(SMSG_GNOSNAP));
         nodeId = strtoul(tmpStr,NULL,0);
         nodeIx = getNodeIxById(nodeId);
-        print_P(SMSG_TX_PREFIX);
+        beginSerMsg();
         if (nodeId == 254){
             // return all
             print_P(SMSG_NOSNAP);
@@ -1633,13 +3605,13 @@ void processSerialMessage(){
     // Request to reset node meter value.
     // Form is [SMVAL,node_id,new_meter_value].
     else if (strStartsWithP(serInBuff, SMSG_RX_PREFIX, SMSG_SMVAL) == 1){
-        strncpy(tmpStr, serInBuff + strlen_P(SMSG_RX_PREFIX) +
-                strlen_P(SMSG_SMVAL) + 1,
-                (strlen(serInBuff) - strlen_P(SMSG_SMVAL)));
-        static uint32_t newMeterValue = 0ul;
-        sscanf(tmpStr, "%" SCNu8 ",%lu", &nodeId, &newMeterValue);
-        nodeIx = getNodeIxById(nodeId);
-        print_P(SMSG_TX_PREFIX);
+        copyCmdArgs(tmpStr, sizeof(tmpStr), serInBuff +
+                strlen_P(SMSG_RX_PREFIX) + strlen_P(SMSG_SMVAL));
+        uint32_t newMeterValue = 0ul;
+        if (sscanf(tmpStr, "%" SCNu8 ",%" SCNu32, &nodeId,
+                &newMeterValue) == 2)
+            nodeIx = getNodeIxById(nodeId);
+        beginSerMsg();
         if (nodeIx < UINT8_MAX &&
                 (newMeterValue > 0 && newMeterValue < UINT32_MAX)){
             meterNodes[nodeIx].newMeterValue = newMeterValue;
@@ -1664,15 +3636,14 @@ void processSerialMessage(){
     // Request to set node meter puck LED pulse rate and time.  Form is
     // [SPLED,node_id,new_puck_led_rate,new_puck_led_time].
     else if (strStartsWithP(serInBuff, SMSG_RX_PREFIX, SMSG_SPLED) == 1){
-        strncpy(tmpStr, serInBuff + strlen_P(SMSG_RX_PREFIX) +
-                strlen_P(SMSG_SPLED) + 1,
-                (strlen(serInBuff) - strlen_P(SMSG_SPLED)));
-        static uint32_t newPuckLEDRate = 0ul;
-        static uint32_t newPuckLEDTime = 0ul;
-        sscanf(tmpStr, "%" SCNu8 ",%lu,%lu",
-                    &nodeId, &newPuckLEDRate, &newPuckLEDTime);
-        nodeIx = getNodeIxById(nodeId);
-        print_P(SMSG_TX_PREFIX);
+        copyCmdArgs(tmpStr, sizeof(tmpStr), serInBuff +
+                strlen_P(SMSG_RX_PREFIX) + strlen_P(SMSG_SPLED));
+        uint32_t newPuckLEDRate = 0ul;
+        uint32_t newPuckLEDTime = 0ul;
+        if (sscanf(tmpStr, "%" SCNu8 ",%" SCNu32 ",%" SCNu32,
+                    &nodeId, &newPuckLEDRate, &newPuckLEDTime) == 3)
+            nodeIx = getNodeIxById(nodeId);
+        beginSerMsg();
         if (nodeIx < UINT8_MAX && newPuckLEDRate < UINT8_MAX
                 && newPuckLEDTime <= 3000){
             meterNodes[nodeIx].newPuckLEDRate = newPuckLEDRate;
@@ -1700,13 +3671,13 @@ void processSerialMessage(){
     // entry, e.g. 5s, which may be an aggregation of many reads).  Form is
     // [SMINT,node_id,new_meter_interval].
     else if (strStartsWithP(serInBuff, SMSG_RX_PREFIX, SMSG_SMINT) == 1){
-        strncpy(tmpStr,
-                serInBuff + strlen_P(SMSG_RX_PREFIX) + strlen_P(SMSG_SMINT) + 1,
-                (strlen(serInBuff) - strlen_P(SMSG_SMINT)));
-        static uint32_t newMeterInterval = 0ul;
-        sscanf(tmpStr, "%" SCNu8 "%lu", &nodeId, &newMeterInterval);
-        nodeIx = getNodeIxById(nodeId);
-        print_P(SMSG_TX_PREFIX);
+        copyCmdArgs(tmpStr, sizeof(tmpStr), serInBuff +
+                strlen_P(SMSG_RX_PREFIX) + strlen_P(SMSG_SMINT));
+        uint32_t newMeterInterval = 0ul;
+        if (sscanf(tmpStr, "%" SCNu8 ",%" SCNu32, &nodeId,
+                &newMeterInterval) == 2)
+            nodeIx = getNodeIxById(nodeId);
+        beginSerMsg();
         if (nodeIx < UINT8_MAX && newMeterInterval < UINT8_MAX){
             meterNodes[nodeIx].newMeterInterval = newMeterInterval;
             print_P(SMSG_SMINT_ACK);
@@ -1729,14 +3700,14 @@ void processSerialMessage(){
     // Request to set node GINR poll rate temporarily to more aggressive value
     // [SGITR;node_id,tmp_poll_rate,tmp_poll_period].
     else if (strStartsWithP(serInBuff, SMSG_RX_PREFIX, SMSG_SGITR) == 1){
-        strncpy(tmpStr,
-                serInBuff + strlen_P(SMSG_RX_PREFIX) + strlen_P(SMSG_SGITR) + 1,
-                (strlen(serInBuff) - strlen_P(SMSG_SGITR)));
-        static uint32_t tmpPollRate = 0ul;
-        static uint32_t tmpPollPeriod = 0ul;
-        sscanf(tmpStr, "%" SCNu8 ",%lu,%lu", &nodeId, &tmpPollRate, &tmpPollPeriod);
-        nodeIx = getNodeIxById(nodeId);
-        print_P(SMSG_TX_PREFIX);
+        copyCmdArgs(tmpStr, sizeof(tmpStr), serInBuff +
+                strlen_P(SMSG_RX_PREFIX) + strlen_P(SMSG_SGITR));
+        uint32_t tmpPollRate = 0ul;
+        uint32_t tmpPollPeriod = 0ul;
+        if (sscanf(tmpStr, "%" SCNu8 ",%" SCNu32 ",%" SCNu32, &nodeId,
+                &tmpPollRate, &tmpPollPeriod) == 3)
+            nodeIx = getNodeIxById(nodeId);
+        beginSerMsg();
         if (nodeIx < UINT8_MAX && tmpPollRate >= 10 && tmpPollRate <= 600
                && tmpPollPeriod >= 10 && tmpPollPeriod <= 3000){
             meterNodes[nodeIx].tmpGinrPollRate = tmpPollRate;
@@ -1761,7 +3732,121 @@ void processSerialMessage(){
         writeLogLnF(F("s"), logInfo);
     }
 
+    // Request to set node health alert thresholds, 0 to disable.  Form is
+    // [SALRT;batt_mv,rssi,drift_secs,free_ram].
+    else if (ALERT_ENABLED &&
+            strStartsWithP(serInBuff, SMSG_RX_PREFIX, SMSG_SALRT) == 1){
+        copyCmdArgs(tmpStr, sizeof(tmpStr), serInBuff +
+                strlen_P(SMSG_RX_PREFIX) + strlen_P(SMSG_SALRT));
+        beginSerMsg();
+        if (setAlertConfig(tmpStr)){
+            println_P(SMSG_SALRT_ACK);
+            writeLogF(F("Set alerts svr inst="), logInfo);
+            writeLogLn(tmpStr, logInfo);
+        }
+        else{
+            println_P(SMSG_SALRT_NACK);
+            writeLogF(F("Bad alerts svr inst="), logWarn);
+            writeLogLn(tmpStr, logWarn);
+        }
+    }
+
+    // Request to filter node events sent to server, by type and node.  Form
+    // is [SFILT;type_mask,node_id_1,...,node_id_n], all nodes if none given.
+    else if (EVT_FILTER_ENABLED &&
+            strStartsWithP(serInBuff, SMSG_RX_PREFIX, SMSG_SFILT) == 1){
+        copyCmdArgs(tmpStr, sizeof(tmpStr), serInBuff +
+                strlen_P(SMSG_RX_PREFIX) + strlen_P(SMSG_SFILT));
+        beginSerMsg();
+        if (setSerEventFilter(tmpStr)){
+            println_P(SMSG_SFILT_ACK);
+            writeLogF(F("Set evt filter svr inst, types="), logInfo);
+            writeLogLn(evtFilterTypes, logInfo);
+        }
+        else{
+            println_P(SMSG_SFILT_NACK);
+            writeLogLnF(F("Bad evt filter svr inst"), logWarn);
+        }
+    }
+
+    // Request to update a node's firmware, see Firmware Relay.  Form is
+    // [SFWST;node_id,image_len,image_crc16], image_len 0 to cancel.
+    else if (FW_RELAY_ENABLED &&
+            strStartsWithP(serInBuff, SMSG_RX_PREFIX, SMSG_SFWST) == 1){
+        copyCmdArgs(tmpStr, sizeof(tmpStr), serInBuff +
+                strlen_P(SMSG_RX_PREFIX) + strlen_P(SMSG_SFWST));
+        uint32_t imageLen = UINT32_MAX;
+        uint32_t imageCrc = 0ul;
+        if (sscanf(tmpStr, "%" SCNu8 ",%" SCNu32 ",%" SCNu32, &nodeId,
+                &imageLen, &imageCrc) != 3)
+            nodeId = 0;
+        beginSerMsg();
+        // one transfer at a time
+        if (nodeId > 0 && nodeId < UINT8_MAX && nodeId != cfgGatewayId &&
+                imageLen <= UINT16_MAX && imageCrc <= UINT16_MAX &&
+                (fwNodeId == 0 || fwNodeId == nodeId)){
+            startFwRelay(nodeId, imageLen, imageCrc);
+            print_P(SMSG_SFWST_ACK);
+            Serial.write(SMSG_RS);
+            writeLogLn(nodeId, logNull);
+            writeLogF(F("Set firmware svr inst"), logInfo);
+        }
+        else{
+            print_P(SMSG_SFWST_NACK);
+            Serial.write(SMSG_RS);
+            writeLogLn(nodeId, logNull);
+            writeLogF(F("Bad firmware svr inst"), logWarn);
+        }
+        writeLogF(F(". Node="), logInfo);
+        writeLog(nodeId, logInfo);
+        writeLogF(F(", len="), logInfo);
+        writeLogLn(imageLen, logInfo);
+    }
+
+    // Part of a firmware image, in reply to GFWCH.  Form is
+    // [SFWCH;part_seq,base64_data], NACKed only if not taken.
+    else if (FW_RELAY_ENABLED &&
+            strStartsWithP(serInBuff, SMSG_RX_PREFIX, SMSG_SFWCH) == 1){
+        copyCmdArgs(tmpStr, sizeof(tmpStr), serInBuff +
+                strlen_P(SMSG_RX_PREFIX) + strlen_P(SMSG_SFWCH));
+        if (! putFwPart(tmpStr)){
+            beginSerMsg();
+            print_P(SMSG_SFWCH_NACK);
+            Serial.write(SMSG_RS);
+            writeLogLn((uint32_t)strtoul(tmpStr, NULL, 10), logNull);
+        }
+    }
+
+    // Request to sweep the spectrum around the radio's channel, see Spectrum
+    // Sweep.  Form is [SSWEEP;span_khz,step_khz,samples].
+    else if (SWEEP_ENABLED &&
+            strStartsWithP(serInBuff, SMSG_RX_PREFIX, SMSG_SSWEEP) == 1){
+        copyCmdArgs(tmpStr, sizeof(tmpStr), serInBuff +
+                strlen_P(SMSG_RX_PREFIX) + strlen_P(SMSG_SSWEEP));
+        uint16_t spanKhz = 0;
+        uint16_t stepKhz = 0;
+        uint8_t samples = 0;
+        uint8_t stepCount = 0;
+        if (sscanf(tmpStr, "%" SCNu16 ",%" SCNu16 ",%" SCNu8, &spanKhz,
+                &stepKhz, &samples) == 3)
+            stepCount = startSweep(spanKhz, stepKhz, samples);
+        beginSerMsg();
+        if (stepCount > 0){
+            print_P(SMSG_SSWEEP_ACK);
+            Serial.write(SMSG_RS);
+            writeLogLn((uint16_t)stepCount, logNull);
+            writeLogF(F("Set sweep svr inst, steps="), logInfo);
+            writeLogLn((uint16_t)stepCount, logInfo);
+        }
+        else{
+            println_P(SMSG_SSWEEP_NACK);
+            writeLogF(F("Bad sweep svr inst="), logWarn);
+            writeLogLn(tmpStr, logWarn);
+        }
+    }
+
     else {
+        incStat(statSerBadMsg);
         writeLogF(F("Bad Serial Message: "), logWarn);
         writeLogLn(serInBuff, logWarn);
     }
@@ -1774,11 +3859,578 @@ void checkSerialInput() {
        commands
     */
     if (readLineSerial(Serial.read(), serInBuff) > 0) {
-        if (strStartsWithP(serInBuff, SMSG_RX_PREFIX) == 1)
+        captureSerialLine();
+        // may hold radio phase data (see BuffArena), handlers copy args in
+        // unterminated
+        memset(tmpStr, 0, sizeof(tmpStr));
+        uint32_t profStartMicros = startProfile();
+        if (strStartsWithP(serInBuff, SMSG_RX_PREFIX) == 1){
             processSerialMessage();
-        else
+            endProfile(profSerMsg, profStartMicros);
+        }
+        else {
             processSerialCommand();
+            endProfile(profSerCmd, profStartMicros);
+        }
+    }
+}
+
+
+const char* nextMsgField(const char* msgField){
+    /*
+       Returns start of the next ';' or ',' delimited field in a message after
+       that at msgField, or NULL if none.  Unlike strtok, leaves the message
+       intact to be passed through afterwards.
+    */
+    msgField += strcspn(msgField, ";,");
+    msgField += strspn(msgField, ";,");
+    return (*msgField == '\0') ? NULL : msgField;
+}
+
+
+void parseMeterUpdateMsg(uint8_t nodeIx, bool isWithCurrent){
+    /**
+        Parses a meter update (MUPC, or MUP_ if without current reads) in the
+        message buffer into the node's latest entry.
+     */
+    uint32_t meterEntryFinishTime = 0ul;
+    uint32_t meterEntryValue = 0ul;
+    double currentRMS = 0.0;
+    uint8_t i = 0;
+
+    // step through message value fields, adding up times and entry values
+    const char* token = nextMsgField(msgBuffStr);
+    while (token != NULL){
+        i++;
+        if (i == 1)
+            meterEntryFinishTime = strtoul(token, NULL, 0);
+        else if (i == 2)
+            meterEntryValue = strtoul(token, NULL, 0);
+        else if (isWithCurrent && i % 3 == 0)       // a current entry
+            currentRMS = strtod(token, NULL);       //TODO: replace strtod
+        else if (i % 2 == 0)        // a meter entry as even field num
+            meterEntryValue += strtoul(token, NULL, 0);
+        else
+            meterEntryFinishTime += strtoul(token, NULL, 0);
+        token = nextMsgField(token);
+    }
+    if (i < 2)
+        incStat(statParseErr);
+    meterNodes[nodeIx].lastEntryFinishTime = meterEntryFinishTime;
+    meterNodes[nodeIx].lastMeterValue = meterEntryValue;
+    if (isWithCurrent)
+        meterNodes[nodeIx].lastCurrentRMS = currentRMS;
+}
+
+
+void parseGinrMsg(uint8_t nodeIx){
+    /**
+        Parses the status fields of an instruction request (GINR) in the
+        message buffer into the node's record.
+     */
+    if (sscanf(msgBuffStr, "GINR,%" SCNu16 ",%" SCNu32 ",%" SCNu32 ",%" SCNu16
+            ",%" SCNd8 ",%" SCNu8 ",%" SCNu16 ",%" SCNu8 ",%" SCNu16,
+            &meterNodes[nodeIx].battVoltageMV,
+            &meterNodes[nodeIx].secondsUptime,
+            &meterNodes[nodeIx].secondsSlept,
+            &meterNodes[nodeIx].freeRAM,
+            &lastRSSIAtNode,
+            &meterNodes[nodeIx].puckLEDRate,
+            &meterNodes[nodeIx].puckLEDTime,
+            &meterNodes[nodeIx].meterInterval,
+            &meterNodes[nodeIx].meterImpPerKwh
+        ) != 9)
+        incStat(statParseErr);
+}
+
+
+bool unwrapRelayMsg(){
+    /*
+       If the message in the buffer came through a relay (RFWD), takes it out
+       of its envelope, as from the node it came from, noting the route.  False
+       if relayed but not accepted.
+    */
+    lastMsgRelay = 0;
+    lastMsgHops = 0;
+    lastMsgHeldMs = 0;
+    if (! RELAY_ENABLED || strStartsWithP(msgBuffStr, RMSG_RFWD) != 1)
+        return true;
+
+    // RFWD,<node_id>,<hops>,<held_ms>;<frame>
+    char* fieldEnd = msgBuffStr + strlen_P(RMSG_RFWD);
+    uint32_t originId = 0;
+    uint32_t relayHops = 0;
+    uint32_t heldMs = 0;
+    if (*fieldEnd == ',')
+        originId = strtoul(fieldEnd + 1, &fieldEnd, 10);
+    if (*fieldEnd == ',')
+        relayHops = strtoul(fieldEnd + 1, &fieldEnd, 10);
+    if (*fieldEnd == ',')
+        heldMs = strtoul(fieldEnd + 1, &fieldEnd, 10);
+
+    if (*fieldEnd != ';' || originId == 0 || originId >= UINT8_MAX ||
+            originId == cfgGatewayId || originId == lastMsgFrom ||
+            relayHops == 0 || relayHops > cfgRelayMaxHops){
+        incStat(statRxUnknown);
+        writeLogF(F("Relayed msg refused from node "), logWarn);
+        writeLog(lastMsgFrom, logWarn);
+        writeLogF(F(": "), logWarn);
+        writeLogLn(msgBuffStr, logWarn);
+        return false;
+    }
+
+    lastMsgRelay = lastMsgFrom;
+    lastMsgFrom = originId;
+    lastMsgHops = relayHops;
+    lastMsgHeldMs = heldMs < UINT16_MAX ? heldMs : UINT16_MAX;
+    memmove(msgBuffStr, fieldEnd + 1, strlen(fieldEnd + 1) + 1);
+
+    writeLogF(F("Relayed by node "), logDebug);
+    writeLog(lastMsgRelay, logDebug);
+    writeLogF(F(", hops="), logDebug);
+    writeLog((uint16_t)lastMsgHops, logDebug);
+    writeLogF(F(", held_ms="), logDebug);
+    writeLogLn(lastMsgHeldMs, logDebug);
+    return true;
+}
+
+
+bool wrapRelayMsg(uint8_t* recipient){
+    /*
+       If the recipient node's route is through a relay, puts the message in
+       the buffer in a relay envelope, to be sent to the relay instead.  False
+       if it won't fit.
+    */
+    if (! RELAY_ENABLED)
+        return true;
+
+    uint8_t nodeIx = getNodeIxById(*recipient);
+    if (nodeIx == UINT8_MAX || meterNodes[nodeIx].relayId == 0)
+        return true;
+
+    char envStr[16];
+    sprintf_P(envStr, RMSG_RFWD);
+    sprintf(envStr + strlen(envStr), ",%d,%d,0;", *recipient,
+            meterNodes[nodeIx].relayHops);
+    size_t envLen = strlen(envStr);
+    size_t msgLen = strlen(msgBuffStr);
+    if (envLen + msgLen > RH_RF69_MAX_MESSAGE_LEN){
+        writeLogF(F("Msg too long to relay: "), logError);
+        writeLogLn(msgBuffStr, logError);
+        return false;
+    }
+
+    memmove(msgBuffStr + envLen, msgBuffStr, msgLen + 1);
+    memcpy(msgBuffStr, envStr, envLen);
+    *recipient = meterNodes[nodeIx].relayId;
+    return true;
+}
+
+
+int8_t decodeBase64(const char* b64Str, uint8_t* outBytes, uint8_t maxLen){
+    /*
+       Decodes base64 (standard alphabet, '=' padding optional) to outBytes.
+       Returns the length, or -1 if malformed or longer than maxLen.
+    */
+    uint16_t bitBuff = 0;
+    uint8_t bitCount = 0;
+    uint8_t outLen = 0;
+
+    for (; *b64Str != '\0' && *b64Str != '='; b64Str++){
+        char b64Char = *b64Str;
+        uint8_t b64Val;
+        if (b64Char >= 'A' && b64Char <= 'Z')
+            b64Val = b64Char - 'A';
+        else if (b64Char >= 'a' && b64Char <= 'z')
+            b64Val = b64Char - 'a' + 26;
+        else if (b64Char >= '0' && b64Char <= '9')
+            b64Val = b64Char - '0' + 52;
+        else if (b64Char == '+')
+            b64Val = 62;
+        else if (b64Char == '/')
+            b64Val = 63;
+        else
+            return -1;
+
+        bitBuff = (bitBuff << 6) | b64Val;
+        bitCount += 6;
+        if (bitCount >= 8){
+            bitCount -= 8;
+            if (outLen == maxLen)
+                return -1;
+            outBytes[outLen++] = (uint8_t)(bitBuff >> bitCount);
+        }
+    }
+    return outLen;
+}
+
+
+void sendSerFwStatus(FwEvent fwEvent){
+    /*
+       Reports a firmware transfer event to the server, with the node's next
+       chunk needed and the image's chunk count
+    */
+    wdt_reset();
+    beginSerMsg();
+    print_P(SMSG_FWSTAT);
+    Serial.write(SMSG_RS);
+    writeLog(fwNodeId, logNull);
+    Serial.write(SMSG_FS);
+    writeLog(fwBase, logNull);
+    Serial.write(SMSG_FS);
+    writeLog(fwChunkCount, logNull);
+    Serial.write(SMSG_FS);
+    println_P((char*)pgm_read_word(&(FW_EVT_LBLS[fwEvent])));
+}
+
+
+void startFwRelay(uint8_t nodeId, uint16_t imageLen, uint16_t imageCrc){
+    /*
+       Queues a firmware image for a node, to be offered at its next GINR, or
+       cancels the transfer if imageLen is 0
+    */
+    fwNodeId = (imageLen > 0) ? nodeId : 0;
+    fwImageLen = imageLen;
+    fwImageCrc = imageCrc;
+    fwChunkCount = (imageLen + FW_CHUNK_LEN - 1) / FW_CHUNK_LEN;
+    fwBase = 0;
+    fwAcked = 0;
+    fwSent = 0;
+    fwParts = 0;
+    fwIsActive = false;
+    fwRetries = 0;
+}
+
+
+uint16_t getFwChunkParts(uint8_t chunkIx){
+    /*
+       Returns the bits in fwParts of the window's chunkIx'th chunk, those of
+       parts within the image (none if the chunk is past its end)
+    */
+    uint16_t chunkParts = 0;
+    uint32_t partStart = ((uint32_t)fwBase + chunkIx) * FW_CHUNK_LEN;
+    for (uint8_t i = 0; i < FW_CHUNK_PARTS; i++){
+        if (partStart < fwImageLen)
+            chunkParts |= (1 << (chunkIx * FW_CHUNK_PARTS + i));
+        partStart += FW_PART_LEN;
+    }
+    return chunkParts;
+}
+
+
+uint8_t getFwHeldChunks(){
+    /*
+       Returns a bit per window chunk with all its parts from the server
+    */
+    uint8_t heldChunks = 0;
+    for (uint8_t i = 0; i < FW_WINDOW_CHUNKS; i++){
+        uint16_t chunkParts = getFwChunkParts(i);
+        if (chunkParts != 0 && (fwParts & chunkParts) == chunkParts)
+            heldChunks |= (1 << i);
+    }
+    return heldChunks;
+}
+
+
+bool putFwPart(const char* partStr){
+    /*
+       Puts a part of the image from the server, of form
+       <part_seq>,<base64_data>, into the window.  False if not in the window
+       or malformed.
+    */
+    char* fieldEnd = NULL;
+    uint32_t partSeq = strtoul(partStr, &fieldEnd, 10);
+    uint32_t partStart = partSeq * FW_PART_LEN;
+    uint32_t chunkSeq = partSeq / FW_CHUNK_PARTS;
+    if (fwNodeId == 0 || *fieldEnd != SMSG_FS || chunkSeq < fwBase ||
+            chunkSeq >= (uint32_t)fwBase + FW_WINDOW_CHUNKS ||
+            partStart >= fwImageLen)
+        return false;
+
+    // the last part of the image may be short
+    uint8_t partLen = (fwImageLen - partStart < FW_PART_LEN) ?
+            fwImageLen - partStart : FW_PART_LEN;
+    uint8_t* partBytes = fwWindow[chunkSeq % FW_WINDOW_CHUNKS] +
+            (partSeq % FW_CHUNK_PARTS) * FW_PART_LEN;
+    if (decodeBase64(fieldEnd + 1, partBytes, FW_PART_LEN) != partLen)
+        return false;
+
+    fwParts |= (1 << (partSeq - (uint32_t)fwBase * FW_CHUNK_PARTS));
+    return true;
+}
+
+
+void requestFwParts(){
+    /*
+       Asks the server for the window's parts not held, for chunks the node
+       hasn't ACKed - as one run, from the first part missing to the last
+    */
+    uint16_t missingParts = 0;
+    for (uint8_t i = 0; i < FW_WINDOW_CHUNKS; i++)
+        if (! (fwAcked & (1 << i)))
+            missingParts |= getFwChunkParts(i);
+    missingParts &= ~fwParts;
+    if (missingParts == 0)
+        return;
+
+    uint8_t firstIx = 0;
+    uint8_t endIx = 0;
+    for (uint8_t i = 0; i < FW_WINDOW_CHUNKS * FW_CHUNK_PARTS; i++)
+        if (missingParts & (1 << i)){
+            if (endIx == 0)
+                firstIx = i;
+            endIx = i + 1;
+        }
+
+    wdt_reset();
+    beginSerMsg();
+    print_P(SMSG_GFWCH);
+    Serial.write(SMSG_RS);
+    writeLog(fwNodeId, logNull);
+    Serial.write(SMSG_FS);
+    writeLog((uint32_t)fwBase * FW_CHUNK_PARTS + firstIx, logNull);
+    Serial.write(SMSG_FS);
+    writeLogLn((uint16_t)(endIx - firstIx), logNull);
+}
+
+
+void sendFwChunk(uint8_t chunkIx, bool isLast){
+    /*
+       Broadcasts the window's chunkIx'th chunk to the node being updated,
+       without waiting for an ACK (see Firmware Relay)
+    */
+    uint16_t chunkSeq = fwBase + chunkIx;
+    uint32_t chunkStart = (uint32_t)chunkSeq * FW_CHUNK_LEN;
+    uint8_t chunkLen = (fwImageLen - chunkStart < FW_CHUNK_LEN) ?
+            fwImageLen - chunkStart : FW_CHUNK_LEN;
+
+    uint8_t frameLen = strlen_P(RMSG_FWCH);
+    memcpy_P(msgBuffStr, RMSG_FWCH, frameLen);
+    msgBuffStr[frameLen++] = fwNodeId;
+    msgBuffStr[frameLen++] = chunkSeq >> 8;
+    msgBuffStr[frameLen++] = chunkSeq & 0xFF;
+    msgBuffStr[frameLen++] = isLast ? FW_FLAG_LAST : 0;
+    memcpy(msgBuffStr + frameLen, fwWindow[chunkSeq % FW_WINDOW_CHUNKS],
+            chunkLen);
+    frameLen += chunkLen;
+
+    wdt_reset();
+    msgManager.sendtoWait((uint8_t*)msgBuffStr, frameLen,
+            RH_BROADCAST_ADDRESS);
+    captureRadioMsg('T', fwNodeId, 0, frameLen, true);
+    incStat(statTxOk);
+}
+
+
+void slideFwWindow(uint16_t nextSeq){
+    /*
+       Moves the window to the node's next chunk needed, keeping what's held
+       if it's still in the window
+    */
+    uint16_t slideBy = nextSeq - fwBase;
+    if (nextSeq < fwBase || slideBy >= FW_WINDOW_CHUNKS){
+        fwAcked = 0;
+        fwSent = 0;
+        fwParts = 0;
+    }
+    else {
+        fwAcked >>= slideBy;
+        fwSent >>= slideBy;
+        fwParts >>= slideBy * FW_CHUNK_PARTS;
+    }
+    fwBase = nextSeq;
+}
+
+
+void processFwMsg(){
+    /*
+       Handles a firmware transfer message from the node being updated, in
+       the message buffer (see Firmware Relay):
+         FWRQ,<next_seq>                  start/resume from a chunk
+         FWAK,<next_seq>,<have_mask>      bit n set if has chunk next_seq + n
+         FWDN,<crc_ok 0/1>                image received
+    */
+    uint32_t nextSeq = 0;
+    uint32_t haveMask = 0;
+    // all three names are the same length
+    char* fieldEnd = msgBuffStr + strlen_P(RMSG_FWRQ);
+    if (*fieldEnd == ',')
+        nextSeq = strtoul(fieldEnd + 1, &fieldEnd, 10);
+    if (*fieldEnd == ',')
+        haveMask = strtoul(fieldEnd + 1, &fieldEnd, 10);
+
+    if (fwNodeId == 0 || lastMsgFrom != fwNodeId || *fieldEnd != '\0' ||
+            nextSeq > fwChunkCount){
+        incStat(statRxUnknown);
+        writeLogF(F("Firmware msg refused from node "), logWarn);
+        writeLog(lastMsgFrom, logWarn);
+        writeLogF(F(": "), logWarn);
+        writeLogLn(msgBuffStr, logWarn);
+        return;
+    }
+
+    if (strStartsWithP(msgBuffStr, RMSG_FWDN) == 1){
+        // nextSeq holds the CRC result
+        fwBase = fwChunkCount;
+        sendSerFwStatus(nextSeq == 1 ? fwEvtDone : fwEvtFail);
+        writeLogF(F("Firmware sent to node "), logInfo);
+        writeLog(fwNodeId, logInfo);
+        writeLogF(F(", crc_ok="), logInfo);
+        writeLogLn(nextSeq, logInfo);
+        startFwRelay(0, 0, 0);
+        return;
+    }
+
+    if (strStartsWithP(msgBuffStr, RMSG_FWRQ) == 1){
+        slideFwWindow(nextSeq);
+        fwAcked = 0;
+        fwSent = 0;
+        fwIsActive = true;
+        sendSerFwStatus(fwEvtRun);
+    }
+    else {
+        // a stale ACK, from before a resend or a resume
+        if (! fwIsActive || nextSeq < fwBase || nextSeq > (uint32_t)fwBase +
+                FW_WINDOW_CHUNKS)
+            return;
+        slideFwWindow(nextSeq);
+        fwAcked |= haveMask & ((1 << FW_WINDOW_CHUNKS) - 1);
+        // chunks sent and not ACKed were lost, send again
+        fwSent = 0;
+    }
+
+    fwRetries = 0;
+    fwLastMillis = millis();
+    // all ACKed, waiting for FWDN
+    if (fwBase >= fwChunkCount)
+        fwIsActive = false;
+    else
+        requestFwParts();
+}
+
+
+void checkFwRelay(){
+    /*
+       Sends the node being updated the next chunk held and not yet sent.  If
+       there's been no progress for FW_RETRY_MS, resends and re-requests, or
+       after FW_MAX_RETRIES leaves the transfer to resume at its next GINR.
+    */
+    if (! fwIsActive)
+        return;
+
+    uint8_t heldChunks = getFwHeldChunks();
+    uint8_t sendChunks = heldChunks & ~fwAcked & ~fwSent;
+    if (sendChunks != 0){
+        uint8_t chunkIx = 0;
+        while (! (sendChunks & (1 << chunkIx)))
+            chunkIx++;
+        // last if no more to send, nor parts still to come from the server
+        uint8_t windowChunks = 0;
+        for (uint8_t i = 0; i < FW_WINDOW_CHUNKS; i++)
+            if (getFwChunkParts(i) != 0)
+                windowChunks |= (1 << i);
+        sendFwChunk(chunkIx, (sendChunks >> (chunkIx + 1)) == 0 &&
+                ((heldChunks | fwAcked) & windowChunks) == windowChunks);
+        fwSent |= (1 << chunkIx);
+        fwLastMillis = millis();
+        return;
+    }
+
+    if (millis() - fwLastMillis < FW_RETRY_MS)
+        return;
+    fwLastMillis = millis();
+    if (++fwRetries > FW_MAX_RETRIES){
+        fwIsActive = false;
+        sendSerFwStatus(fwEvtStall);
+        writeLogF(F("Firmware transfer stalled, node "), logWarn);
+        writeLogLn(fwNodeId, logWarn);
+        return;
+    }
+    fwSent = 0;
+    requestFwParts();
+}
+
+
+uint8_t startSweep(uint16_t spanKhz, uint16_t stepKhz, uint8_t samples){
+    /*
+       Starts a spectrum sweep of RADIO_FREQ +/- spanKhz, returning its number
+       of steps, or 0 if the sweep is out of bounds or one is under way
+    */
+    if (sweepStepsLeft > 0 || spanKhz > SWEEP_MAX_SPAN_KHZ ||
+            stepKhz < SWEEP_MIN_STEP_KHZ || samples == 0 ||
+            samples > SWEEP_MAX_SAMPLES ||
+            2ul * spanKhz / stepKhz + 1 > SWEEP_MAX_STEPS)
+        return 0;
+
+    sweepStepCount = 2ul * spanKhz / stepKhz + 1;
+    sweepStepsLeft = sweepStepCount;
+    sweepSamples = samples;
+    sweepStepKhz = stepKhz;
+    sweepFreqKhz = (uint32_t)(RADIO_FREQ * 1000.0f + 0.5f) -
+            (uint32_t)(sweepStepCount / 2) * stepKhz;
+    return sweepStepCount;
+}
+
+
+void checkSweep(){
+    /*
+       Samples the next step of a spectrum sweep and sends its histogram to
+       the server.  After the last, retunes the radio to RADIO_FREQ.
+    */
+    if (sweepStepsLeft == 0)
+        return;
+
+    wdt_reset();
+    radio.setModeIdle();
+    radio.setFrequency(sweepFreqKhz / 1000.0f);
+    radio.setModeRx();
+
+    uint8_t bktCounts[SWEEP_BKT_COUNT] = {0};
+    int16_t minRssi = INT16_MAX;
+    int16_t maxRssi = INT16_MIN;
+    for (uint8_t i = 0; i < sweepSamples; i++){
+        delayMicroseconds(SWEEP_SAMPLE_US);
+        int16_t rssi = radio.rssiRead();
+        if (rssi < minRssi)
+            minRssi = rssi;
+        if (rssi > maxRssi)
+            maxRssi = rssi;
+        int16_t bktIx = (rssi - SWEEP_BKT_FLOOR_DBM + SWEEP_BKT_DB) /
+                SWEEP_BKT_DB;
+        if (bktIx < 0)
+            bktIx = 0;
+        else if (bktIx >= SWEEP_BKT_COUNT)
+            bktIx = SWEEP_BKT_COUNT - 1;
+        bktCounts[bktIx]++;
+    }
+
+    beginSerMsg();
+    print_P(SMSG_SWEEP);
+    Serial.write(SMSG_RS);
+    writeLog(sweepFreqKhz, logNull);
+    Serial.write(SMSG_FS);
+    writeLog(minRssi, logNull);
+    Serial.write(SMSG_FS);
+    writeLog(maxRssi, logNull);
+    for (uint8_t i = 0; i < SWEEP_BKT_COUNT; i++){
+        Serial.write(SMSG_FS);
+        writeLog((uint16_t)bktCounts[i], logNull);
     }
+    printNewLine(logNull);
+
+    sweepFreqKhz += sweepStepKhz;
+    if (--sweepStepsLeft > 0)
+        return;
+
+    radio.setModeIdle();
+    if (!radio.setFrequency(RADIO_FREQ))
+        writeLogLnF(F("SetFreq fail"), logError);
+    radio.setModeRx();
+    beginSerMsg();
+    print_P(SMSG_SWEEPD);
+    Serial.write(SMSG_RS);
+    writeLogLn((uint16_t)sweepStepCount, logNull);
+    writeLogLnF(F("Sweep done"), logInfo);
 }
 
 
@@ -1789,35 +4441,39 @@ void processMsgRecv(){
 
     wdt_reset();
     lastRSSIAtGateway = radio.lastRssi();
+    if (! unwrapRelayMsg())
+        return;
 
     writeLogF(F("Got msg: "), logDebug);
-    writeLog((char*)radioMsgBuff, logDebug);
+    writeLog(msgBuffStr, logDebug);
     writeLogF(F(". RSSI = "), logDebug);
     writeLogLn(lastRSSIAtGateway, logDebug);
 
-    strcpy(msgBuffStr, "");
-    sprintf(msgBuffStr, "%s", (char*)radioMsgBuff);
-
     // ensure the sending node exists in the meternode array, create a new entry
     // if it doesnt
-    static uint8_t nodeIx = 0;
-    nodeIx = getNodeIxByIdWithCreate(lastMsgFrom);
+    uint8_t nodeIx = getNodeIxByIdWithCreate(lastMsgFrom);
 
     if (nodeIx == UINT8_MAX)
         return;     // abort if find/create failed
 
-    // update when node last seen, RSSI from node at server
+    // update when node last seen, RSSI from node at server, and its route
     meterNodes[nodeIx].lastSeenTime = getNowTimestampSec();
     meterNodes[nodeIx].lastNodeRSSI = lastRSSIAtGateway;
+    meterNodes[nodeIx].relayId = lastMsgRelay;
+    meterNodes[nodeIx].relayHops = lastMsgHops;
+    meterNodes[nodeIx].relayLatencyMs = lastMsgHeldMs;
+    checkNodeAlert(nodeIx, alertRSSI);
 
     // record and pass through rebase (MREB)
     // MREB:  meter rebase (to gateway) - a time and value baseline
     // format: MREB,<meter_time_start>,<meter_value_start>;
     // e.g.:   MREB,1496842913428,18829393;
     if (strStartsWithP(msgBuffStr, RMSG_MREBASE) == 1){
-        sscanf(msgBuffStr, "MREB,%lu,%lu",
+        incStat(statRxMREB);
+        if (sscanf(msgBuffStr, "MREB,%" SCNu32 ",%" SCNu32,
                 &meterNodes[nodeIx].lastEntryFinishTime,
-                &meterNodes[nodeIx].lastMeterValue);
+                &meterNodes[nodeIx].lastMeterValue) != 2)
+            incStat(statParseErr);
         sendSerMeterRebase(lastMsgFrom);
     }
 
@@ -1831,35 +4487,8 @@ void processMsgRecv(){
     //     MUPC,1496842913428,18829393;15,1,10.2;15,5,10.7;
     // should fit 2-3 entries
     else if (strStartsWithP(msgBuffStr, RMSG_MUPC) == 1){
-        static uint32_t meterEntryFinishTime = 0ul;
-        static uint32_t meterEntryValue = 0ul;
-        static double currentRMS = 0.0;
-        static char* token;
-        static uint8_t i = 0;
-
-        // get message value fields
-        sscanf(msgBuffStr, "MUPC,%s[^\n]", tmpStr);
-        // tokenise and add up times and entry values
-        token = strtok(tmpStr, ";,");
-        i = 0;
-        meterEntryValue = 0;
-        while (token != NULL){
-            i++;
-            if (i == 1)
-                meterEntryFinishTime = strtoul(token, NULL, 0);
-            else if (i == 2)
-                meterEntryValue = strtoul(token, NULL, 0);
-            else if (i % 3 == 0)        // a current entry
-                currentRMS = strtod(token, NULL);       //TODO: replace strtod
-            else if (i % 2 == 0)        // a meter entry as even field num
-                meterEntryValue += strtoul(token, NULL, 0);
-            else
-                meterEntryFinishTime += strtoul(token, NULL, 0);
-            token = strtok(NULL, ";,");     // get next token from strtok
-        }
-        meterNodes[nodeIx].lastEntryFinishTime = meterEntryFinishTime;
-        meterNodes[nodeIx].lastMeterValue = meterEntryValue;
-        meterNodes[nodeIx].lastCurrentRMS = currentRMS;
+        incStat(statRxMUPC);
+        parseMeterUpdateMsg(nodeIx, true);
         sendSerMeterUpdate(lastMsgFrom, true);
     }
 
@@ -1871,31 +4500,8 @@ void processMsgRecv(){
     // e.g.:   MUP_,1496842913428,18829393;15,1;15,5;15,2;16,3;
     // should fit 4 entries unless using > 999Wh per interval
     else if (strStartsWithP(msgBuffStr, RMSG_MUP_) == 1){
-        static uint32_t meterEntryFinishTime = 0ul;
-        static uint32_t meterEntryValue = 0ul;
-        static char* token;
-        static uint8_t i = 0;
-
-        // get message value fields
-        sscanf(msgBuffStr, "MUP_,%s[^\n]", tmpStr);
-        // tokenise and add up times and entry values
-        token = strtok(tmpStr, ";,");
-        i = 0;
-        meterEntryValue = 0;
-        while (token != NULL){
-            i++;
-            if (i == 1)
-                meterEntryFinishTime = strtoul(token, NULL, 0);
-            else if (i == 2)
-                meterEntryValue = strtoul(token, NULL, 0);
-            else if (i % 2 == 0)        // a meter entry as even field num
-                meterEntryValue += strtoul(token, NULL, 0);
-            else
-                meterEntryFinishTime += strtoul(token, NULL, 0);
-            token = strtok(NULL, ";,");     // get next token from strtok
-        }
-        meterNodes[nodeIx].lastEntryFinishTime = meterEntryFinishTime;
-        meterNodes[nodeIx].lastMeterValue = meterEntryValue;
+        incStat(statRxMUP_);
+        parseMeterUpdateMsg(nodeIx, false);
         sendSerMeterUpdate(lastMsgFrom, false);
     }
 
@@ -1906,22 +4512,15 @@ void processMsgRecv(){
     //                 <meter_interval_time>
     // e.g.:   GINR;4300,890000,555000,880,-80,10,100,5
     else if (strStartsWithP(msgBuffStr, RMSG_GINR) == 1){
-        // get message value fields
-        sscanf(msgBuffStr, "GINR,%d,%lu,%lu,%d,%" SCNd8 ",%" SCNu8 ",%d,%" SCNu8 ",%d",
-                &meterNodes[nodeIx].battVoltageMV,
-                &meterNodes[nodeIx].secondsUptime,
-                &meterNodes[nodeIx].secondsSlept,
-                &meterNodes[nodeIx].freeRAM,
-                &lastRSSIAtNode,
-                &meterNodes[nodeIx].puckLEDRate,
-                &meterNodes[nodeIx].puckLEDTime,
-                &meterNodes[nodeIx].meterInterval,
-                &meterNodes[nodeIx].meterImpPerKwh
-            );
+        incStat(statRxGINR);
+        parseGinrMsg(nodeIx);
 
         writeLogF(F("Last RSSI at node="), logInfo);
         writeLogLn(lastRSSIAtNode, logInfo);
 
+        checkNodeAlert(nodeIx, alertBatt);
+        checkNodeAlert(nodeIx, alertFreeRAM);
+
         // send request to temporarily increase GINR poll rate if queued
         // GITR:
         //  format: GITR;<new_rate>,<duration>,<last_node_rssi>
@@ -1929,7 +4528,7 @@ void processMsgRecv(){
         if (meterNodes[nodeIx].tmpGinrPollRate > 0 &&
                     meterNodes[nodeIx].tmpGinrPollPeriod > 0){
             sprintf_P(msgBuffStr, RMSG_GITR);
-            sprintf(msgBuffStr, "%s,%d,%d,%hhd", msgBuffStr,
+            sprintf(msgBuffStr + strlen(msgBuffStr), ",%d,%d,%hhd",
                     meterNodes[nodeIx].tmpGinrPollRate,
                     meterNodes[nodeIx].tmpGinrPollPeriod, lastRSSIAtGateway);
             writeLogF(F("Sent GINR poll rate increase (GITR) to node "),
@@ -1947,7 +4546,7 @@ void processMsgRecv(){
         //  e.g.: MVAI;120000,-70
         else if (meterNodes[nodeIx].newMeterValue > 0){
             sprintf_P(msgBuffStr, RMSG_MVAI);
-            sprintf(msgBuffStr, "%s,%lu,%hhd", msgBuffStr,
+            sprintf(msgBuffStr + strlen(msgBuffStr), ",%" PRIu32 ",%hhd",
                     meterNodes[nodeIx].newMeterValue, lastRSSIAtGateway);
             writeLogF(F("Sent meter val update inst (MVAI) to node "),
                     logInfo);
@@ -1963,7 +4562,7 @@ void processMsgRecv(){
         // e.g.: MINI;5,-70
         else if (meterNodes[nodeIx].newMeterInterval > 0){
             sprintf_P(msgBuffStr, RMSG_MINI);
-            sprintf(msgBuffStr, "%s,%d,%hhd", msgBuffStr,
+            sprintf(msgBuffStr + strlen(msgBuffStr), ",%d,%hhd",
                     meterNodes[nodeIx].newMeterInterval, lastRSSIAtGateway);
             writeLogF(F("Sent meter int update inst (MINI) to node "),
                     logInfo);
@@ -1979,7 +4578,7 @@ void processMsgRecv(){
         else if (meterNodes[nodeIx].newPuckLEDTime < UINT16_MAX &&
                     meterNodes[nodeIx].newPuckLEDRate < UINT8_MAX){
             sprintf_P(msgBuffStr, RMSG_MPLI);
-            sprintf(msgBuffStr, "%s,%d,%d,%hhd", msgBuffStr,
+            sprintf(msgBuffStr + strlen(msgBuffStr), ",%d,%d,%hhd",
                     meterNodes[nodeIx].newPuckLEDRate,
                     meterNodes[nodeIx].newPuckLEDTime, lastRSSIAtGateway);
             writeLogF(F("Sent meter update inst (MPLI) to node "),
@@ -1990,6 +4589,31 @@ void processMsgRecv(){
             sendRadioMsg(lastMsgFrom, false);
         }
 
+        // offer a firmware image if one is queued for the node, not under
+        // way, and it's in range (see Firmware Relay)
+        // FWOF:
+        // format: FWOF,<image_len>,<image_crc16>,<chunk_len>,<window_chunks>,
+        //             <last_node_rssi>
+        // e.g.: FWOF,28672,48879,36,4,-70
+        else if (FW_RELAY_ENABLED && fwNodeId == lastMsgFrom &&
+                    ! fwIsActive && meterNodes[nodeIx].relayId == 0){
+            char* fieldStr = msgBuffStr + strlen_P(RMSG_FWOF);
+            strcpy_P(msgBuffStr, RMSG_FWOF);
+            *fieldStr++ = ',';
+            fieldStr += fmtUInt16(fieldStr, fwImageLen);
+            *fieldStr++ = ',';
+            fieldStr += fmtUInt16(fieldStr, fwImageCrc);
+            *fieldStr++ = ',';
+            fieldStr += fmtUInt8(fieldStr, FW_CHUNK_LEN);
+            *fieldStr++ = ',';
+            fieldStr += fmtUInt8(fieldStr, FW_WINDOW_CHUNKS);
+            *fieldStr++ = ',';
+            fmtInt32(fieldStr, lastRSSIAtGateway);
+            writeLogF(F("Sent firmware offer (FWOF) to node "), logInfo);
+            writeLogLn(lastMsgFrom, logInfo);
+            sendRadioMsg(lastMsgFrom, false);
+        }
+
         // send a MNOI if nothing to do
         // MNOI:
         // 'no op' ACK to GINR, provides RSSI for auto-tuning
@@ -1998,7 +4622,8 @@ void processMsgRecv(){
 
         else {
             sprintf_P(msgBuffStr, RMSG_MNOI);
-            sprintf(msgBuffStr, "%s,%hhd", msgBuffStr, lastRSSIAtGateway);
+            sprintf(msgBuffStr + strlen(msgBuffStr), ",%hhd",
+                    lastRSSIAtGateway);
             writeLogF(F("Sent no-op (MNOI) to node "), logInfo);
             writeLogLn(lastMsgFrom, logInfo);
             sendRadioMsg(lastMsgFrom, false);
@@ -2017,22 +4642,26 @@ void processMsgRecv(){
     // <last_node_rssi>
     // e.g.:   PRSP;14968429155328,1496842915428,1,-70
     else if (strStartsWithP(msgBuffStr, RMSG_PREQ) == 1){
-        static uint32_t nodeTime = 0ul;
-        static uint32_t gatewayTime = 0ul;
+        uint32_t nodeTime = 0ul;
+        uint32_t gatewayTime = 0ul;
 
         gatewayTime = getNowTimestampSec();
-        sscanf(msgBuffStr, "PREQ,%lu", &nodeTime);
+        incStat(statRxPREQ);
+        if (sscanf(msgBuffStr, "PREQ,%" SCNu32, &nodeTime) != 1)
+            incStat(statParseErr);
         sprintf_P(msgBuffStr, RMSG_PRSP);
-        sprintf(msgBuffStr, "%s,%lu,%lu,%hhu,%hhd", msgBuffStr, nodeTime,
-                gatewayTime, cfgAlignEntries,
+        sprintf(msgBuffStr + strlen(msgBuffStr), ",%" PRIu32 ",%" PRIu32
+                ",%hhu,%hhd", nodeTime, gatewayTime, cfgAlignEntries,
                 lastRSSIAtGateway);  // 1=align to mm:00
         sendRadioMsg(lastMsgFrom, false);
 
         meterNodes[nodeIx].lastClockDriftSecs = gatewayTime - nodeTime;
+        checkNodeAlert(nodeIx, alertDrift);
     }
 
     // process gen purpose msg (GMSG)
     else if (strStartsWithP(msgBuffStr, RMSG_GMSG) == 1){
+        incStat(statRxGMSG);
         writeLogF(F("Got bcast from node "), logInfo);
         writeLog(lastMsgFrom, logInfo);
         writeLogF(F(": "), logInfo);
@@ -2040,7 +4669,15 @@ void processMsgRecv(){
         sendSerNodeGenMsg(lastMsgFrom);
     }
 
+    // firmware transfer from the node being updated (FWRQ, FWAK, FWDN)
+    else if (FW_RELAY_ENABLED && (strStartsWithP(msgBuffStr, RMSG_FWRQ) == 1 ||
+            strStartsWithP(msgBuffStr, RMSG_FWAK) == 1 ||
+            strStartsWithP(msgBuffStr, RMSG_FWDN) == 1)){
+        processFwMsg();
+    }
+
     else {
+        incStat(statRxUnknown);
         writeLogF(F("Unknown msg from node "), logWarn);
         writeLog(lastMsgFrom, logWarn);
         writeLogF(F(": "), logWarn);
@@ -2058,13 +4695,19 @@ void checkRadioMsg(){
      */
 
     if (msgManager.available()){
-        uint8_t lenBuff = sizeof(radioMsgBuff);
-        memset(radioMsgBuff, 0, sizeof(radioMsgBuff));
+        uint8_t lenBuff = RH_RF69_MAX_MESSAGE_LEN;
+        // zeroed beyond max length too, so always terminated
+        memset(msgBuffStr, 0, sizeof(msgBuffStr));
         wdt_reset();
         // Check for newly arrived message and ACK.  No wait/timeout as not
         // assured of having one.
-        if (msgManager.recvfromAck(radioMsgBuff, &lenBuff, &lastMsgFrom))
+        if (msgManager.recvfromAck((uint8_t*)msgBuffStr, &lenBuff,
+                    &lastMsgFrom)){
+            captureRadioMsg('R', lastMsgFrom, radio.lastRssi(), lenBuff);
+            uint32_t profStartMicros = startProfile();
             processMsgRecv();
+            endProfile(profMsgRecv, profStartMicros);
+        }
     }
     wdt_reset();
 }
@@ -2072,34 +4715,49 @@ void checkRadioMsg(){
 
 void sendRadioMsg(uint8_t recipient, bool checkReply){
     /*
-        Sends whatever's in msgBuffStr to radio recipient
+        Sends whatever's in msgBuffStr to radio recipient, through its relay
+        if it has one
     */
 
+    if (! wrapRelayMsg(&recipient))
+        return;
+
     if (strlen(msgBuffStr) > RH_RF69_MAX_MESSAGE_LEN){
        writeLogF(F("Msg too long: "), logError);
        writeLogLn(msgBuffStr, logError);
        return;
     }
 
-    uint8_t lenBuff = sizeof(radioMsgBuff);
-    memset(radioMsgBuff, 0, sizeof(radioMsgBuff));
+    uint8_t lenBuff = RH_RF69_MAX_MESSAGE_LEN;
 
     writeLogF(F("Sending: "), logDebug);
     writeLogLn(msgBuffStr, logDebug);
-    memcpy(radioMsgBuff, msgBuffStr, strlen(msgBuffStr));
+    // sent zero padded to full length, as nodes expect
+    memset(msgBuffStr + strlen(msgBuffStr), 0,
+            sizeof(msgBuffStr) - strlen(msgBuffStr));
     wdt_reset();
 
     // Send message with an ack timeout as specified by TX_TIMEOUT
-    if (msgManager.sendtoWait(radioMsgBuff, lenBuff, recipient)){
+    bool isAcked = msgManager.sendtoWait((uint8_t*)msgBuffStr, lenBuff,
+            recipient);
+    captureRadioMsg('T', recipient, isAcked, lenBuff);
+    if (isAcked){
+        incStat(statTxOk);
         // Wait for a reply from the Gateway if instructed to
         wdt_reset();
-        if (checkReply && msgManager.recvfromAckTimeout(radioMsgBuff, &lenBuff,
-                    RX_TIMEOUT, &lastMsgFrom))
-            processMsgRecv();
-        else if (checkReply)
-            writeLogLnF(F("No ACK recv"), logInfo);
+        if (checkReply){
+            memset(msgBuffStr, 0, sizeof(msgBuffStr));
+            if (msgManager.recvfromAckTimeout((uint8_t*)msgBuffStr, &lenBuff,
+                        RX_TIMEOUT, &lastMsgFrom)){
+                captureRadioMsg('R', lastMsgFrom, radio.lastRssi(), lenBuff);
+                processMsgRecv();
+            }
+            else
+                writeLogLnF(F("No ACK recv"), logInfo);
+        }
     }
     else {
+        incStat(statTxFail);
         writeLogF(F("Send fail: "), logWarn);
         writeLogLn(msgBuffStr, logWarn);
     }
@@ -2117,12 +4775,14 @@ void checkNodeLife(){
                 && (getNowTimestampSec() - meterNodes[i].lastSeenTime >
                         POL_MSG_TIMEOUT_SEC)){
             wdt_reset();
-            print_P(SMSG_TX_PREFIX);
-            print_P(SMSG_NDARK);
-            Serial.write(SMSG_RS);
-            writeLog(meterNodes[i].nodeId, logNull);
-            Serial.write(SMSG_FS);
-            writeLogLn(meterNodes[i].lastSeenTime, logNull);
+            if (isSerEventWanted(evtNDARK, meterNodes[i].nodeId)){
+                beginSerMsg();
+                print_P(SMSG_NDARK);
+                Serial.write(SMSG_RS);
+                writeLog(meterNodes[i].nodeId, logNull);
+                Serial.write(SMSG_FS);
+                writeLogLn(meterNodes[i].lastSeenTime, logNull);
+            }
             //set to max to avoid double reporting; interpret as 'node dark'
             meterNodes[i].lastSeenTime = UINT32_MAX;
         }
@@ -2165,6 +4825,7 @@ void checkButton(){
 
 }
 
+#ifdef __AVR__
 // save reset cause from bootloader
 void resetFlagsInit(void) __attribute__ ((naked))
                           __attribute__ ((used))
@@ -2178,6 +4839,32 @@ void resetFlagsInit(void)
 }
 
 
+// paint free RAM for stack high-water mark, before C runtime init
+void paintStack(void) __attribute__ ((naked))
+                      __attribute__ ((used))
+                      __attribute__ ((section (".init1")));
+
+
+void paintStack(void)
+{
+// fill from end of static data (_end, also the heap start) to top of RAM
+// (__stack).  No stack or C runtime available yet, so done in asm.
+  __asm__ __volatile__ (
+        "    ldi r30, lo8(_end)\n"
+        "    ldi r31, hi8(_end)\n"
+        "    ldi r24, %0\n"
+        "    ldi r25, hi8(__stack)\n"
+        "    rjmp 2f\n"
+        "1:  st Z+, r24\n"
+        "2:  cpi r30, lo8(__stack)\n"
+        "    cpc r31, r25\n"
+        "    brlo 1b\n"
+        "    breq 1b\n"
+        : : "M" (STACK_PAINT));
+}
+#endif
+
+
 void printResetVal(uint8_t resetVal){
     writeLogF(F("R_FLG 0x"), logNull);
     Serial.print(resetVal, HEX);
@@ -2247,23 +4934,28 @@ void setup() {
     writeLogLnF(F("=BOOT="), logNull);
     printResetVal(resetFlags);
 
+    if (EVT_FILTER_ENABLED)
+        resetSerEventFilter();
+
     /* get config from EEPROM */
     getConfigFromMem();
     applyRadioConfig();
 
     /* send boot message to server */
     sprintf_P(msgBuffStr, RMSG_GMSG);
-    sprintf(msgBuffStr, "%s,BOOT v%hhu. Flags: %hhu", msgBuffStr, FW_VERSION,
-            resetFlags);
+    sprintf(msgBuffStr + strlen(msgBuffStr), ",BOOT v%hhu. Flags: %hhu",
+            FW_VERSION, resetFlags);
     sendSerNodeGenMsg(cfgGatewayId);
 
     /* initialise Clock */
     writeLogLnF(F("RTC Init"), logDebug);
     setNowTimestampSec(INIT_TIME);  // in case get time fails
-    sendSerGetTime();
 
     blinkLED(3);
 
+    // after the blink, so its delays aren't counted in the round trip
+    sendSerGetTime();
+
     wdt_enable(WDTO_8S);    //Time for wait before autoreset
 }
 
@@ -2274,19 +4966,35 @@ void loop() {
     before sleeping.
     */
 
-    static uint8_t doEvery = 0;
+    uint32_t loopStartMicros = micros();
 
-    for (doEvery = 1; doEvery <=5; doEvery++){
+    for (uint8_t doEvery = 1; doEvery <=5; doEvery++){
         // do every time
         checkSerialInput();
         wdt_reset();
         checkButton();
 
         // do processing if not in middle of serial input
-        if (serialBuffPos == 0 && doEvery % 2 == 0)
+        // radio is off channel while sweeping
+        if (serialBuffPos == 0 && doEvery % 2 == 0 && sweepStepsLeft == 0)
             checkRadioMsg();
 
-        if (serialBuffPos == 0 && doEvery == 5)
+        if (FW_RELAY_ENABLED && serialBuffPos == 0 && sweepStepsLeft == 0)
+            checkFwRelay();
+
+        if (SWEEP_ENABLED && serialBuffPos == 0)
+            checkSweep();
+
+        if (BENCH_ENABLED && serialBuffPos == 0)
+            checkBench();
+
+        if (serialBuffPos == 0 && doEvery == 5){
             checkNodeLife();
+            checkTimeSync();
+        }
     }
+
+    uint32_t loopMicros = micros() - loopStartMicros;
+    if (STATS_ENABLED && loopMicros > statMaxLoopMicros)
+        statMaxLoopMicros = loopMicros;
 }
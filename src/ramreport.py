@@ -0,0 +1,76 @@
+#!/usr/bin/python3
+# Reports static RAM use of a gateway build by region, from the symbol table of
+# the built .elf (requires avr-nm from the AVR toolchain).  Whatever is not
+# statically allocated is left for stack and heap.
+#
+# Usage:
+#   ramreport.py firmware.elf [--nm avr-nm] [--symbols]
+
+import argparse
+import subprocess
+
+RAM_SIZE = 2048
+
+# region label and symbol name prefixes, first match wins
+REGIONS = [
+    ('buffer arena', ('buffArena',)),
+    ('meter nodes', ('meterNodes',)),
+    ('radio driver', ('radio', 'msgManager')),
+    ('serial (HW buffers)', ('Serial',)),
+    ('config', ('cfg',)),
+    ('alerts/event filter', ('alert', 'evtFilter')),
+]
+OTHER_REGION = 'other'
+
+
+def read_ram_symbols(nm_cmd, elf_path):
+    # (name, size) for each .data/.bss symbol
+    nm_out = subprocess.run([nm_cmd, '-S', '-C', '--size-sort', elf_path],
+                            check=True, stdout=subprocess.PIPE,
+                            universal_newlines=True).stdout
+    symbols = []
+    for nm_line in nm_out.splitlines():
+        fields = nm_line.split(None, 3)
+        if len(fields) == 4 and fields[2] in 'bBdD':
+            symbols.append((fields[3], int(fields[1], 16)))
+    return symbols
+
+
+def region_of(sym_name):
+    # strip any class/namespace qualification from demangled names
+    base_name = sym_name.split('::')[-1]
+    for region, prefixes in REGIONS:
+        if sym_name.startswith(prefixes) or base_name.startswith(prefixes):
+            return region
+    return OTHER_REGION
+
+
+def main():
+    parser = argparse.ArgumentParser(
+            description='Report gateway static RAM use by region')
+    parser.add_argument('elf_file', help='built firmware (.elf)')
+    parser.add_argument('--nm', default='avr-nm', help='nm command to use')
+    parser.add_argument('--symbols', action='store_true',
+                        help='also list symbols within each region')
+    args = parser.parse_args()
+
+    region_syms = {}
+    for sym_name, sym_size in read_ram_symbols(args.nm, args.elf_file):
+        region_syms.setdefault(region_of(sym_name), []).append(
+                (sym_name, sym_size))
+
+    total = 0
+    for region in [r for r, _ in REGIONS] + [OTHER_REGION]:
+        syms = region_syms.get(region, [])
+        region_size = sum(size for _, size in syms)
+        total += region_size
+        print('%-22s %5d B' % (region, region_size))
+        if args.symbols:
+            for sym_name, sym_size in sorted(syms, key=lambda s: -s[1]):
+                print('    %-30s %5d' % (sym_name, sym_size))
+    print('%-22s %5d B' % ('total static', total))
+    print('%-22s %5d B' % ('left for stack/heap', RAM_SIZE - total))
+
+
+if __name__ == '__main__':
+    main()